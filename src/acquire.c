@@ -4,9 +4,14 @@
 #include "logger.h"
 #include "platform.h"
 #include "runtime/channel.h"
+#include "runtime/frame_stats.h"
+#include "runtime/fusion.h"
+#include "runtime/marker.h"
 #include "runtime/video.h"
 #include "runtime/vfslice.h"
+#include "runtime/worker_pool.h"
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -58,7 +63,18 @@ struct runtime
 
     uint8_t valid_video_streams; /// i'th bit set iff i'th video stream is valid
 
+    /// Shared by the data-parallel stages of every video stream.
+    struct worker_pool pool;
+
     struct video_s video[2];
+
+    /// What each video stream was last configured with. See
+    /// `comparable_settings()`.
+    struct aq_properties_video_s configured_as[2];
+
+    /// Combines frames from both video streams.
+    struct video_fusion_s fusion;
+    struct channel_reader fusion_monitor; //< exposed through the public api
 };
 
 #define QUOTE(name) #name
@@ -99,8 +115,10 @@ acquire_map_read(const struct AcquireRuntime* self_,
     self = containerof(self_, struct runtime, handle);
     EXPECT(self->video[istream].monitor.reader.state == ChannelState_Unmapped,
            "Expected an unmapped reader. See acquire_unmap_read().");
-    struct vfslice_mut slice = make_vfslice_mut(channel_read_map(
-      &self->video[istream].sink.in, &self->video[istream].monitor.reader));
+    struct vfslice_mut slice = make_vfslice_mut(
+      decimator_read_map(&self->video[istream].monitor.decimator,
+                         self->video[istream].monitor.from,
+                         &self->video[istream].monitor.reader));
     CHECK(self->video[istream].monitor.reader.status == Channel_Ok);
     *beg = slice.beg;
     *end = slice.end;
@@ -118,7 +136,7 @@ acquire_unmap_read(const struct AcquireRuntime* self_,
     CHECK(self_);
     CHECK(istream < countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    channel_read_unmap(&self->video[istream].sink.in,
+    channel_read_unmap(self->video[istream].monitor.from,
                        &self->video[istream].monitor.reader,
                        consumed_bytes);
     return AcquireStatus_Ok;
@@ -126,6 +144,318 @@ Error:
     return AcquireStatus_Error;
 }
 
+uint8_t
+acquire_is_burst_marker(const struct VideoFrame* frame)
+{
+    return frame && frame_marker_of(frame) == FrameMarker_Burst;
+}
+
+uint8_t
+acquire_is_encoded_frame(const struct VideoFrame* frame)
+{
+    return frame && encoded_frame_header_of(frame) != 0;
+}
+
+enum AcquireStatusCode
+acquire_decode_frame(const struct VideoFrame* frame,
+                     uint8_t* dst,
+                     size_t capacity)
+{
+    EXPECT(frame, "Invalid parameter: `frame` was NULL.");
+    EXPECT(dst, "Invalid parameter: `dst` was NULL.");
+    EXPECT(encoded_frame_header_of(frame),
+           "Expected a compressed frame (frame %llu).",
+           (unsigned long long)frame->frame_id);
+    EXPECT(codec_decode_frame(frame, dst, capacity),
+           "Failed to decode frame %llu.",
+           (unsigned long long)frame->frame_id);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+uint32_t
+acquire_get_tiled_frame_count(const struct VideoFrame* record)
+{
+    const struct tiled_frame_header* header =
+      record ? tiled_frame_header_of(record) : 0;
+    return header ? header->frame_count : 0;
+}
+
+enum AcquireStatusCode
+acquire_untile_frame(const struct VideoFrame* record,
+                     uint32_t k,
+                     uint8_t* dst,
+                     size_t capacity)
+{
+    EXPECT(record, "Invalid parameter: `record` was NULL.");
+    EXPECT(dst, "Invalid parameter: `dst` was NULL.");
+    EXPECT(tiler_read_frame(record, k, dst, capacity),
+           "Failed to read frame %u of tiled record %llu.",
+           k,
+           (unsigned long long)record->frame_id);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_map_read_fused(const struct AcquireRuntime* self_,
+                       struct VideoFrame** beg,
+                       struct VideoFrame** end)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    self = containerof(self_, struct runtime, handle);
+    EXPECT(self->fusion.out.data, "Fusion is not enabled.");
+    EXPECT(self->fusion_monitor.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read_fused().");
+    struct vfslice_mut slice = make_vfslice_mut(
+      channel_read_map(&self->fusion.out, &self->fusion_monitor));
+    CHECK(self->fusion_monitor.status == Channel_Ok);
+    *beg = slice.beg;
+    *end = slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_fused(const struct AcquireRuntime* self_,
+                         size_t consumed_bytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(self->fusion.out.data);
+    channel_read_unmap(
+      &self->fusion.out, &self->fusion_monitor, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+// Spot lists are handed to api clients as is.
+_Static_assert(sizeof(struct AcquireSpot) == sizeof(struct spot),
+               "AcquireSpot must match struct spot");
+_Static_assert(sizeof(struct AcquireSpotList) == sizeof(struct spot_list),
+               "AcquireSpotList must match struct spot_list");
+
+enum AcquireStatusCode
+acquire_map_read_spots(const struct AcquireRuntime* self_,
+                       uint32_t istream,
+                       struct AcquireSpotList** beg,
+                       struct AcquireSpotList** end)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->detector.out.data,
+           "[stream %d] Detection is not enabled.",
+           istream);
+    EXPECT(video->monitor.spots_reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read_spots().");
+    struct slice slice =
+      channel_read_map(&video->detector.out, &video->monitor.spots_reader);
+    CHECK(video->monitor.spots_reader.status == Channel_Ok);
+    *beg = (struct AcquireSpotList*)slice.beg;
+    *end = (struct AcquireSpotList*)slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+// Gating records are handed to api clients as is.
+_Static_assert(sizeof(struct AcquireGatingRecord) == sizeof(struct gate_record),
+               "AcquireGatingRecord must match struct gate_record");
+_Static_assert((int)AcquireGating_Stored == (int)GateRecord_Stored &&
+                 (int)AcquireGating_Keyframe == (int)GateRecord_Keyframe,
+               "AcquireGatingFlags must match enum gate_record_flags");
+
+enum AcquireStatusCode
+acquire_map_read_gating(const struct AcquireRuntime* self_,
+                        uint32_t istream,
+                        struct AcquireGatingRecord** beg,
+                        struct AcquireGatingRecord** end)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->gate.log.data,
+           "[stream %d] Change gating is not enabled.",
+           istream);
+    EXPECT(video->monitor.gating_reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read_gating().");
+    struct slice slice =
+      channel_read_map(&video->gate.log, &video->monitor.gating_reader);
+    CHECK(video->monitor.gating_reader.status == Channel_Ok);
+    *beg = (struct AcquireGatingRecord*)slice.beg;
+    *end = (struct AcquireGatingRecord*)slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_gating(const struct AcquireRuntime* self_,
+                          uint32_t istream,
+                          size_t consumed_bytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(istream < countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    CHECK(video->gate.log.data);
+    channel_read_unmap(
+      &video->gate.log, &video->monitor.gating_reader, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+// Trace records are handed to api clients as is.
+_Static_assert(sizeof(struct AcquireTraceRecord) ==
+                 sizeof(struct trace_record),
+               "AcquireTraceRecord must match struct trace_record");
+_Static_assert((int)AcquireTraceStatistic_Sum == (int)TraceStatistic_Sum,
+               "AcquireTraceStatistic must match enum trace_statistic");
+
+enum AcquireStatusCode
+acquire_map_read_traces(const struct AcquireRuntime* self_,
+                        uint32_t istream,
+                        struct AcquireTraceRecord** beg,
+                        struct AcquireTraceRecord** end)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->traces.out.data,
+           "[stream %d] Traces are not enabled.",
+           istream);
+    EXPECT(video->monitor.traces_reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read_traces().");
+    struct slice slice =
+      channel_read_map(&video->traces.out, &video->monitor.traces_reader);
+    CHECK(video->monitor.traces_reader.status == Channel_Ok);
+    *beg = (struct AcquireTraceRecord*)slice.beg;
+    *end = (struct AcquireTraceRecord*)slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_traces(const struct AcquireRuntime* self_,
+                          uint32_t istream,
+                          size_t consumed_bytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(istream < countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    CHECK(video->traces.out.data);
+    channel_read_unmap(
+      &video->traces.out, &video->monitor.traces_reader, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_map_read_preview(const struct AcquireRuntime* self_,
+                         uint32_t istream,
+                         struct VideoFrame** beg,
+                         struct VideoFrame** end)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(beg, "Invalid parameter: `beg` was NULL.");
+    EXPECT(end, "Invalid parameter: `end` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->preview.out.data,
+           "[stream %d] Previews are not enabled.",
+           istream);
+    EXPECT(video->monitor.preview_reader.state == ChannelState_Unmapped,
+           "Expected an unmapped reader. See acquire_unmap_read_preview().");
+    struct slice slice =
+      channel_read_map(&video->preview.out, &video->monitor.preview_reader);
+    CHECK(video->monitor.preview_reader.status == Channel_Ok);
+    *beg = (struct VideoFrame*)slice.beg;
+    *end = (struct VideoFrame*)slice.end;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_preview(const struct AcquireRuntime* self_,
+                           uint32_t istream,
+                           size_t consumed_bytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(istream < countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    CHECK(video->preview.out.data);
+    channel_read_unmap(
+      &video->preview.out, &video->monitor.preview_reader, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_unmap_read_spots(const struct AcquireRuntime* self_,
+                         uint32_t istream,
+                         size_t consumed_bytes)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(istream < countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    CHECK(video->detector.out.data);
+    channel_read_unmap(
+      &video->detector.out, &video->monitor.spots_reader, consumed_bytes);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+/// The runtime that owns `video`.
+static struct runtime*
+runtime_of(struct video_s* video)
+{
+    return containerof(video - video->stream_id, struct runtime, video);
+}
+
 static void
 sig_sink_stop_source(const struct video_sink_s* sink)
 {
@@ -136,11 +466,28 @@ sig_sink_stop_source(const struct video_sink_s* sink)
 }
 
 static void
-await_filter_reset(const struct video_source_s* source)
+sig_filtered_sink_stop_source(const struct video_sink_s* sink)
 {
-    struct video_s* self = containerof(source, struct video_s, source);
-    self->filter.sig_accumulator_reset = 1;
-    event_wait(&self->filter.accumulator_reset_event);
+    struct video_s* self = containerof(sink, struct video_s, filtered_sink);
+    self->source.is_stopping = 1;
+}
+
+static void
+sig_filter_stop_sink(const struct video_filter_s* filter)
+{
+    // Only the filtered frames' own storage waits on the filter. The raw
+    // frames' storage is stopped by the source.
+    struct video_s* self = containerof(filter, struct video_s, filter);
+    if (self->filtered_sink.is_running)
+        self->filtered_sink.is_stopping = 1;
+}
+
+/// @returns nonzero if the filter reads the raw frames next to storage
+///          instead of sitting in front of it.
+static uint8_t
+is_filter_routed(const struct video_s* video)
+{
+    return video->filter.from != &video->filter.in;
 }
 
 static void
@@ -152,13 +499,161 @@ sig_source_stop_filter(const struct video_source_s* source)
     self->filter.is_stopping = 1;
 }
 
+/// Stages on the way to storage, in order.
+enum storage_stage
+{
+    StorageStage_Roi,
+    StorageStage_Lut,
+    StorageStage_Gate,
+    StorageStage_Tiler,
+    StorageStage_Encoder,
+    StorageStage_Sink,
+};
+
+/// Stops the first running stage on the way to storage, starting at
+/// `first`. Each stage stops the next once it has flushed.
+static void
+stop_storage_path(struct video_s* video, enum storage_stage first)
+{
+    if (first <= StorageStage_Roi && video->roi.is_running)
+        video->roi.is_stopping = 1;
+    else if (first <= StorageStage_Lut && video->lut.is_running)
+        video->lut.is_stopping = 1;
+    else if (first <= StorageStage_Gate && video->gate.is_running)
+        video->gate.is_stopping = 1;
+    else if (first <= StorageStage_Tiler && video->tiler.is_running)
+        video->tiler.is_stopping = 1;
+    else if (first <= StorageStage_Encoder && video->encoder.is_running)
+        video->encoder.is_stopping = 1;
+    else
+        video->sink.is_stopping = 1;
+}
+
+/// Stops the readers of `sink.in`. Called once nothing more will be
+/// written to it.
+static void
+stop_sink_readers(struct video_s* self)
+{
+    struct video_fusion_s* const fusion = &runtime_of(self)->fusion;
+    if (self->detector.is_running)
+        self->detector.is_stopping = 1;
+    if (self->preview.is_running)
+        self->preview.is_stopping = 1;
+    if (self->traces.is_running)
+        self->traces.is_stopping = 1;
+    if (self->meter.is_running)
+        self->meter.is_stopping = 1;
+    if (self->demosaic.is_running)
+        self->demosaic.is_stopping = 1;
+    if (fusion->is_running) {
+        video_fusion_input_done(fusion, self->stream_id);
+        // Fusion stops the storage path it feeds once it has flushed.
+        if (fusion->is_stored && self->stream_id == 0)
+            return;
+    }
+    stop_storage_path(self, StorageStage_Roi);
+}
+
 static void
 sig_source_stop_sink(const struct video_source_s* source)
 {
     // This is a pretty hacky way of signaling a video stream to stop
     // the sink thread.
     struct video_s* self = containerof(source, struct video_s, source);
-    self->sink.is_stopping = 1;
+    // Frames still being oriented go to the sink first.
+    if (self->orient.is_running)
+        self->orient.is_stopping = 1;
+    else
+        stop_sink_readers(self);
+}
+
+static void
+sig_orient_stop_sink(const struct video_orient_s* orient)
+{
+    struct video_s* self = containerof(orient, struct video_s, orient);
+    stop_sink_readers(self);
+}
+
+static void
+sig_roi_stop_sink(const struct video_roi_s* roi)
+{
+    struct video_s* self = containerof(roi, struct video_s, roi);
+    stop_storage_path(self, StorageStage_Lut);
+}
+
+static void
+sig_lut_stop_sink(const struct video_lut_s* lut)
+{
+    struct video_s* self = containerof(lut, struct video_s, lut);
+    stop_storage_path(self, StorageStage_Gate);
+}
+
+static void
+sig_gate_stop_sink(const struct video_gate_s* gate)
+{
+    struct video_s* self = containerof(gate, struct video_s, gate);
+    stop_storage_path(self, StorageStage_Tiler);
+}
+
+static void
+sig_tiler_stop_sink(const struct video_tiler_s* tiler)
+{
+    struct video_s* self = containerof(tiler, struct video_s, tiler);
+    stop_storage_path(self, StorageStage_Encoder);
+}
+
+static void
+sig_encoder_stop_sink(const struct video_encoder_s* encoder)
+{
+    struct video_s* self = containerof(encoder, struct video_s, encoder);
+    stop_storage_path(self, StorageStage_Sink);
+}
+
+static void
+sig_fusion_stop_sink(const struct video_fusion_s* fusion)
+{
+    struct runtime* self = containerof(fusion, struct runtime, fusion);
+    if (!fusion->is_stored)
+        return;
+    stop_storage_path(self->video, StorageStage_Roi);
+}
+
+/// Reserves the shape of the fused frames on the first stream's storage.
+static int
+reserve_fused_image_shape(struct runtime* self)
+{
+    struct ImageShape shapes[2] = { 0 }, fused = { 0 };
+    for (int i = 0; i < 2; ++i) {
+        const struct video_s* video = self->video + i;
+        CHECK(Device_Ok ==
+              camera_get_image_shape(video->source.camera, shapes + i));
+        shapes[i] = video_orient_output_shape(&video->orient, shapes + i);
+    }
+    EXPECT(fusion_shape(self->fusion.mode, shapes + 0, shapes + 1, &fused),
+           "The frames of the two streams can't be fused.");
+    fused = video_roi_output_shape(&self->video[0].roi, &fused);
+    fused = video_lut_output_shape(&self->video[0].lut, &fused);
+    CHECK(Device_Ok ==
+          storage_reserve_image_shape(self->video[0].sink.storage, &fused));
+    return 1;
+Error:
+    return 0;
+}
+
+/// Reserves the shape of the filtered frames on their own storage.
+static int
+reserve_filtered_image_shape(struct video_s* video)
+{
+    struct ImageShape image_shape = { 0 };
+    CHECK(Device_Ok ==
+          camera_get_image_shape(video->source.camera, &image_shape));
+    image_shape = video_orient_output_shape(&video->orient, &image_shape);
+    image_shape = video_filter_output_shape(&video->filter, &image_shape);
+    CHECK(Device_Ok == storage_reserve_image_shape(
+                         video->filtered_sink.storage, &image_shape));
+    return 1;
+Error:
+    return 0;
 }
 
 static int
@@ -167,6 +662,9 @@ reserve_image_shape(struct video_s* video)
     struct ImageShape image_shape = { 0 };
     CHECK(Device_Ok ==
           camera_get_image_shape(video->source.camera, &image_shape));
+    image_shape = video_orient_output_shape(&video->orient, &image_shape);
+    image_shape = video_roi_output_shape(&video->roi, &image_shape);
+    image_shape = video_lut_output_shape(&video->lut, &image_shape);
     CHECK(Device_Ok ==
           storage_reserve_image_shape(video->sink.storage, &image_shape));
     return 1;
@@ -192,32 +690,132 @@ acquire_init(void (*reporter)(int is_error,
            sizeof(struct runtime));
     memset(self, 0, sizeof(*self)); // NOLINT
     CHECK(device_manager_init(&self->device_manager, reporter) == Device_Ok);
+    EXPECT(worker_pool_init(&self->pool, 0), "Failed to start worker threads");
 
     for (uint8_t i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
         memset(video, 0, sizeof(*video)); // NOLINT
         video->stream_id = (uint8_t)i;
+        video->state = DeviceState_AwaitingConfiguration;
 
         EXPECT(
           video_sink_init(&video->sink, i, 1ULL << 30, sig_sink_stop_source) ==
             Device_Ok,
           "[stream %d] Failed to initialize video sink controller",
           i);
-        EXPECT(video_filter_init(
-                 &video->filter, i, 1ULL << 30, &video->sink.in) == Device_Ok,
+        CHECK(video_sink_reserve(&video->sink) == Device_Ok);
+        // The filtered sink's queue is allocated when the filter is first
+        // routed. See `configure_video_stream()`.
+        EXPECT(video_sink_init(&video->filtered_sink,
+                               i,
+                               1ULL << 29,
+                               sig_filtered_sink_stop_source) == Device_Ok,
+               "[stream %d] Failed to initialize filtered video sink",
+               i);
+        video->monitor.from = &video->sink.in;
+        EXPECT(video_orient_init(&video->orient,
+                                 i,
+                                 1ULL << 30,
+                                 &video->sink.in,
+                                 &self->pool,
+                                 sig_orient_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize orientation",
+               i);
+        EXPECT(video_filter_init(&video->filter,
+                                 i,
+                                 1ULL << 30,
+                                 &video->sink.in,
+                                 &self->pool,
+                                 sig_filter_stop_sink) == Device_Ok,
                "[stream %d] Failed to initialize video filter controller",
                i);
+        EXPECT(video_roi_init(&video->roi,
+                              i,
+                              1ULL << 28,
+                              &video->sink.in,
+                              sig_roi_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize region of interest extraction",
+               i);
+        EXPECT(video_lut_init(&video->lut,
+                              i,
+                              1ULL << 29,
+                              &video->sink.in,
+                              &self->pool,
+                              sig_lut_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize bit-depth reduction",
+               i);
+        EXPECT(video_gate_init(&video->gate,
+                               i,
+                               1ULL << 28,
+                               1ULL << 22,
+                               &video->sink.in,
+                               sig_gate_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize gate",
+               i);
+        EXPECT(video_tiler_init(&video->tiler,
+                                i,
+                                1ULL << 30,
+                                &video->sink.in,
+                                &self->pool,
+                                sig_tiler_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize tiler",
+               i);
+        EXPECT(video_encoder_init(&video->encoder,
+                                  i,
+                                  1ULL << 28,
+                                  &video->sink.in,
+                                  &self->pool,
+                                  sig_encoder_stop_sink) == Device_Ok,
+               "[stream %d] Failed to initialize video encoder",
+               i);
+        EXPECT(video_detector_init(&video->detector,
+                                   i,
+                                   1ULL << 24,
+                                   &video->sink.in,
+                                   &self->pool) == Device_Ok,
+               "[stream %d] Failed to initialize spot detector",
+               i);
+        EXPECT(video_traces_init(&video->traces,
+                                 i,
+                                 1ULL << 24,
+                                 &video->sink.in,
+                                 &self->pool) == Device_Ok,
+               "[stream %d] Failed to initialize region traces",
+               i);
+        EXPECT(video_meter_init(
+                 &video->meter, i, 1ULL << 20, &video->sink.in) == Device_Ok,
+               "[stream %d] Failed to initialize frame statistics",
+               i);
+        EXPECT(video_preview_init(&video->preview,
+                                  i,
+                                  1ULL << 24,
+                                  &video->sink.in,
+                                  &self->pool) == Device_Ok,
+               "[stream %d] Failed to initialize preview",
+               i);
+        EXPECT(video_demosaic_init(&video->demosaic,
+                                   i,
+                                   1ULL << 29,
+                                   &video->sink.in,
+                                   &self->pool) == Device_Ok,
+               "[stream %d] Failed to initialize demosaicing",
+               i);
         EXPECT(video_source_init(&video->source,
                                  i,
                                  -1,
                                  &video->sink.in,
                                  &video->filter.in,
-                                 await_filter_reset,
                                  sig_source_stop_filter,
                                  sig_source_stop_sink) == Device_Ok,
                "[stream %d] Failed to initialize video source controller",
                i);
     }
+    EXPECT(video_fusion_init(&self->fusion,
+                             1ULL << 30,
+                             &self->video[0].sink.in,
+                             &self->video[1].sink.in,
+                             sig_fusion_stop_sink) == Device_Ok,
+           "Failed to initialize fusion");
 
     self->state = DeviceState_AwaitingConfiguration;
     return &self->handle;
@@ -233,12 +831,26 @@ acquire_shutdown(struct AcquireRuntime* self_)
         goto Error;
     acquire_abort(self_);
     self = containerof(self_, struct runtime, handle);
+    video_fusion_destroy(&self->fusion);
     for (size_t i = 0; i < countof(self->video); ++i) {
         struct video_s* video = self->video + i;
         video_source_destroy((&video->source));
         video_filter_destroy(&video->filter);
+        video_orient_destroy(&video->orient);
+        video_roi_destroy(&video->roi);
+        video_lut_destroy(&video->lut);
+        video_gate_destroy(&video->gate);
+        video_tiler_destroy(&video->tiler);
+        video_encoder_destroy(&video->encoder);
+        video_detector_destroy(&video->detector);
+        video_traces_destroy(&video->traces);
+        video_meter_destroy(&video->meter);
+        video_preview_destroy(&video->preview);
+        video_demosaic_destroy(&video->demosaic);
         video_sink_destroy(&video->sink);
+        video_sink_destroy(&video->filtered_sink);
     }
+    worker_pool_destroy(&self->pool);
     device_manager_destroy(&self->device_manager);
     free(self);
     return AcquireStatus_Ok;
@@ -246,32 +858,263 @@ Error:
     return AcquireStatus_Error;
 }
 
+/// @returns 1 if the storage device writes frames byte for byte, headers and
+///          all, so records that aren't plain images survive a round trip.
+///          Storage that writes an image per frame, like tiff, sizes each
+///          image by the frame's shape and can't take them.
+static int
+is_verbatim_storage(const struct DeviceIdentifier* identifier)
+{
+    static const char* const names[] = { "raw", "trash" };
+    if (identifier->kind == DeviceKind_None)
+        return 1;
+    for (size_t i = 0; i < countof(names); ++i) {
+        const char *a = identifier->name, *b = names[i];
+        while (*a && tolower((unsigned char)*a) == *b)
+            ++a, ++b;
+        if (!*a && !*b)
+            return 1;
+    }
+    return 0;
+}
+
+/// Copies the parts of `settings` that `acquire_configure()` compares for
+/// running streams. Camera and storage settings are left out: devices adjust
+/// them, and storage settings hold strings the caller owns. The rest is
+/// compared byte for byte.
+static void
+comparable_settings(struct aq_properties_video_s* out,
+                    const struct aq_properties_video_s* settings)
+{
+    memcpy(out, settings, sizeof(*out)); // NOLINT
+    memset(&out->camera.settings, 0, sizeof(out->camera.settings));
+    memset(&out->storage.settings, 0, sizeof(out->storage.settings));
+    memset(&out->filtered_storage.settings,
+           0,
+           sizeof(out->filtered_storage.settings));
+}
+
 static enum AcquireStatusCode
 configure_video_stream(struct video_s* const video,
-                       enum DeviceState state,
                        const struct DeviceManager* const device_manager,
-                       struct aq_properties_video_s* const pvideo
-
-)
+                       struct aq_properties_video_s* const pvideo,
+                       struct channel* const to_storage)
 {
     struct aq_properties_camera_s* const pcamera = &pvideo->camera;
     struct aq_properties_storage_s* const pstorage = &pvideo->storage;
+    struct aq_properties_compression_s* const pcompression =
+      &pvideo->compression;
+    struct aq_properties_detection_s* const pdetection = &pvideo->detection;
+    struct aq_properties_tiling_s* const ptiling = &pvideo->tiling;
+    struct aq_properties_preview_s* const ppreview = &pvideo->preview;
+    struct aq_properties_gating_s* const pgating = &pvideo->gating;
+    struct aq_properties_bit_depth_s* const pbit_depth = &pvideo->bit_depth;
+    struct aq_properties_roi_s* const proi = &pvideo->roi;
+    struct aq_properties_traces_s* const ptraces = &pvideo->traces;
+    struct aq_properties_demosaic_s* const pdemosaic = &pvideo->demosaic;
+    struct AcquireDecimationPolicy* const pmonitor_decimation =
+      &pvideo->monitor_decimation;
+    struct AcquireDecimationPolicy* const pstorage_decimation =
+      &pvideo->storage_decimation;
+    struct aq_properties_filtered_storage_s* const pfiltered_storage =
+      &pvideo->filtered_storage;
+    const enum filter_routing routing =
+      (enum filter_routing)pvideo->filter_routing;
+
+    EXPECT(routing < FilterRouting_Count,
+           "[stream %d] Unknown filter routing %d.",
+           video->stream_id,
+           (int)routing);
+    EXPECT(!pvideo->sequence.split_storage ||
+             pvideo->sequence.frames_per_burst > 0,
+           "[stream %d] Splitting storage by burst requires bursts. Set "
+           "`sequence.frames_per_burst`.",
+           video->stream_id);
 
     int is_ok = 1;
-    is_ok &= (video_source_configure(&video->source,
-                                     device_manager,
-                                     &pcamera->identifier,
-                                     &pcamera->settings,
-                                     pvideo->max_frame_count,
-                                     pvideo->frame_average_count > 1) == Device_Ok);
-    is_ok &= (video_filter_configure(&video->filter,
-                                     pvideo->frame_average_count) == Device_Ok);
+    is_ok &= (video_orient_configure(
+                &video->orient, (enum orientation)pvideo->orientation) ==
+              Device_Ok);
+    // Frames are oriented on their way into the sink's input.
+    struct channel* const to_sink = video_orient_is_enabled(&video->orient)
+                                      ? &video->orient.in
+                                      : &video->sink.in;
+    video_source_set_output(&video->source, to_sink);
+    is_ok &= (video_filter_configure(
+                &video->filter,
+                pvideo->frame_average_count,
+                (enum frame_reduction)pvideo->frame_reduction) == Device_Ok);
+    // Routed next to storage, the filter reads the raw frames in place and
+    // the source writes straight to the sink.
+    video->filter_routing = routing;
+    const uint8_t is_routed = routing != FilterRouting_Inline &&
+                              video_filter_is_enabled(&video->filter);
+    if (is_routed)
+        is_ok &= (video_sink_reserve(&video->filtered_sink) == Device_Ok);
+    video_filter_set_route(&video->filter,
+                           is_routed ? &video->sink.in : &video->filter.in,
+                           is_routed ? &video->filtered_sink.in : to_sink);
+    is_ok &= (video_source_set_defect_fill(
+                &video->source, (enum defect_fill)pvideo->defect_correction) ==
+              Device_Ok);
+    is_ok &= (video_source_configure(
+                &video->source,
+                device_manager,
+                &pcamera->identifier,
+                &pcamera->settings,
+                pvideo->max_frame_count,
+                video_filter_is_enabled(&video->filter) && !is_routed) ==
+              Device_Ok);
+    is_ok &= (video_source_set_limits(
+                &video->source,
+                &(struct video_source_limits_s){
+                  .max_duration_s = pvideo->limits.max_duration_s,
+                  .max_bytes = pvideo->limits.max_bytes,
+                  .has_last_hardware_frame_id =
+                    pvideo->limits.has_last_hardware_frame_id,
+                  .last_hardware_frame_id =
+                    pvideo->limits.last_hardware_frame_id,
+                  .has_last_hardware_timestamp =
+                    pvideo->limits.has_last_hardware_timestamp,
+                  .last_hardware_timestamp =
+                    pvideo->limits.last_hardware_timestamp,
+                }) == Device_Ok);
+    video_source_set_sequence(&video->source,
+                              pvideo->sequence.frames_per_burst,
+                              pvideo->sequence.burst_count);
+    video_roi_set_input(&video->roi, to_storage);
+    is_ok &= (video_roi_configure(&video->roi,
+                                  (const struct roi_rect*)proi->rects,
+                                  proi->count) == Device_Ok);
+    struct channel* const to_lut =
+      video_roi_is_enabled(&video->roi) ? &video->roi.out : to_storage;
+    video_lut_set_input(&video->lut, to_lut);
+    is_ok &= (video_lut_configure(&video->lut,
+                                  (enum lut_curve)pbit_depth->curve,
+                                  pbit_depth->window_min,
+                                  pbit_depth->window_max,
+                                  pbit_depth->gamma,
+                                  pbit_depth->storage_only) == Device_Ok);
+    struct channel* const to_gate =
+      video_lut_is_enabled(&video->lut) ? &video->lut.out : to_lut;
+    video_gate_set_input(&video->gate, to_gate);
+    is_ok &= (video_gate_configure(&video->gate,
+                                   pgating->enable,
+                                   pgating->threshold,
+                                   pgating->keyframe_interval) == Device_Ok);
+    struct channel* const to_tiler =
+      video_gate_is_enabled(&video->gate) ? &video->gate.out : to_gate;
+    video_tiler_set_input(&video->tiler, to_tiler);
+    is_ok &= (video_tiler_configure(&video->tiler,
+                                    ptiling->tile_x,
+                                    ptiling->tile_y,
+                                    ptiling->tile_t) == Device_Ok);
+    struct channel* const to_encoder = video_tiler_is_enabled(&video->tiler)
+                                         ? &video->tiler.out
+                                         : to_tiler;
+    video_encoder_set_input(&video->encoder, to_encoder);
+    is_ok &=
+      (video_encoder_configure(&video->encoder,
+                               (enum codec_id)pcompression->codec,
+                               (enum shuffle_kind)pcompression->shuffle,
+                               pcompression->bytes_per_block,
+                               pcompression->sparse_threshold,
+                               pcompression->sparse_max_density) == Device_Ok);
+    if (video_tiler_is_enabled(&video->tiler) &&
+        video_encoder_is_enabled(&video->encoder)) {
+        LOGE("Tiling can't be combined with compression.");
+        is_ok = 0;
+    }
+    if (video_encoder_is_enabled(&video->encoder) &&
+        !is_verbatim_storage(&pstorage->identifier)) {
+        LOGE("Compressed frames can't be stored with \"%s\". Use raw "
+             "storage.",
+             pstorage->identifier.name);
+        is_ok = 0;
+    }
+    if (video_tiler_is_enabled(&video->tiler) &&
+        !is_verbatim_storage(&pstorage->identifier)) {
+        LOGE("Tiled frames can't be stored with \"%s\". Use raw storage.",
+             pstorage->identifier.name);
+        is_ok = 0;
+    }
+    // Both expect a stream of frames of one shape.
+    if (video_roi_is_enabled(&video->roi) &&
+        (video_gate_is_enabled(&video->gate) ||
+         video_tiler_is_enabled(&video->tiler))) {
+        LOGE("Regions of interest can't be combined with gating or tiling.");
+        is_ok = 0;
+    }
+    is_ok &= (video_detector_configure(&video->detector,
+                                       pdetection->enable,
+                                       pdetection->threshold) == Device_Ok);
+    is_ok &=
+      (video_traces_configure(&video->traces,
+                              ptraces->enable,
+                              (enum trace_statistic)ptraces->statistic) ==
+       Device_Ok);
+    is_ok &= (video_meter_configure(
+                &video->meter, pvideo->enable_frame_statistics) == Device_Ok);
+    is_ok &= (video_preview_configure(&video->preview,
+                                      ppreview->downscale,
+                                      ppreview->max_rate_hz,
+                                      ppreview->display_min,
+                                      ppreview->display_max) == Device_Ok);
+    is_ok &= (video_demosaic_configure(
+                &video->demosaic,
+                (enum demosaic_method)pdemosaic->method,
+                (enum bayer_pattern)pdemosaic->pattern,
+                (enum color_layout)pdemosaic->layout) == Device_Ok);
+    {
+        // The monitor reads reduced frames unless they're only for storage,
+        // and filtered frames when the filter is routed to it. Demosaicing
+        // comes last.
+        struct channel* to_monitor = &video->sink.in;
+        if (is_routed)
+            to_monitor = &video->filtered_sink.in;
+        else if (video_lut_is_enabled(&video->lut) && !video->lut.storage_only)
+            to_monitor = &video->lut.out;
+        if (video_demosaic_is_enabled(&video->demosaic)) {
+            video_demosaic_set_input(&video->demosaic, to_monitor);
+            to_monitor = &video->demosaic.out;
+        }
+        if (to_monitor != video->monitor.from) {
+            channel_reader_detach(video->monitor.from, &video->monitor.reader);
+            video->monitor.from = to_monitor;
+        }
+    }
+    is_ok &= (decimator_configure(
+                &video->monitor.decimator,
+                (enum decimation_policy)pmonitor_decimation->policy,
+                pmonitor_decimation->every,
+                pmonitor_decimation->max_rate_hz) == Device_Ok);
+    is_ok &= (decimator_configure(
+                &video->sink.decimator,
+                (enum decimation_policy)pstorage_decimation->policy,
+                pstorage_decimation->every,
+                pstorage_decimation->max_rate_hz) == Device_Ok);
+    video_sink_set_input(&video->sink,
+                         video_encoder_is_enabled(&video->encoder)
+                           ? &video->encoder.out
+                           : to_encoder);
     is_ok &=
       (video_sink_configure(&video->sink,
                             device_manager,
                             &pstorage->identifier,
                             &pstorage->settings,
-                            pstorage->write_delay_ms) == Device_Ok);
+                            pstorage->write_delay_ms,
+                            pdetection->enable ? pdetection->store_every
+                                               : 0) == Device_Ok);
+    video_sink_set_split_by_burst(&video->sink, pvideo->sequence.split_storage);
+    video_sink_set_split_by_burst(&video->filtered_sink,
+                                  pvideo->sequence.split_storage);
+    if (routing == FilterRouting_Split)
+        is_ok &= (video_sink_configure(&video->filtered_sink,
+                                       device_manager,
+                                       &pfiltered_storage->identifier,
+                                       &pfiltered_storage->settings,
+                                       pstorage->write_delay_ms,
+                                       0) == Device_Ok);
 
     EXPECT(is_ok, "Failed to configure video stream.");
 
@@ -294,126 +1137,711 @@ video_stream_requirements_check(struct aq_properties_video_s* video_settings)
     return 1;
 }
 
+/// Sets the state of each stream that isn't running from whether it's
+/// configured, and the runtime's state from its streams'.
+static void
+update_state(struct runtime* self)
+{
+    uint8_t is_running = 0;
+    for (int i = 0; i < countof(self->video); ++i) {
+        struct video_s* video = self->video + i;
+        if (video->state != DeviceState_Running)
+            video->state = ((self->valid_video_streams >> i) & 1)
+                             ? DeviceState_Armed
+                             : DeviceState_AwaitingConfiguration;
+        is_running |= video->state == DeviceState_Running;
+    }
+    if (is_running)
+        self->state = DeviceState_Running;
+    else
+        self->state = self->valid_video_streams > 0
+                        ? DeviceState_Armed
+                        : DeviceState_AwaitingConfiguration;
+}
+
+enum AcquireStatusCode
+acquire_get_configuration(const struct AcquireRuntime* self_,
+                          struct AcquireProperties* settings)
+{
+    struct runtime* self = 0;
+    int is_ok = 1;
+    EXPECT(self_, "Invalid parameter. Expected AcquireRuntime* got NULL.");
+    EXPECT(settings,
+           "Invalid parameter. Expected AcquireProperties* got NULL.");
+    self = containerof(self_, struct runtime, handle);
+    for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
+        const struct video_s* const video = self->video + istream;
+        struct aq_properties_video_s* const pvideo = settings->video + istream;
+        struct aq_properties_camera_s* const pcamera = &pvideo->camera;
+        struct aq_properties_storage_s* const pstorage = &pvideo->storage;
+
+        pvideo->frame_average_count = video->filter.filter_window_frames;
+        pvideo->compression = (struct aq_properties_compression_s){
+            .codec = (enum AcquireCodec)video->encoder.params.codec,
+            .shuffle = (enum AcquireShuffle)video->encoder.params.shuffle,
+            .bytes_per_block = video->encoder.bytes_per_block,
+            .sparse_threshold = video->encoder.params.sparse_threshold,
+            .sparse_max_density = video->encoder.params.sparse_max_density,
+        };
+        pvideo->enable_frame_statistics = video->meter.is_enabled;
+        pvideo->defect_correction =
+          (enum AcquireDefectFill)video->source.defects.fill;
+        pvideo->frame_reduction =
+          (enum AcquireFrameReduction)video->filter.reduction;
+        pvideo->detection = (struct aq_properties_detection_s){
+            .enable = video->detector.is_enabled,
+            .threshold = video->detector.threshold,
+            .store_every = video->sink.store_every,
+        };
+        pvideo->tiling = (struct aq_properties_tiling_s){
+            .tile_x = video->tiler.tile_x,
+            .tile_y = video->tiler.tile_y,
+            .tile_t = video->tiler.tile_t,
+        };
+        pvideo->traces = (struct aq_properties_traces_s){
+            .enable = video->traces.is_enabled,
+            .statistic = (enum AcquireTraceStatistic)video->traces.statistic,
+        };
+        pvideo->monitor_decimation = (struct AcquireDecimationPolicy){
+            .policy = (enum AcquireDecimation)video->monitor.decimator.policy,
+            .every = video->monitor.decimator.every,
+            .max_rate_hz = video->monitor.decimator.max_rate_hz,
+        };
+        pvideo->storage_decimation = (struct AcquireDecimationPolicy){
+            .policy = (enum AcquireDecimation)video->sink.decimator.policy,
+            .every = video->sink.decimator.every,
+            .max_rate_hz = video->sink.decimator.max_rate_hz,
+        };
+        pvideo->demosaic = (struct aq_properties_demosaic_s){
+            .method = (enum AcquireDemosaic)video->demosaic.method,
+            .pattern = (enum AcquireBayerPattern)video->demosaic.pattern,
+            .layout = (enum AcquireColorLayout)video->demosaic.layout,
+        };
+        pvideo->orientation =
+          (enum AcquireOrientation)video->orient.orientation;
+        pvideo->limits = (struct aq_properties_limits_s){
+            .max_duration_s = video->source.limits.max_duration_s,
+            .max_bytes = video->source.limits.max_bytes,
+            .has_last_hardware_frame_id =
+              video->source.limits.has_last_hardware_frame_id,
+            .last_hardware_frame_id =
+              video->source.limits.last_hardware_frame_id,
+            .has_last_hardware_timestamp =
+              video->source.limits.has_last_hardware_timestamp,
+            .last_hardware_timestamp =
+              video->source.limits.last_hardware_timestamp,
+        };
+        pvideo->sequence = (struct aq_properties_sequence_s){
+            .frames_per_burst = video->source.sequence.frames_per_burst,
+            .burst_count = video->source.sequence.burst_count,
+            .split_storage = video->sink.is_split_by_burst,
+        };
+        pvideo->preview = (struct aq_properties_preview_s){
+            .downscale = video->preview.downscale,
+            .max_rate_hz = video->preview.max_rate_hz,
+            .display_min = video->preview.display_min,
+            .display_max = video->preview.display_max,
+        };
+        pvideo->bit_depth = (struct aq_properties_bit_depth_s){
+            .curve = (enum AcquireLutCurve)video->lut.curve,
+            .window_min = video->lut.window_min,
+            .window_max = video->lut.window_max,
+            .gamma = video->lut.gamma,
+            .storage_only = video->lut.storage_only,
+        };
+        pvideo->roi = (struct aq_properties_roi_s){
+            .count = video->roi.count,
+        };
+        memcpy(pvideo->roi.rects, // NOLINT
+               video->roi.rects,
+               sizeof(pvideo->roi.rects));
+        pvideo->gating = (struct aq_properties_gating_s){
+            .enable = video->gate.is_enabled,
+            .threshold = video->gate.threshold,
+            .keyframe_interval = video->gate.keyframe_interval,
+        };
+
+        is_ok &= (video_source_get(&video->source,
+                                   &pcamera->identifier,
+                                   &pcamera->settings,
+                                   &pvideo->max_frame_count) == Device_Ok);
+
+        is_ok &= (video_sink_get(&video->sink,
+                                 &pstorage->identifier,
+                                 &pstorage->settings,
+                                 &pstorage->write_delay_ms) == Device_Ok);
+
+        pvideo->filter_routing =
+          (enum AcquireFilterRouting)video->filter_routing;
+        {
+            float write_delay_ms = 0.0f;
+            is_ok &= (video_sink_get(&video->filtered_sink,
+                                     &pvideo->filtered_storage.identifier,
+                                     &pvideo->filtered_storage.settings,
+                                     &write_delay_ms) == Device_Ok);
+        }
+    }
+    settings->fusion = (struct aq_properties_fusion_s){
+        .mode = (enum AcquireFusion)self->fusion.mode,
+        .pairing = (enum AcquireFusionPairing)self->fusion.pairing,
+        .max_timestamp_delta = self->fusion.max_timestamp_delta,
+        .store = self->fusion.is_stored,
+    };
+
+    return is_ok ? AcquireStatus_Ok : AcquireStatus_Error;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_get_configuration_metadata(const struct AcquireRuntime* self_,
+                                   struct AcquirePropertyMetadata* metadata)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    CHECK(metadata);
+    self = containerof(self_, struct runtime, handle);
+    for (int i = 0; i < countof(metadata->video); ++i) {
+        if (self->video[i].source.camera)
+            camera_get_meta(self->video[i].source.camera,
+                            &metadata->video[i].camera);
+        if (self->video[i].sink.storage)
+            storage_get_meta(self->video[i].sink.storage,
+                             &metadata->video[i].storage);
+        if (self->video[i].filtered_sink.storage)
+            storage_get_meta(self->video[i].filtered_sink.storage,
+                             &metadata->video[i].filtered_storage);
+        metadata->video[i].max_frame_count = (struct Property){
+            .writable = 1,
+            .low = 0.0f,
+            .high = -1.0f, // NOTE: (nclack) Not sure what's right here.
+            .type = PropertyType_FixedPrecision
+        };
+        metadata->video[i].frame_average_count =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high =
+                               -1.0f, // TODO: (nclack) Compute this. Depends on
+                                      // the queue and frame size
+                             .type = PropertyType_FixedPrecision };
+        metadata->video[i].compression = (struct aq_metadata_compression_s){
+            .codec = { .writable = 1,
+                       .low = (float)AcquireCodec_None,
+                       .high = (float)AcquireCodec_Sparse,
+                       .type = PropertyType_Enum },
+            .shuffle = { .writable = 1,
+                         .low = (float)AcquireShuffle_None,
+                         .high = (float)AcquireShuffle_Bit,
+                         .type = PropertyType_Enum },
+            .bytes_per_block = { .writable = 1,
+                                 .low = 64.0f,
+                                 .high = (float)(1ULL << 31),
+                                 .type = PropertyType_FixedPrecision },
+            .sparse_threshold = { .writable = 1,
+                                  .low = 0.0f,
+                                  .high = 65535.0f,
+                                  .type = PropertyType_FixedPrecision },
+            .sparse_max_density = { .writable = 1,
+                                    .low = 0.0f,
+                                    .high = 1.0f,
+                                    .type = PropertyType_FloatingPrecision },
+        };
+        metadata->video[i].enable_frame_statistics =
+          (struct Property){ .writable = 1,
+                             .low = 0.0f,
+                             .high = 1.0f,
+                             .type = PropertyType_FixedPrecision };
+        metadata->video[i].defect_correction =
+          (struct Property){ .writable = 1,
+                             .low = (float)AcquireDefectFill_None,
+                             .high = (float)AcquireDefectFill_Median,
+                             .type = PropertyType_Enum };
+        metadata->video[i].frame_reduction =
+          (struct Property){ .writable = 1,
+                             .low = (float)AcquireFrameReduction_Mean,
+                             .high =
+                               (float)AcquireFrameReduction_MeanVariance,
+                             .type = PropertyType_Enum };
+        metadata->video[i].detection = (struct aq_metadata_detection_s){
+            .enable = { .writable = 1,
+                        .low = 0.0f,
+                        .high = 1.0f,
+                        .type = PropertyType_FixedPrecision },
+            .threshold = { .writable = 1,
+                           .low = 0.0f,
+                           .high = -1.0f,
+                           .type = PropertyType_FloatingPrecision },
+            .store_every = { .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].tiling = (struct aq_metadata_tiling_s){
+            .tile_x = { .writable = 1,
+                        .low = 0.0f,
+                        .high = -1.0f,
+                        .type = PropertyType_FixedPrecision },
+            .tile_y = { .writable = 1,
+                        .low = 0.0f,
+                        .high = -1.0f,
+                        .type = PropertyType_FixedPrecision },
+            .tile_t = { .writable = 1,
+                        .low = 0.0f,
+                        .high = -1.0f,
+                        .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].traces = (struct aq_metadata_traces_s){
+            .enable = { .writable = 1,
+                        .low = 0.0f,
+                        .high = 1.0f,
+                        .type = PropertyType_FixedPrecision },
+            .statistic = { .writable = 1,
+                           .low = (float)AcquireTraceStatistic_Mean,
+                           .high = (float)AcquireTraceStatistic_Sum,
+                           .type = PropertyType_Enum },
+        };
+        metadata->video[i].monitor_decimation =
+          (struct aq_metadata_decimation_s){
+              .policy = { .writable = 1,
+                          .low = (float)AcquireDecimation_None,
+                          .high = (float)AcquireDecimation_LatestOnly,
+                          .type = PropertyType_Enum },
+              .every = { .writable = 1,
+                         .low = 0.0f,
+                         .high = -1.0f,
+                         .type = PropertyType_FixedPrecision },
+              .max_rate_hz = { .writable = 1,
+                               .low = 0.0f,
+                               .high = -1.0f,
+                               .type = PropertyType_FloatingPrecision },
+          };
+        metadata->video[i].storage_decimation =
+          metadata->video[i].monitor_decimation;
+        metadata->video[i].filter_routing = (struct Property){
+            .writable = 1,
+            .low = (float)AcquireFilterRouting_Inline,
+            .high = (float)AcquireFilterRouting_Split,
+            .type = PropertyType_Enum,
+        };
+        metadata->video[i].demosaic = (struct aq_metadata_demosaic_s){
+            .method = { .writable = 1,
+                        .low = (float)AcquireDemosaic_None,
+                        .high = (float)AcquireDemosaic_EdgeAware,
+                        .type = PropertyType_Enum },
+            .pattern = { .writable = 1,
+                         .low = (float)AcquireBayerPattern_RGGB,
+                         .high = (float)AcquireBayerPattern_GBRG,
+                         .type = PropertyType_Enum },
+            .layout = { .writable = 1,
+                        .low = (float)AcquireColorLayout_Interleaved,
+                        .high = (float)AcquireColorLayout_Planar,
+                        .type = PropertyType_Enum },
+        };
+        metadata->video[i].orientation = (struct Property){
+            .writable = 1,
+            .low = (float)AcquireOrientation_None,
+            .high = (float)AcquireOrientation_Transpose,
+            .type = PropertyType_Enum,
+        };
+        metadata->video[i].limits = (struct aq_metadata_limits_s){
+            .max_duration_s = { .writable = 1,
+                                .low = 0.0f,
+                                .high = -1.0f,
+                                .type = PropertyType_FloatingPrecision },
+            .max_bytes = { .writable = 1,
+                           .low = 0.0f,
+                           .high = -1.0f,
+                           .type = PropertyType_FixedPrecision },
+            .has_last_hardware_frame_id = { .writable = 1,
+                                            .low = 0.0f,
+                                            .high = 1.0f,
+                                            .type =
+                                              PropertyType_FixedPrecision },
+            .last_hardware_frame_id = { .writable = 1,
+                                        .low = 0.0f,
+                                        .high = -1.0f,
+                                        .type = PropertyType_FixedPrecision },
+            .has_last_hardware_timestamp = { .writable = 1,
+                                             .low = 0.0f,
+                                             .high = 1.0f,
+                                             .type =
+                                               PropertyType_FixedPrecision },
+            .last_hardware_timestamp = { .writable = 1,
+                                         .low = 0.0f,
+                                         .high = -1.0f,
+                                         .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].sequence = (struct aq_metadata_sequence_s){
+            .frames_per_burst = { .writable = 1,
+                                  .low = 0.0f,
+                                  .high = -1.0f,
+                                  .type = PropertyType_FixedPrecision },
+            .burst_count = { .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FixedPrecision },
+            .split_storage = { .writable = 1,
+                               .low = 0.0f,
+                               .high = 1.0f,
+                               .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].preview = (struct aq_metadata_preview_s){
+            .downscale = { .writable = 1,
+                           .low = 0.0f,
+                           .high = (float)PREVIEW_MAX_DOWNSCALE,
+                           .type = PropertyType_FixedPrecision },
+            .max_rate_hz = { .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FloatingPrecision },
+            .display_min = { .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FloatingPrecision },
+            .display_max = { .writable = 1,
+                             .low = 0.0f,
+                             .high = -1.0f,
+                             .type = PropertyType_FloatingPrecision },
+        };
+        metadata->video[i].bit_depth = (struct aq_metadata_bit_depth_s){
+            .curve = { .writable = 1,
+                       .low = (float)AcquireLutCurve_None,
+                       .high = (float)AcquireLutCurve_Custom,
+                       .type = PropertyType_Enum },
+            .window_min = { .writable = 1,
+                            .low = 0.0f,
+                            .high = (float)UINT16_MAX,
+                            .type = PropertyType_FloatingPrecision },
+            .window_max = { .writable = 1,
+                            .low = 0.0f,
+                            .high = (float)UINT16_MAX,
+                            .type = PropertyType_FloatingPrecision },
+            .gamma = { .writable = 1,
+                       .low = 0.0f,
+                       .high = -1.0f,
+                       .type = PropertyType_FloatingPrecision },
+            .storage_only = { .writable = 1,
+                              .low = 0.0f,
+                              .high = 1.0f,
+                              .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].roi = (struct aq_metadata_roi_s){
+            .count = { .writable = 1,
+                       .low = 0.0f,
+                       .high = (float)ACQUIRE_MAX_ROI_COUNT,
+                       .type = PropertyType_FixedPrecision },
+        };
+        metadata->video[i].gating = (struct aq_metadata_gating_s){
+            .enable = { .writable = 1,
+                        .low = 0.0f,
+                        .high = 1.0f,
+                        .type = PropertyType_FixedPrecision },
+            .threshold = { .writable = 1,
+                           .low = 0.0f,
+                           .high = -1.0f,
+                           .type = PropertyType_FloatingPrecision },
+            .keyframe_interval = { .writable = 1,
+                                   .low = 0.0f,
+                                   .high = -1.0f,
+                                   .type = PropertyType_FixedPrecision },
+        };
+    }
+    metadata->fusion = (struct aq_metadata_fusion_s){
+        .mode = { .writable = 1,
+                  .low = (float)AcquireFusion_None,
+                  .high = (float)AcquireFusion_SideBySide,
+                  .type = PropertyType_Enum },
+        .pairing = { .writable = 1,
+                     .low = (float)AcquireFusionPairing_FrameId,
+                     .high = (float)AcquireFusionPairing_HardwareTimestamp,
+                     .type = PropertyType_Enum },
+        .max_timestamp_delta = { .writable = 1,
+                                 .low = 0.0f,
+                                 .high = -1.0f,
+                                 .type = PropertyType_FixedPrecision },
+        .store = { .writable = 1,
+                   .low = 0.0f,
+                   .high = 1.0f,
+                   .type = PropertyType_FixedPrecision },
+    };
+
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+size_t
+acquire_bytes_waiting_to_be_written_to_disk(const struct AcquireRuntime* self_,
+                                            uint32_t istream)
+{
+    struct runtime* self = 0;
+    CHECK(self_);
+    self = containerof(self_, struct runtime, handle);
+    CHECK(istream < countof(self->video));
+    const struct video_s* video = self->video + istream;
+    return video_sink_bytes_waiting(&video->sink);
+Error:
+    return 0;
+}
+
+enum AcquireStatusCode
+acquire_get_statistics(const struct AcquireRuntime* self_,
+                       uint32_t istream,
+                       struct AcquireStreamStatistics* stats)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(stats, "Invalid parameter: `stats` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    const struct video_s* const video = self->video + istream;
+
+    const struct video_encoder_stats_s encoder = video->encoder.stats;
+    const struct video_detector_stats_s detector = video->detector.stats;
+    const struct video_preview_stats_s preview = video->preview.stats;
+    const struct video_gate_stats_s gate = video->gate.stats;
+    const struct video_roi_stats_s roi = video->roi.stats;
+    const struct video_traces_stats_s traces = video->traces.stats;
+    const struct video_demosaic_stats_s demosaic = video->demosaic.stats;
+    const struct video_orient_stats_s orient = video->orient.stats;
+    const struct video_source_stats_s source = video->source.stats;
+    *stats = (struct AcquireStreamStatistics){
+        .compression = {
+          .frame_count = encoder.frame_count,
+          .bytes_in = encoder.bytes_in,
+          .bytes_out = encoder.bytes_out,
+          .ratio = encoder.bytes_out
+                     ? (float)((double)encoder.bytes_in / encoder.bytes_out)
+                     : 0.0f,
+          .throughput_mb_per_s =
+            encoder.busy_ms > 0.0
+              ? (float)(1e-3 * (double)encoder.bytes_in / encoder.busy_ms)
+              : 0.0f,
+        },
+        .frame_statistics_dropped = video->meter.stats.dropped_count,
+        .fusion_unpaired = self->fusion.stats.unpaired[istream],
+        .detection = {
+          .frame_count = detector.frame_count,
+          .spot_count = detector.spot_count,
+          .dropped_count = detector.dropped_count,
+        },
+        .preview = {
+          .frame_count = preview.frame_count,
+          .dropped_count = preview.dropped_count,
+        },
+        .gating = {
+          .frame_count = gate.frame_count,
+          .stored_count = gate.stored_count,
+          .keyframe_count = gate.keyframe_count,
+          .records_dropped = gate.records_dropped,
+        },
+        .roi = {
+          .frame_count = roi.frame_count,
+          .skipped_count = roi.skipped_count,
+        },
+        .traces = {
+          .frame_count = traces.frame_count,
+          .skipped_count = traces.skipped_count,
+          .dropped_count = traces.dropped_count,
+        },
+        .demosaic = {
+          .frame_count = demosaic.frame_count,
+          .skipped_count = demosaic.skipped_count,
+        },
+        .orientation = {
+          .frame_count = orient.frame_count,
+          .skipped_count = orient.skipped_count,
+        },
+        .acquisition = {
+          .frame_count = source.frame_count,
+          .bytes = source.bytes,
+          .burst_count = source.burst_count,
+          .stop_reason = (enum AcquireStopReason)source.stop_reason,
+        },
+    };
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+enum AcquireStatusCode
+acquire_read_frame_statistics(const struct AcquireRuntime* self_,
+                              uint32_t istream,
+                              struct AcquireFrameStatistics* stats,
+                              uint32_t capacity,
+                              uint32_t* count)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(stats || !capacity, "Invalid parameter: `stats` was NULL.");
+    EXPECT(count, "Invalid parameter: `count` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    self = containerof(self_, struct runtime, handle);
+    struct video_s* const video = self->video + istream;
+    *count = 0;
+    EXPECT(video->meter.out.data,
+           "[stream %d] Frame statistics are not enabled.",
+           istream);
+
+    struct channel* const channel = &video->meter.out;
+    struct channel_reader* const reader = &video->monitor.stats_reader;
+    while (*count < capacity) {
+        const struct slice slice = channel_read_map(channel, reader);
+        CHECK(reader->status == Channel_Ok);
+        const struct frame_stats* const beg = (struct frame_stats*)slice.beg;
+        const struct frame_stats* const end = (struct frame_stats*)slice.end;
+        size_t n = end - beg;
+        if (n > capacity - *count)
+            n = capacity - *count;
+        for (size_t i = 0; i < n; ++i) {
+            const struct frame_stats* const in = beg + i;
+            struct AcquireFrameStatistics* const out = stats + *count + i;
+            *out = (struct AcquireFrameStatistics){
+                .frame_id = in->frame_id,
+                .hardware_frame_id = in->hardware_frame_id,
+                .timestamp_hardware = in->timestamp_hardware,
+                .timestamp_acq_thread = in->timestamp_acq_thread,
+                .pixel_count = in->pixel_count,
+                .saturated_count = in->saturated_count,
+                .min = in->min,
+                .max = in->max,
+                .mean = in->mean,
+                .histogram_low = in->histogram_low,
+                .histogram_bin_width = in->histogram_bin_width,
+            };
+            memcpy(out->histogram, // NOLINT
+                   in->histogram,
+                   sizeof(out->histogram));
+        }
+        channel_read_unmap(channel, reader, n * sizeof(*beg));
+        *count += (uint32_t)n;
+        // The queue may have wrapped. If so, the rest is read next pass.
+        if (!n || beg + n < end)
+            break;
+    }
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+// Regions of interest are handed to the stage as is.
+_Static_assert(sizeof(struct AcquireRoi) == sizeof(struct roi_rect),
+               "AcquireRoi must match struct roi_rect");
+_Static_assert(ACQUIRE_MAX_ROI_COUNT == ROI_MAX_COUNT,
+               "ACQUIRE_MAX_ROI_COUNT must match ROI_MAX_COUNT");
+
+_Static_assert((int)AcquireLutCurve_Custom == (int)LutCurve_Custom,
+               "AcquireLutCurve must match enum lut_curve");
+_Static_assert((int)AcquireFilterRouting_Split == (int)FilterRouting_Split,
+               "AcquireFilterRouting must match enum filter_routing");
+_Static_assert((int)AcquireDecimation_LatestOnly ==
+                 (int)Decimation_LatestOnly,
+               "AcquireDecimation must match enum decimation_policy");
+_Static_assert((int)AcquireDemosaic_EdgeAware == (int)Demosaic_EdgeAware,
+               "AcquireDemosaic must match enum demosaic_method");
+_Static_assert((int)AcquireBayerPattern_GBRG == (int)BayerPattern_GBRG,
+               "AcquireBayerPattern must match enum bayer_pattern");
+_Static_assert((int)AcquireColorLayout_Planar == (int)ColorLayout_Planar,
+               "AcquireColorLayout must match enum color_layout");
+_Static_assert((int)AcquireOrientation_Transpose ==
+                 (int)Orientation_Transpose,
+               "AcquireOrientation must match enum orientation");
+_Static_assert((int)AcquireStopReason_BurstCount ==
+                 (int)SourceStop_BurstCount,
+               "AcquireStopReason must match enum source_stop_reason");
+
 enum AcquireStatusCode
-acquire_configure(struct AcquireRuntime* self_,
-                  struct AcquireProperties* settings)
+acquire_set_bit_depth_table(struct AcquireRuntime* self_,
+                            uint32_t istream,
+                            const uint8_t* table,
+                            uint32_t count)
 {
     struct runtime* self = 0;
-    EXPECT(self_, "Invalid parameter. Expected AcquireRuntime* got NULL.");
-    EXPECT(settings,
-           "Invalid parameter. Expected AcquireProperties* but got NULL.");
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(table || !count, "Invalid parameter: `table` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    EXPECT(self->state != DeviceState_Closed, "Device state is Closed.");
-    self->valid_video_streams = 0;
-    for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
-        if (video_stream_requirements_check(settings->video + istream)) {
-            struct video_s* const video = self->video + istream;
-            if (AcquireStatus_Ok ==
-                configure_video_stream(video,
-                                       self->state,
-                                       &self->device_manager,
-                                       settings->video + istream)) {
-                self->valid_video_streams |= (1 << istream);
-                TRACE("Configured video stream %d.", istream);
-            } else {
-                TRACE("Failed to configure video stream %d.", istream);
-            }
-        }
-    }
-    TRACE("Valid video streams: code %#04x", self->valid_video_streams);
-    self->state = self->valid_video_streams > 0
-                    ? DeviceState_Armed
-                    : DeviceState_AwaitingConfiguration;
+    EXPECT(self->video[istream].state != DeviceState_Running,
+           "The lookup table can't be changed while running.");
+    CHECK(video_lut_set_table(&self->video[istream].lut, table, count) ==
+          Device_Ok);
     return AcquireStatus_Ok;
 Error:
-    if (self_)
-        acquire_abort(self_);
-    if (self)
-        self->state = DeviceState_AwaitingConfiguration;
     return AcquireStatus_Error;
 }
 
 enum AcquireStatusCode
-acquire_get_configuration(const struct AcquireRuntime* self_,
-                          struct AcquireProperties* settings)
+acquire_set_defect_pixels(struct AcquireRuntime* self_,
+                          uint32_t istream,
+                          const uint32_t* xs,
+                          const uint32_t* ys,
+                          uint32_t count)
 {
     struct runtime* self = 0;
-    int is_ok = 1;
-    EXPECT(self_, "Invalid parameter. Expected AcquireRuntime* got NULL.");
-    EXPECT(settings,
-           "Invalid parameter. Expected AcquireProperties* got NULL.");
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT((xs && ys) || !count, "Invalid parameter: `xs` or `ys` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
-        const struct video_s* const video = self->video + istream;
-        struct aq_properties_video_s* const pvideo = settings->video + istream;
-        struct aq_properties_camera_s* const pcamera = &pvideo->camera;
-        struct aq_properties_storage_s* const pstorage = &pvideo->storage;
-
-        pvideo->frame_average_count = video->filter.filter_window_frames;
-
-        is_ok &= (video_source_get(&video->source,
-                                   &pcamera->identifier,
-                                   &pcamera->settings,
-                                   &pvideo->max_frame_count) == Device_Ok);
-
-        is_ok &= (video_sink_get(&video->sink,
-                                 &pstorage->identifier,
-                                 &pstorage->settings,
-                                 &pstorage->write_delay_ms) == Device_Ok);
-    }
-
-    return is_ok ? AcquireStatus_Ok : AcquireStatus_Error;
+    EXPECT(self->video[istream].state != DeviceState_Running,
+           "Defective pixels can't be changed while running.");
+    struct video_s* const video = self->video + istream;
+    CHECK(defect_map_set_pixels(&video->source.defects, xs, ys, count));
+    return AcquireStatus_Ok;
 Error:
     return AcquireStatus_Error;
 }
 
 enum AcquireStatusCode
-acquire_get_configuration_metadata(const struct AcquireRuntime* self_,
-                                   struct AcquirePropertyMetadata* metadata)
+acquire_set_defect_mask(struct AcquireRuntime* self_,
+                        uint32_t istream,
+                        const uint8_t* mask,
+                        uint32_t width,
+                        uint32_t height)
 {
     struct runtime* self = 0;
-    CHECK(self_);
-    CHECK(metadata);
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(mask || !(width && height), "Invalid parameter: `mask` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    for (int i = 0; i < countof(metadata->video); ++i) {
-        if (self->video[i].source.camera)
-            camera_get_meta(self->video[i].source.camera,
-                            &metadata->video[i].camera);
-        if (self->video[i].sink.storage)
-            storage_get_meta(self->video[i].sink.storage,
-                             &metadata->video[i].storage);
-        metadata->video[i].max_frame_count = (struct Property){
-            .writable = 1,
-            .low = 0.0f,
-            .high = -1.0f, // NOTE: (nclack) Not sure what's right here.
-            .type = PropertyType_FixedPrecision
-        };
-        metadata->video[i].frame_average_count =
-          (struct Property){ .writable = 1,
-                             .low = 0.0f,
-                             .high =
-                               -1.0f, // TODO: (nclack) Compute this. Depends on
-                                      // the queue and frame size
-                             .type = PropertyType_FixedPrecision };
-    }
-
+    EXPECT(self->video[istream].state != DeviceState_Running,
+           "Defective pixels can't be changed while running.");
+    struct video_s* const video = self->video + istream;
+    CHECK(defect_map_set_mask(&video->source.defects, mask, width, height));
     return AcquireStatus_Ok;
 Error:
     return AcquireStatus_Error;
 }
 
-size_t
-acquire_bytes_waiting_to_be_written_to_disk(const struct AcquireRuntime* self_,
-                                            uint32_t istream)
+enum AcquireStatusCode
+acquire_set_trace_labels(struct AcquireRuntime* self_,
+                         uint32_t istream,
+                         const uint16_t* labels,
+                         uint32_t width,
+                         uint32_t height)
 {
     struct runtime* self = 0;
-    CHECK(self_);
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
     self = containerof(self_, struct runtime, handle);
-    CHECK(istream < countof(self->video));
-    const struct video_s* video = self->video + istream;
-    return video_sink_bytes_waiting(&video->sink);
+    EXPECT(self->video[istream].state != DeviceState_Running,
+           "Trace labels can't be changed while running.");
+    CHECK(video_traces_set_labels(
+            &self->video[istream].traces, labels, width, height) == Device_Ok);
+    return AcquireStatus_Ok;
 Error:
-    return 0;
+    return AcquireStatus_Error;
 }
 
 static uint32_t
@@ -471,10 +1899,355 @@ acquire_get_shape(const struct AcquireRuntime* self_,
     CHECK(istream < countof(self->video));
     const struct video_s* const video = self->video + istream;
 
-    CHECK_SILENT(self->state != DeviceState_AwaitingConfiguration);
+    CHECK_SILENT(video->state != DeviceState_AwaitingConfiguration);
     CHECK(camera_get_image_shape(video->source.camera, shape) == Device_Ok);
+    *shape = video_orient_output_shape(&video->orient, shape);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// Releases everything `reader` hasn't read from `channel`.
+static void
+discard_unread(struct channel* channel, struct channel_reader* reader)
+{
+    size_t nbytes;
+    do {
+        struct slice slice = channel_read_map(channel, reader);
+        nbytes = slice_size_bytes(&slice);
+        channel_read_unmap(channel, reader, nbytes);
+    } while (nbytes);
+}
+
+/// @returns `DeviceState_Running` while any of the stream's threads are
+///          running. A stream whose acquisition has ended on its own is
+///          `DeviceState_Armed`, though its threads are only joined on stop.
+static enum DeviceState
+poll_stream_state(struct video_s* video)
+{
+    if (DeviceState_Running != video->state)
+        return video->state;
+
+    TRACE("[stream %d]\n"
+          "source %s running, %s stopping\n"
+          "filter %s running, %s stopping\n"
+          "  sink %s running, %s stopping",
+          video->stream_id,
+          video->source.is_running ? "" : "not",
+          video->source.is_stopping ? "" : "not",
+          video->filter.is_running ? "" : "not",
+          video->filter.is_stopping ? "" : "not",
+          video->sink.is_running ? "" : "not",
+          video->sink.is_stopping ? "" : "not");
+
+    uint8_t is_running = 0;
+    is_running |= video->source.is_running;
+    is_running |= video->filter.is_running;
+    is_running |= video->orient.is_running;
+    is_running |= video->roi.is_running;
+    is_running |= video->lut.is_running;
+    is_running |= video->gate.is_running;
+    is_running |= video->tiler.is_running;
+    is_running |= video->encoder.is_running;
+    is_running |= video->detector.is_running;
+    is_running |= video->traces.is_running;
+    is_running |= video->meter.is_running;
+    is_running |= video->demosaic.is_running;
+    is_running |= video->preview.is_running;
+    is_running |= video->sink.is_running;
+    is_running |= video->filtered_sink.is_running;
+
+    return video->state =
+             is_running ? DeviceState_Running : DeviceState_Armed;
+}
+
+/// Starts the threads of one stream, from storage back to the source. On
+/// failure, the threads that were started are left running.
+static enum AcquireStatusCode
+start_video_stream(struct runtime* self, struct video_s* video)
+{
+    const uint8_t i = video->stream_id;
+    EXPECT(poll_stream_state(video) != DeviceState_Running,
+           "[stream %d] Video stream is already running.",
+           i);
+
+    CHECK(video_sink_start(&video->sink) == Device_Ok);
+    decimator_reset(&video->monitor.decimator);
+    if (self->fusion.is_stored && i == 0)
+        CHECK(reserve_fused_image_shape(self));
+    else
+        CHECK(reserve_image_shape(video));
+    if (is_filter_routed(video)) {
+        channel_accept_writes(&video->filtered_sink.in, 1);
+        if (video->filter_routing == FilterRouting_Split) {
+            CHECK(video_sink_start(&video->filtered_sink) == Device_Ok);
+            CHECK(reserve_filtered_image_shape(video));
+        }
+    }
+    if (video_roi_is_enabled(&video->roi))
+        CHECK(video_roi_start(&video->roi) == Device_Ok);
+    if (video_lut_is_enabled(&video->lut))
+        CHECK(video_lut_start(&video->lut) == Device_Ok);
+    if (video_gate_is_enabled(&video->gate)) {
+        // The log of the last acquisition stays readable until now.
+        discard_unread(&video->gate.log, &video->monitor.gating_reader);
+        CHECK(video_gate_start(&video->gate) == Device_Ok);
+    }
+    if (video_tiler_is_enabled(&video->tiler))
+        CHECK(video_tiler_start(&video->tiler) == Device_Ok);
+    if (video_encoder_is_enabled(&video->encoder))
+        CHECK(video_encoder_start(&video->encoder) == Device_Ok);
+    if (video_detector_is_enabled(&video->detector))
+        CHECK(video_detector_start(&video->detector) == Device_Ok);
+    if (video_traces_is_enabled(&video->traces)) {
+        // Traces of the last acquisition stay readable until now.
+        discard_unread(&video->traces.out, &video->monitor.traces_reader);
+        CHECK(video_traces_start(&video->traces) == Device_Ok);
+    }
+    if (video_meter_is_enabled(&video->meter))
+        CHECK(video_meter_start(&video->meter) == Device_Ok);
+    if (video_preview_is_enabled(&video->preview))
+        CHECK(video_preview_start(&video->preview) == Device_Ok);
+    if (video_demosaic_is_enabled(&video->demosaic))
+        CHECK(video_demosaic_start(&video->demosaic) == Device_Ok);
+    if (video_orient_is_enabled(&video->orient))
+        CHECK(video_orient_start(&video->orient) == Device_Ok);
+    CHECK(video_filter_start(&video->filter) == Device_Ok);
+    CHECK(video_source_start(&video->source) == Device_Ok);
+
+    TRACE("START[%2d] sink:%d processing:%d camera:%d",
+          i,
+          video->sink.is_running,
+          video->filter.is_running,
+          video->source.is_running);
+    video->state = DeviceState_Running;
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
+/// Waits for the threads of one stream to finish, and flushes what the
+/// client hasn't read.
+static void
+stop_video_stream(struct video_s* video)
+{
+    ECHO(parked_thread_join(&video->source.thread));
+    ECHO(parked_thread_join(&video->filter.thread));
+    ECHO(parked_thread_join(&video->orient.thread));
+    ECHO(parked_thread_join(&video->roi.thread));
+    ECHO(parked_thread_join(&video->lut.thread));
+    ECHO(parked_thread_join(&video->gate.thread));
+    ECHO(parked_thread_join(&video->tiler.thread));
+    ECHO(parked_thread_join(&video->encoder.thread));
+    ECHO(parked_thread_join(&video->detector.thread));
+    ECHO(parked_thread_join(&video->traces.thread));
+    ECHO(parked_thread_join(&video->meter.thread));
+    ECHO(parked_thread_join(&video->demosaic.thread));
+    ECHO(parked_thread_join(&video->preview.thread));
+    ECHO(parked_thread_join(&video->sink.thread));
+    ECHO(parked_thread_join(&video->filtered_sink.thread));
+    channel_accept_writes(&video->sink.in, 1);
+    if (video->filtered_sink.in.data)
+        channel_accept_writes(&video->filtered_sink.in, 1);
+    if (video->orient.in.data)
+        channel_accept_writes(&video->orient.in, 1);
+    if (video->roi.out.data)
+        channel_accept_writes(&video->roi.out, 1);
+    if (video->lut.out.data)
+        channel_accept_writes(&video->lut.out, 1);
+    if (video->gate.out.data) {
+        channel_accept_writes(&video->gate.out, 1);
+        // The log is left for the client to finish reading.
+        channel_accept_writes(&video->gate.log, 1);
+    }
+    if (video->tiler.out.data)
+        channel_accept_writes(&video->tiler.out, 1);
+    if (video->encoder.out.data)
+        channel_accept_writes(&video->encoder.out, 1);
+    if (video->detector.out.data) {
+        channel_accept_writes(&video->detector.out, 1);
+        discard_unread(&video->detector.out, &video->monitor.spots_reader);
+    }
+    if (video->traces.out.data) {
+        // The traces are left for the client to finish reading.
+        channel_accept_writes(&video->traces.out, 1);
+    }
+    if (video->meter.out.data) {
+        // The statistics are left for the client to finish reading.
+        channel_accept_writes(&video->meter.out, 1);
+    }
+    if (video->demosaic.out.data)
+        channel_accept_writes(&video->demosaic.out, 1);
+    if (video->preview.out.data) {
+        channel_accept_writes(&video->preview.out, 1);
+        discard_unread(&video->preview.out, &video->monitor.preview_reader);
+    }
+
+    // Flush the monitor's read region if it hasn't already been released.
+    // This takes at most 2 iterations.
+    {
+        size_t nbytes;
+        do {
+            struct slice slice =
+              channel_read_map(video->monitor.from, &video->monitor.reader);
+            nbytes = slice_size_bytes(&slice);
+            channel_read_unmap(
+              video->monitor.from, &video->monitor.reader, nbytes);
+            TRACE("[stream: %d] Monitor flushed %llu bytes",
+                  video->stream_id,
+                  nbytes);
+        } while (nbytes);
+    }
+    video->state = DeviceState_Armed;
+}
+
+/// Signals the threads of one stream to stop without waiting for the frame
+/// count, and closes its channels to writes. Follow with
+/// `stop_video_stream()`.
+static void
+abort_video_stream(struct video_s* video)
+{
+    video->source.is_stopping = 1;
+    channel_accept_writes(&video->sink.in, 0);
+    if (video->filtered_sink.in.data)
+        channel_accept_writes(&video->filtered_sink.in, 0);
+    if (video->orient.in.data)
+        channel_accept_writes(&video->orient.in, 0);
+    if (video->roi.out.data)
+        channel_accept_writes(&video->roi.out, 0);
+    if (video->lut.out.data)
+        channel_accept_writes(&video->lut.out, 0);
+    if (video->gate.out.data) {
+        channel_accept_writes(&video->gate.out, 0);
+        channel_accept_writes(&video->gate.log, 0);
+    }
+    if (video->tiler.out.data)
+        channel_accept_writes(&video->tiler.out, 0);
+    if (video->encoder.out.data)
+        channel_accept_writes(&video->encoder.out, 0);
+    if (video->detector.out.data)
+        channel_accept_writes(&video->detector.out, 0);
+    if (video->traces.out.data)
+        channel_accept_writes(&video->traces.out, 0);
+    if (video->meter.out.data)
+        channel_accept_writes(&video->meter.out, 0);
+    if (video->demosaic.out.data)
+        channel_accept_writes(&video->demosaic.out, 0);
+    if (video->preview.out.data)
+        channel_accept_writes(&video->preview.out, 0);
+    camera_stop(video->source.camera);
+}
+
+/// @returns The `istream`'th stream if it can be started and stopped on its
+///          own, otherwise 0.
+static struct video_s*
+get_independent_stream(struct AcquireRuntime* self_, uint32_t istream)
+{
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    self = containerof(self_, struct runtime, handle);
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    EXPECT((self->valid_video_streams >> istream) & 1,
+           "[stream %d] Video stream is not configured.",
+           istream);
+    EXPECT(!video_fusion_is_enabled(&self->fusion),
+           "[stream %d] Fused streams start and stop together. Use "
+           "acquire_start() and acquire_stop() instead.",
+           istream);
+    return self->video + istream;
+Error:
+    return 0;
+}
+
+enum AcquireStatusCode
+acquire_configure(struct AcquireRuntime* self_,
+                  struct AcquireProperties* settings)
+{
+    struct runtime* self = 0;
+    // Running streams are left as they are and stay valid. The others are
+    // configured anew, and are tracked so a failure only undoes them.
+    uint8_t running = 0, configured = 0;
+    EXPECT(self_, "Invalid parameter. Expected AcquireRuntime* got NULL.");
+    EXPECT(settings,
+           "Invalid parameter. Expected AcquireProperties* but got NULL.");
+    self = containerof(self_, struct runtime, handle);
+    EXPECT(self->state != DeviceState_Closed, "Device state is Closed.");
+    for (uint32_t istream = 0; istream < countof(self->video); ++istream)
+        if (poll_stream_state(self->video + istream) == DeviceState_Running)
+            running |= (uint8_t)(1 << istream);
+    self->valid_video_streams &= running;
+    if (running) {
+        EXPECT((enum fusion_mode)settings->fusion.mode == self->fusion.mode,
+               "Fusion can't be changed while a video stream is running.");
+        for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
+            if (((running >> istream) & 1) == 0)
+                continue;
+            struct aq_properties_video_s requested;
+            comparable_settings(&requested, settings->video + istream);
+            EXPECT(!memcmp(&requested,
+                           self->configured_as + istream,
+                           sizeof(requested)),
+                   "[stream %d] Settings can't be changed while the stream "
+                   "is running.",
+                   istream);
+        }
+    } else {
+        EXPECT(video_fusion_configure(
+                 &self->fusion,
+                 (enum fusion_mode)settings->fusion.mode,
+                 (enum fusion_pairing)settings->fusion.pairing,
+                 settings->fusion.max_timestamp_delta,
+                 settings->fusion.store) == Device_Ok,
+               "Failed to configure fusion.");
+    }
+    for (uint32_t istream = 0; istream < countof(self->video); ++istream) {
+        if ((running >> istream) & 1)
+            continue;
+        if (video_stream_requirements_check(settings->video + istream)) {
+            struct video_s* const video = self->video + istream;
+            struct channel* const to_storage =
+              (self->fusion.is_stored && istream == 0) ? &self->fusion.out
+                                                      : &video->sink.in;
+            if (AcquireStatus_Ok ==
+                configure_video_stream(video,
+                                       &self->device_manager,
+                                       settings->video + istream,
+                                       to_storage)) {
+                self->valid_video_streams |= (1 << istream);
+                configured |= (uint8_t)(1 << istream);
+                comparable_settings(self->configured_as + istream,
+                                    settings->video + istream);
+                TRACE("Configured video stream %d.", istream);
+            } else {
+                TRACE("Failed to configure video stream %d.", istream);
+            }
+        }
+    }
+    TRACE("Valid video streams: code %#04x", self->valid_video_streams);
+    EXPECT(!video_fusion_is_enabled(&self->fusion) ||
+             self->valid_video_streams == 3,
+           "Fusion requires both video streams to be configured.");
+    update_state(self);
     return AcquireStatus_Ok;
 Error:
+    if (self) {
+        for (int i = 0; i < countof(self->video); ++i) {
+            if ((configured >> i) & 1) {
+                abort_video_stream(self->video + i);
+                stop_video_stream(self->video + i);
+            }
+        }
+        self->valid_video_streams &= running;
+        update_state(self);
+    }
     return AcquireStatus_Error;
 }
 
@@ -482,47 +2255,62 @@ enum AcquireStatusCode
 acquire_start(struct AcquireRuntime* self_)
 {
     struct runtime* self = containerof(self_, struct runtime, handle);
+    // The streams this call started. Only these are taken down on failure.
+    uint8_t started = 0;
 
     EXPECT(self->valid_video_streams > 0,
            "At least one video stream must be marked valid");
 
+    // Fusion starts first so it sees the first frame of each stream.
+    if (video_fusion_is_enabled(&self->fusion))
+        CHECK(video_fusion_start(&self->fusion) == Device_Ok);
+
     for (int i = 0; i < countof(self->video); ++i) {
-        struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
             TRACE("Skipping unconfirmed video stream %d", i);
             continue;
         }
-
-        CHECK(video_sink_start(&video->sink) == Device_Ok);
-        CHECK(reserve_image_shape(video));
-        CHECK(video_filter_start(&video->filter) == Device_Ok);
-        CHECK(video_source_start(&video->source) == Device_Ok);
-
-        TRACE("START[%2d] sink:%d processing:%d camera:%d",
-              i,
-              video->sink.is_running,
-              video->filter.is_running,
-              video->source.is_running);
+        struct video_s* const video = self->video + i;
+        if (poll_stream_state(video) == DeviceState_Running) {
+            TRACE("Skipping running video stream %d", i);
+            continue;
+        }
+        started |= (uint8_t)(1 << i);
+        CHECK(start_video_stream(self, video) == AcquireStatus_Ok);
     }
-    self->state = DeviceState_Running;
+    update_state(self);
     return AcquireStatus_Ok;
 Error:
     for (int i = 0; i < countof(self->video); ++i) {
-        if (((self->valid_video_streams >> i) & 1) == 0) {
-            TRACE("(Abort) Skipping disabled video stream %d", i);
-            continue;
+        if ((started >> i) & 1) {
+            abort_video_stream(self->video + i);
+            stop_video_stream(self->video + i);
         }
-        struct video_s* video = self->video + i;
-        camera_stop(video->source.camera);
     }
-    self->state = DeviceState_AwaitingConfiguration;
+    self->fusion.is_stopping = 1;
+    update_state(self);
     return AcquireStatus_Error;
 }
 
-static size_t
-slice_size_bytes(const struct slice* slice)
+enum AcquireStatusCode
+acquire_start_stream(struct AcquireRuntime* self_, uint32_t istream)
 {
-    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+    struct video_s* video = 0;
+    CHECK(video = get_independent_stream(self_, istream));
+    EXPECT(poll_stream_state(video) != DeviceState_Running,
+           "[stream %d] Video stream is already running.",
+           istream);
+    struct runtime* self = containerof(self_, struct runtime, handle);
+    if (AcquireStatus_Ok != start_video_stream(self, video)) {
+        // Only this stream is taken down. The others keep running.
+        abort_video_stream(video);
+        stop_video_stream(video);
+        goto Error;
+    }
+    update_state(self);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
 }
 
 enum AcquireStatusCode
@@ -531,56 +2319,65 @@ acquire_stop(struct AcquireRuntime* self_)
     struct runtime* self = containerof(self_, struct runtime, handle);
 
     for (size_t i = 0; i < countof(self->video); ++i) {
-        struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
             TRACE("Skipping disabled video stream %d", i);
             continue;
         }
+        stop_video_stream(self->video + i);
+    }
 
-        ECHO(thread_join(&video->source.thread));
-        ECHO(thread_join(&video->filter.thread));
-        ECHO(thread_join(&video->sink.thread));
-        channel_accept_writes(&video->sink.in, 1);
-
-        // Flush the monitor's read region if it hasn't already been released.
-        // This takes at most 2 iterations.
-        {
-            size_t nbytes;
-            do {
-                struct slice slice =
-                  channel_read_map(&video->sink.in, &video->monitor.reader);
-                nbytes = slice_size_bytes(&slice);
-                channel_read_unmap(
-                  &video->sink.in, &video->monitor.reader, nbytes);
-                TRACE("[stream: %d] Monitor flushed %llu bytes", i, nbytes);
-            } while (nbytes);
-        }
+    ECHO(parked_thread_join(&self->fusion.thread));
+    if (self->fusion.out.data) {
+        channel_accept_writes(&self->fusion.out, 1);
+        discard_unread(&self->fusion.out, &self->fusion_monitor);
     }
     self->state = DeviceState_Armed;
 
     return AcquireStatus_Ok;
 }
 
+enum AcquireStatusCode
+acquire_stop_stream(struct AcquireRuntime* self_, uint32_t istream)
+{
+    struct video_s* video = 0;
+    CHECK(video = get_independent_stream(self_, istream));
+    stop_video_stream(video);
+    update_state(containerof(self_, struct runtime, handle));
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 enum AcquireStatusCode
 acquire_abort(struct AcquireRuntime* self_)
 {
     struct runtime* self = containerof(self_, struct runtime, handle);
 
     for (size_t i = 0; i < countof(self->video); ++i) {
-        struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
             TRACE("Skipping disabled video stream %d", i);
             continue;
         }
-
-        video->source.is_stopping = 1;
-        channel_accept_writes(&video->sink.in, 0);
-        camera_stop(video->source.camera);
+        abort_video_stream(self->video + i);
     }
+    self->fusion.is_stopping = 1;
+    if (self->fusion.out.data)
+        channel_accept_writes(&self->fusion.out, 0);
 
     return acquire_stop(self_);
 }
 
+enum AcquireStatusCode
+acquire_abort_stream(struct AcquireRuntime* self_, uint32_t istream)
+{
+    struct video_s* video = 0;
+    CHECK(video = get_independent_stream(self_, istream));
+    abort_video_stream(video);
+    return acquire_stop_stream(self_, istream);
+Error:
+    return AcquireStatus_Error;
+}
+
 enum AcquireStatusCode
 acquire_execute_trigger(struct AcquireRuntime* self_, uint32_t istream)
 {
@@ -596,6 +2393,73 @@ Error:
     return AcquireStatus_Error;
 }
 
+enum AcquireStatusCode
+acquire_update_live(struct AcquireRuntime* self_,
+                    uint32_t istream,
+                    const struct AcquireProperties* settings,
+                    uint32_t mask)
+{
+    const uint32_t known =
+      AcquireLiveUpdate_Exposure | AcquireLiveUpdate_ExternalMetadata |
+      AcquireLiveUpdate_FrameAverageCount | AcquireLiveUpdate_Filename;
+    struct runtime* self = 0;
+    EXPECT(self_, "Invalid parameter: `self` was NULL.");
+    EXPECT(settings, "Invalid parameter: `settings` was NULL.");
+    EXPECT(istream < countof(self->video),
+           "Invalid parameter: `istream` was out-of-bounds (%d).",
+           countof(self->video));
+    EXPECT((mask & ~known) == 0, "Unknown live update flags %#x.", mask);
+    self = containerof(self_, struct runtime, handle);
+    EXPECT((self->valid_video_streams >> istream) & 1,
+           "[stream %d] Video stream is not configured.",
+           istream);
+    struct video_s* const video = self->video + istream;
+    EXPECT(video->state == DeviceState_Running,
+           "[stream %d] Live updates require a running acquisition. Use "
+           "acquire_configure() instead.",
+           istream);
+    const struct aq_properties_video_s* const pvideo =
+      settings->video + istream;
+    const struct String* const filename = &pvideo->storage.settings.filename;
+    const struct String* const metadata =
+      &pvideo->storage.settings.external_metadata_json;
+
+    // Everything that can be refused is checked before anything is posted.
+    if (mask & AcquireLiveUpdate_FrameAverageCount)
+        EXPECT(video->filter.filter_window_frames > 1,
+               "[stream %d] Frame averaging can only be changed while "
+               "running when it's on.",
+               istream);
+    if (mask & AcquireLiveUpdate_Filename)
+        EXPECT(filename->str && filename->nbytes > 1,
+               "[stream %d] Expected a file name.",
+               istream);
+
+    if (mask & AcquireLiveUpdate_FrameAverageCount)
+        CHECK(video_filter_update_live(&video->filter,
+                                       pvideo->frame_average_count) ==
+              Device_Ok);
+    if (mask &
+        (AcquireLiveUpdate_Filename | AcquireLiveUpdate_ExternalMetadata)) {
+        const int has_metadata =
+          (mask & AcquireLiveUpdate_ExternalMetadata) && metadata->str;
+        CHECK(video_sink_update_live(
+                &video->sink,
+                (mask & AcquireLiveUpdate_Filename) ? filename->str : 0,
+                filename->nbytes,
+                (mask & AcquireLiveUpdate_ExternalMetadata)
+                  ? (has_metadata ? metadata->str : "")
+                  : 0,
+                has_metadata ? metadata->nbytes : 1) == Device_Ok);
+    }
+    if (mask & AcquireLiveUpdate_Exposure)
+        video_source_update_live(&video->source,
+                                 pvideo->camera.settings.exposure_time_us);
+    return AcquireStatus_Ok;
+Error:
+    return AcquireStatus_Error;
+}
+
 enum DeviceState
 acquire_get_state(struct AcquireRuntime* self_)
 {
@@ -609,33 +2473,29 @@ acquire_get_state(struct AcquireRuntime* self_)
     // check that at least one pipeline has active threads
     uint8_t is_running = 0;
     for (int i = 0; i < countof(self->video); ++i) {
-        struct video_s* video = self->video + i;
         if (((self->valid_video_streams >> i) & 1) == 0) {
             TRACE("Skipping video stream %d", i);
             continue;
         }
-
-        TRACE("source %s running, %s stopping\n"
-              "filter %s running, %s stopping\n"
-              "  sink %s running, %s stopping",
-              video->source.is_running ? "" : "not",
-              video->source.is_stopping ? "" : "not",
-              video->filter.is_running ? "" : "not",
-              video->filter.is_stopping ? "" : "not",
-              video->sink.is_running ? "" : "not",
-              video->sink.is_stopping ? "" : "not");
-
-        is_running |= video->source.is_running;
-        is_running |= video->filter.is_running;
-        is_running |= video->sink.is_running;
-
-        if (is_running)
-            break;
+        is_running |=
+          poll_stream_state(self->video + i) == DeviceState_Running;
     }
+    is_running |= self->fusion.is_running;
 
     return self->state = is_running ? DeviceState_Running : DeviceState_Armed;
 }
 
+enum DeviceState
+acquire_get_stream_state(struct AcquireRuntime* self_, uint32_t istream)
+{
+    if (!self_)
+        return DeviceState_Closed;
+    struct runtime* self = containerof(self_, struct runtime, handle);
+    if (istream >= countof(self->video))
+        return DeviceState_Closed;
+    return poll_stream_state(self->video + istream);
+}
+
 const struct DeviceManager*
 acquire_device_manager(const struct AcquireRuntime* self_)
 {
@@ -21,6 +21,178 @@ extern "C"
         void* impl;
     };
 
+    enum AcquireCodec
+    {
+        AcquireCodec_None = 0,
+        AcquireCodec_Lz,
+        AcquireCodec_Sparse,
+    };
+
+    enum AcquireShuffle
+    {
+        AcquireShuffle_None = 0,
+        AcquireShuffle_Byte,
+        AcquireShuffle_Bit,
+    };
+
+    enum AcquireDefectFill
+    {
+        AcquireDefectFill_None = 0,
+        AcquireDefectFill_Mean,
+        AcquireDefectFill_Median,
+    };
+
+    enum AcquireFrameReduction
+    {
+        AcquireFrameReduction_Mean = 0,
+        AcquireFrameReduction_Median,
+        AcquireFrameReduction_MeanVariance,
+    };
+
+    enum AcquireFusion
+    {
+        AcquireFusion_None = 0,
+        AcquireFusion_Ratio,      //< `video[0]/video[1]` as f32
+        AcquireFusion_Difference, //< `video[0]-video[1]` as f32
+        AcquireFusion_SideBySide, //< `video[0]` left of `video[1]`
+    };
+
+    enum AcquireFusionPairing
+    {
+        AcquireFusionPairing_FrameId = 0,
+        AcquireFusionPairing_HardwareTimestamp,
+    };
+
+    enum AcquireLutCurve
+    {
+        AcquireLutCurve_None = 0,
+        AcquireLutCurve_Linear,
+        AcquireLutCurve_Gamma,
+        /// Anscombe transform. Makes shot noise roughly uniform.
+        AcquireLutCurve_Sqrt,
+        /// See `acquire_set_bit_depth_table()`.
+        AcquireLutCurve_Custom,
+    };
+
+    enum AcquireTraceStatistic
+    {
+        AcquireTraceStatistic_Mean = 0,
+        AcquireTraceStatistic_Sum,
+    };
+
+    enum AcquireDecimation
+    {
+        AcquireDecimation_None = 0,
+        /// Keeps every `every`'th frame.
+        AcquireDecimation_EveryN,
+        /// Keeps a frame when at least `1/max_rate_hz` seconds have passed
+        /// since the last kept frame.
+        AcquireDecimation_MaxRate,
+        /// Keeps only the newest frame available when frames are read.
+        AcquireDecimation_LatestOnly,
+    };
+
+    enum AcquireFilterRouting
+    {
+        /// Filtered frames replace the raw frames everywhere.
+        AcquireFilterRouting_Inline = 0,
+        /// Raw frames go to storage. Filtered frames go to the monitor.
+        AcquireFilterRouting_Monitor,
+        /// Raw frames go to storage. Filtered frames go to the monitor and
+        /// to `filtered_storage`.
+        AcquireFilterRouting_Split,
+    };
+
+    enum AcquireDemosaic
+    {
+        AcquireDemosaic_None = 0,
+        /// Averages the nearest samples of each missing color.
+        AcquireDemosaic_Bilinear,
+        /// Interpolates along edges rather than across them.
+        AcquireDemosaic_EdgeAware,
+    };
+
+    /// The colors of the top left 2x2 block of the mosaic, in raster order.
+    enum AcquireBayerPattern
+    {
+        AcquireBayerPattern_RGGB = 0,
+        AcquireBayerPattern_BGGR,
+        AcquireBayerPattern_GRBG,
+        AcquireBayerPattern_GBRG,
+    };
+
+    enum AcquireColorLayout
+    {
+        /// Red, green and blue samples alternate within each row.
+        AcquireColorLayout_Interleaved = 0,
+        /// A plane of red, then green, then blue.
+        AcquireColorLayout_Planar,
+    };
+
+    enum AcquireOrientation
+    {
+        AcquireOrientation_None = 0,
+        /// Mirrors left and right.
+        AcquireOrientation_FlipX,
+        /// Mirrors top and bottom.
+        AcquireOrientation_FlipY,
+        /// Rotates clockwise by a quarter turn.
+        AcquireOrientation_Rotate90,
+        AcquireOrientation_Rotate180,
+        /// Rotates counterclockwise by a quarter turn.
+        AcquireOrientation_Rotate270,
+        /// Swaps rows and columns.
+        AcquireOrientation_Transpose,
+    };
+
+    /// Why a stream's acquisition ended. See
+    /// `AcquireStreamStatistics::acquisition`.
+    enum AcquireStopReason
+    {
+        /// Still running, or never started.
+        AcquireStopReason_None = 0,
+        /// `acquire_stop()` or `acquire_abort()`, or storage stopped.
+        AcquireStopReason_Requested,
+        /// The camera failed.
+        AcquireStopReason_Error,
+        AcquireStopReason_FrameCount,
+        AcquireStopReason_Duration,
+        AcquireStopReason_Bytes,
+        AcquireStopReason_HardwareFrameId,
+        AcquireStopReason_HardwareTimestamp,
+        /// Every burst of `AcquireProperties::video[i].sequence` is done.
+        AcquireStopReason_BurstCount,
+    };
+
+    /// What `acquire_update_live()` changes. Combine as flags.
+    enum AcquireLiveUpdate
+    {
+        /// `camera.settings.exposure_time_us`
+        AcquireLiveUpdate_Exposure = 1,
+        /// `storage.settings.external_metadata_json`
+        AcquireLiveUpdate_ExternalMetadata = 2,
+        /// `frame_average_count`
+        AcquireLiveUpdate_FrameAverageCount = 4,
+        /// `storage.settings.filename`
+        AcquireLiveUpdate_Filename = 8,
+    };
+
+    /// See `AcquireProperties::video[i].monitor_decimation`.
+    struct AcquireDecimationPolicy
+    {
+        enum AcquireDecimation policy;
+        uint32_t every;
+        float max_rate_hz;
+    };
+
+#define ACQUIRE_MAX_ROI_COUNT (8)
+
+    /// A rectangle of pixels. See `AcquireProperties::video[i].roi`.
+    struct AcquireRoi
+    {
+        uint32_t x, y, width, height;
+    };
+
     struct AcquireProperties
     {
         struct aq_properties_video_s
@@ -38,7 +210,239 @@ extern "C"
             } storage;
             uint64_t max_frame_count;
             uint32_t frame_average_count;
+
+            /// Compression of the frames sent to storage. Frames are
+            /// compressed in parallel and passed to storage in order. Frames
+            /// read with `acquire_map_read()` are not compressed.
+            ///
+            /// Requires storage that writes frames as they are, like raw
+            /// storage. Decode what's read back with `acquire_decode_frame()`.
+            ///
+            /// `AcquireCodec_Sparse` keeps only the samples above
+            /// `sparse_threshold`; the rest are stored as 0. Blocks where
+            /// more than `sparse_max_density` of the samples are kept are
+            /// stored as they are. It applies to unsigned sample types.
+            struct aq_properties_compression_s
+            {
+                enum AcquireCodec codec;
+                enum AcquireShuffle shuffle;
+                uint32_t bytes_per_block; //< 0 selects a default.
+                uint32_t sparse_threshold;
+                float sparse_max_density; //< 0 selects a default.
+            } compression;
+
+            /// Publish per-frame pixel statistics of the frames on their way
+            /// to storage, alongside the other readers of the stream. Read
+            /// them with `acquire_read_frame_statistics()`.
+            uint8_t enable_frame_statistics;
+
+            /// How to replace defective pixels. The defects are set with
+            /// `acquire_set_defect_pixels()` or `acquire_set_defect_mask()`.
+            /// Frames are corrected in place as they're acquired, before
+            /// anything reads them.
+            enum AcquireDefectFill defect_correction;
+
+            /// How each window of `frame_average_count` frames is combined.
+            /// The median keeps the sample type of the input and requires a
+            /// window of 3 to 9 frames. `MeanVariance` emits f32 frames twice
+            /// the height of the input: the per-pixel mean on top of the
+            /// per-pixel sample variance.
+            enum AcquireFrameReduction frame_reduction;
+
+            /// Finds bright spots in each frame and reports their centroids.
+            /// Read them with `acquire_map_read_spots()`.
+            struct aq_properties_detection_s
+            {
+                uint8_t enable;
+                /// Spots must be more than this far above the background,
+                /// which is estimated per 64x64 tile.
+                float threshold;
+                /// While detecting, only every `store_every`'th frame goes
+                /// to storage. 0 and 1 store every frame.
+                uint32_t store_every;
+            } detection;
+
+            /// Reorders the frames sent to storage into chunks of
+            /// `tile_x` by `tile_y` pixels by `tile_t` frames, each stored
+            /// contiguously. Set `tile_x` or `tile_y` to 0 to disable it.
+            /// Can't be combined with `compression`. Requires storage that
+            /// writes frames as they are, like raw storage. Read frames
+            /// back with `acquire_untile_frame()`.
+            struct aq_properties_tiling_s
+            {
+                uint32_t tile_x, tile_y;
+                uint32_t tile_t; //< 0 is treated as 1.
+            } tiling;
+
+            /// Publishes small 8-bit frames for display. Read them with
+            /// `acquire_map_read_preview()`.
+            struct aq_properties_preview_s
+            {
+                /// Each `downscale` by `downscale` block of pixels is
+                /// averaged into one. One of 1, 2, 4 or 8. 0 disables
+                /// previews.
+                uint8_t downscale;
+                /// The most previews per second. 0 doesn't limit the rate.
+                float max_rate_hz;
+                /// Sample values shown as black and white. When
+                /// `display_max` is not more than `display_min`, the range of
+                /// the sample type is used. Floating point samples are
+                /// expected in [0,1].
+                float display_min, display_max;
+            } preview;
+
+            /// Keeps frames that barely differ from the last stored frame
+            /// out of storage. Every frame is logged, stored or not. Read
+            /// the log with `acquire_map_read_gating()`.
+            struct aq_properties_gating_s
+            {
+                uint8_t enable;
+                /// Frames are stored when the mean absolute difference from
+                /// the last stored frame, sampled on a grid of every 4th
+                /// pixel, is at least this.
+                float threshold;
+                /// A keyframe is stored after this many frames in a row
+                /// were skipped. 0 for no limit.
+                uint32_t keyframe_interval;
+            } gating;
+
+            /// Reduces unsigned 16, 14, 12 and 10-bit frames to 8 bits
+            /// through a lookup table.
+            struct aq_properties_bit_depth_s
+            {
+                /// `AcquireLutCurve_None` disables reduction.
+                enum AcquireLutCurve curve;
+                /// Input values mapped to 0 and 255. When `window_max` is not
+                /// more than `window_min`, the range of the sample type is
+                /// used.
+                float window_min, window_max;
+                /// Exponent for `AcquireLutCurve_Gamma`.
+                float gamma;
+                /// When set, only the frames sent to storage are reduced.
+                /// Otherwise `acquire_map_read()` returns the reduced frames
+                /// sent to storage as well.
+                uint8_t storage_only;
+            } bit_depth;
+
+            /// Regions copied out of each frame sent to storage. Each frame
+            /// is replaced by one compact frame per region, written in the
+            /// order of `rects` and sharing the frame's `frame_id`. Frames
+            /// that don't contain every region are skipped.
+            struct aq_properties_roi_s
+            {
+                struct AcquireRoi rects[ACQUIRE_MAX_ROI_COUNT];
+                /// 0 disables extraction.
+                uint32_t count;
+            } roi;
+
+            /// Publishes the sum or mean of each labeled region of every
+            /// frame. Set the regions with `acquire_set_trace_labels()` and
+            /// read the traces with `acquire_map_read_traces()`.
+            struct aq_properties_traces_s
+            {
+                uint8_t enable;
+                enum AcquireTraceStatistic statistic;
+            } traces;
+
+            /// Skips frames before `acquire_map_read()` maps them. Skipped
+            /// frames are released right away, so a decimated reader never
+            /// holds back the other readers.
+            struct AcquireDecimationPolicy monitor_decimation;
+
+            /// Skips frames on their way to storage. Applied after
+            /// `detection.store_every`.
+            struct AcquireDecimationPolicy storage_decimation;
+
+            /// Where the output of `frame_average_count` and
+            /// `frame_reduction` goes. When not inline, the filter reads the
+            /// raw frames in place, next to storage, and `acquire_map_read()`
+            /// returns the filtered frames. The spot detector, previews,
+            /// traces and frame statistics see the raw frames.
+            /// Can't be changed while running.
+            enum AcquireFilterRouting filter_routing;
+
+            /// Stores the filtered frames for `AcquireFilterRouting_Split`.
+            struct aq_properties_filtered_storage_s
+            {
+                struct DeviceIdentifier identifier;
+                struct StorageProperties settings;
+            } filtered_storage;
+
+            /// Reconstructs color from the Bayer mosaic of a color camera
+            /// for `acquire_map_read()`. Frames have 3 channels laid out as
+            /// `layout` says. Storage, the spot detector, previews and
+            /// traces see the raw mosaic.
+            struct aq_properties_demosaic_s
+            {
+                enum AcquireDemosaic method;
+                enum AcquireBayerPattern pattern;
+                enum AcquireColorLayout layout;
+            } demosaic;
+
+            /// Reorients frames for cameras mounted rotated or mirrored.
+            /// Applied after the filter, when it's inline, and before
+            /// anything reads the frames, so storage and every reader see the
+            /// same orientation. Defective pixels are still given in camera
+            /// coordinates. Can't be changed while running.
+            enum AcquireOrientation orientation;
+
+            /// Ends the acquisition, besides `max_frame_count`. Limits are
+            /// checked for every frame as it's acquired. A frame past a
+            /// limit is dropped before storage or any reader sees it, so
+            /// storage ends exactly on the last frame within every limit.
+            struct aq_properties_limits_s
+            {
+                /// Seconds since `acquire_start()`. 0 for no limit.
+                double max_duration_s;
+                /// Bytes of pixel data. 0 for no limit.
+                uint64_t max_bytes;
+                /// When set, the frame with `last_hardware_frame_id` is the
+                /// last one acquired.
+                uint8_t has_last_hardware_frame_id;
+                uint64_t last_hardware_frame_id;
+                /// When set, the last frame acquired is the last one stamped
+                /// at or before `last_hardware_timestamp`.
+                uint8_t has_last_hardware_timestamp;
+                uint64_t last_hardware_timestamp;
+            } limits;
+
+            /// Splits the acquisition into bursts of `frames_per_burst`
+            /// frames without stopping it. Threads, the camera and storage
+            /// keep running between bursts, so a triggered camera only waits
+            /// for its next trigger. Configure the camera's trigger so each
+            /// trigger yields a burst.
+            ///
+            /// Each burst starts with a marker in the stream. See
+            /// `acquire_is_burst_marker()`. Frames are never averaged, tiled
+            /// or gated across bursts.
+            ///
+            /// Acquisition stops after `burst_count` bursts, unless it's 0.
+            /// With `split_storage`, each burst after the first is stored to
+            /// a new output, named after the configured file name with
+            /// `_<burst>` before the extension. Can't be changed while
+            /// running.
+            struct aq_properties_sequence_s
+            {
+                uint64_t frames_per_burst;
+                uint64_t burst_count;
+                uint8_t split_storage;
+            } sequence;
         } video[2];
+
+        /// Combines pairs of frames from `video[0]` and `video[1]`. Read the
+        /// fused frames with `acquire_map_read_fused()`. Requires both
+        /// streams to be configured.
+        struct aq_properties_fusion_s
+        {
+            enum AcquireFusion mode;
+            enum AcquireFusionPairing pairing;
+            /// When pairing by hardware timestamp, the largest difference
+            /// between the timestamps of paired frames.
+            uint64_t max_timestamp_delta;
+            /// Send the fused frames to `video[0]`'s storage instead of its
+            /// own frames.
+            uint8_t store;
+        } fusion;
     };
 
     struct AcquirePropertyMetadata
@@ -50,7 +454,277 @@ extern "C"
             //  description
             struct Property max_frame_count;
             struct Property frame_average_count;
+            struct aq_metadata_compression_s
+            {
+                struct Property codec;
+                struct Property shuffle;
+                struct Property bytes_per_block;
+                struct Property sparse_threshold;
+                struct Property sparse_max_density;
+            } compression;
+            struct Property enable_frame_statistics;
+            struct Property defect_correction;
+            struct Property frame_reduction;
+            struct aq_metadata_detection_s
+            {
+                struct Property enable;
+                struct Property threshold;
+                struct Property store_every;
+            } detection;
+            struct aq_metadata_tiling_s
+            {
+                struct Property tile_x;
+                struct Property tile_y;
+                struct Property tile_t;
+            } tiling;
+            struct aq_metadata_preview_s
+            {
+                struct Property downscale;
+                struct Property max_rate_hz;
+                struct Property display_min;
+                struct Property display_max;
+            } preview;
+            struct aq_metadata_gating_s
+            {
+                struct Property enable;
+                struct Property threshold;
+                struct Property keyframe_interval;
+            } gating;
+            struct aq_metadata_bit_depth_s
+            {
+                struct Property curve;
+                struct Property window_min;
+                struct Property window_max;
+                struct Property gamma;
+                struct Property storage_only;
+            } bit_depth;
+            struct aq_metadata_roi_s
+            {
+                struct Property count;
+            } roi;
+            struct aq_metadata_traces_s
+            {
+                struct Property enable;
+                struct Property statistic;
+            } traces;
+            struct aq_metadata_decimation_s
+            {
+                struct Property policy;
+                struct Property every;
+                struct Property max_rate_hz;
+            } monitor_decimation, storage_decimation;
+            struct Property filter_routing;
+            struct StoragePropertyMetadata filtered_storage;
+            struct aq_metadata_demosaic_s
+            {
+                struct Property method;
+                struct Property pattern;
+                struct Property layout;
+            } demosaic;
+            struct Property orientation;
+            struct aq_metadata_limits_s
+            {
+                struct Property max_duration_s;
+                struct Property max_bytes;
+                struct Property has_last_hardware_frame_id;
+                struct Property last_hardware_frame_id;
+                struct Property has_last_hardware_timestamp;
+                struct Property last_hardware_timestamp;
+            } limits;
+            struct aq_metadata_sequence_s
+            {
+                struct Property frames_per_burst;
+                struct Property burst_count;
+                struct Property split_storage;
+            } sequence;
         } video[2];
+        struct aq_metadata_fusion_s
+        {
+            struct Property mode;
+            struct Property pairing;
+            struct Property max_timestamp_delta;
+            struct Property store;
+        } fusion;
+    };
+
+    struct AcquireStreamStatistics
+    {
+        struct aq_statistics_compression_s
+        {
+            uint64_t frame_count;
+            uint64_t bytes_in;  //< uncompressed bytes
+            uint64_t bytes_out; //< compressed bytes, including headers
+            /// `bytes_in/bytes_out`. 0 when nothing has been compressed.
+            float ratio;
+            /// Uncompressed megabytes per second of time spent compressing.
+            float throughput_mb_per_s;
+        } compression;
+
+        /// Number of frame statistics records that were dropped because
+        /// they weren't read in time. See `acquire_read_frame_statistics()`.
+        uint64_t frame_statistics_dropped;
+
+        /// Number of frames from this stream that fusion dropped because no
+        /// frame from the other stream paired with them.
+        uint64_t fusion_unpaired;
+
+        struct aq_statistics_detection_s
+        {
+            uint64_t frame_count;
+            uint64_t spot_count;
+            /// Spots left out of their frame's list because their part of
+            /// the frame had too many.
+            uint64_t dropped_count;
+        } detection;
+
+        struct aq_statistics_preview_s
+        {
+            uint64_t frame_count;
+            /// Previews dropped because the unread ones filled the preview
+            /// queue.
+            uint64_t dropped_count;
+        } preview;
+
+        struct aq_statistics_gating_s
+        {
+            uint64_t frame_count;
+            uint64_t stored_count;
+            /// Stored frames that were forced by `keyframe_interval` or a
+            /// change of shape.
+            uint64_t keyframe_count;
+            /// Log records dropped because the unread ones filled the log.
+            uint64_t records_dropped;
+        } gating;
+
+        struct aq_statistics_roi_s
+        {
+            uint64_t frame_count;
+            /// Frames that didn't contain every region.
+            uint64_t skipped_count;
+        } roi;
+
+        struct aq_statistics_traces_s
+        {
+            uint64_t frame_count;
+            /// Frames whose shape didn't match the label mask.
+            uint64_t skipped_count;
+            /// Records dropped because the unread ones filled the queue.
+            uint64_t dropped_count;
+        } traces;
+
+        struct aq_statistics_demosaic_s
+        {
+            uint64_t frame_count;
+            /// Frames that weren't single channel mosaics of a supported
+            /// type.
+            uint64_t skipped_count;
+        } demosaic;
+
+        struct aq_statistics_orientation_s
+        {
+            uint64_t frame_count;
+            /// Frames passed on unchanged because their pixels weren't
+            /// packed.
+            uint64_t skipped_count;
+        } orientation;
+
+        /// Frames acquired from the camera, and why acquisition ended.
+        struct aq_statistics_acquisition_s
+        {
+            uint64_t frame_count;
+            /// Bytes of pixel data.
+            uint64_t bytes;
+            /// Bursts started. See `AcquireProperties::video[i].sequence`.
+            uint64_t burst_count;
+            enum AcquireStopReason stop_reason;
+        } acquisition;
+    };
+
+    /// Pixel statistics of one acquired frame.
+    struct AcquireFrameStatistics
+    {
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+
+        uint64_t pixel_count;
+        /// Pixels at the largest value the sample type can represent.
+        uint64_t saturated_count;
+        double min, max, mean;
+
+        /// `histogram[i]` counts pixels with values in
+        /// `[histogram_low + i * histogram_bin_width,
+        ///   histogram_low + (i + 1) * histogram_bin_width)`.
+        /// The bins cover the range of the sample type. Floating point
+        /// frames have no histogram (`histogram_bin_width` is 0).
+        double histogram_low;
+        double histogram_bin_width;
+        uint32_t histogram[256];
+    };
+
+    /// A spot found by detection.
+    struct AcquireSpot
+    {
+        /// Centroid in pixels. Pixel centers are at integer coordinates.
+        float x, y;
+        /// The brightest pixel, less the background.
+        float peak;
+        /// Background-subtracted intensity summed over a 5x5 window.
+        float sum;
+        float background;
+    };
+
+    /// The spots found in one frame. Records are contiguous, like frames:
+    /// the next record starts `bytes_of_record` bytes after this one.
+    struct AcquireSpotList
+    {
+        uint64_t bytes_of_record;
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        uint32_t spot_count;
+        /// Spots left out of `spots` because their part of the frame had too
+        /// many.
+        uint32_t dropped_count;
+        struct AcquireSpot spots[];
+    };
+
+    enum AcquireGatingFlags
+    {
+        AcquireGating_Stored = 1,
+        /// Stored because of `keyframe_interval` or a change of shape.
+        AcquireGating_Keyframe = 2,
+    };
+
+    /// What change gating did with one frame.
+    struct AcquireGatingRecord
+    {
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        /// Mean absolute difference from the last stored frame. Negative
+        /// when there was nothing to compare with.
+        float score;
+        uint32_t flags; //< `enum AcquireGatingFlags`
+    };
+
+    /// The traces of one frame. Records are contiguous, like frames: the
+    /// next record starts `bytes_of_record` bytes after this one.
+    struct AcquireTraceRecord
+    {
+        uint64_t bytes_of_record;
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        uint32_t label_count;
+        uint32_t statistic; //< `enum AcquireTraceStatistic`
+        /// `values[i]` is the statistic of label `i+1`. Labels without
+        /// pixels are 0.
+        float values[];
     };
 
     const char* acquire_api_version_string();
@@ -80,6 +754,11 @@ extern "C"
 
     enum AcquireStatusCode acquire_shutdown(struct AcquireRuntime* self);
 
+    /// Streams that are running keep their configuration, and the call fails
+    /// if `settings` would change it. Camera and storage settings aren't
+    /// checked. The fusion mode can't change while any stream is running. If
+    /// configuration fails, only the streams this call configured are
+    /// stopped.
     enum AcquireStatusCode acquire_configure(
       struct AcquireRuntime* self,
       struct AcquireProperties* settings);
@@ -99,21 +778,76 @@ extern "C"
     const struct DeviceManager* acquire_device_manager(
       const struct AcquireRuntime* self);
 
+    /// @brief The shape of the camera's frames, as reoriented by
+    /// `AcquireProperties::video[istream].orientation`.
     enum AcquireStatusCode acquire_get_shape(const struct AcquireRuntime* self,
                                              uint32_t istream,
                                              struct ImageShape* shape);
 
+    /// Starts every configured stream that isn't already running. If one
+    /// fails to start, the streams this call started are stopped. Streams
+    /// that were already running keep running.
     enum AcquireStatusCode acquire_start(struct AcquireRuntime* self);
 
     enum AcquireStatusCode acquire_stop(struct AcquireRuntime* self);
 
     enum AcquireStatusCode acquire_abort(struct AcquireRuntime* self);
 
+    /// @brief Starts the `istream`'th video stream on its own, while other
+    /// streams may already be running.
+    ///
+    /// The stream must be configured and not running. Streams that are
+    /// fused start and stop together, with `acquire_start()`. If the stream
+    /// fails to start, it's stopped, and other streams are left running.
+    enum AcquireStatusCode acquire_start_stream(struct AcquireRuntime* self,
+                                                uint32_t istream);
+
+    /// @brief Waits for the `istream`'th video stream to finish, like
+    /// `acquire_stop()`, without waiting on other streams.
+    enum AcquireStatusCode acquire_stop_stream(struct AcquireRuntime* self,
+                                               uint32_t istream);
+
+    /// @brief Stops the `istream`'th video stream right away, like
+    /// `acquire_abort()`. Other streams keep running.
+    enum AcquireStatusCode acquire_abort_stream(struct AcquireRuntime* self,
+                                                uint32_t istream);
+
     enum AcquireStatusCode acquire_execute_trigger(struct AcquireRuntime* self,
                                                    uint32_t istream);
 
+    /// @brief Changes some properties of the `istream`'th video stream while
+    /// it's running, without stopping it.
+    ///
+    /// Only the properties selected by `mask` are read from
+    /// `settings->video[istream]`. Each change is handed to the thread that
+    /// owns it and applied between two frames, so no frame is dropped:
+    /// - `AcquireLiveUpdate_Exposure` goes to the camera before the next
+    ///   frame is acquired. A change the camera rejects is logged.
+    /// - `AcquireLiveUpdate_FrameAverageCount` takes effect from the next
+    ///   window. Averaging must already be on, and stays on.
+    /// - `AcquireLiveUpdate_Filename` rolls storage over to the new file.
+    ///   Frames wait in the stream's queue while storage restarts.
+    /// - `AcquireLiveUpdate_ExternalMetadata` goes with the next output
+    ///   storage starts: a new file name, a new burst or the next
+    ///   acquisition.
+    ///
+    /// Updates made before the last ones were applied are merged. The
+    /// updated properties are reported by `acquire_get_configuration()` once
+    /// applied, and are kept for later acquisitions.
+    /// @param[in] mask `enum AcquireLiveUpdate` flags.
+    enum AcquireStatusCode acquire_update_live(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const struct AcquireProperties* settings,
+      uint32_t mask);
+
+    /// @returns `DeviceState_Running` while any video stream is running.
     enum DeviceState acquire_get_state(struct AcquireRuntime* self);
 
+    /// @returns The state of the `istream`'th video stream on its own.
+    enum DeviceState acquire_get_stream_state(struct AcquireRuntime* self,
+                                              uint32_t istream);
+
     /// @brief Read's data from a video stream.
     /// @see acquire_map_unread()
     /// @param[in] self 'runtime' reference.
@@ -134,6 +868,9 @@ extern "C"
     /// data. When no new data is available an empty region is returned
     /// (`*beg==*end`) - this call does not wait for data.
     ///
+    /// With a `monitor_decimation` policy, the mapped region holds at most one
+    /// frame and the frames the policy drops are skipped.
+    ///
     /// Holding on to a mapped region will prevent writers from making progress.
     /// Call `acquire_unmap_read()` to release.
     enum AcquireStatusCode acquire_map_read(const struct AcquireRuntime* self,
@@ -152,10 +889,239 @@ extern "C"
                                               uint32_t istream,
                                               size_t consumed_bytes);
 
+    /// @returns 1 if `frame` is the marker that starts a burst, otherwise 0.
+    /// @see AcquireProperties::video[i].sequence
+    ///
+    /// Markers are read with the frames, from `acquire_map_read()` and
+    /// `acquire_map_read_fused()`. They have no pixels. A marker's
+    /// `frame_id` is the id of the first frame of its burst.
+    uint8_t acquire_is_burst_marker(const struct VideoFrame* frame);
+
+    /// @returns 1 if `frame` was compressed by
+    /// `AcquireProperties::video[i].compression`, otherwise 0.
+    ///
+    /// Compressed frames are only stored by storage that writes frames as
+    /// they are, like raw storage. A compressed frame keeps the `shape` of
+    /// its pixels, but `bytes_of_frame` covers the compressed data.
+    uint8_t acquire_is_encoded_frame(const struct VideoFrame* frame);
+
+    /// @brief Decodes the pixels of a compressed frame read back from
+    /// storage.
+    /// @param[out] dst,capacity Receives the pixels, laid out as
+    ///                          `frame->shape` describes.
+    enum AcquireStatusCode acquire_decode_frame(const struct VideoFrame* frame,
+                                                uint8_t* dst,
+                                                size_t capacity);
+
+    /// @returns The number of frames in `record` if it was written by
+    /// `AcquireProperties::video[i].tiling`, otherwise 0.
+    ///
+    /// Tiled records are only stored by storage that writes frames as they
+    /// are, like raw storage. A record's `shape` describes one of its
+    /// frames, and `frame_id` is the id of its first frame.
+    uint32_t acquire_get_tiled_frame_count(const struct VideoFrame* record);
+
+    /// @brief Copies the `k`'th frame of a tiled record out of its tiles.
+    /// @param[out] dst,capacity Receives the frame's samples, densely packed:
+    ///                          channels, then columns, rows and planes.
+    enum AcquireStatusCode acquire_untile_frame(const struct VideoFrame* record,
+                                                uint32_t k,
+                                                uint8_t* dst,
+                                                size_t capacity);
+
+    /// @brief Reads frames fused from both video streams.
+    /// @see acquire_map_read()
+    ///
+    /// Requires `AcquireProperties::fusion`. Behaves like
+    /// `acquire_map_read()` for the output of the fusion stage.
+    enum AcquireStatusCode acquire_map_read_fused(
+      const struct AcquireRuntime* self,
+      struct VideoFrame** beg,
+      struct VideoFrame** end);
+
+    /// @brief Releases the read region reserved by `acquire_map_read_fused()`.
+    enum AcquireStatusCode acquire_unmap_read_fused(
+      const struct AcquireRuntime* self,
+      size_t consumed_bytes);
+
     size_t acquire_bytes_waiting_to_be_written_to_disk(
       const struct AcquireRuntime* self,
       uint32_t istream);
 
+    /// @brief Reports throughput statistics for the `istream`'th video
+    /// stream.
+    ///
+    /// Statistics are reset when the stream is started, and are kept after
+    /// it stops.
+    /// @param[in] self 'runtime' reference.
+    /// @param[in] istream Integer index selecting the video stream.
+    /// @param[out] stats Must not be NULL. Populated with the result.
+    enum AcquireStatusCode acquire_get_statistics(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireStreamStatistics* stats);
+
+    /// @brief Copies out the pixel statistics of frames acquired on the
+    /// `istream`'th video stream.
+    ///
+    /// Requires `AcquireProperties::video[istream].enable_frame_statistics`.
+    /// Each call returns the next unread records, oldest first, and does not
+    /// wait for new ones. Records are computed as frames are acquired and
+    /// held in a small queue. When the queue is full, new records are
+    /// dropped rather than stalling acquisition.
+    /// @param[in] self 'runtime' reference.
+    /// @param[in] istream Integer index selecting the video stream.
+    /// @param[out] stats Receives up to `capacity` records.
+    /// @param[in] capacity The number of elements in `stats`.
+    /// @param[out] count Must not be NULL. The number of records written to
+    ///                   `stats`.
+    enum AcquireStatusCode acquire_read_frame_statistics(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireFrameStatistics* stats,
+      uint32_t capacity,
+      uint32_t* count);
+
+    /// @brief Reads the spots detected in frames of the `istream`'th video
+    /// stream.
+    /// @see acquire_map_read()
+    ///
+    /// Requires `AcquireProperties::video[istream].detection`. There is one
+    /// `AcquireSpotList` per frame, in acquisition order. Like the frames
+    /// read with `acquire_map_read()`, unread records hold back the
+    /// detector, so release them promptly with `acquire_unmap_read_spots()`.
+    enum AcquireStatusCode acquire_map_read_spots(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireSpotList** beg,
+      struct AcquireSpotList** end);
+
+    /// @brief Releases the read region reserved by `acquire_map_read_spots()`.
+    enum AcquireStatusCode acquire_unmap_read_spots(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      size_t consumed_bytes);
+
+    /// @brief Reads the latest previews of the `istream`'th video stream.
+    /// @see acquire_map_read()
+    ///
+    /// Requires `AcquireProperties::video[istream].preview`. Previews are
+    /// `SampleType_u8` frames in a small queue of their own, so reading them
+    /// never holds back acquisition. When the queue is full, new previews
+    /// are dropped until the unread ones are released with
+    /// `acquire_unmap_read_preview()`.
+    enum AcquireStatusCode acquire_map_read_preview(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct VideoFrame** beg,
+      struct VideoFrame** end);
+
+    /// @brief Releases the read region reserved by
+    /// `acquire_map_read_preview()`.
+    enum AcquireStatusCode acquire_unmap_read_preview(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      size_t consumed_bytes);
+
+    /// @brief Reads the change gating log of the `istream`'th video stream.
+    /// @see acquire_map_read()
+    ///
+    /// Requires `AcquireProperties::video[istream].gating`. There is one
+    /// `AcquireGatingRecord` per frame, in acquisition order, including the
+    /// frames that weren't stored. Unread records stay readable after
+    /// `acquire_stop()` and are discarded on the next `acquire_start()`.
+    /// When the log is full, new records are dropped rather than holding back
+    /// storage.
+    enum AcquireStatusCode acquire_map_read_gating(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireGatingRecord** beg,
+      struct AcquireGatingRecord** end);
+
+    /// @brief Releases the read region reserved by `acquire_map_read_gating()`.
+    enum AcquireStatusCode acquire_unmap_read_gating(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      size_t consumed_bytes);
+
+    /// @brief Reads the region traces of the `istream`'th video stream.
+    /// @see acquire_map_read()
+    ///
+    /// Requires `AcquireProperties::video[istream].traces`. There is one
+    /// `AcquireTraceRecord` per traced frame. Unread records stay readable
+    /// after `acquire_stop()` and are discarded on the next
+    /// `acquire_start()`. When the queue is full, new records are dropped
+    /// rather than holding back acquisition.
+    enum AcquireStatusCode acquire_map_read_traces(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      struct AcquireTraceRecord** beg,
+      struct AcquireTraceRecord** end);
+
+    /// @brief Releases the read region reserved by `acquire_map_read_traces()`.
+    enum AcquireStatusCode acquire_unmap_read_traces(
+      const struct AcquireRuntime* self,
+      uint32_t istream,
+      size_t consumed_bytes);
+
+    /// @brief Sets the lookup table used by `AcquireLutCurve_Custom` on the
+    /// `istream`'th video stream.
+    ///
+    /// Input value `v` maps to `table[v]`. Values past the end of the table
+    /// map to its last entry. May not be called while running. Takes effect
+    /// on the next `acquire_configure()`.
+    /// @param[in] table `count` entries.
+    /// @param[in] count At most 65536. 0 clears the table. `acquire_start()`
+    /// fails while the stream is configured with `AcquireLutCurve_Custom`
+    /// and no table is set.
+    enum AcquireStatusCode acquire_set_bit_depth_table(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const uint8_t* table,
+      uint32_t count);
+
+    /// @brief Sets the defective pixels of the `istream`'th video stream.
+    ///
+    /// Defective pixels are replaced with an estimate from their good
+    /// neighbors according to `AcquireProperties::video[i].defect_correction`.
+    /// Replaces any previously set defects. Pass a `count` of 0 to clear
+    /// them. May not be called while running.
+    /// @param[in] self 'runtime' reference.
+    /// @param[in] istream Integer index selecting the video stream.
+    /// @param[in] xs,ys Pixel coordinates of the `count` defects. Defects
+    ///                  outside the frame are ignored.
+    enum AcquireStatusCode acquire_set_defect_pixels(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const uint32_t* xs,
+      const uint32_t* ys,
+      uint32_t count);
+
+    /// @brief Sets the defective pixels of the `istream`'th video stream
+    /// from a mask.
+    /// @see acquire_set_defect_pixels()
+    /// @param[in] mask A `width` by `height` image in row-major order.
+    ///                 Nonzero values mark defective pixels.
+    enum AcquireStatusCode acquire_set_defect_mask(struct AcquireRuntime* self,
+                                                   uint32_t istream,
+                                                   const uint8_t* mask,
+                                                   uint32_t width,
+                                                   uint32_t height);
+
+    /// @brief Sets the regions traced on the `istream`'th video stream.
+    ///
+    /// May not be called while running. Frames whose shape doesn't match the
+    /// mask aren't traced.
+    /// @param[in] labels A `width` by `height` image in row-major order.
+    ///                   0 is background. Regions are labeled from 1. NULL
+    ///                   clears the regions.
+    enum AcquireStatusCode acquire_set_trace_labels(
+      struct AcquireRuntime* self,
+      uint32_t istream,
+      const uint16_t* labels,
+      uint32_t width,
+      uint32_t height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,18 @@
 #include "channel.h"
+#include "logger.h"
 #include <string.h>
 
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
 #define countof(e) (sizeof(e) / sizeof((e)[0]))
 #define MAX_READERS countof(((struct channel*)0)->holds.pos) //(1 << 3)
 
@@ -23,17 +35,24 @@ cursor_cmp(size_t cycle_a, size_t pos_a, size_t cycle_b, size_t pos_b)
 }
 
 static uint32_t
-reader_min(const size_t* tails, const size_t* cycles, uint32_t n)
+reader_min(const size_t* tails,
+           const size_t* cycles,
+           const uint8_t* is_detached,
+           uint32_t n)
 {
+    uint32_t argmin = 0;
+    while (argmin < n && is_detached[argmin])
+        ++argmin;
     struct
     {
         size_t tail, cycle;
     } mn = {
-        .tail = tails[0],
-        .cycle = cycles[0],
+        .tail = tails[argmin],
+        .cycle = cycles[argmin],
     };
-    uint32_t argmin = 0;
-    for (uint32_t i = 1; i < n; ++i) {
+    for (uint32_t i = argmin + 1; i < n; ++i) {
+        if (is_detached[i])
+            continue;
         if (cursor_cmp(mn.cycle, mn.tail, cycles[i], tails[i]) == 1) {
             mn.tail = tails[i];
             mn.cycle = cycles[i];
@@ -43,6 +62,15 @@ reader_min(const size_t* tails, const size_t* cycles, uint32_t n)
     return argmin;
 }
 
+static unsigned
+attached_reader_count(const struct channel* self)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < self->holds.n; ++i)
+        count += !self->holds.is_detached[i];
+    return count;
+}
+
 static uint32_t
 next_write(const struct channel* self,
            size_t nbytes,
@@ -54,8 +82,10 @@ next_write(const struct channel* self,
     if (!self->is_accepting_writes)
         return 0;
 
-    const uint32_t argmin =
-      reader_min(self->holds.pos, self->holds.cycles, self->holds.n);
+    const uint32_t argmin = reader_min(self->holds.pos,
+                                       self->holds.cycles,
+                                       self->holds.is_detached,
+                                       self->holds.n);
     const size_t tail = self->holds.pos[argmin];
 
     if (self->head < tail) {
@@ -91,11 +121,20 @@ reader_initialize(struct channel* self, struct channel_reader* reader)
 {
     if (reader->id > 0)
         return 1;
-    reader->id = ++self->holds.n;
-    self->holds.cycles[reader->id - 1] = self->cycle;
-    self->holds.pos[reader->id - 1] = 0;
-    if (self->holds.n >= MAX_READERS)
+
+    // Reuse the first detached slot, otherwise take a new one.
+    unsigned slot = 0;
+    while (slot < self->holds.n && !self->holds.is_detached[slot])
+        ++slot;
+    if (slot >= MAX_READERS)
         return 0;
+    if (slot == self->holds.n)
+        ++self->holds.n;
+
+    reader->id = slot + 1;
+    self->holds.is_detached[slot] = 0;
+    self->holds.cycles[slot] = self->cycle;
+    self->holds.pos[slot] = 0;
     return 1;
 }
 
@@ -162,7 +201,11 @@ channel_read_map(struct channel* self, struct channel_reader* reader)
     size_t nbytes = 0;
     lock_acquire(&self->lock);
 
-    reader_initialize(self, reader);
+    if (!reader_initialize(self, reader)) {
+        reader->status = Channel_Error;
+        lock_release(&self->lock);
+        return (struct slice){ 0 };
+    }
 
     size_t* const cycle = self->holds.cycles + reader->id - 1;
     size_t* const pos = self->holds.pos + reader->id - 1;
@@ -173,6 +216,14 @@ channel_read_map(struct channel* self, struct channel_reader* reader)
         goto AdvanceToWriterHead;
     }
 
+    // A reader that consumed everything up to the high water mark of the
+    // last cycle continues from the start of the current one.
+    if (*pos == self->high && *cycle + 1 == self->cycle) {
+        *pos = 0;
+        *cycle = self->cycle;
+        out = self->data;
+    }
+
     if (*pos == self->head && *cycle == self->cycle) {
         goto Finalize;
     }
@@ -245,8 +296,36 @@ channel_read_unmap(struct channel* self,
     condition_variable_notify_all(&self->notify_space_available);
 }
 
-void*
-channel_write_map(struct channel* self, size_t nbytes)
+void
+channel_reader_attach(struct channel* self, struct channel_reader* reader)
+{
+    if (reader->id)
+        return;
+    lock_acquire(&self->lock);
+    if (reader_initialize(self, reader)) {
+        self->holds.pos[reader->id - 1] = self->head;
+        self->holds.cycles[reader->id - 1] = self->cycle;
+    } else {
+        reader->status = Channel_Error;
+    }
+    lock_release(&self->lock);
+}
+
+void
+channel_reader_detach(struct channel* self, struct channel_reader* reader)
+{
+    if (!reader->id)
+        return;
+    lock_acquire(&self->lock);
+    if (reader->id <= self->holds.n)
+        self->holds.is_detached[reader->id - 1] = 1;
+    lock_release(&self->lock);
+    *reader = (struct channel_reader){ 0 };
+    condition_variable_notify_all(&self->notify_space_available);
+}
+
+static void*
+write_map(struct channel* self, size_t nbytes, int should_wait)
 {
     void* out = 0;
     if (nbytes >= self->capacity)
@@ -254,7 +333,7 @@ channel_write_map(struct channel* self, size_t nbytes)
     lock_acquire(&self->lock);
 
     size_t beg, end;
-    if (!self->holds.n) {
+    if (!attached_reader_count(self)) {
         beg = self->head;
         end = self->head + nbytes;
         if (end >= self->capacity) {
@@ -268,7 +347,8 @@ channel_write_map(struct channel* self, size_t nbytes)
 
         while (self->is_accepting_writes &&
                !next_write(self, nbytes, &beg, &should_wrap)) {
-
+            if (!should_wait)
+                goto Finalize;
             condition_variable_wait(&self->notify_space_available, &self->lock);
         }
         if (!self->is_accepting_writes)
@@ -293,6 +373,18 @@ Finalize:
     return out;
 }
 
+void*
+channel_write_map(struct channel* self, size_t nbytes)
+{
+    return write_map(self, nbytes, 1);
+}
+
+void*
+channel_try_write_map(struct channel* self, size_t nbytes)
+{
+    return write_map(self, nbytes, 0);
+}
+
 void
 channel_write_unmap(struct channel* self)
 {
@@ -302,3 +394,95 @@ channel_write_unmap(struct channel* self)
     }
     lock_release(&self->lock);
 }
+
+#ifndef NO_UNIT_TESTS
+
+/// Writes `nbytes` of `value`.
+/// @returns 0 if there was no room, otherwise 1.
+static int
+try_write(struct channel* self, size_t nbytes, uint8_t value)
+{
+    uint8_t* dst = (uint8_t*)channel_try_write_map(self, nbytes);
+    if (!dst)
+        return 0;
+    memset(dst, value, nbytes); // NOLINT
+    channel_write_unmap(self);
+    return 1;
+}
+
+/// Reads everything available to `reader`.
+/// @returns The number of bytes read.
+static size_t
+read_all(struct channel* self, struct channel_reader* reader)
+{
+    struct slice slice = channel_read_map(self, reader);
+    const size_t nbytes = slice.end - slice.beg;
+    channel_read_unmap(self, reader, nbytes);
+    return nbytes;
+}
+
+int
+unit_test__channel_detached_reader_does_not_block_writer()
+{
+    struct channel channel = { 0 };
+    struct channel_reader a = { 0 }, b = { 0 }, c = { 0 };
+    channel_new(&channel, 64);
+    channel_reader_attach(&channel, &a);
+    channel_reader_attach(&channel, &b);
+    CHECK(a.id == 1 && b.id == 2);
+
+    for (int i = 0; i < 3; ++i)
+        CHECK(try_write(&channel, 20, (uint8_t)i));
+    CHECK(read_all(&channel, &b) == 60);
+
+    // `a` hasn't read anything, so it holds the space the writer needs.
+    CHECK(!try_write(&channel, 20, 3));
+    channel_reader_detach(&channel, &a);
+    CHECK(a.id == 0);
+    CHECK(try_write(&channel, 20, 3));
+    CHECK(read_all(&channel, &b) == 20);
+
+    // A new reader takes the detached slot and starts at the writer's head.
+    channel_reader_attach(&channel, &c);
+    CHECK(c.id == 1);
+    CHECK(read_all(&channel, &c) == 0);
+    CHECK(try_write(&channel, 20, 4));
+    CHECK(read_all(&channel, &c) == 20);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+int
+unit_test__channel_reader_follows_wrap()
+{
+    struct channel channel = { 0 };
+    struct channel_reader reader = { 0 };
+    channel_new(&channel, 64);
+    channel_reader_attach(&channel, &reader);
+
+    for (int i = 0; i < 3; ++i)
+        CHECK(try_write(&channel, 20, (uint8_t)i));
+    CHECK(read_all(&channel, &reader) == 60);
+
+    // The reader caught up at the high water mark. The next write wraps to
+    // the start of the buffer, and the reader must follow it there.
+    CHECK(try_write(&channel, 20, 7));
+    struct slice slice = channel_read_map(&channel, &reader);
+    CHECK(slice.beg == channel.data);
+    CHECK(slice.end - slice.beg == 20);
+    CHECK(slice.beg[0] == 7 && slice.beg[19] == 7);
+    channel_read_unmap(&channel, &reader, 20);
+    CHECK(read_all(&channel, &reader) == 0);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -44,7 +44,11 @@ extern "C"
         {
             size_t pos[8];
             size_t cycles[8];
-            unsigned n; /// Number of readers currently reading from the channel.
+            /// Nonzero for slots released by `channel_reader_detach()`.
+            /// Detached slots do not hold back the writer and are reused by
+            /// the next reader to attach.
+            uint8_t is_detached[8];
+            unsigned n; /// Number of reader slots handed out on the channel.
         } holds;
     };
 
@@ -80,6 +84,13 @@ extern "C"
 
     void* channel_write_map(struct channel* self, size_t nbytes);
 
+    /// @brief Like `channel_write_map()`, but returns NULL instead of waiting
+    /// when a reader is holding the space that's needed.
+    ///
+    /// For lossy side streams, where the writer should drop data rather
+    /// than wait on a slow reader.
+    void* channel_try_write_map(struct channel* self, size_t nbytes);
+
     void channel_write_unmap(struct channel* self);
 
     void channel_abort_write(struct channel* self);
@@ -93,6 +104,23 @@ extern "C"
                             struct channel_reader* reader,
                             size_t consumed_bytes);
 
+    /// @brief Registers `reader` with the channel at the writer's head, so it
+    /// only sees data written from now on.
+    ///
+    /// Does nothing if `reader` is already registered. Readers that are not
+    /// explicitly attached register on their first `channel_read_map()`.
+    void channel_reader_attach(struct channel* self,
+                               struct channel_reader* reader);
+
+    /// @brief Releases `reader`'s hold on the channel.
+    ///
+    /// Afterwards the reader no longer prevents the writer from making
+    /// progress. Any mapped region is released. The `reader` is reset so it
+    /// may be used to read from this, or another, channel; it will start
+    /// reading at the writer's head.
+    void channel_reader_detach(struct channel* self,
+                               struct channel_reader* reader);
+
 #ifdef __cplusplus
 } // end extern "C"
 #endif //__cplusplus
@@ -0,0 +1,834 @@
+#include "codec.h"
+#include "logger.h"
+#include "device/props/components.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define LZ_HASH_BITS (12)
+#define LZ_MIN_MATCH (4)
+#define LZ_MAX_OFFSET (65535)
+/// No match starts in the last `LZ_END_LITERALS` bytes of a block.
+#define LZ_END_LITERALS (12)
+/// No match extends into the last `LZ_END_MATCH` bytes of a block.
+#define LZ_END_MATCH (5)
+
+static size_t
+bytes_of_image(const struct ImageShape* const shape)
+{
+    return shape->strides.planes * bytes_of_type(shape->type);
+}
+
+//
+//  Shuffles
+//
+
+void
+shuffle_bytes(const uint8_t* src,
+              uint8_t* dst,
+              size_t nbytes,
+              size_t bytes_per_sample)
+{
+    const size_t k = bytes_per_sample;
+    const size_t n = nbytes / k;
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (k == 2) {
+        const __m256i lanes = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, //
+                                               1, 3, 5, 7, 9, 11, 13, 15,
+                                               0, 2, 4, 6, 8, 10, 12, 14, //
+                                               1, 3, 5, 7, 9, 11, 13, 15);
+        for (; i + 16 <= n; i += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+            v = _mm256_shuffle_epi8(v, lanes);
+            v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(v));
+            _mm_storeu_si128((__m128i*)(dst + n + i),
+                             _mm256_extracti128_si256(v, 1));
+        }
+    }
+#endif
+    for (size_t j = 0; j < k; ++j) {
+        const uint8_t* s = src + j;
+        uint8_t* d = dst + j * n;
+        for (size_t e = i; e < n; ++e)
+            d[e] = s[e * k];
+    }
+    memcpy(dst + n * k, src + n * k, nbytes - n * k); // NOLINT
+}
+
+void
+unshuffle_bytes(const uint8_t* src,
+                uint8_t* dst,
+                size_t nbytes,
+                size_t bytes_per_sample)
+{
+    const size_t k = bytes_per_sample;
+    const size_t n = nbytes / k;
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (k == 2) {
+        for (; i + 16 <= n; i += 16) {
+            __m128i lo = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i hi = _mm_loadu_si128((const __m128i*)(src + n + i));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i),
+                             _mm_unpacklo_epi8(lo, hi));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 16),
+                             _mm_unpackhi_epi8(lo, hi));
+        }
+    }
+#endif
+    for (size_t j = 0; j < k; ++j) {
+        const uint8_t* s = src + j * n;
+        uint8_t* d = dst + j;
+        for (size_t e = i; e < n; ++e)
+            d[e * k] = s[e];
+    }
+    memcpy(dst + n * k, src + n * k, nbytes - n * k); // NOLINT
+}
+
+/// Transposes the bits of each group of 8 bytes in `src`.
+/// The output holds 8 bit-planes of `nbytes/8` bytes followed by any
+/// remaining bytes, copied as-is.
+static void
+shuffle_bits(const uint8_t* src, uint8_t* dst, size_t nbytes)
+{
+    const size_t n8 = nbytes / 8;
+    size_t g = 0;
+#if defined(__AVX2__)
+    for (; g + 4 <= n8; g += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + 8 * g));
+        for (int b = 7; b >= 0; --b) {
+            // movemask collects the high bit of every byte.
+            const uint32_t m = (uint32_t)_mm256_movemask_epi8(v);
+            memcpy(dst + b * n8 + g, &m, sizeof(m)); // NOLINT
+            v = _mm256_add_epi8(v, v);
+        }
+    }
+#endif
+    for (; g < n8; ++g) {
+        const uint8_t* s = src + 8 * g;
+        for (int b = 0; b < 8; ++b) {
+            uint8_t out = 0;
+            for (int i = 0; i < 8; ++i)
+                out |= (uint8_t)(((s[i] >> b) & 1) << i);
+            dst[b * n8 + g] = out;
+        }
+    }
+    memcpy(dst + 8 * n8, src + 8 * n8, nbytes - 8 * n8); // NOLINT
+}
+
+static void
+unshuffle_bits(const uint8_t* src, uint8_t* dst, size_t nbytes)
+{
+    const size_t n8 = nbytes / 8;
+    for (size_t g = 0; g < n8; ++g) {
+        uint8_t* d = dst + 8 * g;
+        for (int i = 0; i < 8; ++i) {
+            uint8_t out = 0;
+            for (int b = 0; b < 8; ++b)
+                out |= (uint8_t)(((src[b * n8 + g] >> i) & 1) << b);
+            d[i] = out;
+        }
+    }
+    memcpy(dst + 8 * n8, src + 8 * n8, nbytes - 8 * n8); // NOLINT
+}
+
+/// Applies `f` to each byte-plane of a byte-shuffled buffer.
+static void
+for_each_plane(void (*f)(const uint8_t*, uint8_t*, size_t),
+               const uint8_t* src,
+               uint8_t* dst,
+               size_t nbytes,
+               size_t bytes_per_sample)
+{
+    const size_t n = nbytes / bytes_per_sample;
+    for (size_t j = 0; j < bytes_per_sample; ++j)
+        f(src + j * n, dst + j * n, n);
+    memcpy(dst + n * bytes_per_sample, // NOLINT
+           src + n * bytes_per_sample,
+           nbytes - n * bytes_per_sample);
+}
+
+//
+//  LZ
+//
+//  A byte-oriented LZ77 in the style of LZ4. The block is a series of
+//  sequences:
+//
+//      token | [literal length bytes] | literals | offset | [match len bytes]
+//
+//  The high nibble of the token is the literal count and the low nibble is
+//  the match length less LZ_MIN_MATCH. A nibble of 15 is extended by bytes
+//  that are summed until one is less than 255. The offset is a little-endian
+//  uint16. The last sequence has no match.
+//
+
+static uint32_t
+read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v)); // NOLINT
+    return v;
+}
+
+static uint64_t
+read64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v)); // NOLINT
+    return v;
+}
+
+static uint32_t
+lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t*
+write_length(uint8_t* op, const uint8_t* oend, size_t len)
+{
+    len -= 15;
+    for (; len >= 255; len -= 255) {
+        if (op >= oend)
+            return 0;
+        *op++ = 255;
+    }
+    if (op >= oend)
+        return 0;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static int
+read_length(const uint8_t** ip, const uint8_t* iend, size_t* len)
+{
+    uint8_t b = 0;
+    do {
+        if (*ip >= iend)
+            return 0;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+/// Emits a sequence. A sequence with `nmatch==0` terminates the block.
+/// @returns The new output position, or NULL if `dst` is too small.
+static uint8_t*
+emit_sequence(uint8_t* op,
+              const uint8_t* oend,
+              const uint8_t* literals,
+              size_t nliterals,
+              size_t offset,
+              size_t nmatch)
+{
+    if (op >= oend)
+        return 0;
+    uint8_t* const token = op++;
+    *token = (uint8_t)(min(nliterals, 15) << 4);
+    if (nliterals >= 15 && !(op = write_length(op, oend, nliterals)))
+        return 0;
+    if ((size_t)(oend - op) < nliterals)
+        return 0;
+    memcpy(op, literals, nliterals); // NOLINT
+    op += nliterals;
+    if (!nmatch)
+        return op;
+
+    if (oend - op < 2)
+        return 0;
+    op[0] = (uint8_t)(offset & 0xff);
+    op[1] = (uint8_t)(offset >> 8);
+    op += 2;
+    const size_t m = nmatch - LZ_MIN_MATCH;
+    *token |= (uint8_t)min(m, 15);
+    if (m >= 15 && !(op = write_length(op, oend, m)))
+        return 0;
+    return op;
+}
+
+size_t
+lz_compress(const uint8_t* src, size_t nbytes, uint8_t* dst, size_t capacity)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table)); // NOLINT
+
+    uint8_t* op = dst;
+    const uint8_t* const oend = dst + capacity;
+    size_t ip = 0, anchor = 0;
+    if (nbytes > LZ_END_LITERALS) {
+        const size_t limit = nbytes - LZ_END_LITERALS;
+        const size_t match_limit = nbytes - LZ_END_MATCH;
+        while (ip < limit) {
+            const uint32_t seq = read32(src + ip);
+            const uint32_t h = lz_hash(seq);
+            const size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref < ip && ip - ref <= LZ_MAX_OFFSET &&
+                read32(src + ref) == seq) {
+                size_t len = LZ_MIN_MATCH;
+                while (ip + len + 8 <= match_limit &&
+                       read64(src + ref + len) == read64(src + ip + len))
+                    len += 8;
+                while (ip + len < match_limit &&
+                       src[ref + len] == src[ip + len])
+                    ++len;
+                op = emit_sequence(
+                  op, oend, src + anchor, ip - anchor, ip - ref, len);
+                if (!op)
+                    return 0;
+                ip += len;
+                anchor = ip;
+                if (ip < limit)
+                    table[lz_hash(read32(src + ip - 2))] = (uint32_t)(ip - 2);
+            } else {
+                // Step faster through data that isn't matching.
+                ip += 1 + ((ip - anchor) >> 6);
+            }
+        }
+    }
+    op = emit_sequence(op, oend, src + anchor, nbytes - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+size_t
+lz_decompress(const uint8_t* src, size_t nbytes, uint8_t* dst, size_t capacity)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + nbytes;
+    uint8_t* op = dst;
+    const uint8_t* const oend = dst + capacity;
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        size_t nliterals = token >> 4;
+        if (nliterals == 15 && !read_length(&ip, iend, &nliterals))
+            return 0;
+        if ((size_t)(iend - ip) < nliterals || (size_t)(oend - op) < nliterals)
+            return 0;
+        memcpy(op, ip, nliterals); // NOLINT
+        op += nliterals;
+        ip += nliterals;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return 0;
+        const size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t nmatch = token & 15;
+        if (nmatch == 15 && !read_length(&ip, iend, &nmatch))
+            return 0;
+        nmatch += LZ_MIN_MATCH;
+        if (!offset || offset > (size_t)(op - dst) ||
+            (size_t)(oend - op) < nmatch)
+            return 0;
+        const uint8_t* ref = op - offset;
+        if (offset >= nmatch) {
+            memcpy(op, ref, nmatch); // NOLINT
+        } else {
+            for (size_t i = 0; i < nmatch; ++i)
+                op[i] = ref[i];
+        }
+        op += nmatch;
+    }
+    return (size_t)(op - dst);
+}
+
+//
+//  Sparse
+//
+//  Keeps only the samples above a threshold. The block is a run count
+//  followed by the runs:
+//
+//      uint32 count | (uint32 start | uint32 length | samples...) x count
+//
+//  `start` and `length` count samples. Samples outside every run decode as
+//  0. Nearby samples are joined into one run when the samples in between
+//  cost no more than starting a new run, so a few samples at or below the
+//  threshold may keep their value.
+//
+//  The scan compares a vector of samples at a time and only visits the
+//  samples that pass, so empty stretches of a frame cost one compare per
+//  32 bytes.
+//
+
+#define SPARSE_RUN_HEADER_BYTES (2 * sizeof(uint32_t))
+
+struct sparse_writer
+{
+    const uint8_t* src;
+    size_t k;
+    uint8_t* op;
+    uint8_t* end;
+    uint32_t count;
+    /// Samples in the open run are [run_beg, run_end). No run is open when
+    /// `run_end` is 0.
+    size_t run_beg, run_end;
+    size_t max_gap;
+    /// Samples kept so far, and the most that may be kept.
+    size_t kept, max_kept;
+};
+
+static unsigned
+lowest_set_bit(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(x);
+#endif
+}
+
+static int
+sparse_flush_run(struct sparse_writer* w)
+{
+    if (!w->run_end)
+        return 1;
+    const size_t n = w->run_end - w->run_beg;
+    if ((size_t)(w->end - w->op) < SPARSE_RUN_HEADER_BYTES + n * w->k)
+        return 0;
+    const uint32_t header[2] = { (uint32_t)w->run_beg, (uint32_t)n };
+    uint8_t* const samples = w->op + sizeof(header);
+    memcpy(w->op, header, sizeof(header));                 // NOLINT
+    memcpy(samples, w->src + w->run_beg * w->k, n * w->k); // NOLINT
+    w->op = samples + n * w->k;
+    ++w->count;
+    w->run_end = 0;
+    return 1;
+}
+
+/// Adds sample `i` to the output. Samples must be added in order.
+/// @returns 0 when the output is full or too many samples have been kept.
+static int
+sparse_keep(struct sparse_writer* w, size_t i)
+{
+    if (++w->kept > w->max_kept)
+        return 0;
+    if (w->run_end && i <= w->run_end + w->max_gap) {
+        w->run_end = i + 1;
+        return 1;
+    }
+    if (!sparse_flush_run(w))
+        return 0;
+    w->run_beg = i;
+    w->run_end = i + 1;
+    return 1;
+}
+
+static int
+sparse_scan_u8(struct sparse_writer* w, uint32_t threshold, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i t = _mm256_set1_epi8((char)(uint8_t)(threshold + 1));
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(w->src + i));
+        // x > threshold  <=>  max(x, threshold+1) == x
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_max_epu8(x, t), x));
+        for (; mask; mask &= mask - 1)
+            if (!sparse_keep(w, i + lowest_set_bit(mask)))
+                return 0;
+    }
+#endif
+    for (; i < n; ++i)
+        if (w->src[i] > threshold && !sparse_keep(w, i))
+            return 0;
+    return 1;
+}
+
+static int
+sparse_scan_u16(struct sparse_writer* w, uint32_t threshold, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i t = _mm256_set1_epi16((short)(uint16_t)(threshold + 1));
+    for (; i + 16 <= n; i += 16) {
+        const __m256i x =
+          _mm256_loadu_si256((const __m256i*)((const uint16_t*)w->src + i));
+        // Two mask bits per sample.
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+          _mm256_cmpeq_epi16(_mm256_max_epu16(x, t), x));
+        for (; mask; mask &= mask - 1, mask &= mask - 1)
+            if (!sparse_keep(w, i + lowest_set_bit(mask) / 2))
+                return 0;
+    }
+#endif
+    for (; i < n; ++i)
+        if (((const uint16_t*)w->src)[i] > threshold && !sparse_keep(w, i))
+            return 0;
+    return 1;
+}
+
+size_t
+sparse_encode(const uint8_t* src,
+              size_t nbytes,
+              size_t bytes_per_sample,
+              uint32_t threshold,
+              float max_density,
+              uint8_t* dst,
+              size_t capacity)
+{
+    const size_t k = bytes_per_sample;
+    const size_t n = nbytes / k;
+    if ((k != 1 && k != 2) || nbytes % k || capacity < sizeof(uint32_t))
+        return 0;
+    struct sparse_writer w = {
+        .src = src,
+        .k = k,
+        .op = dst + sizeof(uint32_t),
+        .end = dst + capacity,
+        .max_gap = SPARSE_RUN_HEADER_BYTES / k,
+        .max_kept = (size_t)(max_density * (float)n),
+    };
+    // Nothing can be above the largest value.
+    if (threshold < (k == 1 ? 0xffu : 0xffffu)) {
+        if (!(k == 1 ? sparse_scan_u8(&w, threshold, n)
+                     : sparse_scan_u16(&w, threshold, n)))
+            return 0;
+        if (!sparse_flush_run(&w))
+            return 0;
+    }
+    memcpy(dst, &w.count, sizeof(w.count)); // NOLINT
+    return (size_t)(w.op - dst);
+}
+
+int
+sparse_decode(const uint8_t* src,
+              size_t src_nbytes,
+              size_t bytes_per_sample,
+              uint8_t* dst,
+              size_t nbytes)
+{
+    const size_t k = bytes_per_sample;
+    const uint8_t* ip = src + sizeof(uint32_t);
+    const uint8_t* const end = src + src_nbytes;
+    uint32_t count = 0;
+    CHECK(src_nbytes >= sizeof(count));
+    memcpy(&count, src, sizeof(count)); // NOLINT
+    memset(dst, 0, nbytes);             // NOLINT
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t header[2];
+        CHECK((size_t)(end - ip) >= sizeof(header));
+        memcpy(header, ip, sizeof(header)); // NOLINT
+        ip += sizeof(header);
+        const size_t offset = (size_t)header[0] * k;
+        const size_t run_nbytes = (size_t)header[1] * k;
+        CHECK(offset <= nbytes && run_nbytes <= nbytes - offset);
+        CHECK((size_t)(end - ip) >= run_nbytes);
+        memcpy(dst + offset, ip, run_nbytes); // NOLINT
+        ip += run_nbytes;
+    }
+    CHECK(ip == end);
+    return 1;
+Error:
+    return 0;
+}
+
+//
+//  Blocks and frames
+//
+
+size_t
+codec_block_bound(size_t nbytes)
+{
+    return nbytes + nbytes / 255 + 16;
+}
+
+size_t
+codec_block_scratch_bytes(size_t nbytes)
+{
+    return 2 * nbytes;
+}
+
+size_t
+codec_encode_block(const struct codec_params* params,
+                   const uint8_t* src,
+                   size_t nbytes,
+                   uint8_t* scratch,
+                   uint8_t* dst,
+                   size_t capacity)
+{
+    const size_t k = params->bytes_per_sample ? params->bytes_per_sample : 1;
+    const uint8_t* in = src;
+    // Sparse blocks are smaller than `nbytes` by construction. The runs
+    // keep whole samples, so there's no shuffle.
+    if (params->codec == Codec_Sparse)
+        return sparse_encode(src,
+                             nbytes,
+                             k,
+                             params->sparse_threshold,
+                             params->sparse_max_density,
+                             dst,
+                             min(capacity, nbytes - 1));
+    switch (params->shuffle) {
+        case Shuffle_Byte:
+            shuffle_bytes(src, scratch, nbytes, k);
+            in = scratch;
+            break;
+        case Shuffle_Bit:
+            shuffle_bytes(src, scratch, nbytes, k);
+            for_each_plane(shuffle_bits, scratch, scratch + nbytes, nbytes, k);
+            in = scratch + nbytes;
+            break;
+        default:
+            break;
+    }
+    switch (params->codec) {
+        case Codec_Lz:
+            // Only report success when the block got smaller.
+            return nbytes > 1
+                     ? lz_compress(in, nbytes, dst, min(capacity, nbytes - 1))
+                     : 0;
+        default:
+            return 0;
+    }
+}
+
+int
+codec_decode_block(const struct codec_params* params,
+                   const uint8_t* src,
+                   size_t src_nbytes,
+                   uint8_t* scratch,
+                   uint8_t* dst,
+                   size_t nbytes)
+{
+    const size_t k = params->bytes_per_sample ? params->bytes_per_sample : 1;
+    uint8_t* const stage = params->shuffle == Shuffle_Byte ? scratch : dst;
+    if (params->codec == Codec_Sparse)
+        return sparse_decode(src, src_nbytes, k, dst, nbytes);
+    CHECK(params->codec == Codec_Lz);
+    CHECK(lz_decompress(src, src_nbytes, stage, nbytes) == nbytes);
+    switch (params->shuffle) {
+        case Shuffle_Byte:
+            unshuffle_bytes(scratch, dst, nbytes, k);
+            break;
+        case Shuffle_Bit:
+            for_each_plane(unshuffle_bits, dst, scratch, nbytes, k);
+            unshuffle_bytes(scratch, dst, nbytes, k);
+            break;
+        default:
+            break;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+const struct encoded_frame_header*
+encoded_frame_header_of(const struct VideoFrame* frame)
+{
+    const size_t bytes_of_raw = bytes_of_image(&frame->shape);
+    // The encoder never emits a frame whose size matches the raw frame.
+    if (frame->bytes_of_frame == sizeof(*frame) + bytes_of_raw ||
+        frame->bytes_of_frame <
+          sizeof(*frame) + sizeof(struct encoded_frame_header))
+        return 0;
+    const struct encoded_frame_header* header =
+      (const struct encoded_frame_header*)frame->data;
+    if (header->magic != ENCODED_FRAME_MAGIC ||
+        header->bytes_of_raw != bytes_of_raw)
+        return 0;
+    return header;
+}
+
+int
+codec_decode_frame(const struct VideoFrame* frame,
+                   uint8_t* dst,
+                   size_t capacity)
+{
+    uint8_t* scratch = 0;
+    const struct encoded_frame_header* header = encoded_frame_header_of(frame);
+    CHECK(header);
+    EXPECT(capacity >= header->bytes_of_raw,
+           "Expected at least %llu bytes for decoded frame. Got %llu.",
+           (unsigned long long)header->bytes_of_raw,
+           (unsigned long long)capacity);
+    const struct codec_params params = {
+        .codec = (enum codec_id)header->codec,
+        .shuffle = (enum shuffle_kind)header->shuffle,
+        .bytes_per_sample = header->bytes_per_sample,
+    };
+    CHECK(scratch = (uint8_t*)malloc(header->bytes_per_block));
+
+    const uint32_t* sizes = (const uint32_t*)(header + 1);
+    const uint8_t* src = (const uint8_t*)(sizes + header->block_count);
+    const uint8_t* const end = (const uint8_t*)frame + frame->bytes_of_frame;
+    for (uint32_t i = 0; i < header->block_count; ++i) {
+        const size_t offset = (size_t)i * header->bytes_per_block;
+        const size_t nbytes =
+          min(header->bytes_per_block, header->bytes_of_raw - offset);
+        const size_t src_nbytes = sizes[i] & ~CODEC_BLOCK_STORED;
+        CHECK(src + src_nbytes <= end);
+        if (sizes[i] & CODEC_BLOCK_STORED) {
+            CHECK(src_nbytes == nbytes);
+            memcpy(dst + offset, src, nbytes); // NOLINT
+        } else {
+            CHECK(codec_decode_block(
+              &params, src, src_nbytes, scratch, dst + offset, nbytes));
+        }
+        src += src_nbytes;
+    }
+    free(scratch);
+    return 1;
+Error:
+    free(scratch);
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__codec_round_trip()
+{
+    const size_t nbytes = (1 << 16) + 7; // odd, so there's a tail
+    uint8_t *src = 0, *scratch = 0, *enc = 0, *dec = 0;
+    CHECK(src = (uint8_t*)malloc(nbytes));
+    CHECK(scratch = (uint8_t*)malloc(codec_block_scratch_bytes(nbytes)));
+    CHECK(enc = (uint8_t*)malloc(codec_block_bound(nbytes)));
+    CHECK(dec = (uint8_t*)malloc(nbytes));
+
+    // A smooth ramp with some low-bit noise: typical of camera data.
+    {
+        uint32_t state = 1;
+        for (size_t i = 0; i + 1 < nbytes; i += 2) {
+            state = state * 1664525u + 1013904223u;
+            const uint16_t v = (uint16_t)(1000 + (i >> 6) + (state >> 29));
+            memcpy(src + i, &v, sizeof(v)); // NOLINT
+        }
+        src[nbytes - 1] = 0xab;
+    }
+
+    for (int shuffle = 0; shuffle < Shuffle_Count; ++shuffle) {
+        const struct codec_params params = {
+            .codec = Codec_Lz,
+            .shuffle = (enum shuffle_kind)shuffle,
+            .bytes_per_sample = 2,
+        };
+        const size_t n = codec_encode_block(
+          &params, src, nbytes, scratch, enc, codec_block_bound(nbytes));
+        EXPECT(n > 0 && n < nbytes,
+               "Expected compressible data (shuffle %d). Got %llu bytes.",
+               shuffle,
+               (unsigned long long)n);
+        memset(dec, 0, nbytes); // NOLINT
+        CHECK(codec_decode_block(&params, enc, n, scratch, dec, nbytes));
+        EXPECT(memcmp(src, dec, nbytes) == 0,
+               "Round trip failed (shuffle %d)",
+               shuffle);
+    }
+
+    // Random data doesn't compress
+    {
+        uint32_t state = 7;
+        for (size_t i = 0; i < nbytes; ++i) {
+            state = state * 1664525u + 1013904223u;
+            src[i] = (uint8_t)(state >> 24);
+        }
+        const struct codec_params params = { .codec = Codec_Lz,
+                                             .shuffle = Shuffle_None,
+                                             .bytes_per_sample = 1 };
+        CHECK(0 == codec_encode_block(
+                     &params, src, nbytes, scratch, enc, nbytes));
+    }
+
+    free(src);
+    free(scratch);
+    free(enc);
+    free(dec);
+    return 1;
+Error:
+    free(src);
+    free(scratch);
+    free(enc);
+    free(dec);
+    return 0;
+}
+
+int
+unit_test__sparse_round_trip()
+{
+    // Enough samples to use both the vector path and the scalar tail.
+    enum
+    {
+        N = 4099
+    };
+    uint16_t src[N], dec[N];
+    uint8_t enc[2 * N];
+    const uint32_t threshold = 120;
+    const size_t spots[] = { 0, 17, 18, 20, 1000, 1001, 2047, N - 1 };
+    for (size_t i = 0; i < N; ++i)
+        src[i] = (uint16_t)(100 + i % 7); // background below the threshold
+    for (size_t i = 0; i < sizeof(spots) / sizeof(spots[0]); ++i)
+        src[spots[i]] = (uint16_t)(1000 + i);
+
+    const struct codec_params params = { .codec = Codec_Sparse,
+                                         .bytes_per_sample = 2,
+                                         .sparse_threshold = threshold,
+                                         .sparse_max_density = 0.01f };
+    const size_t n = codec_encode_block(
+      &params, (const uint8_t*)src, sizeof(src), 0, enc, sizeof(enc));
+    EXPECT(n > 0 && n < 128,
+           "Expected a small block. Got %llu bytes.",
+           (unsigned long long)n);
+    CHECK(codec_decode_block(&params, enc, n, 0, (uint8_t*)dec, sizeof(dec)));
+    for (size_t i = 0; i < N; ++i) {
+        // Samples in a gap joined into a run keep their value.
+        const int is_kept = src[i] > threshold || i == 19;
+        const uint16_t expected = is_kept ? src[i] : 0;
+        EXPECT(dec[i] == expected,
+               "Sample %llu: got %u, expected %u",
+               (unsigned long long)i,
+               dec[i],
+               expected);
+    }
+
+    // A block with too much signal is left to be stored as is.
+    for (size_t i = 0; i < N; i += 50)
+        src[i] = 5000;
+    CHECK(0 == codec_encode_block(&params,
+                                  (const uint8_t*)src,
+                                  sizeof(src),
+                                  0,
+                                  enc,
+                                  sizeof(enc)));
+
+    // An empty block still encodes.
+    memset(src, 0, sizeof(src)); // NOLINT
+    CHECK(sizeof(uint32_t) ==
+          sparse_encode((const uint8_t*)src, N, 1, 0, 0.0f, enc, sizeof(enc)));
+    CHECK(sparse_decode(enc, sizeof(uint32_t), 1, (uint8_t*)dec, N));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
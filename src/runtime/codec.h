@@ -0,0 +1,178 @@
+//! Codecs for video frames.
+//!
+//! An encoded frame keeps its `VideoFrame` header - the `shape` still
+//! describes the decoded image - but `bytes_of_frame` covers the encoded
+//! payload instead of the pixel data. The payload starts with an
+//! `encoded_frame_header` followed by a table of block sizes and then the
+//! blocks themselves:
+//!
+//! ~~~
+//!     VideoFrame | encoded_frame_header | uint32_t[block_count] | blocks...
+//! ~~~
+//!
+//! Pixel data is split into independent blocks so the blocks of a frame can
+//! be encoded and decoded in parallel. Each block is shuffled and then
+//! compressed. A block that doesn't compress is stored verbatim and its size
+//! is tagged with `CODEC_BLOCK_STORED`.
+//!
+//! `Codec_Sparse` is the one lossy codec: it drops the samples at or below a
+//! threshold. It suits frames where only a few pixels carry signal. Blocks
+//! with more signal than that are stored as they are.
+//!
+//! Use `encoded_frame_header_of()` to tell an encoded frame from a raw one.
+
+#ifndef H_ACQUIRE_CODEC_V0
+#define H_ACQUIRE_CODEC_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+    enum codec_id
+    {
+        Codec_None = 0,
+        Codec_Lz,
+        /// Runs of the samples above a threshold. Other samples decode as 0.
+        Codec_Sparse,
+        Codec_Count,
+    };
+
+    enum shuffle_kind
+    {
+        Shuffle_None = 0,
+        /// Groups the i'th byte of every element together.
+        Shuffle_Byte,
+        /// Byte shuffle, then groups the j'th bit of every byte together.
+        Shuffle_Bit,
+        Shuffle_Count,
+    };
+
+#define ENCODED_FRAME_MAGIC (0x46455141) // "AQEF"
+#define CODEC_BLOCK_STORED (0x80000000u)
+
+    struct encoded_frame_header
+    {
+        uint32_t magic;           //< ENCODED_FRAME_MAGIC
+        uint8_t codec;            //< enum codec_id
+        uint8_t shuffle;          //< enum shuffle_kind
+        uint8_t bytes_per_sample; //< element size used by the shuffle
+        uint8_t reserved;
+        uint32_t bytes_per_block; //< decoded size of every block but the last
+        uint32_t block_count;
+        uint64_t bytes_of_raw; //< decoded size of the pixel data
+    };
+
+    struct codec_params
+    {
+        enum codec_id codec;
+        enum shuffle_kind shuffle;
+        uint8_t bytes_per_sample;
+
+        /// `Codec_Sparse` only. Samples must be above `sparse_threshold` to
+        /// be kept. A block is stored as is when the fraction of samples
+        /// kept would exceed `sparse_max_density`.
+        uint32_t sparse_threshold;
+        float sparse_max_density;
+    };
+
+    /// @returns an upper bound on the encoded size of a block of `nbytes`.
+    size_t codec_block_bound(size_t nbytes);
+
+    /// @returns the number of bytes of scratch memory needed to encode a
+    /// block of `nbytes`.
+    size_t codec_block_scratch_bytes(size_t nbytes);
+
+    /// @brief Encodes one block.
+    /// @param[in] params codec and shuffle to apply.
+    /// @param[in] src,nbytes The block to encode.
+    /// @param[in] scratch At least `codec_block_scratch_bytes(nbytes)`.
+    /// @param[out] dst,capacity Output buffer.
+    /// @returns the number of bytes written to `dst`, or 0 if the block
+    ///          couldn't be compressed to fewer than `nbytes`.
+    size_t codec_encode_block(const struct codec_params* params,
+                              const uint8_t* src,
+                              size_t nbytes,
+                              uint8_t* scratch,
+                              uint8_t* dst,
+                              size_t capacity);
+
+    /// @brief Decodes one block produced by `codec_encode_block()`.
+    /// @param[out] dst Receives exactly `nbytes` decoded bytes.
+    /// @param[in] scratch At least `nbytes`.
+    /// @returns 1 on success, otherwise 0.
+    int codec_decode_block(const struct codec_params* params,
+                           const uint8_t* src,
+                           size_t src_nbytes,
+                           uint8_t* scratch,
+                           uint8_t* dst,
+                           size_t nbytes);
+
+    /// @returns The header of an encoded frame, or NULL if `frame` holds raw
+    ///          pixel data.
+    const struct encoded_frame_header* encoded_frame_header_of(
+      const struct VideoFrame* frame);
+
+    /// @brief Decodes the pixel data of an encoded frame.
+    /// @param[in] frame An encoded frame.
+    /// @param[out] dst,capacity Receives the decoded pixel data.
+    /// @returns 1 on success, otherwise 0.
+    int codec_decode_frame(const struct VideoFrame* frame,
+                           uint8_t* dst,
+                           size_t capacity);
+
+    void shuffle_bytes(const uint8_t* src,
+                       uint8_t* dst,
+                       size_t nbytes,
+                       size_t bytes_per_sample);
+
+    void unshuffle_bytes(const uint8_t* src,
+                         uint8_t* dst,
+                         size_t nbytes,
+                         size_t bytes_per_sample);
+
+    size_t lz_compress(const uint8_t* src,
+                       size_t nbytes,
+                       uint8_t* dst,
+                       size_t capacity);
+
+    /// @returns the number of bytes written to `dst` or 0 on a corrupt input.
+    size_t lz_decompress(const uint8_t* src,
+                         size_t nbytes,
+                         uint8_t* dst,
+                         size_t capacity);
+
+    /// @brief Encodes the samples of `src` that are above `threshold`.
+    ///
+    /// Only 1 and 2 byte unsigned samples are supported.
+    /// @returns the number of bytes written to `dst`, or 0 if the output
+    ///          doesn't fit in `capacity`, more than `max_density` of the
+    ///          samples are above `threshold`, or the sample size isn't
+    ///          supported.
+    size_t sparse_encode(const uint8_t* src,
+                         size_t nbytes,
+                         size_t bytes_per_sample,
+                         uint32_t threshold,
+                         float max_density,
+                         uint8_t* dst,
+                         size_t capacity);
+
+    /// @brief Decodes a block produced by `sparse_encode()`.
+    /// @param[out] dst Receives exactly `nbytes` decoded bytes.
+    /// @returns 1 on success, or 0 on a corrupt input.
+    int sparse_decode(const uint8_t* src,
+                      size_t src_nbytes,
+                      size_t bytes_per_sample,
+                      uint8_t* dst,
+                      size_t nbytes);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_CODEC_V0
@@ -0,0 +1,227 @@
+#include "decimator.h"
+#include "frame_iterator.h"
+#include "logger.h"
+#include "marker.h"
+#include "device/props/components.h"
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+enum DeviceStatusCode
+decimator_configure(struct decimator* self,
+                    enum decimation_policy policy,
+                    uint32_t every,
+                    float max_rate_hz)
+{
+    EXPECT(policy < Decimation_Count, "Unknown decimation policy %d.", policy);
+    EXPECT(policy != Decimation_EveryN || every > 0,
+           "Expected a positive decimation interval. Got %u.",
+           every);
+    EXPECT(policy != Decimation_MaxRate || max_rate_hz > 0.0f,
+           "Expected a positive decimation rate. Got %f.",
+           max_rate_hz);
+    *self = (struct decimator){
+        .policy = policy,
+        .every = every,
+        .max_rate_hz = max_rate_hz,
+    };
+    return Device_Ok;
+Error:
+    *self = (struct decimator){ 0 };
+    return Device_Err;
+}
+
+void
+decimator_reset(struct decimator* self)
+{
+    self->frame_count = 0;
+    self->has_kept = 0;
+}
+
+uint8_t
+decimator_is_enabled(const struct decimator* self)
+{
+    return self->policy != Decimation_None;
+}
+
+int
+decimator_keep(struct decimator* self,
+               const struct VideoFrame* frame,
+               int is_latest)
+{
+    // Markers are always kept, and aren't counted.
+    if (frame_marker_of(frame) != FrameMarker_None)
+        return 1;
+    int keep = 1;
+    switch (self->policy) {
+        case Decimation_EveryN:
+            keep = self->frame_count % self->every == 0;
+            break;
+        case Decimation_MaxRate:
+            keep = !self->has_kept ||
+                   clock_toc_ms(&self->clock) >= 1e3 / self->max_rate_hz;
+            break;
+        case Decimation_LatestOnly:
+            keep = is_latest;
+            break;
+        default:;
+    }
+    ++self->frame_count;
+    if (keep) {
+        clock_tic(&self->clock);
+        self->has_kept = 1;
+    }
+    return keep;
+}
+
+struct slice
+decimator_read_map(struct decimator* self,
+                   struct channel* channel,
+                   struct channel_reader* reader)
+{
+    if (!decimator_is_enabled(self))
+        return channel_read_map(channel, reader);
+    while (1) {
+        struct slice slice = channel_read_map(channel, reader);
+        if (slice.beg == slice.end)
+            return slice;
+
+        const struct VideoFrame* kept = 0;
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it))) {
+            const int is_latest = it.remaining.beg == it.remaining.end;
+            if (decimator_keep(self, frame, is_latest)) {
+                kept = frame;
+                break;
+            }
+        }
+        if (!kept) {
+            // Release the skipped frames and look for more.
+            channel_read_unmap(channel, reader, slice_size_bytes(&slice));
+            continue;
+        }
+
+        const size_t skipped = (const uint8_t*)kept - slice.beg;
+        if (skipped) {
+            channel_read_unmap(channel, reader, skipped);
+            slice = channel_read_map(channel, reader);
+        }
+        // Only the kept frame is mapped. Everything after it stays unread.
+        slice.end = slice.beg + kept->bytes_of_frame;
+        return slice;
+    }
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Writes `n` empty frames numbered from `first`.
+static int
+write_frames(struct channel* channel, uint64_t first, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i) {
+        struct VideoFrame* frame = (struct VideoFrame*)channel_write_map(
+          channel, sizeof(struct VideoFrame));
+        CHECK(frame);
+        *frame = (struct VideoFrame){
+            .bytes_of_frame = sizeof(struct VideoFrame),
+            .frame_id = first + i,
+        };
+        channel_write_unmap(channel);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+/// Reads until nothing is left, recording the ids of the frames that were
+/// mapped.
+/// @returns The number of frames read.
+static size_t
+read_ids(struct decimator* decimator,
+         struct channel* channel,
+         struct channel_reader* reader,
+         uint64_t* ids,
+         size_t capacity)
+{
+    size_t n = 0;
+    struct slice slice;
+    do {
+        slice = decimator_read_map(decimator, channel, reader);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            if (n < capacity)
+                ids[n++] = frame->frame_id;
+        channel_read_unmap(channel, reader, slice_size_bytes(&slice));
+    } while (slice.beg != slice.end);
+    return n;
+}
+
+int
+unit_test__decimator_skips_frames()
+{
+    struct channel channel = { 0 };
+    struct channel_reader reader = { 0 };
+    struct decimator decimator = { 0 };
+    uint64_t ids[16] = { 0 };
+    channel_new(&channel, 1 << 12);
+    channel_reader_attach(&channel, &reader);
+
+    // Every 3rd frame.
+    CHECK(decimator_configure(&decimator, Decimation_EveryN, 3, 0.0f) ==
+          Device_Ok);
+    CHECK(write_frames(&channel, 0, 10));
+    CHECK(read_ids(&decimator, &channel, &reader, ids, 16) == 4);
+    CHECK(ids[0] == 0 && ids[1] == 3 && ids[2] == 6 && ids[3] == 9);
+    // Skipped frames were released, so the reader is caught up.
+    CHECK(reader.pos == channel.head);
+
+    // Only the newest frame.
+    CHECK(decimator_configure(&decimator, Decimation_LatestOnly, 0, 0.0f) ==
+          Device_Ok);
+    CHECK(write_frames(&channel, 10, 5));
+    CHECK(read_ids(&decimator, &channel, &reader, ids, 16) == 1);
+    CHECK(ids[0] == 14);
+
+    // At most 1 Hz: only the first of a quick burst.
+    CHECK(decimator_configure(&decimator, Decimation_MaxRate, 0, 1.0f) ==
+          Device_Ok);
+    CHECK(write_frames(&channel, 15, 5));
+    CHECK(read_ids(&decimator, &channel, &reader, ids, 16) == 1);
+    CHECK(ids[0] == 15);
+
+    // No decimation.
+    CHECK(decimator_configure(&decimator, Decimation_None, 0, 0.0f) ==
+          Device_Ok);
+    CHECK(write_frames(&channel, 20, 5));
+    CHECK(read_ids(&decimator, &channel, &reader, ids, 16) == 5);
+
+    CHECK(decimator_configure(&decimator, Decimation_EveryN, 0, 0.0f) ==
+          Device_Err);
+    CHECK(decimator_configure(&decimator, Decimation_MaxRate, 0, 0.0f) ==
+          Device_Err);
+
+    channel_release(&channel);
+    return 1;
+Error:
+    channel_release(&channel);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,84 @@
+//!
+//! # Decimation
+//!
+//! Lets one reader of a frame channel see fewer frames than the others:
+//!
+//! - `Decimation_EveryN` keeps every `every`'th frame.
+//! - `Decimation_MaxRate` keeps a frame when at least `1/max_rate_hz`
+//!   seconds have passed since the last kept frame.
+//! - `Decimation_LatestOnly` keeps only the newest frame available.
+//!
+//! `decimator_read_map()` applies the policy when the channel is mapped. The
+//! frames it skips are released right away, so a decimated reader never
+//! holds back the writer with frames it won't look at.
+//!
+
+#ifndef H_ACQUIRE_DECIMATOR_V0
+#define H_ACQUIRE_DECIMATOR_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "platform.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+    enum decimation_policy
+    {
+        Decimation_None = 0,
+        Decimation_EveryN,
+        Decimation_MaxRate,
+        Decimation_LatestOnly,
+        Decimation_Count,
+    };
+
+    struct decimator
+    {
+        enum decimation_policy policy;
+        uint32_t every;
+        float max_rate_hz;
+
+        /// Frames seen since the last reset.
+        uint64_t frame_count;
+        /// Started when a frame is kept.
+        struct clock clock;
+        uint8_t has_kept;
+    };
+
+    /// @param[in] every Used by `Decimation_EveryN`. Must be positive.
+    /// @param[in] max_rate_hz Used by `Decimation_MaxRate`. Must be positive.
+    enum DeviceStatusCode decimator_configure(struct decimator* self,
+                                              enum decimation_policy policy,
+                                              uint32_t every,
+                                              float max_rate_hz);
+
+    /// @brief Forgets the frames seen so far. The next frame is kept.
+    void decimator_reset(struct decimator* self);
+
+    uint8_t decimator_is_enabled(const struct decimator* self);
+
+    /// @brief Decides whether to keep `frame`.
+    /// @param[in] is_latest Nonzero if no newer frame is available.
+    int decimator_keep(struct decimator* self,
+                       const struct VideoFrame* frame,
+                       int is_latest);
+
+    /// @brief Like `channel_read_map()`, but skips the frames the policy
+    /// drops.
+    ///
+    /// When decimating, the mapped region holds at most one frame. Release
+    /// it with `channel_read_unmap()` as usual.
+    struct slice decimator_read_map(struct decimator* self,
+                                    struct channel* channel,
+                                    struct channel_reader* reader);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_DECIMATOR_V0
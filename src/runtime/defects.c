@@ -0,0 +1,327 @@
+#include "defects.h"
+#include "logger.h"
+#include "device/props/components.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// A defect and the neighbors used to estimate it. Offsets are in samples
+/// from the start of a channel-plane.
+struct defect_entry_s
+{
+    int64_t at;
+    int64_t neighbors[8];
+    uint8_t n;
+};
+
+static void
+clear_index(struct defect_map* self)
+{
+    free(self->index.entries);
+    self->index = (struct defect_index_s){ 0 };
+}
+
+void
+defect_map_destroy(struct defect_map* self)
+{
+    clear_index(self);
+    free(self->xs);
+    free(self->ys);
+    self->xs = self->ys = 0;
+    self->count = 0;
+}
+
+int
+defect_map_set_pixels(struct defect_map* self,
+                      const uint32_t* xs,
+                      const uint32_t* ys,
+                      size_t count)
+{
+    uint32_t *x = 0, *y = 0;
+    if (count) {
+        CHECK(xs && ys);
+        CHECK(x = (uint32_t*)malloc(count * sizeof(uint32_t)));
+        CHECK(y = (uint32_t*)malloc(count * sizeof(uint32_t)));
+        memcpy(x, xs, count * sizeof(uint32_t)); // NOLINT
+        memcpy(y, ys, count * sizeof(uint32_t)); // NOLINT
+    }
+    defect_map_destroy(self);
+    self->xs = x;
+    self->ys = y;
+    self->count = count;
+    return 1;
+Error:
+    free(x);
+    free(y);
+    return 0;
+}
+
+int
+defect_map_set_mask(struct defect_map* self,
+                    const uint8_t* mask,
+                    uint32_t width,
+                    uint32_t height)
+{
+    uint32_t *xs = 0, *ys = 0;
+    size_t count = 0;
+    CHECK(mask || !(width && height));
+    for (size_t i = 0; i < (size_t)width * height; ++i)
+        count += (mask[i] != 0);
+    if (count) {
+        CHECK(xs = (uint32_t*)malloc(count * sizeof(uint32_t)));
+        CHECK(ys = (uint32_t*)malloc(count * sizeof(uint32_t)));
+        size_t k = 0;
+        for (uint32_t y = 0; y < height; ++y)
+            for (uint32_t x = 0; x < width; ++x)
+                if (mask[(size_t)y * width + x]) {
+                    xs[k] = x;
+                    ys[k] = y;
+                    ++k;
+                }
+    }
+    CHECK(defect_map_set_pixels(self, xs, ys, count));
+    free(xs);
+    free(ys);
+    return 1;
+Error:
+    free(xs);
+    free(ys);
+    return 0;
+}
+
+uint8_t
+defect_map_is_enabled(const struct defect_map* self)
+{
+    return self->fill != DefectFill_None && self->count > 0;
+}
+
+static int
+cmp_u64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int
+is_defect(const uint64_t* sorted, size_t n, uint64_t key)
+{
+    return bsearch(&key, sorted, n, sizeof(key), cmp_u64) != 0;
+}
+
+/// Computes, for each in-bounds defect, the offsets of the defect and of its
+/// good neighbors for frames of the given `shape`.
+static int
+build_index(struct defect_map* self, const struct ImageShape* shape)
+{
+    const uint32_t w = shape->dims.width, h = shape->dims.height;
+    uint64_t* keys = 0;
+    clear_index(self);
+    CHECK(keys = (uint64_t*)malloc(self->count * sizeof(uint64_t)));
+    CHECK(self->index.entries = (struct defect_entry_s*)malloc(
+            self->count * sizeof(struct defect_entry_s)));
+
+    size_t nkeys = 0;
+    for (size_t i = 0; i < self->count; ++i)
+        if (self->xs[i] < w && self->ys[i] < h)
+            keys[nkeys++] = (uint64_t)self->ys[i] * w + self->xs[i];
+    qsort(keys, nkeys, sizeof(*keys), cmp_u64);
+
+    size_t n = 0;
+    for (size_t i = 0; i < nkeys; ++i) {
+        if (i && keys[i] == keys[i - 1])
+            continue; // duplicate
+        const int64_t x = (int64_t)(keys[i] % w), y = (int64_t)(keys[i] / w);
+        struct defect_entry_s* e = self->index.entries + n++;
+        *e = (struct defect_entry_s){
+            .at = x * shape->strides.width + y * shape->strides.height,
+        };
+        for (int64_t dy = -1; dy <= 1; ++dy) {
+            for (int64_t dx = -1; dx <= 1; ++dx) {
+                const int64_t nx = x + dx, ny = y + dy;
+                if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= w ||
+                    ny >= h ||
+                    is_defect(keys, nkeys, (uint64_t)ny * w + (uint64_t)nx))
+                    continue;
+                e->neighbors[e->n++] =
+                  nx * shape->strides.width + ny * shape->strides.height;
+            }
+        }
+    }
+    free(keys);
+
+    self->index.width = w;
+    self->index.height = h;
+    self->index.stride_x = shape->strides.width;
+    self->index.stride_y = shape->strides.height;
+    self->index.count = n;
+    LOG("Indexed %llu defective pixels for %ux%u frames",
+        (unsigned long long)n,
+        w,
+        h);
+    return 1;
+Error:
+    free(keys);
+    clear_index(self);
+    return 0;
+}
+
+static int
+is_index_current(const struct defect_map* self,
+                 const struct ImageShape* shape)
+{
+    return self->index.entries && self->index.width == shape->dims.width &&
+           self->index.height == shape->dims.height &&
+           self->index.stride_x == shape->strides.width &&
+           self->index.stride_y == shape->strides.height;
+}
+
+static double
+estimate(enum defect_fill fill, double* v, uint8_t n)
+{
+    if (fill == DefectFill_Median) {
+        // insertion sort. n <= 8.
+        for (uint8_t i = 1; i < n; ++i) {
+            const double t = v[i];
+            uint8_t j = i;
+            for (; j > 0 && v[j - 1] > t; --j)
+                v[j] = v[j - 1];
+            v[j] = t;
+        }
+        return (n & 1) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    }
+    double sum = 0.0;
+    for (uint8_t i = 0; i < n; ++i)
+        sum += v[i];
+    return sum / n;
+}
+
+static int64_t
+round_to_nearest(double x)
+{
+    return (int64_t)(x < 0.0 ? x - 0.5 : x + 0.5);
+}
+
+#define DEFINE_CORRECT(T, suffix, STORE)                                       \
+    static void correct_##suffix(const struct defect_index_s* index,           \
+                                 enum defect_fill fill,                        \
+                                 T* data)                                      \
+    {                                                                          \
+        for (size_t i = 0; i < index->count; ++i) {                            \
+            const struct defect_entry_s* e = index->entries + i;               \
+            double v[8];                                                       \
+            if (!e->n)                                                         \
+                continue;                                                      \
+            for (uint8_t k = 0; k < e->n; ++k)                                 \
+                v[k] = (double)data[e->neighbors[k]];                          \
+            data[e->at] = STORE(T, estimate(fill, v, e->n));                   \
+        }                                                                      \
+    }
+
+#define STORE_INT(T, x) (T) round_to_nearest(x)
+#define STORE_FLOAT(T, x) (T)(x)
+
+DEFINE_CORRECT(uint8_t, u8, STORE_INT)
+DEFINE_CORRECT(uint16_t, u16, STORE_INT)
+DEFINE_CORRECT(int8_t, i8, STORE_INT)
+DEFINE_CORRECT(int16_t, i16, STORE_INT)
+DEFINE_CORRECT(float, f32, STORE_FLOAT)
+
+int
+defect_map_apply(struct defect_map* self, struct VideoFrame* frame)
+{
+    if (!defect_map_is_enabled(self))
+        return 1;
+    if (!is_index_current(self, &frame->shape))
+        CHECK(build_index(self, &frame->shape));
+
+    const struct ImageShape* const shape = &frame->shape;
+    const size_t bpp = bytes_of_type(shape->type);
+    for (uint32_t p = 0; p < shape->dims.planes; ++p) {
+        for (uint32_t c = 0; c < shape->dims.channels; ++c) {
+            uint8_t* const base =
+              frame->data +
+              bpp * (p * shape->strides.planes + c * shape->strides.channels);
+            switch (shape->type) {
+                case SampleType_u8:
+                    correct_u8(&self->index, self->fill, base);
+                    break;
+                case SampleType_u10:
+                case SampleType_u12:
+                case SampleType_u14:
+                case SampleType_u16:
+                    correct_u16(&self->index, self->fill, (uint16_t*)base);
+                    break;
+                case SampleType_i8:
+                    correct_i8(&self->index, self->fill, (int8_t*)base);
+                    break;
+                case SampleType_i16:
+                    correct_i16(&self->index, self->fill, (int16_t*)base);
+                    break;
+                case SampleType_f32:
+                    correct_f32(&self->index, self->fill, (float*)base);
+                    break;
+                default:
+                    EXPECT(0,
+                           "Unsupported pixel type for defect correction: %d",
+                           (int)shape->type);
+            }
+        }
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__defect_map_corrects_listed_pixels()
+{
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[4 * 3];
+    } im = { 0 };
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = 4, .height = 3, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = 4, .planes = 12 },
+        .type = SampleType_u16,
+    };
+    for (int i = 0; i < 12; ++i)
+        im.data[i] = 10;
+    im.data[1 * 4 + 1] = 4095; // (1,1): neighbors are all 10
+    im.data[0 * 4 + 3] = 4095; // (3,0): corner, neighbor (2,1) is 40
+    im.data[1 * 4 + 2] = 40;
+
+    struct defect_map map = { .fill = DefectFill_Median };
+    const uint32_t xs[] = { 1, 3, 9 }, ys[] = { 1, 0, 9 }; // last is outside
+    CHECK(defect_map_set_pixels(&map, xs, ys, 3));
+    CHECK(defect_map_apply(&map, &im.frame));
+    CHECK(map.index.count == 2);
+    CHECK(im.data[1 * 4 + 1] == 10);
+    CHECK(im.data[0 * 4 + 3] == 10); // median of 10, 40, 10
+
+    map.fill = DefectFill_Mean;
+    im.data[0 * 4 + 3] = 4095;
+    CHECK(defect_map_apply(&map, &im.frame));
+    CHECK(im.data[0 * 4 + 3] == 20); // mean of 10, 40, 10
+    defect_map_destroy(&map);
+    return 1;
+Error:
+    defect_map_destroy(&map);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
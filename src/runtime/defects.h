@@ -0,0 +1,81 @@
+//!
+//! # Defective pixel correction
+//!
+//! Replaces known bad pixels (e.g. hot pixels) with an estimate from their
+//! neighbors. The defects are given as a list of pixel coordinates or as a
+//! mask. For each frame shape, an index of each defect's location and of its
+//! usable neighbors is computed once, so correcting a frame costs time
+//! proportional to the number of defects rather than the size of the frame.
+//!
+
+#ifndef H_ACQUIRE_DEFECTS_V0
+#define H_ACQUIRE_DEFECTS_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+    enum defect_fill
+    {
+        DefectFill_None = 0,
+        /// Mean of the good pixels among the 8 nearest neighbors.
+        DefectFill_Mean,
+        /// Median of the good pixels among the 8 nearest neighbors.
+        DefectFill_Median,
+        DefectFill_Count,
+    };
+
+    struct defect_map
+    {
+        enum defect_fill fill;
+
+        /// Defective pixel coordinates.
+        uint32_t* xs;
+        uint32_t* ys;
+        size_t count;
+
+        /// Built on demand for the last seen frame shape.
+        struct defect_index_s
+        {
+            uint32_t width, height;
+            int64_t stride_x, stride_y;
+            struct defect_entry_s* entries;
+            size_t count;
+        } index;
+    };
+
+    void defect_map_destroy(struct defect_map* self);
+
+    /// @brief Replaces the defect list.
+    /// @returns 1 on success, otherwise 0.
+    int defect_map_set_pixels(struct defect_map* self,
+                              const uint32_t* xs,
+                              const uint32_t* ys,
+                              size_t count);
+
+    /// @brief Replaces the defect list with the nonzero pixels of `mask`.
+    /// @param[in] mask A `width` by `height` image in row-major order.
+    /// @returns 1 on success, otherwise 0.
+    int defect_map_set_mask(struct defect_map* self,
+                            const uint8_t* mask,
+                            uint32_t width,
+                            uint32_t height);
+
+    /// @returns nonzero if correcting frames would change them.
+    uint8_t defect_map_is_enabled(const struct defect_map* self);
+
+    /// @brief Corrects the defective pixels of `frame` in place.
+    /// @returns 1 on success, otherwise 0.
+    int defect_map_apply(struct defect_map* self, struct VideoFrame* frame);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_DEFECTS_V0
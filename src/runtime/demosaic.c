@@ -0,0 +1,915 @@
+#include "demosaic.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Strips are at least this many rows, so the rows a strip converts for its
+/// neighbors' sake stay a small fraction of the work.
+#define MIN_ROWS_PER_STRIP (16)
+
+/// Row buffers are padded by this many samples on each side.
+#define PAD (2)
+
+/// Rows kept per strip. Writing a row touches input rows up to 3 away, so 8
+/// slots never evict a row that's still in use.
+#define INPUT_SLOTS (8)
+#define GREEN_SLOTS (4)
+#define DIFF_SLOTS (4)
+
+enum color
+{
+    Color_Red = 0,
+    Color_Green,
+    Color_Blue,
+};
+
+/// Where an output channel of a pixel comes from.
+enum source
+{
+    /// The pixel's own sample.
+    Source_Center = 0,
+    /// The mean of the left and right neighbors.
+    Source_Horizontal,
+    /// The mean of the neighbors above and below.
+    Source_Vertical,
+    /// The mean of the 4 nearest neighbors.
+    Source_Cross,
+    /// The mean of the 4 diagonal neighbors.
+    Source_Diagonal,
+};
+
+/// Colors of the top left 2x2 block, indexed by pattern, row and column.
+static const uint8_t colors[BayerPattern_Count][2][2] = {
+    [BayerPattern_RGGB] = { { Color_Red, Color_Green },
+                            { Color_Green, Color_Blue } },
+    [BayerPattern_BGGR] = { { Color_Blue, Color_Green },
+                            { Color_Green, Color_Red } },
+    [BayerPattern_GRBG] = { { Color_Green, Color_Red },
+                            { Color_Blue, Color_Green } },
+    [BayerPattern_GBRG] = { { Color_Green, Color_Blue },
+                            { Color_Red, Color_Green } },
+};
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns The largest value of an integer `type`, +inf for f32 and 0 for
+///          types that can't be demosaiced.
+static float
+max_value_of(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u8:
+            return (float)UINT8_MAX;
+        case SampleType_u10:
+            return (float)((1 << 10) - 1);
+        case SampleType_u12:
+            return (float)((1 << 12) - 1);
+        case SampleType_u14:
+            return (float)((1 << 14) - 1);
+        case SampleType_u16:
+            return (float)UINT16_MAX;
+        case SampleType_f32:
+            return INFINITY;
+        default:
+            return 0.0f;
+    }
+}
+
+static int
+is_supported(const struct ImageShape* shape)
+{
+    return max_value_of(shape->type) > 0.0f && shape->dims.channels == 1 &&
+           shape->strides.width == 1 && shape->dims.width >= 3 &&
+           shape->dims.height >= 3;
+}
+
+/// Mirrors `y` about the first and last rows without repeating them, which
+/// keeps the parity of the mosaic.
+static int32_t
+reflect(int32_t y, int32_t n)
+{
+    if (y < 0)
+        y = -y;
+    if (y >= n)
+        y = 2 * (n - 1) - y;
+    return y;
+}
+
+/// Mirrors the `PAD` samples on either side of `row[0,w)`.
+static void
+pad_row(float* row, uint32_t w)
+{
+    row[-1] = row[1];
+    row[-2] = row[2];
+    row[w] = row[w - 2];
+    row[w + 1] = row[w - 3];
+}
+
+static void
+convert_u8(const uint8_t* src, float* dst, uint32_t w)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= w; i += 8)
+        _mm256_storeu_ps(dst + i,
+                         _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                           _mm_loadl_epi64((const __m128i*)(src + i)))));
+#endif
+    for (; i < w; ++i)
+        dst[i] = (float)src[i];
+}
+
+static void
+convert_u16(const uint16_t* src, float* dst, uint32_t w)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= w; i += 8)
+        _mm256_storeu_ps(dst + i,
+                         _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+                           _mm_loadu_si128((const __m128i*)(src + i)))));
+#endif
+    for (; i < w; ++i)
+        dst[i] = (float)src[i];
+}
+
+/// Averages the neighbors of each sample of row `c`, given the rows above
+/// (`u`) and below (`d`). Indices are signed since they reach into the
+/// padding to the left of the rows.
+static void
+interpolate(const float* u,
+            const float* c,
+            const float* d,
+            float* horizontal,
+            float* vertical,
+            float* cross,
+            float* diagonal,
+            int32_t w)
+{
+    int32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    for (; i + 8 <= w; i += 8) {
+        const __m256 h = _mm256_add_ps(_mm256_loadu_ps(c + i - 1),
+                                       _mm256_loadu_ps(c + i + 1));
+        const __m256 v =
+          _mm256_add_ps(_mm256_loadu_ps(u + i), _mm256_loadu_ps(d + i));
+        const __m256 g = _mm256_add_ps(
+          _mm256_add_ps(_mm256_loadu_ps(u + i - 1), _mm256_loadu_ps(u + i + 1)),
+          _mm256_add_ps(_mm256_loadu_ps(d + i - 1),
+                        _mm256_loadu_ps(d + i + 1)));
+        _mm256_storeu_ps(horizontal + i, _mm256_mul_ps(h, half));
+        _mm256_storeu_ps(vertical + i, _mm256_mul_ps(v, half));
+        _mm256_storeu_ps(cross + i,
+                         _mm256_mul_ps(_mm256_add_ps(h, v), quarter));
+        _mm256_storeu_ps(diagonal + i, _mm256_mul_ps(g, quarter));
+    }
+#endif
+    for (; i < w; ++i) {
+        const float h = c[i - 1] + c[i + 1];
+        const float v = u[i] + d[i];
+        horizontal[i] = 0.5f * h;
+        vertical[i] = 0.5f * v;
+        cross[i] = 0.25f * (h + v);
+        diagonal[i] = 0.25f * (u[i - 1] + u[i + 1] + d[i - 1] + d[i + 1]);
+    }
+}
+
+/// Estimates green at every sample of row `r[2]` from the rows `r[0..4]`
+/// around it. Interpolates along the direction with the smaller gradient,
+/// corrected by the curvature of the center color along that direction.
+static void
+estimate_green(const float* const r[5], float* g, int32_t w)
+{
+    const float* u2 = r[0];
+    const float* u = r[1];
+    const float* c = r[2];
+    const float* d = r[3];
+    const float* d2 = r[4];
+    int32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= w; i += 8) {
+        const __m256 c2 = _mm256_add_ps(_mm256_loadu_ps(c + i),
+                                        _mm256_loadu_ps(c + i));
+        const __m256 l = _mm256_loadu_ps(c + i - 1);
+        const __m256 rr = _mm256_loadu_ps(c + i + 1);
+        const __m256 t = _mm256_loadu_ps(u + i);
+        const __m256 b = _mm256_loadu_ps(d + i);
+        const __m256 lap_h =
+          _mm256_sub_ps(c2,
+                        _mm256_add_ps(_mm256_loadu_ps(c + i - 2),
+                                      _mm256_loadu_ps(c + i + 2)));
+        const __m256 lap_v = _mm256_sub_ps(
+          c2, _mm256_add_ps(_mm256_loadu_ps(u2 + i), _mm256_loadu_ps(d2 + i)));
+        const __m256 gh =
+          _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(l, rr), half),
+                        _mm256_mul_ps(lap_h, quarter));
+        const __m256 gv =
+          _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(t, b), half),
+                        _mm256_mul_ps(lap_v, quarter));
+        const __m256 dh =
+          _mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(l, rr)),
+                        _mm256_andnot_ps(sign, lap_h));
+        const __m256 dv =
+          _mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(t, b)),
+                        _mm256_andnot_ps(sign, lap_v));
+        __m256 v = _mm256_mul_ps(_mm256_add_ps(gh, gv), half);
+        v = _mm256_blendv_ps(v, gh, _mm256_cmp_ps(dh, dv, _CMP_LT_OQ));
+        v = _mm256_blendv_ps(v, gv, _mm256_cmp_ps(dv, dh, _CMP_LT_OQ));
+        _mm256_storeu_ps(g + i, v);
+    }
+#endif
+    for (; i < w; ++i) {
+        const float lap_h = 2.0f * c[i] - c[i - 2] - c[i + 2];
+        const float lap_v = 2.0f * c[i] - u2[i] - d2[i];
+        const float gh = 0.5f * (c[i - 1] + c[i + 1]) + 0.25f * lap_h;
+        const float gv = 0.5f * (u[i] + d[i]) + 0.25f * lap_v;
+        const float dh = fabsf(c[i - 1] - c[i + 1]) + fabsf(lap_h);
+        const float dv = fabsf(u[i] - d[i]) + fabsf(lap_v);
+        g[i] = dh < dv ? gh : dv < dh ? gv : 0.5f * (gh + gv);
+    }
+}
+
+/// Converted rows of one frame, indexed by row modulo the number of slots.
+struct row_cache
+{
+    float* data;
+    size_t stride;
+    int32_t rows[INPUT_SLOTS];
+    uint32_t nslots;
+};
+
+static float*
+row_cache_init(struct row_cache* self,
+               float* data,
+               size_t stride,
+               uint32_t nslots)
+{
+    self->data = data;
+    self->stride = stride;
+    self->nslots = nslots;
+    for (uint32_t i = 0; i < nslots; ++i)
+        self->rows[i] = -1;
+    return data + stride * nslots;
+}
+
+/// @returns The row buffer for `y`. Sets `is_hit` if it already holds `y`.
+static float*
+row_cache_slot(struct row_cache* self, int32_t y, int* is_hit)
+{
+    const uint32_t i = (uint32_t)y % self->nslots;
+    *is_hit = self->rows[i] == y;
+    self->rows[i] = y;
+    return self->data + i * self->stride + PAD;
+}
+
+struct strip_job_s
+{
+    const struct video_demosaic_s* self;
+    const struct VideoFrame* in;
+    struct VideoFrame* out;
+    uint32_t rows_per_strip;
+    size_t floats_per_strip;
+};
+
+/// Per-strip state. Lives in the stage's scratch.
+struct strip_s
+{
+    const struct strip_job_s* job;
+    struct row_cache input, green, diff;
+    float *horizontal, *vertical, *cross, *diagonal;
+    float* rgb[3];
+};
+
+static const float*
+input_row(struct strip_s* strip, int32_t y)
+{
+    const struct VideoFrame* in = strip->job->in;
+    const uint32_t w = in->shape.dims.width;
+    y = reflect(y, (int32_t)in->shape.dims.height);
+    int is_hit = 0;
+    float* row = row_cache_slot(&strip->input, y, &is_hit);
+    if (is_hit)
+        return row;
+    const size_t offset = (size_t)y * in->shape.strides.height;
+    switch (in->shape.type) {
+        case SampleType_u8:
+            convert_u8(in->data + offset, row, w);
+            break;
+        case SampleType_f32:
+            memcpy(row, (const float*)in->data + offset, w * sizeof(float));
+            break;
+        default:
+            convert_u16((const uint16_t*)in->data + offset, row, w);
+            break;
+    }
+    pad_row(row, w);
+    return row;
+}
+
+static const float*
+green_row(struct strip_s* strip, int32_t y)
+{
+    const struct video_demosaic_s* self = strip->job->self;
+    const struct VideoFrame* in = strip->job->in;
+    const uint32_t w = in->shape.dims.width;
+    y = reflect(y, (int32_t)in->shape.dims.height);
+    int is_hit = 0;
+    float* g = row_cache_slot(&strip->green, y, &is_hit);
+    if (is_hit)
+        return g;
+    const float* r[5];
+    for (int i = 0; i < 5; ++i)
+        r[i] = input_row(strip, y + i - 2);
+    estimate_green(r, g, w);
+    // Keep the measured green samples, and keep the estimates in range.
+    const float max_value = max_value_of(in->shape.type);
+    const uint8_t* row_colors = colors[self->pattern][y & 1];
+    const uint32_t green_x = row_colors[0] == Color_Green ? 0 : 1;
+    for (uint32_t x = green_x; x < w; x += 2)
+        g[x] = r[2][x];
+    for (uint32_t x = 1 - green_x; x < w; x += 2)
+        g[x] = g[x] < 0.0f ? 0.0f : g[x] > max_value ? max_value : g[x];
+    pad_row(g, w);
+    return g;
+}
+
+/// The difference between each sample and green at that sample.
+static const float*
+diff_row(struct strip_s* strip, int32_t y)
+{
+    const uint32_t w = strip->job->in->shape.dims.width;
+    y = reflect(y, (int32_t)strip->job->in->shape.dims.height);
+    int is_hit = 0;
+    float* d = row_cache_slot(&strip->diff, y, &is_hit);
+    if (is_hit)
+        return d;
+    const float* g = green_row(strip, y);
+    const float* c = input_row(strip, y);
+    for (int32_t x = -PAD; x < (int32_t)w + PAD; ++x)
+        d[x] = c[x] - g[x];
+    return d;
+}
+
+static void
+store_row(const struct strip_s* strip, uint32_t y)
+{
+    const struct VideoFrame* out = strip->job->out;
+    const uint32_t w = out->shape.dims.width;
+    const int64_t channel_stride = out->shape.strides.channels;
+    const int64_t pixel_stride = out->shape.strides.width;
+    const size_t row_offset = (size_t)y * out->shape.strides.height;
+    const float max_value = max_value_of(out->shape.type);
+
+#define STORE(T)                                                               \
+    do {                                                                       \
+        T* row = (T*)out->data + row_offset;                                   \
+        for (int k = 0; k < 3; ++k) {                                          \
+            const float* v = strip->rgb[k];                                    \
+            T* dst = row + k * channel_stride;                                 \
+            for (uint32_t x = 0; x < w; ++x) {                                 \
+                const float s = v[x] < 0.0f        ? 0.0f                      \
+                                : v[x] > max_value ? max_value                 \
+                                                   : v[x];                     \
+                dst[x * pixel_stride] = (T)(s + 0.5f);                         \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+    switch (out->shape.type) {
+        case SampleType_u8:
+            STORE(uint8_t);
+            break;
+        case SampleType_f32: {
+            float* row = (float*)out->data + row_offset;
+            for (int k = 0; k < 3; ++k)
+                for (uint32_t x = 0; x < w; ++x)
+                    row[k * channel_stride + x * pixel_stride] =
+                      strip->rgb[k][x];
+            break;
+        }
+        default:
+            STORE(uint16_t);
+            break;
+    }
+#undef STORE
+}
+
+/// Demosaics row `y` into `strip->rgb`.
+static void
+demosaic_row(struct strip_s* strip, int32_t y)
+{
+    const struct video_demosaic_s* self = strip->job->self;
+    const uint32_t w = strip->job->in->shape.dims.width;
+    const int is_edge_aware = self->method == Demosaic_EdgeAware;
+
+    // Bilinear interpolates the samples themselves. Edge-aware interpolates
+    // their difference from green, and adds green back.
+    const float* c = input_row(strip, y);
+    const float* g = 0;
+    if (is_edge_aware) {
+        const float* du = diff_row(strip, y - 1);
+        const float* dc = diff_row(strip, y);
+        const float* dd = diff_row(strip, y + 1);
+        g = green_row(strip, y);
+        interpolate(du,
+                    dc,
+                    dd,
+                    strip->horizontal,
+                    strip->vertical,
+                    strip->cross,
+                    strip->diagonal,
+                    w);
+    } else {
+        interpolate(input_row(strip, y - 1),
+                    c,
+                    input_row(strip, y + 1),
+                    strip->horizontal,
+                    strip->vertical,
+                    strip->cross,
+                    strip->diagonal,
+                    w);
+    }
+
+    const float* by_source[] = {
+        [Source_Center] = c,
+        [Source_Horizontal] = strip->horizontal,
+        [Source_Vertical] = strip->vertical,
+        [Source_Cross] = strip->cross,
+        [Source_Diagonal] = strip->diagonal,
+    };
+    for (int k = 0; k < 3; ++k) {
+        float* dst = strip->rgb[k];
+        for (uint32_t px = 0; px < 2; ++px) {
+            const uint8_t source = self->sources[y & 1][px][k];
+            const float* src = by_source[source];
+            if (!is_edge_aware || source == Source_Center) {
+                for (uint32_t x = px; x < w; x += 2)
+                    dst[x] = src[x];
+            } else if (source == Source_Cross) {
+                // Green at a red or blue sample.
+                for (uint32_t x = px; x < w; x += 2)
+                    dst[x] = g[x];
+            } else {
+                for (uint32_t x = px; x < w; x += 2)
+                    dst[x] = g[x] + src[x];
+            }
+        }
+    }
+}
+
+static size_t
+floats_per_strip(uint32_t width)
+{
+    const size_t stride = ((size_t)width + 2 * PAD + 7) & ~(size_t)7;
+    const size_t aligned_width = ((size_t)width + 7) & ~(size_t)7;
+    return stride * (INPUT_SLOTS + GREEN_SLOTS + DIFF_SLOTS) +
+           aligned_width * (4 + 3);
+}
+
+static void
+strip_job(void* ctx, size_t i)
+{
+    const struct strip_job_s* job = (const struct strip_job_s*)ctx;
+    const uint32_t w = job->in->shape.dims.width;
+    const uint32_t h = job->in->shape.dims.height;
+    const uint32_t y0 = (uint32_t)i * job->rows_per_strip;
+    const uint32_t y1 = y0 + job->rows_per_strip < h ? y0 + job->rows_per_strip
+                                                     : h;
+
+    const size_t stride = ((size_t)w + 2 * PAD + 7) & ~(size_t)7;
+    const size_t aligned_width = ((size_t)w + 7) & ~(size_t)7;
+    struct strip_s strip = { .job = job };
+    float* p = job->self->scratch.data + i * job->floats_per_strip;
+    p = row_cache_init(&strip.input, p, stride, INPUT_SLOTS);
+    p = row_cache_init(&strip.green, p, stride, GREEN_SLOTS);
+    p = row_cache_init(&strip.diff, p, stride, DIFF_SLOTS);
+    float** arrays[] = { &strip.horizontal, &strip.vertical, &strip.cross,
+                         &strip.diagonal,   strip.rgb + 0,   strip.rgb + 1,
+                         strip.rgb + 2 };
+    for (size_t k = 0; k < sizeof(arrays) / sizeof(arrays[0]); ++k) {
+        *arrays[k] = p;
+        p += aligned_width;
+    }
+
+    for (uint32_t y = y0; y < y1; ++y) {
+        demosaic_row(&strip, (int32_t)y);
+        store_row(&strip, y);
+    }
+}
+
+static int
+reserve_scratch(struct video_demosaic_s* self, size_t n)
+{
+    if (self->scratch.capacity >= n)
+        return 1;
+    free(self->scratch.data);
+    self->scratch.capacity = 0;
+    CHECK(self->scratch.data = (float*)malloc(n * sizeof(float)));
+    self->scratch.capacity = n;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+demosaic_frame(struct video_demosaic_s* self, const struct VideoFrame* in)
+{
+    // The monitor reads markers too.
+    if (frame_marker_of(in) != FrameMarker_None) {
+        frame_marker_pass_on(&self->out, in);
+        return 1;
+    }
+    ++self->stats.frame_count;
+    if (!is_supported(&in->shape)) {
+        if (!self->stats.skipped_count++)
+            LOGE("[stream %d] DEMOSAIC: Can't demosaic a %ux%u frame of "
+                 "type %d with %u channels. Skipping frames like it.",
+                 self->stream_id,
+                 in->shape.dims.width,
+                 in->shape.dims.height,
+                 (int)in->shape.type,
+                 in->shape.dims.channels);
+        return 1;
+    }
+
+    const struct ImageShape shape =
+      video_demosaic_output_shape(self, &in->shape);
+    const size_t nbytes =
+      (sizeof(*in) + shape.strides.planes * bytes_of_type(shape.type) + 7) &
+      ~(size_t)7;
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!out)
+        return 1; // Not accepting writes
+    *out = *in;
+    out->bytes_of_frame = nbytes;
+    out->shape = shape;
+
+    const uint32_t h = in->shape.dims.height;
+    uint32_t rows_per_strip =
+      (h + DEMOSAIC_MAX_STRIPS - 1) / DEMOSAIC_MAX_STRIPS;
+    if (rows_per_strip < MIN_ROWS_PER_STRIP)
+        rows_per_strip = MIN_ROWS_PER_STRIP;
+    const uint32_t nstrips = (h + rows_per_strip - 1) / rows_per_strip;
+    struct strip_job_s job = {
+        .self = self,
+        .in = in,
+        .out = out,
+        .rows_per_strip = rows_per_strip,
+        .floats_per_strip = floats_per_strip(in->shape.dims.width),
+    };
+    if (!reserve_scratch(self, nstrips * job.floats_per_strip)) {
+        channel_abort_write(&self->out);
+        goto Error;
+    }
+    worker_pool_run(self->pool, nstrips, strip_job, &job);
+    channel_write_unmap(&self->out);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+demosaic_available(struct video_demosaic_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it))) {
+            if (!demosaic_frame(self, frame)) {
+                channel_read_unmap(self->in, &self->reader, nbytes);
+                goto Error;
+            }
+        }
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+video_demosaic_thread(struct video_demosaic_s* self)
+{
+    int ecode = 0;
+    LOG("[stream %d] DEMOSAIC: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        CHECK(demosaic_available(self));
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] DEMOSAIC: Flushing", self->stream_id);
+    CHECK(demosaic_available(self));
+Finalize:
+    LOG("[stream %d] DEMOSAIC: Exiting thread (%llu frames, %llu skipped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.skipped_count);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("[stream %d] DEMOSAIC: Error", self->stream_id);
+    // Don't hold back the other readers of the input channel.
+    channel_reader_detach(self->in, &self->reader);
+    ecode = 1;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_demosaic_init(struct video_demosaic_s* self,
+                    uint8_t stream_id,
+                    size_t channel_capacity_bytes,
+                    struct channel* in,
+                    struct worker_pool* pool)
+{
+    CHECK(in);
+    CHECK(pool);
+    *self = (struct video_demosaic_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_demosaic_destroy(struct video_demosaic_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    free(self->scratch.data);
+    self->scratch.data = 0;
+    self->scratch.capacity = 0;
+}
+
+enum DeviceStatusCode
+video_demosaic_configure(struct video_demosaic_s* self,
+                         enum demosaic_method method,
+                         enum bayer_pattern pattern,
+                         enum color_layout layout)
+{
+    EXPECT(method < Demosaic_Count, "Unknown demosaic method %d.", method);
+    EXPECT(pattern < BayerPattern_Count, "Unknown Bayer pattern %d.", pattern);
+    EXPECT(layout < ColorLayout_Count, "Unknown color layout %d.", layout);
+    self->method = method;
+    self->pattern = pattern;
+    self->layout = layout;
+    for (int py = 0; py < 2; ++py) {
+        for (int px = 0; px < 2; ++px) {
+            const uint8_t site = colors[pattern][py][px];
+            for (int k = 0; k < 3; ++k) {
+                uint8_t source = Source_Center;
+                if (k == site)
+                    ; // The sample itself.
+                else if (site == Color_Green)
+                    source = k == colors[pattern][py][px ^ 1]
+                               ? Source_Horizontal
+                               : Source_Vertical;
+                else
+                    source =
+                      k == Color_Green ? Source_Cross : Source_Diagonal;
+                self->sources[py][px][k] = source;
+            }
+        }
+    }
+    if (method == Demosaic_None) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the demosaic queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->method = Demosaic_None;
+    return Device_Err;
+}
+
+uint8_t
+video_demosaic_is_enabled(const struct video_demosaic_s* self)
+{
+    return self->method != Demosaic_None;
+}
+
+void
+video_demosaic_set_input(struct video_demosaic_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_demosaic_start(struct video_demosaic_s* self)
+{
+    EXPECT(video_demosaic_is_enabled(self),
+           "Expected demosaicing to be configured for stream %d.",
+           self->stream_id);
+    // Only demosaic frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_demosaic_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_demosaic_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+struct ImageShape
+video_demosaic_output_shape(const struct video_demosaic_s* self,
+                            const struct ImageShape* in)
+{
+    if (!video_demosaic_is_enabled(self) || !is_supported(in))
+        return *in;
+    const uint32_t w = in->dims.width, h = in->dims.height;
+    const int64_t npx = (int64_t)w * h;
+    struct ImageShape out = {
+        .dims = { .channels = 3, .width = w, .height = h, .planes = 1 },
+        .type = in->type,
+    };
+    if (self->layout == ColorLayout_Planar)
+        out.strides = (struct image_strides_s){
+            .channels = npx,
+            .width = 1,
+            .height = w,
+            .planes = 3 * npx,
+        };
+    else
+        out.strides = (struct image_strides_s){
+            .channels = 1,
+            .width = 3,
+            .height = 3 * (int64_t)w,
+            .planes = 3 * npx,
+        };
+    return out;
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Fills a `w` by `h` mosaic sampled from a smooth color gradient and checks
+/// demosaicing recovers the gradient.
+static int
+check_gradient(enum demosaic_method method,
+               enum bayer_pattern pattern,
+               enum color_layout layout)
+{
+    const uint32_t w = 40, h = 37;
+    struct worker_pool pool = { 0 };
+    struct video_demosaic_s self = { 0 };
+    struct VideoFrame* in = 0;
+    struct VideoFrame* out = 0;
+    CHECK(worker_pool_init(&pool, 2));
+    self.pool = &pool;
+    self.out_capacity_bytes = 1 << 12;
+    CHECK(video_demosaic_configure(&self, method, pattern, layout) ==
+          Device_Ok);
+
+    CHECK(in = (struct VideoFrame*)malloc(sizeof(*in) +
+                                          (size_t)w * h * sizeof(uint16_t)));
+    in->shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = w, .height = h, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = w,
+                     .planes = (int64_t)w * h },
+        .type = SampleType_u16,
+    };
+    // Each channel is a different linear ramp, which both methods
+    // reproduce exactly away from the edges.
+    for (uint32_t y = 0; y < h; ++y) {
+        for (uint32_t x = 0; x < w; ++x) {
+            const float rgb[3] = { 1000.0f + 10.0f * x + 5.0f * y,
+                                   2000.0f + 4.0f * x + 8.0f * y,
+                                   3000.0f + 6.0f * x - 2.0f * y };
+            const int k = colors[pattern][y & 1][x & 1];
+            ((uint16_t*)in->data)[y * w + x] = (uint16_t)rgb[k];
+        }
+    }
+
+    const struct ImageShape shape =
+      video_demosaic_output_shape(&self, &in->shape);
+    CHECK(shape.dims.channels == 3);
+    CHECK(shape.strides.planes == 3 * (int64_t)w * h);
+    CHECK(out = (struct VideoFrame*)calloc(
+            1, sizeof(*out) + shape.strides.planes * sizeof(uint16_t)));
+    out->shape = shape;
+
+    const uint32_t rows_per_strip = 16;
+    const uint32_t nstrips = (h + rows_per_strip - 1) / rows_per_strip;
+    struct strip_job_s job = {
+        .self = &self,
+        .in = in,
+        .out = out,
+        .rows_per_strip = rows_per_strip,
+        .floats_per_strip = floats_per_strip(w),
+    };
+    CHECK(reserve_scratch(&self, nstrips * job.floats_per_strip));
+    worker_pool_run(&pool, nstrips, strip_job, &job);
+
+    // Edge-aware reaches 3 samples out, past the mirrored edges.
+    for (uint32_t y = 3; y < h - 3; ++y) {
+        for (uint32_t x = 3; x < w - 3; ++x) {
+            const float rgb[3] = { 1000.0f + 10.0f * x + 5.0f * y,
+                                   2000.0f + 4.0f * x + 8.0f * y,
+                                   3000.0f + 6.0f * x - 2.0f * y };
+            for (int k = 0; k < 3; ++k) {
+                const uint16_t v =
+                  ((uint16_t*)out->data)[k * shape.strides.channels +
+                                         x * shape.strides.width +
+                                         y * shape.strides.height];
+                EXPECT(fabsf((float)v - rgb[k]) <= 1.0f,
+                       "Method %d, pattern %d, layout %d: (%u,%u) channel "
+                       "%d: expected %f. Got %u.",
+                       (int)method,
+                       (int)pattern,
+                       (int)layout,
+                       x,
+                       y,
+                       k,
+                       rgb[k],
+                       v);
+            }
+        }
+    }
+
+    free(in);
+    free(out);
+    video_demosaic_destroy(&self);
+    worker_pool_destroy(&pool);
+    return 1;
+Error:
+    free(in);
+    free(out);
+    video_demosaic_destroy(&self);
+    worker_pool_destroy(&pool);
+    return 0;
+}
+
+int
+unit_test__demosaic_recovers_gradients()
+{
+    for (int method = Demosaic_Bilinear; method < Demosaic_Count; ++method) {
+        for (int pattern = 0; pattern < BayerPattern_Count; ++pattern)
+            CHECK(check_gradient((enum demosaic_method)method,
+                                 (enum bayer_pattern)pattern,
+                                 ColorLayout_Interleaved));
+        CHECK(check_gradient((enum demosaic_method)method,
+                             BayerPattern_GRBG,
+                             ColorLayout_Planar));
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,155 @@
+//!
+//! # Demosaicing
+//!
+//! Reconstructs color frames from the raw Bayer mosaics of color cameras,
+//! for the monitor. Storage keeps the raw mosaic. The demosaic thread reads
+//! the channel the monitor would otherwise read and writes color frames to a
+//! channel of its own.
+//!
+//! - `Demosaic_Bilinear` averages the nearest samples of each missing color.
+//! - `Demosaic_EdgeAware` interpolates green along the direction with the
+//!   smaller gradient, corrected by the curvature of the center color, and
+//!   then interpolates the red and blue differences from green. This keeps
+//!   edges from picking up colored fringes.
+//!
+//! Frames are split into strips of rows that are demosaiced in parallel on
+//! the worker pool. Each strip converts the rows it needs to float, mirrored
+//! at the edges of the frame, and reuses them across the rows it writes.
+//!
+//! Output frames keep the sample type of the input and have 3 channels, red,
+//! green and blue, either interleaved per pixel or as one plane per channel.
+//! Unsigned integer (8 to 16-bit) and f32 frames are supported. Other frames,
+//! and frames narrower or shorter than 3 pixels, are skipped and counted.
+//!
+
+#ifndef H_ACQUIRE_DEMOSAIC_V0
+#define H_ACQUIRE_DEMOSAIC_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+/// Upper bound on the number of strips a frame's rows are split into.
+#define DEMOSAIC_MAX_STRIPS (64)
+
+    enum demosaic_method
+    {
+        Demosaic_None = 0,
+        Demosaic_Bilinear,
+        Demosaic_EdgeAware,
+        Demosaic_Count,
+    };
+
+    /// The colors of the top left 2x2 block of the mosaic, in raster order.
+    enum bayer_pattern
+    {
+        BayerPattern_RGGB = 0,
+        BayerPattern_BGGR,
+        BayerPattern_GRBG,
+        BayerPattern_GBRG,
+        BayerPattern_Count,
+    };
+
+    enum color_layout
+    {
+        /// `rgbrgb...`. The channel stride is 1.
+        ColorLayout_Interleaved = 0,
+        /// A plane of red, then green, then blue. The channel stride is a
+        /// plane.
+        ColorLayout_Planar,
+        ColorLayout_Count,
+    };
+
+    /// Context for the demosaic thread
+    struct video_demosaic_s
+    {
+        enum demosaic_method method;
+        enum bayer_pattern pattern;
+        enum color_layout layout;
+
+        /// Where each output channel of a pixel comes from. Indexed by row
+        /// parity, column parity and channel. Computed from `pattern`.
+        uint8_t sources[2][2][3];
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Color frames. Allocated the first time demosaicing is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// Row buffers for each strip. Sized for `scratch.width`.
+        struct
+        {
+            float* data;
+            size_t capacity;
+            uint32_t width;
+        } scratch;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the demosaic thread. Reset on start.
+        struct video_demosaic_stats_s
+        {
+            uint64_t frame_count;
+            /// Frames that couldn't be demosaiced.
+            uint64_t skipped_count;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_demosaic_init(struct video_demosaic_s* self,
+                                              uint8_t stream_id,
+                                              size_t channel_capacity_bytes,
+                                              struct channel* in,
+                                              struct worker_pool* pool);
+
+    void video_demosaic_destroy(struct video_demosaic_s* self);
+
+    /// @param[in] method `Demosaic_None` disables demosaicing.
+    enum DeviceStatusCode video_demosaic_configure(
+      struct video_demosaic_s* self,
+      enum demosaic_method method,
+      enum bayer_pattern pattern,
+      enum color_layout layout);
+
+    uint8_t video_demosaic_is_enabled(const struct video_demosaic_s* self);
+
+    /// @brief Selects the channel the stage reads from.
+    /// @see video_encoder_set_input()
+    void video_demosaic_set_input(struct video_demosaic_s* self,
+                                  struct channel* in);
+
+    enum DeviceStatusCode video_demosaic_start(struct video_demosaic_s* self);
+
+    /// @returns The shape of the color frames made from mosaics of shape
+    ///          `in`.
+    struct ImageShape video_demosaic_output_shape(
+      const struct video_demosaic_s* self,
+      const struct ImageShape* in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_DEMOSAIC_V0
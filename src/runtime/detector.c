@@ -0,0 +1,462 @@
+#include "detector.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Tiles are loaded with this many pixels of their neighbors on each side,
+/// enough for both the local maximum test and the centroid window.
+#define HALO (DETECTOR_CENTROID_RADIUS > 1 ? DETECTOR_CENTROID_RADIUS : 1)
+#define SPAN (DETECTOR_TILE + 2 * HALO)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+static uint32_t
+tiles_along(uint32_t n)
+{
+    return (n + DETECTOR_TILE - 1) / DETECTOR_TILE;
+}
+
+#define LOAD_ROW(T)                                                            \
+    for (int64_t x = x0; x < x1; ++x)                                          \
+        dst[x - x0] = (float)((const T*)frame->data)[x * sx + y * sy];
+
+/// Converts pixels `[x0,x1)` of row `y` to float.
+static void
+load_row(const struct VideoFrame* frame,
+         int64_t y,
+         int64_t x0,
+         int64_t x1,
+         float* dst)
+{
+    const int64_t sx = frame->shape.strides.width;
+    const int64_t sy = frame->shape.strides.height;
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            LOAD_ROW(uint8_t);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            LOAD_ROW(uint16_t);
+            break;
+        case SampleType_i8:
+            LOAD_ROW(int8_t);
+            break;
+        case SampleType_i16:
+            LOAD_ROW(int16_t);
+            break;
+        case SampleType_f32:
+            LOAD_ROW(float);
+            break;
+        default:
+            for (int64_t x = x0; x < x1; ++x)
+                dst[x - x0] = -FLT_MAX;
+    }
+}
+
+#undef LOAD_ROW
+
+uint32_t
+detect_spots_in_tile(const struct VideoFrame* frame,
+                     uint32_t tx,
+                     uint32_t ty,
+                     float threshold,
+                     struct spot* spots)
+{
+    const int64_t w = frame->shape.dims.width;
+    const int64_t h = frame->shape.dims.height;
+    const int64_t x0 = (int64_t)tx * DETECTOR_TILE;
+    const int64_t y0 = (int64_t)ty * DETECTOR_TILE;
+    const int64_t x1 = x0 + DETECTOR_TILE < w ? x0 + DETECTOR_TILE : w;
+    const int64_t y1 = y0 + DETECTOR_TILE < h ? y0 + DETECTOR_TILE : h;
+    if (x0 >= x1 || y0 >= y1)
+        return 0;
+
+    // The tile and its halo. Pixels outside the frame are -FLT_MAX, so they
+    // are never a maximum and contribute nothing to a centroid.
+    float px[SPAN][SPAN];
+    for (int64_t j = 0; j < SPAN; ++j) {
+        const int64_t y = y0 - HALO + j;
+        const int64_t xa = x0 - HALO < 0 ? 0 : x0 - HALO;
+        const int64_t xb = x1 + HALO < w ? x1 + HALO : w;
+        for (int i = 0; i < SPAN; ++i)
+            px[j][i] = -FLT_MAX;
+        if (y >= 0 && y < h)
+            load_row(frame, y, xa, xb, px[j] + (xa - (x0 - HALO)));
+    }
+
+    double total = 0.0;
+    for (int64_t j = HALO; j < HALO + y1 - y0; ++j)
+        for (int64_t i = HALO; i < HALO + x1 - x0; ++i)
+            total += px[j][i];
+    const float background = (float)(total / (double)((x1 - x0) * (y1 - y0)));
+    const float level = background + threshold;
+
+    uint32_t count = 0;
+    for (int64_t j = HALO; j < HALO + y1 - y0; ++j) {
+        for (int64_t i = HALO; i < HALO + x1 - x0; ++i) {
+            const float v = px[j][i];
+            if (v <= level)
+                continue;
+            // Ties go to the first pixel in raster order.
+            if (!(v > px[j - 1][i - 1] && v > px[j - 1][i] &&
+                  v > px[j - 1][i + 1] && v > px[j][i - 1] &&
+                  v >= px[j][i + 1] && v >= px[j + 1][i - 1] &&
+                  v >= px[j + 1][i] && v >= px[j + 1][i + 1]))
+                continue;
+            if (count++ >= DETECTOR_MAX_SPOTS_PER_TILE)
+                continue;
+
+            const int r = DETECTOR_CENTROID_RADIUS;
+            float sum = 0.0f, sx = 0.0f, sy = 0.0f;
+            for (int dy = -r; dy <= r; ++dy) {
+                for (int dx = -r; dx <= r; ++dx) {
+                    const float d = px[j + dy][i + dx] - background;
+                    if (d > 0.0f) {
+                        sum += d;
+                        sx += d * (float)dx;
+                        sy += d * (float)dy;
+                    }
+                }
+            }
+            spots[count - 1] = (struct spot){
+                .x = (float)(x0 + i - HALO) + sx / sum,
+                .y = (float)(y0 + j - HALO) + sy / sum,
+                .peak = v - background,
+                .sum = sum,
+                .background = background,
+            };
+        }
+    }
+    return count;
+}
+
+struct detect_job_s
+{
+    const struct VideoFrame* frame;
+    float threshold;
+    uint32_t tiles_x;
+    struct spot* spots;
+    uint32_t* counts;
+};
+
+static void
+detect_job(void* ctx, size_t i)
+{
+    const struct detect_job_s* job = (const struct detect_job_s*)ctx;
+    job->counts[i] =
+      detect_spots_in_tile(job->frame,
+                           (uint32_t)(i % job->tiles_x),
+                           (uint32_t)(i / job->tiles_x),
+                           job->threshold,
+                           job->spots + i * DETECTOR_MAX_SPOTS_PER_TILE);
+}
+
+static int
+reserve_scratch(struct video_detector_s* self, size_t ntiles)
+{
+    if (self->scratch.tile_capacity >= ntiles)
+        return 1;
+    free(self->scratch.spots);
+    free(self->scratch.counts);
+    self->scratch.spots = 0;
+    self->scratch.counts = 0;
+    self->scratch.tile_capacity = 0;
+    CHECK(self->scratch.spots = (struct spot*)malloc(
+            ntiles * DETECTOR_MAX_SPOTS_PER_TILE * sizeof(struct spot)));
+    CHECK(self->scratch.counts =
+            (uint32_t*)malloc(ntiles * sizeof(*self->scratch.counts)));
+    self->scratch.tile_capacity = ntiles;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+detect_frame(struct video_detector_s* self, const struct VideoFrame* frame)
+{
+    if (frame_marker_of(frame) != FrameMarker_None)
+        return 1;
+    const uint32_t tiles_x = tiles_along(frame->shape.dims.width);
+    const size_t ntiles =
+      (size_t)tiles_x * tiles_along(frame->shape.dims.height);
+    CHECK(reserve_scratch(self, ntiles));
+    struct detect_job_s job = {
+        .frame = frame,
+        .threshold = self->threshold,
+        .tiles_x = tiles_x,
+        .spots = self->scratch.spots,
+        .counts = self->scratch.counts,
+    };
+    worker_pool_run(self->pool, ntiles, detect_job, &job);
+
+    uint32_t nspots = 0, ndropped = 0;
+    for (size_t i = 0; i < ntiles; ++i) {
+        const uint32_t n = job.counts[i];
+        const uint32_t kept = n < DETECTOR_MAX_SPOTS_PER_TILE
+                                ? n
+                                : DETECTOR_MAX_SPOTS_PER_TILE;
+        nspots += kept;
+        ndropped += n - kept;
+    }
+
+    const size_t nbytes =
+      (sizeof(struct spot_list) + nspots * sizeof(struct spot) + 7) & ~7ULL;
+    struct spot_list* out =
+      (struct spot_list*)channel_write_map(&self->out, nbytes);
+    if (!out)
+        return 1; // Not accepting writes
+    *out = (struct spot_list){
+        .bytes_of_record = nbytes,
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamp_hardware = frame->timestamps.hardware,
+        .timestamp_acq_thread = frame->timestamps.acq_thread,
+        .spot_count = nspots,
+        .dropped_count = ndropped,
+    };
+    struct spot* dst = out->spots;
+    for (size_t i = 0; i < ntiles; ++i) {
+        const uint32_t kept = job.counts[i] < DETECTOR_MAX_SPOTS_PER_TILE
+                                ? job.counts[i]
+                                : DETECTOR_MAX_SPOTS_PER_TILE;
+        memcpy(dst, // NOLINT
+               job.spots + i * DETECTOR_MAX_SPOTS_PER_TILE,
+               kept * sizeof(*dst));
+        dst += kept;
+    }
+    channel_write_unmap(&self->out);
+
+    ++self->stats.frame_count;
+    self->stats.spot_count += nspots;
+    self->stats.dropped_count += ndropped;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+detect_available(struct video_detector_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            CHECK(detect_frame(self, frame));
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+    return 1;
+Error:
+    channel_read_unmap(self->in, &self->reader, 0);
+    return 0;
+}
+
+static int
+video_detector_thread(struct video_detector_s* self)
+{
+    int ecode = 0;
+    LOG("[stream %d] DETECTOR: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        CHECK(detect_available(self));
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] DETECTOR: Flushing", self->stream_id);
+    CHECK(detect_available(self));
+Finalize:
+    LOG("[stream %d] DETECTOR: Exiting thread (%llu frames, %llu spots)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.spot_count);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("[stream %d] DETECTOR: Error", self->stream_id);
+    // Don't hold back the other readers of the input channel.
+    channel_reader_detach(self->in, &self->reader);
+    ecode = 1;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_detector_init(struct video_detector_s* self,
+                    uint8_t stream_id,
+                    size_t channel_capacity_bytes,
+                    struct channel* in,
+                    struct worker_pool* pool)
+{
+    CHECK(in);
+    CHECK(pool);
+    *self = (struct video_detector_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_detector_destroy(struct video_detector_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    free(self->scratch.spots);
+    free(self->scratch.counts);
+    self->scratch.spots = 0;
+    self->scratch.counts = 0;
+    self->scratch.tile_capacity = 0;
+}
+
+enum DeviceStatusCode
+video_detector_configure(struct video_detector_s* self,
+                         uint8_t enable,
+                         float threshold)
+{
+    EXPECT(threshold >= 0.0f,
+           "Expected a non-negative detection threshold. Got %f.",
+           threshold);
+    self->is_enabled = enable != 0;
+    self->threshold = threshold;
+    if (!enable) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the detector queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->is_enabled = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_detector_is_enabled(const struct video_detector_s* self)
+{
+    return self->is_enabled;
+}
+
+enum DeviceStatusCode
+video_detector_start(struct video_detector_s* self)
+{
+    EXPECT(video_detector_is_enabled(self),
+           "Expected detection to be configured for stream %d.",
+           self->stream_id);
+    // Only search frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_detector_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_detector_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__detect_spots_in_tile()
+{
+    enum
+    {
+        W = 100,
+        H = 70
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[W * H];
+    } im = { 0 };
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = W,
+                     .planes = W * H },
+        .type = SampleType_u16,
+    };
+    for (int i = 0; i < W * H; ++i)
+        im.data[i] = 100;
+    // A spot whose centroid is right of (20,30).
+    im.data[30 * W + 20] = 1100;
+    im.data[30 * W + 21] = 600;
+    im.data[30 * W + 19] = 300;
+    // A spot on the edge of a tile, at (64,10).
+    im.data[10 * W + 64] = 900;
+    // Too dim.
+    im.data[50 * W + 50] = 140;
+
+    struct spot spots[DETECTOR_MAX_SPOTS_PER_TILE];
+    uint32_t n = detect_spots_in_tile(&im.frame, 0, 0, 100.0f, spots);
+    EXPECT(n == 1, "Expected 1 spot in the first tile. Got %u.", n);
+    // Background is the tile mean, slightly above 100.
+    CHECK(spots[0].background > 100.0f && spots[0].background < 101.0f);
+    {
+        // Weights are background subtracted, so recompute the expectation.
+        const float b = spots[0].background;
+        const float wl = 300 - b, wc = 1100 - b, wr = 600 - b;
+        const float x = 20.0f + (wr - wl) / (wl + wc + wr);
+        EXPECT(spots[0].x > x - 1e-3f && spots[0].x < x + 1e-3f,
+               "Expected x=%f. Got %f.",
+               x,
+               spots[0].x);
+        EXPECT(spots[0].y > 30.0f - 1e-3f && spots[0].y < 30.0f + 1e-3f,
+               "Expected y=30. Got %f.",
+               spots[0].y);
+    }
+
+    n = detect_spots_in_tile(&im.frame, 1, 0, 100.0f, spots);
+    EXPECT(n == 1, "Expected 1 spot in the second tile. Got %u.", n);
+    CHECK(spots[0].x > 63.9f && spots[0].x < 64.1f);
+    CHECK(spots[0].y > 9.9f && spots[0].y < 10.1f);
+
+    CHECK(0 == detect_spots_in_tile(&im.frame, 0, 1, 100.0f, spots));
+    CHECK(0 == detect_spots_in_tile(&im.frame, 2, 0, 100.0f, spots));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
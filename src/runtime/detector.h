@@ -0,0 +1,146 @@
+//!
+//! # Spot detection
+//!
+//! Finds bright, compact spots in each frame and publishes their sub-pixel
+//! centroids instead of the pixels. The detector thread reads the sink's
+//! input channel alongside the other readers. Each frame is split into tiles
+//! that are searched in parallel on the worker pool:
+//!
+//! 1. The background of a tile is estimated as the mean of its pixels.
+//! 2. Pixels more than `threshold` above the background that are the largest
+//!    in their 3x3 neighborhood are spots.
+//! 3. The position of a spot is the centroid of the background-subtracted
+//!    intensity in the window of `DETECTOR_CENTROID_RADIUS` around it.
+//!
+//! One `spot_list` record, holding every spot in a frame, is written to
+//! `out` per frame.
+//!
+
+#ifndef H_ACQUIRE_DETECTOR_V0
+#define H_ACQUIRE_DETECTOR_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define DETECTOR_TILE (64)
+#define DETECTOR_CENTROID_RADIUS (2)
+/// Spots found in a tile beyond this are counted, but not reported.
+#define DETECTOR_MAX_SPOTS_PER_TILE (256)
+
+    struct spot
+    {
+        /// Centroid in pixels. Pixel centers are at integer coordinates.
+        float x, y;
+        /// The brightest pixel, less the background.
+        float peak;
+        /// Background-subtracted intensity summed over the centroid window.
+        float sum;
+        float background;
+    };
+
+    /// The spots found in one frame.
+    struct spot_list
+    {
+        /// Size of this record, including `spots`. A multiple of 8.
+        uint64_t bytes_of_record;
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        uint32_t spot_count;
+        /// Spots that weren't reported because a tile had too many.
+        uint32_t dropped_count;
+        struct spot spots[];
+    };
+
+    /// Context for the detector thread
+    struct video_detector_s
+    {
+        /// Spots must be more than this far above the background.
+        float threshold;
+        uint8_t is_enabled;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Detected spots, as `spot_list` records. Allocated the first time
+        /// detection is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// Per-frame working memory.
+        struct
+        {
+            struct spot* spots; //< DETECTOR_MAX_SPOTS_PER_TILE per tile
+            uint32_t* counts;   //< spots found in each tile
+            size_t tile_capacity;
+        } scratch;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the detector thread. Reset on start.
+        struct video_detector_stats_s
+        {
+            uint64_t frame_count;
+            uint64_t spot_count;
+            uint64_t dropped_count;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_detector_init(struct video_detector_s* self,
+                                              uint8_t stream_id,
+                                              size_t channel_capacity_bytes,
+                                              struct channel* in,
+                                              struct worker_pool* pool);
+
+    void video_detector_destroy(struct video_detector_s* self);
+
+    /// @param[in] enable Nonzero to detect spots.
+    /// @param[in] threshold Spots must be more than this far above the
+    ///                      background. Must not be negative.
+    enum DeviceStatusCode video_detector_configure(
+      struct video_detector_s* self,
+      uint8_t enable,
+      float threshold);
+
+    uint8_t video_detector_is_enabled(const struct video_detector_s* self);
+
+    enum DeviceStatusCode video_detector_start(struct video_detector_s* self);
+
+    /// @brief Finds the spots in the tile at `(tx,ty)` of `frame`.
+    /// @param[out] spots Receives up to `DETECTOR_MAX_SPOTS_PER_TILE` spots,
+    ///                   in raster order.
+    /// @returns The number of spots found. This may be more than the number
+    ///          written to `spots`.
+    uint32_t detect_spots_in_tile(const struct VideoFrame* frame,
+                                  uint32_t tx,
+                                  uint32_t ty,
+                                  float threshold,
+                                  struct spot* spots);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_DETECTOR_V0
@@ -0,0 +1,440 @@
+#include "encoder.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "platform.h"
+#include "logger.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define DEFAULT_BYTES_PER_BLOCK (1U << 18)
+#define DEFAULT_SPARSE_MAX_DENSITY (0.1f)
+
+/// Encoding a block of pixel data is the unit of parallel work.
+struct encoder_job_s
+{
+    struct codec_params params;
+    const uint8_t* src;
+    size_t nbytes;
+    uint8_t* scratch;
+    uint8_t* dst;
+    size_t capacity;
+
+    /// Set by the worker. 0 means the block is stored verbatim.
+    size_t encoded_bytes;
+};
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+static size_t
+bytes_of_image(const struct ImageShape* const shape)
+{
+    return shape->strides.planes * bytes_of_type(shape->type);
+}
+
+/// The sparse codec compares samples as unsigned integers.
+static int
+is_sparse_supported(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u8:
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static size_t
+block_count(const struct video_encoder_s* self, size_t nbytes)
+{
+    return (nbytes + self->bytes_per_block - 1) / self->bytes_per_block;
+}
+
+static size_t
+bytes_per_job(const struct video_encoder_s* self)
+{
+    return codec_block_scratch_bytes(self->bytes_per_block) +
+           codec_block_bound(self->bytes_per_block);
+}
+
+static int
+reserve_scratch(struct video_encoder_s* self, size_t njobs)
+{
+    if (self->scratch.jobs_capacity < njobs) {
+        struct encoder_job_s* jobs = (struct encoder_job_s*)realloc(
+          self->scratch.jobs, njobs * sizeof(struct encoder_job_s));
+        EXPECT(jobs, "Failed to allocate %llu encoder jobs", njobs);
+        self->scratch.jobs = jobs;
+        self->scratch.jobs_capacity = njobs;
+    }
+    const size_t nbytes = njobs * bytes_per_job(self);
+    if (self->scratch.data_capacity < nbytes) {
+        free(self->scratch.data);
+        self->scratch.data_capacity = 0;
+        self->scratch.data = (uint8_t*)malloc(nbytes);
+        EXPECT(self->scratch.data,
+               "Failed to allocate %llu bytes for encoding",
+               nbytes);
+        self->scratch.data_capacity = nbytes;
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+static void
+encode_job(void* ctx, size_t i)
+{
+    struct encoder_job_s* job = (struct encoder_job_s*)ctx + i;
+    job->encoded_bytes = codec_encode_block(&job->params,
+                                            job->src,
+                                            job->nbytes,
+                                            job->scratch,
+                                            job->dst,
+                                            job->capacity);
+}
+
+/// Writes the encoded form of `frame` to the output channel.
+/// `jobs` are the blocks of `frame`.
+static int
+emit_frame(struct video_encoder_s* self,
+           const struct VideoFrame* frame,
+           const struct encoder_job_s* jobs)
+{
+    // Markers have no pixels, so they have no blocks.
+    if (frame_marker_of(frame) != FrameMarker_None) {
+        frame_marker_pass_on(&self->out, frame);
+        return 1;
+    }
+    const size_t bytes_of_raw = bytes_of_image(&frame->shape);
+    const uint32_t nblocks = (uint32_t)block_count(self, bytes_of_raw);
+
+    size_t bytes_of_payload = 0;
+    for (uint32_t i = 0; i < nblocks; ++i)
+        bytes_of_payload +=
+          jobs[i].encoded_bytes ? jobs[i].encoded_bytes : jobs[i].nbytes;
+
+    size_t nbytes = sizeof(struct VideoFrame) +
+                    sizeof(struct encoded_frame_header) +
+                    nblocks * sizeof(uint32_t) + bytes_of_payload;
+    nbytes = (nbytes + 7) & ~(size_t)7;
+    // Encoded frames are recognized by their size.
+    // See encoded_frame_header_of().
+    if (nbytes == sizeof(struct VideoFrame) + bytes_of_raw)
+        nbytes += 8;
+
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!out) {
+        // Writes are refused while aborting.
+        EXPECT(!self->out.is_accepting_writes,
+               "[stream %d] ENCODER: Encoded frame is too large for the queue "
+               "(%llu bytes).",
+               self->stream_id,
+               (unsigned long long)nbytes);
+        return 1;
+    }
+    *out = *frame;
+    out->bytes_of_frame = nbytes;
+
+    struct encoded_frame_header* header =
+      (struct encoded_frame_header*)out->data;
+    *header = (struct encoded_frame_header){
+        .magic = ENCODED_FRAME_MAGIC,
+        .codec = (uint8_t)self->params.codec,
+        .shuffle = (uint8_t)self->params.shuffle,
+        .bytes_per_sample = (uint8_t)bytes_of_type(frame->shape.type),
+        .bytes_per_block = self->bytes_per_block,
+        .block_count = nblocks,
+        .bytes_of_raw = bytes_of_raw,
+    };
+
+    uint32_t* sizes = (uint32_t*)(header + 1);
+    uint8_t* dst = (uint8_t*)(sizes + nblocks);
+    for (uint32_t i = 0; i < nblocks; ++i) {
+        if (jobs[i].encoded_bytes) {
+            sizes[i] = (uint32_t)jobs[i].encoded_bytes;
+            memcpy(dst, jobs[i].dst, jobs[i].encoded_bytes); // NOLINT
+        } else {
+            sizes[i] = (uint32_t)jobs[i].nbytes | CODEC_BLOCK_STORED;
+            memcpy(dst, jobs[i].src, jobs[i].nbytes); // NOLINT
+        }
+        dst += sizes[i] & ~CODEC_BLOCK_STORED;
+    }
+    memset(dst, 0, (uint8_t*)out + nbytes - dst); // NOLINT
+    channel_write_unmap(&self->out);
+
+    self->stats.frame_count += 1;
+    self->stats.bytes_in += bytes_of_raw;
+    self->stats.bytes_out += nbytes - sizeof(struct VideoFrame);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Encodes the frames in `[beg,end)` in parallel, then emits them in order.
+static int
+encode_batch(struct video_encoder_s* self,
+             const struct VideoFrame* beg,
+             const struct VideoFrame* end,
+             size_t njobs)
+{
+    struct clock clock = { 0 };
+    clock_init(&clock);
+
+    CHECK(reserve_scratch(self, njobs));
+    {
+        struct slice slice = { .beg = (uint8_t*)beg, .end = (uint8_t*)end };
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        struct encoder_job_s* job = self->scratch.jobs;
+        uint8_t* mem = self->scratch.data;
+        while ((frame = frame_iterator_next(&it))) {
+            struct codec_params params = self->params;
+            params.bytes_per_sample =
+              (uint8_t)bytes_of_type(frame->shape.type);
+            // Every block of an unsupported frame is stored as is.
+            if (params.codec == Codec_Sparse &&
+                !is_sparse_supported(frame->shape.type))
+                params.codec = Codec_None;
+            const size_t bytes_of_raw = bytes_of_image(&frame->shape);
+            for (size_t offset = 0; offset < bytes_of_raw;
+                 offset += self->bytes_per_block) {
+                const size_t remaining = bytes_of_raw - offset;
+                *job++ = (struct encoder_job_s){
+                    .params = params,
+                    .src = frame->data + offset,
+                    .nbytes = remaining < self->bytes_per_block
+                                ? remaining
+                                : self->bytes_per_block,
+                    .scratch = mem,
+                    .dst = mem + codec_block_scratch_bytes(
+                                   self->bytes_per_block),
+                    .capacity = codec_block_bound(self->bytes_per_block),
+                };
+                mem += bytes_per_job(self);
+            }
+        }
+        CHECK((size_t)(job - self->scratch.jobs) == njobs);
+    }
+
+    worker_pool_run(self->pool, njobs, encode_job, self->scratch.jobs);
+
+    {
+        struct slice slice = { .beg = (uint8_t*)beg, .end = (uint8_t*)end };
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        const struct encoder_job_s* jobs = self->scratch.jobs;
+        while ((frame = frame_iterator_next(&it))) {
+            CHECK(emit_frame(self, frame, jobs));
+            jobs += block_count(self, bytes_of_image(&frame->shape));
+        }
+    }
+    self->stats.busy_ms += clock_toc_ms(&clock);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+encode_available(struct video_encoder_s* self)
+{
+    // Bound the scratch memory by the number of blocks in flight.
+    const size_t max_jobs = 2 * (size_t)worker_pool_concurrency(self->pool);
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* batch = (const struct VideoFrame*)slice.beg;
+        const struct VideoFrame* frame = 0;
+        size_t nframes = 0, njobs = 0;
+        while ((frame = frame_iterator_next(&it))) {
+            const size_t n = block_count(self, bytes_of_image(&frame->shape));
+            if (nframes && njobs + n > max_jobs) {
+                CHECK(encode_batch(self, batch, frame, njobs));
+                batch = frame;
+                nframes = njobs = 0;
+            }
+            ++nframes;
+            njobs += n;
+        }
+        if (nframes)
+            CHECK(encode_batch(
+              self, batch, (const struct VideoFrame*)slice.end, njobs));
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+    return 1;
+Error:
+    channel_read_unmap(self->in, &self->reader, 0);
+    return 0;
+}
+
+static int
+video_encoder_thread(struct video_encoder_s* self)
+{
+    int ecode = 0;
+    LOG("[stream %d] ENCODER: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        CHECK(encode_available(self));
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] ENCODER: Flushing", self->stream_id);
+    CHECK(encode_available(self));
+Finalize:
+    LOG("[stream %d] ENCODER: Exiting thread (%llu frames, ratio %f)",
+        self->stream_id,
+        self->stats.frame_count,
+        self->stats.bytes_out
+          ? (double)self->stats.bytes_in / (double)self->stats.bytes_out
+          : 0.0);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("[stream %d] ENCODER: Error", self->stream_id);
+    // Don't hold back the other readers of the input channel.
+    channel_reader_detach(self->in, &self->reader);
+    ecode = 1;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_encoder_init(struct video_encoder_s* self,
+                   uint8_t stream_id,
+                   size_t channel_capacity_bytes,
+                   struct channel* in,
+                   struct worker_pool* pool,
+                   void (*sig_stop_sink)(const struct video_encoder_s*))
+{
+    CHECK(in);
+    CHECK(sig_stop_sink);
+    *self = (struct video_encoder_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+        .sig_stop_sink = sig_stop_sink,
+        .bytes_per_block = DEFAULT_BYTES_PER_BLOCK,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_encoder_destroy(struct video_encoder_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    free(self->scratch.jobs);
+    free(self->scratch.data);
+    self->scratch.jobs = 0;
+    self->scratch.data = 0;
+    self->scratch.jobs_capacity = self->scratch.data_capacity = 0;
+}
+
+enum DeviceStatusCode
+video_encoder_configure(struct video_encoder_s* self,
+                        enum codec_id codec,
+                        enum shuffle_kind shuffle,
+                        uint32_t bytes_per_block,
+                        uint32_t sparse_threshold,
+                        float sparse_max_density)
+{
+    EXPECT(codec < Codec_Count, "Unknown codec: %d", (int)codec);
+    EXPECT(shuffle < Shuffle_Count, "Unknown shuffle: %d", (int)shuffle);
+    EXPECT(sparse_max_density >= 0.0f && sparse_max_density <= 1.0f,
+           "Expected a density in [0,1]. Got %f.",
+           sparse_max_density);
+    self->params = (struct codec_params){
+        .codec = codec,
+        .shuffle = shuffle,
+        .sparse_threshold = sparse_threshold,
+        .sparse_max_density = sparse_max_density > 0.0f
+                                ? sparse_max_density
+                                : DEFAULT_SPARSE_MAX_DENSITY,
+    };
+
+    // Keep blocks a multiple of 8 samples for the bit shuffle.
+    bytes_per_block &= ~63U;
+    self->bytes_per_block =
+      bytes_per_block ? bytes_per_block : DEFAULT_BYTES_PER_BLOCK;
+
+    if (codec == Codec_None) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the encoder queue.",
+            self->stream_id,
+            self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+uint8_t
+video_encoder_is_enabled(const struct video_encoder_s* self)
+{
+    return self->params.codec != Codec_None;
+}
+
+void
+video_encoder_set_input(struct video_encoder_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_encoder_start(struct video_encoder_s* self)
+{
+    EXPECT(video_encoder_is_enabled(self),
+           "Expected an encoder to be configured for stream %d.",
+           self->stream_id);
+    // Only encode frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_encoder_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_encoder_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
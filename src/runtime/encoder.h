@@ -0,0 +1,111 @@
+#ifndef H_ACQUIRE_ENCODER_V0
+#define H_ACQUIRE_ENCODER_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "codec.h"
+#include "worker_pool.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Context for video encoder threads
+    ///
+    /// The encoder sits on the storage path. It reads frames from the sink's
+    /// input channel alongside any other reader (e.g. the monitor), encodes
+    /// them on the worker pool, and writes the encoded frames, in order, to
+    /// `out` for the sink thread to consume. Other readers of the sink's
+    /// input channel continue to see raw frames.
+    struct video_encoder_s
+    {
+        struct codec_params params;
+        uint32_t bytes_per_block;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Encoded frames. Allocated the first time encoding is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Called when the encoder thread exits, after the last frame has
+        /// been written to `out`.
+        void (*sig_stop_sink)(const struct video_encoder_s*);
+
+        /// Per-batch working memory.
+        struct
+        {
+            struct encoder_job_s* jobs;
+            size_t jobs_capacity;
+            uint8_t* data;
+            size_t data_capacity;
+        } scratch;
+
+        /// Written by the encoder thread. Reset on start.
+        struct video_encoder_stats_s
+        {
+            uint64_t frame_count;
+            uint64_t bytes_in;
+            uint64_t bytes_out;
+            double busy_ms;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_encoder_init(
+      struct video_encoder_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      struct channel* in,
+      struct worker_pool* pool,
+      void (*sig_stop_sink)(const struct video_encoder_s*));
+
+    void video_encoder_destroy(struct video_encoder_s* self);
+
+    /// @brief Selects the codec used for the storage path.
+    /// @param[in] bytes_per_block Encoded blocks are at most this large.
+    ///                            Use 0 for a default.
+    /// @param[in] sparse_threshold,sparse_max_density Used by
+    ///            `Codec_Sparse`. See `codec_params`. Use 0 for a default
+    ///            density.
+    /// Setting `codec` to `Codec_None` disables the encoder. Frames then go
+    /// straight from the sink's input channel to storage.
+    enum DeviceStatusCode video_encoder_configure(struct video_encoder_s* self,
+                                                  enum codec_id codec,
+                                                  enum shuffle_kind shuffle,
+                                                  uint32_t bytes_per_block,
+                                                  uint32_t sparse_threshold,
+                                                  float sparse_max_density);
+
+    uint8_t video_encoder_is_enabled(const struct video_encoder_s* self);
+
+    /// @brief Selects the channel the encoder reads from.
+    ///
+    /// The encoder's reader is detached from the previous channel so it no
+    /// longer holds back that channel's writer.
+    void video_encoder_set_input(struct video_encoder_s* self,
+                                 struct channel* in);
+
+    enum DeviceStatusCode video_encoder_start(struct video_encoder_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_ENCODER_V0
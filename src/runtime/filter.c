@@ -2,9 +2,13 @@
 #include "frame_iterator.h"
 #include "platform.h"
 #include "logger.h"
+#include "marker.h"
+#include "median.h"
 #include "vfslice.h"
 #include "throttler.h"
+#include "welford.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
@@ -48,6 +52,32 @@ assert_consistent_shape(const struct VideoFrame* acc,
     return (res0 == 0) && (res1 == 0);
 }
 
+/// The shape of the frame a window of frames of shape `in` is reduced to.
+static struct ImageShape
+reduced_shape(enum frame_reduction reduction, const struct ImageShape* in)
+{
+    struct ImageShape shape = *in;
+    shape.type = SampleType_f32;
+    if (reduction == FrameReduction_MeanVariance) {
+        // The variance image is stacked below the mean image.
+        shape.dims.height *= 2;
+        shape.strides.planes *= 2;
+    }
+    return shape;
+}
+
+static int
+is_consistent_accumulator(enum frame_reduction reduction,
+                          const struct VideoFrame* acc,
+                          const struct VideoFrame* in)
+{
+    const struct ImageShape shape = reduced_shape(reduction, &in->shape);
+    int res0 = memcmp(&acc->shape.dims, &shape.dims, sizeof(shape.dims));
+    int res1 =
+      memcmp(&acc->shape.strides, &shape.strides, sizeof(shape.strides));
+    return (res0 == 0) && (res1 == 0);
+}
+
 static int
 accumulate(struct VideoFrame* acc, const struct VideoFrame* in)
 {
@@ -100,19 +130,251 @@ normalize(struct VideoFrame* acc, float inverse_norm)
         x[i] *= inverse_norm;
 }
 
+/// Adds `in` to the accumulator, which then holds `n` frames.
+static int
+accumulate_frame(struct video_filter_s* self,
+                 struct VideoFrame* acc,
+                 const struct VideoFrame* in,
+                 uint64_t n)
+{
+    if (self->reduction == FrameReduction_MeanVariance) {
+        const size_t npx = in->shape.strides.planes;
+        float* const mean = (float*)acc->data;
+        return welford_update(mean, mean + npx, npx, in, (uint32_t)n);
+    }
+    // The accumulator is mapped from the output channel, which may hold
+    // stale data.
+    if (n == 1)
+        memset(acc->data, 0, bytes_of_image(&acc->shape)); // NOLINT
+    return accumulate(acc, in);
+}
+
+/// Completes the accumulator for a window of `n` frames.
+static void
+finalize_accumulator(struct video_filter_s* self,
+                     struct VideoFrame* acc,
+                     uint64_t n)
+{
+    if (self->reduction == FrameReduction_MeanVariance) {
+        const size_t npx = acc->shape.strides.planes / 2;
+        welford_finalize((float*)acc->data + npx, npx, (uint32_t)n);
+        return;
+    }
+    normalize(acc, n ? 1.0f / n : 1.0f);
+}
+
+static void
+pass_through(struct video_filter_s* self, const struct VideoFrame* in)
+{
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(self->out, in->bytes_of_frame);
+    if (out) {
+        memcpy(out, in, in->bytes_of_frame); // NOLINT
+        channel_write_unmap(self->out);
+    }
+}
+
+/// Frames collected for the next median.
+struct median_window_s
+{
+    const struct VideoFrame* frames[MEDIAN_MAX_WINDOW];
+    unsigned n;
+    /// Number of `frames` held in the filter's pending buffer.
+    unsigned npending;
+    /// The first of `frames` in the current read from the input channel.
+    const uint8_t* first_in_slice;
+};
+
+struct median_job_s
+{
+    const uint8_t* srcs[MEDIAN_MAX_WINDOW];
+    unsigned k;
+    enum SampleType type;
+    size_t npx;
+    size_t pixels_per_job;
+    uint8_t* dst;
+    int is_ok;
+};
+
+static void
+median_job(void* ctx, size_t i)
+{
+    struct median_job_s* job = (struct median_job_s*)ctx;
+    const size_t beg = i * job->pixels_per_job;
+    const size_t end = beg + job->pixels_per_job < job->npx
+                         ? beg + job->pixels_per_job
+                         : job->npx;
+    if (!temporal_median(job->srcs, job->k, job->type, beg, end, job->dst))
+        job->is_ok = 0;
+}
+
+/// Starts the window with the frames left over from the last read.
+static void
+median_window_init(struct video_filter_s* self, struct median_window_s* w)
+{
+    *w = (struct median_window_s){ 0 };
+    struct slice slice = { .beg = self->pending.data,
+                           .end = self->pending.data + self->pending.nbytes };
+    struct frame_iterator it = frame_iterator_init(&slice);
+    const struct VideoFrame* frame = 0;
+    while ((frame = frame_iterator_next(&it)) && w->n < MEDIAN_MAX_WINDOW)
+        w->frames[w->n++] = frame;
+    w->npending = w->n;
+}
+
+static void
+median_window_clear(struct video_filter_s* self, struct median_window_s* w)
+{
+    *w = (struct median_window_s){ 0 };
+    self->pending.nbytes = 0;
+}
+
+/// Copies the frames in `[beg,end)` to the end of the pending buffer.
+static int
+hold_pending(struct video_filter_s* self,
+             const uint8_t* beg,
+             const uint8_t* end)
+{
+    const size_t nbytes = self->pending.nbytes + (end - beg);
+    if (self->pending.capacity < nbytes) {
+        uint8_t* data = (uint8_t*)realloc(self->pending.data, nbytes);
+        EXPECT(data,
+               "Failed to allocate %llu bytes",
+               (unsigned long long)nbytes);
+        self->pending.data = data;
+        self->pending.capacity = nbytes;
+    }
+    memcpy(self->pending.data + self->pending.nbytes, beg, end - beg); // NOLINT
+    self->pending.nbytes = nbytes;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+emit_median(struct video_filter_s* self, const struct median_window_s* w)
+{
+    const struct VideoFrame* first = w->frames[0];
+    const size_t nbytes =
+      sizeof(struct VideoFrame) + bytes_of_image(&first->shape);
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(self->out, nbytes);
+    if (!out)
+        return 1; // Not accepting writes
+    *out = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .frame_id = first->frame_id,
+        .shape = first->shape,
+        .timestamps = first->timestamps,
+    };
+
+    struct median_job_s job = {
+        .k = w->n,
+        .type = first->shape.type,
+        .npx = first->shape.strides.planes, // assumes planes is outer dim
+        .dst = out->data,
+        .is_ok = 1,
+    };
+    for (unsigned i = 0; i < w->n; ++i)
+        job.srcs[i] = w->frames[i]->data;
+    // A few jobs per thread balances the load. Keep jobs a multiple of the
+    // vector width.
+    const size_t njobs = 4 * (size_t)worker_pool_concurrency(self->pool);
+    job.pixels_per_job = ((job.npx + njobs - 1) / njobs + 63) & ~(size_t)63;
+    worker_pool_run(self->pool,
+                    (job.npx + job.pixels_per_job - 1) / job.pixels_per_job,
+                    median_job,
+                    &job);
+    if (!job.is_ok) {
+        channel_abort_write(self->out);
+        return 0;
+    }
+    channel_write_unmap(self->out);
+    return 1;
+}
+
+static int
+push_median(struct video_filter_s* self,
+            struct median_window_s* w,
+            const struct VideoFrame* in)
+{
+    if (w->n && !assert_consistent_shape(w->frames[0], in)) {
+        LOG("FILTER: dropping median window -- shape inconsistent");
+        median_window_clear(self, w);
+    }
+    if (!w->first_in_slice)
+        w->first_in_slice = (const uint8_t*)in;
+    w->frames[w->n++] = in;
+    if (w->n >= self->filter_window_frames) {
+        CHECK(emit_median(self, w));
+        median_window_clear(self, w);
+    }
+    return 1;
+Error:
+    median_window_clear(self, w);
+    return 0;
+}
+
+/// Switches to the window size posted by `video_filter_update_live()`, if
+/// any. Called between windows.
+static void
+apply_live_updates(struct video_filter_s* self)
+{
+    if (!mailbox_take(&self->updates))
+        return;
+    self->filter_window_frames = self->next_window_frames;
+    mailbox_release(&self->updates);
+    LOG("[stream %d] FILTER: Window changed to %u frames",
+        self->stream_id,
+        self->filter_window_frames);
+}
+
 static int
 process_data(struct video_filter_s* self,
              struct VideoFrame** accumulator,
-             uint64_t* frame_count)
+             uint64_t* frame_count,
+             int is_flushing)
 {
     struct VideoFrame* in = 0;
+    struct median_window_s window = { 0 };
+    median_window_init(self, &window);
     {
-        struct slice slice = channel_read_map(&self->in, &self->reader);
+        struct slice slice = channel_read_map(self->from, &self->reader);
+        // When a read ends at the wrap point of the channel, the reader
+        // continues from the start of the channel.
+        const int is_wrapping = slice.beg != slice.end && self->reader.pos == 0;
+        size_t consumed_bytes = slice_size_bytes(&slice);
+        uint32_t iframe = 0;
         struct frame_iterator it = frame_iterator_init(&slice);
         while ((in = frame_iterator_next(&it))) {
+            const int is_revisit = iframe++ < self->revisit;
+            const enum frame_marker_kind marker = frame_marker_of(in);
+            if (marker != FrameMarker_None) {
+                // Frames are never combined across a reset or a burst.
+                LOG("FILTER: accumulator reset (%d)", *frame_count);
+                if (*accumulator) {
+                    *accumulator = 0;
+                    *frame_count = 0;
+                    channel_abort_write(self->out);
+                }
+                median_window_clear(self, &window);
+                if (marker == FrameMarker_Burst && !is_revisit)
+                    pass_through(self, in);
+                continue;
+            }
+            if (!*accumulator && !window.n && !is_revisit)
+                apply_live_updates(self);
+            if (self->filter_window_frames <= 1) {
+                pass_through(self, in);
+                continue;
+            }
+            if (self->reduction == FrameReduction_Median) {
+                CHECK(push_median(self, &window, in));
+                continue;
+            }
             if (!*accumulator) {
-                struct ImageShape shape = in->shape;
-                shape.type = SampleType_f32;
+                struct ImageShape shape =
+                  reduced_shape(self->reduction, &in->shape);
                 size_t bytes_of_accumulator =
                   bytes_of_image(&shape) + sizeof(struct VideoFrame);
                 *accumulator = (struct VideoFrame*)channel_write_map(
@@ -124,16 +386,17 @@ process_data(struct video_filter_s* self,
                         .shape = shape,
                         .timestamps = in->timestamps,
                     };
-                    CHECK(accumulate(*accumulator, in));
+                    CHECK(accumulate_frame(self, *accumulator, in, 1));
                     *frame_count = 1;
                 }
             } else {
-                if (assert_consistent_shape(*accumulator, in)) {
-                    CHECK(accumulate(*accumulator, in));
+                if (is_consistent_accumulator(
+                      self->reduction, *accumulator, in)) {
                     ++*frame_count;
+                    CHECK(
+                      accumulate_frame(self, *accumulator, in, *frame_count));
                     if (*frame_count >= self->filter_window_frames) {
-                        normalize(*accumulator,
-                                  *frame_count ? 1.0f / (*frame_count) : 1.0f);
+                        finalize_accumulator(self, *accumulator, *frame_count);
                         *frame_count = 0;
                         *accumulator = 0;
                         channel_write_unmap(self->out);
@@ -146,26 +409,31 @@ process_data(struct video_filter_s* self,
                 }
             }
         }
-        channel_read_unmap(&self->in, &self->reader, slice_size_bytes(&slice));
-    };
 
-    if (self->sig_accumulator_reset) {
-        LOG("FILTER: accumulator reset (%d)", *frame_count);
-        if (*accumulator) {
-            *accumulator = 0;
-            *frame_count = 0;
-            channel_abort_write(self->out);
+        // Keep the frames of an incomplete median window. Leave them in the
+        // channel unless the reader is about to wrap past them.
+        self->revisit = 0;
+        if (is_flushing) {
+            median_window_clear(self, &window);
+        } else if (window.first_in_slice) {
+            if (is_wrapping) {
+                CHECK(hold_pending(self, window.first_in_slice, slice.end));
+            } else {
+                consumed_bytes = window.first_in_slice - slice.beg;
+                self->revisit = window.n - window.npending;
+            }
         }
-        self->sig_accumulator_reset = 0;
-        event_notify_all(&self->accumulator_reset_event);
-    }
+        channel_read_unmap(self->from, &self->reader, consumed_bytes);
+    };
     return 1;
 Error:
-    channel_read_unmap(&self->in, &self->reader, 0);
+    channel_read_unmap(self->from, &self->reader, 0);
     // reset state
     *frame_count = 0;
     *accumulator = 0;
     channel_write_unmap(self->out);
+    median_window_clear(self, &window);
+    self->revisit = 0;
     return 0;
 }
 
@@ -179,16 +447,17 @@ video_filter_thread(struct video_filter_s* self)
         self->stream_id);
     struct throttler throttler = throttler_init(10e-3f);
     while (!self->is_stopping) {
-        CHECK(process_data(self, &accumulator, &frame_count));
+        CHECK(process_data(self, &accumulator, &frame_count, 0));
         throttler_wait(&throttler);
     }
     LOG("[stream: %d] PROCESSING: Flush", self->stream_id);
-    CHECK(process_data(self, &accumulator, &frame_count));
+    CHECK(process_data(self, &accumulator, &frame_count, 1));
 Finalize:
     if (accumulator)
         channel_write_unmap(self->out);
     LOG("[stream: %d] PROCESSING: Exiting frame processing thread",
         self->stream_id);
+    self->sig_stop_sink(self);
     self->is_running = 0;
     self->is_stopping = 0;
     return ecode;
@@ -201,13 +470,22 @@ enum DeviceStatusCode
 video_filter_init(struct video_filter_s* self,
                   uint8_t stream_id,
                   size_t channel_size_bytes,
-                  struct channel* out)
+                  struct channel* out,
+                  struct worker_pool* pool,
+                  void (*sig_stop_sink)(const struct video_filter_s*))
 {
     CHECK(out);
-    *self = (struct video_filter_s){ .stream_id = stream_id, .out = out };
+    CHECK(sig_stop_sink);
+    *self = (struct video_filter_s){
+        .stream_id = stream_id,
+        .out = out,
+        .pool = pool,
+        .sig_stop_sink = sig_stop_sink,
+    };
     channel_new(&self->in, channel_size_bytes);
-    thread_init(&self->thread);
-    event_init(&self->accumulator_reset_event);
+    self->from = &self->in;
+    parked_thread_init(&self->thread);
+    mailbox_init(&self->updates);
     return Device_Ok;
 Error:
     return Device_Err;
@@ -216,26 +494,101 @@ Error:
 void
 video_filter_destroy(struct video_filter_s* self)
 {
-    thread_join(&self->thread);
-    event_destroy(&self->accumulator_reset_event);
+    parked_thread_destroy(&self->thread);
     channel_release(&self->in);
+    free(self->pending.data);
+    self->pending.data = 0;
+    self->pending.nbytes = self->pending.capacity = 0;
 }
 
 enum DeviceStatusCode
 video_filter_configure(struct video_filter_s* self,
-                       uint32_t frame_average_count)
+                       uint32_t frame_average_count,
+                       enum frame_reduction reduction)
 {
+    EXPECT(reduction < FrameReduction_Count,
+           "Invalid frame reduction: %d",
+           (int)reduction);
+    EXPECT(reduction != FrameReduction_Median || frame_average_count <= 1 ||
+             (frame_average_count >= MEDIAN_MIN_WINDOW &&
+              frame_average_count <= MEDIAN_MAX_WINDOW),
+           "The median requires a window of %d to %d frames. Got %u.",
+           MEDIAN_MIN_WINDOW,
+           MEDIAN_MAX_WINDOW,
+           frame_average_count);
+    // Live updates that didn't make it to the filter thread are
+    // superseded. It isn't running while the stream is configured.
+    mailbox_clear(&self->updates);
     self->filter_window_frames = frame_average_count;
+    self->reduction = reduction;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_filter_update_live(struct video_filter_s* self,
+                         uint32_t frame_average_count)
+{
+    EXPECT(frame_average_count > 1,
+           "Expected a window of at least 2 frames. Got %u.",
+           frame_average_count);
+    EXPECT(self->reduction != FrameReduction_Median ||
+             (frame_average_count >= MEDIAN_MIN_WINDOW &&
+              frame_average_count <= MEDIAN_MAX_WINDOW),
+           "The median requires a window of %d to %d frames. Got %u.",
+           MEDIAN_MIN_WINDOW,
+           MEDIAN_MAX_WINDOW,
+           frame_average_count);
+    mailbox_lock(&self->updates);
+    self->next_window_frames = frame_average_count;
+    mailbox_post(&self->updates);
     return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+uint8_t
+video_filter_is_enabled(const struct video_filter_s* self)
+{
+    return self->filter_window_frames > 1;
+}
+
+void
+video_filter_set_route(struct video_filter_s* self,
+                       struct channel* from,
+                       struct channel* out)
+{
+    self->out = out;
+    if (from == self->from)
+        return;
+    channel_reader_detach(self->from, &self->reader);
+    self->from = from;
+}
+
+struct ImageShape
+video_filter_output_shape(const struct video_filter_s* self,
+                          const struct ImageShape* in)
+{
+    if (self->filter_window_frames <= 1 ||
+        self->reduction == FrameReduction_Median)
+        return *in;
+    return reduced_shape(self->reduction, in);
 }
 
 enum DeviceStatusCode
 video_filter_start(struct video_filter_s* self)
 {
+    // A shared channel already holds frames for other readers. Only filter
+    // the ones acquired from here on.
+    if (self->from != &self->in)
+        channel_reader_attach(self->from, &self->reader);
+    self->pending.nbytes = 0;
+    self->revisit = 0;
     self->is_stopping = 0;
     self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_filter_thread, self));
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_filter_thread, self));
     return Device_Ok;
 Error:
     return Device_Err;
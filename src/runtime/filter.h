@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include "channel.h"
+#include "mailbox.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
 #include "device/props/device.h"
 
 #ifdef __cplusplus
@@ -10,14 +13,66 @@ extern "C"
 {
 #endif
 
+    /// How a window of frames is reduced to one output frame.
+    enum frame_reduction
+    {
+        /// Per-pixel mean. Output frames are f32.
+        FrameReduction_Mean = 0,
+        /// Per-pixel median. Output frames keep the input sample type.
+        FrameReduction_Median,
+        /// Per-pixel mean and sample variance. Output frames are f32 and
+        /// twice as tall as the input. The mean is the top half and the
+        /// variance the bottom half.
+        FrameReduction_MeanVariance,
+        FrameReduction_Count,
+    };
+
+    /// Where the raw and the filtered frames go.
+    enum filter_routing
+    {
+        /// Filtered frames replace the raw frames.
+        FilterRouting_Inline = 0,
+        /// Raw frames go to storage and filtered frames to the monitor.
+        FilterRouting_Monitor,
+        /// Like `FilterRouting_Monitor`, and the filtered frames are also
+        /// stored on a storage device of their own.
+        FilterRouting_Split,
+        FilterRouting_Count,
+    };
+
     /// Context for video filter threads
     struct video_filter_s
     {
         uint32_t filter_window_frames;
+        enum frame_reduction reduction;
         struct channel in;
         struct channel* out;
+
+        /// The channel `reader` reads. This is `in` unless the filter is an
+        /// extra reader of the raw frames. See `video_filter_set_route()`.
+        struct channel* from;
         struct channel_reader reader;
-        int sig_accumulator_reset;
+
+        /// Median windows are reduced directly from the frames held in
+        /// `in`. Only a window that straddles the end of `in` is copied here,
+        /// so the reader can move on to the frames at the start of `in`.
+        struct
+        {
+            uint8_t* data;
+            size_t nbytes;
+            size_t capacity;
+        } pending;
+
+        /// Number of frames at the start of the next read from `in` that were
+        /// left there by an incomplete median window.
+        uint32_t revisit;
+
+        struct worker_pool* pool;
+
+        /// A window size to switch to while running. The filter thread
+        /// switches between windows. See `video_filter_update_live()`.
+        struct mailbox updates;
+        uint32_t next_window_frames;
 
         /// Used by external threads to signal the controller thread to stop
         /// Other threads may write.
@@ -27,23 +82,69 @@ extern "C"
         /// Other threads should only read.
         uint8_t is_running;
 
-        struct event accumulator_reset_event;
-        struct thread thread;
+        /// Called once the filter thread has flushed its last frame.
+        void (*sig_stop_sink)(const struct video_filter_s*);
+
+        struct parked_thread thread;
         uint8_t stream_id;
     };
 
-    enum DeviceStatusCode video_filter_init(struct video_filter_s* self,
-                                            uint8_t stream_id,
-                                            size_t channel_size_bytes,
-                                            struct channel* out);
+    enum DeviceStatusCode video_filter_init(
+      struct video_filter_s* self,
+      uint8_t stream_id,
+      size_t channel_size_bytes,
+      struct channel* out,
+      struct worker_pool* pool,
+      void (*sig_stop_sink)(const struct video_filter_s*));
 
     void video_filter_destroy(struct video_filter_s* self);
 
-    enum DeviceStatusCode video_filter_configure(struct video_filter_s* self,
-                                                 uint32_t frame_average_count);
+    /// @param[in] frame_average_count Number of frames to reduce to one.
+    ///                                Frames pass through unchanged when
+    ///                                this is 0 or 1.
+    /// @param[in] reduction How frames are combined. The median requires a
+    ///                      window of `MEDIAN_MIN_WINDOW` to
+    ///                      `MEDIAN_MAX_WINDOW` frames.
+    enum DeviceStatusCode video_filter_configure(
+      struct video_filter_s* self,
+      uint32_t frame_average_count,
+      enum frame_reduction reduction);
+
+    /// @returns nonzero if the filter changes frames, in which case the source
+    /// should route frames through the filter.
+    uint8_t video_filter_is_enabled(const struct video_filter_s* self);
+
+    /// @brief Selects the channels the filter reads from and writes to.
+    /// @param[in] from Either the filter's own `in` channel, or a channel of
+    ///                 raw frames that other readers share. The filter reads
+    ///                 the shared frames in place, so they aren't copied.
+    /// @param[in] out Receives the filtered frames.
+    ///
+    /// The filter's reader is detached from the previous channel so it no
+    /// longer holds back that channel's writer.
+    void video_filter_set_route(struct video_filter_s* self,
+                                struct channel* from,
+                                struct channel* out);
+
+    /// @returns The shape of the frames the filter emits for input frames
+    ///          of shape `in`.
+    struct ImageShape video_filter_output_shape(
+      const struct video_filter_s* self,
+      const struct ImageShape* in);
 
     enum DeviceStatusCode video_filter_start(struct video_filter_s* self);
 
+    /// @brief Changes the number of frames reduced to one while the filter
+    /// is running.
+    ///
+    /// The filter thread switches when it has finished the window it's on,
+    /// so no frame is left out of a window.
+    /// @param[in] frame_average_count At least 2, and within the bounds of
+    ///                                the median when that's the reduction.
+    enum DeviceStatusCode video_filter_update_live(
+      struct video_filter_s* self,
+      uint32_t frame_average_count);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
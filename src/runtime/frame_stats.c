@@ -0,0 +1,334 @@
+#include "frame_stats.h"
+#include "logger.h"
+#include "device/props/components.h"
+
+#include <float.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Running totals for one frame.
+///
+/// Histogram updates are spread over several sub-histograms so consecutive
+/// pixels with the same value don't serialize on one counter.
+struct accumulator
+{
+    double min, max, sum;
+    uint64_t saturated_count;
+    uint32_t hist[4][FRAME_STATS_BIN_COUNT];
+};
+
+static void
+merge_extrema(struct accumulator* acc, double mn, double mx)
+{
+    if (mn < acc->min)
+        acc->min = mn;
+    if (mx > acc->max)
+        acc->max = mx;
+}
+
+/// One histogram bin per value.
+static void
+accumulate_u8(struct accumulator* acc, const uint8_t* x, size_t n)
+{
+    uint32_t *h0 = acc->hist[0], *h1 = acc->hist[1], *h2 = acc->hist[2],
+             *h3 = acc->hist[3];
+    uint8_t mn = UINT8_MAX, mx = 0;
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i vmn = _mm256_set1_epi8(-1), vmx = zero, vsum = zero;
+        for (; i + 32 <= n; i += 32) {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(x + i));
+            vmn = _mm256_min_epu8(vmn, v);
+            vmx = _mm256_max_epu8(vmx, v);
+            vsum = _mm256_add_epi64(vsum, _mm256_sad_epu8(v, zero));
+            for (int j = 0; j < 32; j += 4) {
+                ++h0[x[i + j]];
+                ++h1[x[i + j + 1]];
+                ++h2[x[i + j + 2]];
+                ++h3[x[i + j + 3]];
+            }
+        }
+        uint8_t lanes_mn[32], lanes_mx[32];
+        uint64_t lanes_sum[4];
+        _mm256_storeu_si256((__m256i*)lanes_mn, vmn);
+        _mm256_storeu_si256((__m256i*)lanes_mx, vmx);
+        _mm256_storeu_si256((__m256i*)lanes_sum, vsum);
+        for (int j = 0; j < 32; ++j) {
+            mn = lanes_mn[j] < mn ? lanes_mn[j] : mn;
+            mx = lanes_mx[j] > mx ? lanes_mx[j] : mx;
+        }
+        sum = lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3];
+    }
+#endif
+    for (; i < n; ++i) {
+        mn = x[i] < mn ? x[i] : mn;
+        mx = x[i] > mx ? x[i] : mx;
+        sum += x[i];
+        ++acc->hist[i & 3][x[i]];
+    }
+    if (n)
+        merge_extrema(acc, mn, mx);
+    acc->sum += (double)sum;
+    // One value per bin, so the last bin holds the saturated pixels.
+    acc->saturated_count = (uint64_t)acc->hist[0][UINT8_MAX] +
+                           acc->hist[1][UINT8_MAX] + acc->hist[2][UINT8_MAX] +
+                           acc->hist[3][UINT8_MAX];
+}
+
+/// Unsigned samples of up to 16 bits. Values at or above `saturated` count
+/// as saturated. Histogram bins are `1 << shift` wide.
+static void
+accumulate_u16(struct accumulator* acc,
+               const uint16_t* x,
+               size_t n,
+               unsigned shift,
+               uint16_t saturated)
+{
+#define BIN(v) (((v) >> shift) < 0xff ? ((v) >> shift) : 0xff)
+    uint32_t *h0 = acc->hist[0], *h1 = acc->hist[1], *h2 = acc->hist[2],
+             *h3 = acc->hist[3];
+    uint16_t mn = UINT16_MAX, mx = 0;
+    uint64_t sum = 0, nsat = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i low_bytes = _mm256_set1_epi16(0x00ff);
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i vsat = _mm256_set1_epi16((short)saturated);
+        __m256i vmn = _mm256_set1_epi16(-1), vmx = zero;
+        __m256i vsum_lo = zero, vsum_hi = zero, vnsat = zero;
+        for (; i + 16 <= n; i += 16) {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(x + i));
+            vmn = _mm256_min_epu16(vmn, v);
+            vmx = _mm256_max_epu16(vmx, v);
+            // Sums the low and high bytes separately with byte-wise SADs.
+            vsum_lo = _mm256_add_epi64(
+              vsum_lo, _mm256_sad_epu8(_mm256_and_si256(v, low_bytes), zero));
+            vsum_hi = _mm256_add_epi64(
+              vsum_hi, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+            const __m256i is_sat =
+              _mm256_cmpeq_epi16(_mm256_max_epu16(v, vsat), v);
+            vnsat = _mm256_add_epi64(
+              vnsat, _mm256_sad_epu8(_mm256_and_si256(is_sat, ones), zero));
+            for (int j = 0; j < 16; j += 4) {
+                ++h0[BIN(x[i + j])];
+                ++h1[BIN(x[i + j + 1])];
+                ++h2[BIN(x[i + j + 2])];
+                ++h3[BIN(x[i + j + 3])];
+            }
+        }
+        uint16_t lanes_mn[16], lanes_mx[16];
+        uint64_t lo[4], hi[4], s[4];
+        _mm256_storeu_si256((__m256i*)lanes_mn, vmn);
+        _mm256_storeu_si256((__m256i*)lanes_mx, vmx);
+        _mm256_storeu_si256((__m256i*)lo, vsum_lo);
+        _mm256_storeu_si256((__m256i*)hi, vsum_hi);
+        _mm256_storeu_si256((__m256i*)s, vnsat);
+        for (int j = 0; j < 16; ++j) {
+            mn = lanes_mn[j] < mn ? lanes_mn[j] : mn;
+            mx = lanes_mx[j] > mx ? lanes_mx[j] : mx;
+        }
+        for (int j = 0; j < 4; ++j) {
+            sum += lo[j] + (hi[j] << 8);
+            nsat += s[j];
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        mn = x[i] < mn ? x[i] : mn;
+        mx = x[i] > mx ? x[i] : mx;
+        sum += x[i];
+        nsat += x[i] >= saturated;
+        ++acc->hist[i & 3][BIN(x[i])];
+    }
+#undef BIN
+    if (n)
+        merge_extrema(acc, mn, mx);
+    acc->sum += (double)sum;
+    acc->saturated_count += nsat;
+}
+
+static void
+accumulate_i8(struct accumulator* acc, const int8_t* x, size_t n)
+{
+    int8_t mn = INT8_MAX, mx = INT8_MIN;
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        mn = x[i] < mn ? x[i] : mn;
+        mx = x[i] > mx ? x[i] : mx;
+        sum += x[i];
+        ++acc->hist[i & 3][(uint8_t)(x[i] + 128)];
+    }
+    if (n)
+        merge_extrema(acc, mn, mx);
+    acc->sum += (double)sum;
+    acc->saturated_count = (uint64_t)acc->hist[0][UINT8_MAX] +
+                           acc->hist[1][UINT8_MAX] + acc->hist[2][UINT8_MAX] +
+                           acc->hist[3][UINT8_MAX];
+}
+
+static void
+accumulate_i16(struct accumulator* acc, const int16_t* x, size_t n)
+{
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    int64_t sum = 0;
+    uint64_t nsat = 0;
+    for (size_t i = 0; i < n; ++i) {
+        mn = x[i] < mn ? x[i] : mn;
+        mx = x[i] > mx ? x[i] : mx;
+        sum += x[i];
+        nsat += x[i] == INT16_MAX;
+        ++acc->hist[i & 3][(uint16_t)(x[i] + 32768) >> 8];
+    }
+    if (n)
+        merge_extrema(acc, mn, mx);
+    acc->sum += (double)sum;
+    acc->saturated_count += nsat;
+}
+
+static void
+accumulate_f32(struct accumulator* acc, const float* x, size_t n)
+{
+    float mn = FLT_MAX, mx = -FLT_MAX;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        mn = x[i] < mn ? x[i] : mn;
+        mx = x[i] > mx ? x[i] : mx;
+        sum += x[i];
+    }
+    if (n)
+        merge_extrema(acc, mn, mx);
+    acc->sum += sum;
+}
+
+int
+frame_stats_compute(struct frame_stats* out, const struct VideoFrame* frame)
+{
+    struct accumulator acc = { .min = DBL_MAX, .max = -DBL_MAX };
+    const size_t n = frame->shape.strides.planes; // assumes planes is outer
+    const uint8_t* const data = frame->data;
+
+    *out = (struct frame_stats){
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamp_hardware = frame->timestamps.hardware,
+        .timestamp_acq_thread = frame->timestamps.acq_thread,
+        .pixel_count = n,
+        .histogram_bin_width = 1.0,
+    };
+
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            accumulate_u8(&acc, data, n);
+            break;
+        case SampleType_u10:
+            accumulate_u16(&acc, (const uint16_t*)data, n, 2, (1 << 10) - 1);
+            out->histogram_bin_width = 1 << 2;
+            break;
+        case SampleType_u12:
+            accumulate_u16(&acc, (const uint16_t*)data, n, 4, (1 << 12) - 1);
+            out->histogram_bin_width = 1 << 4;
+            break;
+        case SampleType_u14:
+            accumulate_u16(&acc, (const uint16_t*)data, n, 6, (1 << 14) - 1);
+            out->histogram_bin_width = 1 << 6;
+            break;
+        case SampleType_u16:
+            accumulate_u16(&acc, (const uint16_t*)data, n, 8, UINT16_MAX);
+            out->histogram_bin_width = 1 << 8;
+            break;
+        case SampleType_i8:
+            accumulate_i8(&acc, (const int8_t*)data, n);
+            out->histogram_low = INT8_MIN;
+            break;
+        case SampleType_i16:
+            accumulate_i16(&acc, (const int16_t*)data, n);
+            out->histogram_low = INT16_MIN;
+            out->histogram_bin_width = 1 << 8;
+            break;
+        case SampleType_f32:
+            accumulate_f32(&acc, (const float*)data, n);
+            out->histogram_bin_width = 0.0;
+            break;
+        default:
+            EXPECT(0,
+                   "Unsupported pixel type for frame statistics: %d",
+                   (int)frame->shape.type);
+    }
+
+    if (n) {
+        out->min = acc.min;
+        out->max = acc.max;
+        out->mean = acc.sum / (double)n;
+    }
+    out->saturated_count = acc.saturated_count;
+    for (int i = 0; i < FRAME_STATS_BIN_COUNT; ++i)
+        out->histogram[i] =
+          acc.hist[0][i] + acc.hist[1][i] + acc.hist[2][i] + acc.hist[3][i];
+    return 1;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__frame_stats_u16()
+{
+    // 8 * 37 pixels so the vector path and the scalar tail are both used.
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[8 * 37];
+    } im = { 0 };
+    const size_t n = sizeof(im.data) / sizeof(im.data[0]);
+    im.frame.shape.type = SampleType_u12;
+    im.frame.shape.strides.planes = n;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        im.data[i] = (uint16_t)((i * 97) % 4096);
+        sum += im.data[i];
+    }
+    im.data[5] = 4095;
+    im.data[n - 1] = 4095;
+    sum += 2 * 4095.0 - (5 * 97) % 4096 - ((n - 1) * 97) % 4096;
+
+    struct frame_stats stats = { 0 };
+    CHECK(frame_stats_compute(&stats, &im.frame));
+    CHECK(stats.pixel_count == n);
+    CHECK(stats.min == 0.0);
+    CHECK(stats.max == 4095.0);
+    CHECK(stats.mean == sum / n);
+    CHECK(stats.saturated_count == 2);
+    CHECK(stats.histogram_bin_width == 16.0);
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < FRAME_STATS_BIN_COUNT; ++i)
+            total += stats.histogram[i];
+        CHECK(total == n);
+        CHECK(stats.histogram[255] >= 2);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
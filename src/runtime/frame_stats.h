@@ -0,0 +1,56 @@
+//!
+//! # Per-frame pixel statistics
+//!
+//! Summarizes a frame's pixel values: extrema, mean, saturated pixel count
+//! and a 256-bin histogram. The summary is a small fixed-size record, so a
+//! stream of them is cheap to publish alongside the frames.
+//!
+
+#ifndef H_ACQUIRE_FRAME_STATS_V0
+#define H_ACQUIRE_FRAME_STATS_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define FRAME_STATS_BIN_COUNT (256)
+
+    struct frame_stats
+    {
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+
+        uint64_t pixel_count;
+        /// Number of pixels at the largest value representable by the
+        /// frame's sample type. Always 0 for floating point frames.
+        uint64_t saturated_count;
+        double min, max, mean;
+
+        /// `histogram[i]` counts pixels with values in
+        /// `[histogram_low + i * histogram_bin_width,
+        ///   histogram_low + (i + 1) * histogram_bin_width)`.
+        /// The bins span the full range of the sample type. Floating point
+        /// frames have no histogram; their `histogram_bin_width` is 0.
+        double histogram_low;
+        double histogram_bin_width;
+        uint32_t histogram[FRAME_STATS_BIN_COUNT];
+    };
+
+    /// @brief Computes the statistics of `frame` in one pass over its pixels.
+    /// @returns 1 on success, or 0 if the sample type is not supported.
+    int frame_stats_compute(struct frame_stats* out,
+                            const struct VideoFrame* frame);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_FRAME_STATS_V0
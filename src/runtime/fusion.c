@@ -0,0 +1,532 @@
+#include "fusion.h"
+#include "logger.h"
+#include "marker.h"
+#include "platform.h"
+#include "simd.h"
+#include "throttler.h"
+
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static size_t
+bytes_of_image(const struct ImageShape* const shape)
+{
+    return shape->strides.planes * bytes_of_type(shape->type);
+}
+
+static struct VideoFrame*
+next_frame(const struct VideoFrame* frame, const struct slice* slice)
+{
+    const uint8_t* next = (const uint8_t*)frame + frame->bytes_of_frame;
+    return next < slice->end ? (struct VideoFrame*)next : 0;
+}
+
+//
+//  Kernels
+//
+
+#if defined(__AVX2__)
+#define RATIO_SIMD(suffix)                                                     \
+    for (const __m256 zero = _mm256_setzero_ps(); i + 8 <= n; i += 8) {        \
+        const __m256 x = load8_##suffix(a + i), y = load8_##suffix(b + i);     \
+        const __m256 is_nonzero = _mm256_cmp_ps(y, zero, _CMP_NEQ_OQ);         \
+        _mm256_storeu_ps(out + i,                                              \
+                         _mm256_and_ps(_mm256_div_ps(x, y), is_nonzero));      \
+    }
+#define DIFFERENCE_SIMD(suffix)                                                \
+    for (; i + 8 <= n; i += 8)                                                 \
+        _mm256_storeu_ps(                                                      \
+          out + i, _mm256_sub_ps(load8_##suffix(a + i), load8_##suffix(b + i)));
+#else
+#define RATIO_SIMD(suffix)
+#define DIFFERENCE_SIMD(suffix)
+#endif
+
+/// Defines `ratio_<suffix>()` and `difference_<suffix>()` for inputs of type
+/// `T`. Each is vectorized 8 pixels at a time, with a scalar tail.
+#define DEFINE_KERNELS(T, suffix)                                              \
+    static void ratio_##suffix(                                                \
+      const T* a, const T* b, float* out, size_t n)                            \
+    {                                                                          \
+        size_t i = 0;                                                          \
+        RATIO_SIMD(suffix)                                                     \
+        for (; i < n; ++i) {                                                   \
+            const float y = (float)b[i];                                       \
+            out[i] = (y != 0.0f) ? (float)a[i] / y : 0.0f;                     \
+        }                                                                      \
+    }                                                                          \
+    static void difference_##suffix(                                           \
+      const T* a, const T* b, float* out, size_t n)                            \
+    {                                                                          \
+        size_t i = 0;                                                          \
+        DIFFERENCE_SIMD(suffix)                                                \
+        for (; i < n; ++i)                                                     \
+            out[i] = (float)a[i] - (float)b[i];                                \
+    }
+
+DEFINE_KERNELS(uint8_t, u8)
+DEFINE_KERNELS(uint16_t, u16)
+DEFINE_KERNELS(int8_t, i8)
+DEFINE_KERNELS(int16_t, i16)
+DEFINE_KERNELS(float, f32)
+
+#define DISPATCH(kernel, type, a, b, out, n)                                   \
+    switch (type) {                                                            \
+        case SampleType_u8:                                                    \
+            kernel##_u8((a), (b), (out), (n));                                 \
+            break;                                                             \
+        case SampleType_u10:                                                   \
+        case SampleType_u12:                                                   \
+        case SampleType_u14:                                                   \
+        case SampleType_u16:                                                   \
+            kernel##_u16((const uint16_t*)(a), (const uint16_t*)(b), out, n);  \
+            break;                                                             \
+        case SampleType_i8:                                                    \
+            kernel##_i8((const int8_t*)(a), (const int8_t*)(b), out, n);       \
+            break;                                                             \
+        case SampleType_i16:                                                   \
+            kernel##_i16((const int16_t*)(a), (const int16_t*)(b), out, n);    \
+            break;                                                             \
+        case SampleType_f32:                                                   \
+            kernel##_f32((const float*)(a), (const float*)(b), out, n);        \
+            break;                                                             \
+        default:                                                               \
+            EXPECT(0, "Unsupported pixel type for fusion: %d", (int)(type));   \
+    }
+
+static int
+is_same_shape(const struct ImageShape* a, const struct ImageShape* b)
+{
+    return a->type == b->type &&
+           memcmp(&a->dims, &b->dims, sizeof(a->dims)) == 0 &&
+           memcmp(&a->strides, &b->strides, sizeof(a->strides)) == 0;
+}
+
+int
+fusion_shape(enum fusion_mode mode,
+             const struct ImageShape* a,
+             const struct ImageShape* b,
+             struct ImageShape* out)
+{
+    switch (mode) {
+        case FusionMode_Ratio:
+        case FusionMode_Difference:
+            CHECK(is_same_shape(a, b));
+            *out = *a;
+            out->type = SampleType_f32;
+            break;
+        case FusionMode_SideBySide: {
+            CHECK(a->type == b->type);
+            CHECK(a->dims.channels == b->dims.channels);
+            CHECK(a->dims.height == b->dims.height);
+            CHECK(a->dims.planes == b->dims.planes);
+            const uint32_t c = a->dims.channels;
+            const uint32_t w = a->dims.width + b->dims.width;
+            const uint32_t h = a->dims.height;
+            *out = (struct ImageShape){
+                .dims = { .channels = c,
+                          .width = w,
+                          .height = h,
+                          .planes = a->dims.planes },
+                .strides = { .channels = 1,
+                             .width = c,
+                             .height = (int64_t)c * w,
+                             .planes = (int64_t)c * w * h },
+                .type = a->type,
+            };
+            break;
+        }
+        default:
+            EXPECT(0, "Invalid fusion mode: %d", (int)mode);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+static void
+side_by_side(const struct VideoFrame* a,
+             const struct VideoFrame* b,
+             struct VideoFrame* out)
+{
+    const size_t bpp = bytes_of_type(out->shape.type);
+    const size_t row_a = bpp * a->shape.dims.width * a->shape.dims.channels;
+    const size_t row_b = bpp * b->shape.dims.width * b->shape.dims.channels;
+    uint8_t* dst = out->data;
+    for (uint32_t p = 0; p < out->shape.dims.planes; ++p) {
+        for (uint32_t y = 0; y < out->shape.dims.height; ++y) {
+            memcpy(dst, // NOLINT
+                   a->data + bpp * (p * a->shape.strides.planes +
+                                    y * a->shape.strides.height),
+                   row_a);
+            memcpy(dst + row_a, // NOLINT
+                   b->data + bpp * (p * b->shape.strides.planes +
+                                    y * b->shape.strides.height),
+                   row_b);
+            dst += row_a + row_b;
+        }
+    }
+}
+
+int
+fusion_apply(enum fusion_mode mode,
+             const struct VideoFrame* a,
+             const struct VideoFrame* b,
+             struct VideoFrame* out)
+{
+    // Like the filter, this assumes planes is the outer dimension.
+    const size_t n = out->shape.strides.planes;
+    float* const dst = (float*)out->data;
+    switch (mode) {
+        case FusionMode_Ratio:
+            DISPATCH(ratio, a->shape.type, a->data, b->data, dst, n);
+            break;
+        case FusionMode_Difference:
+            DISPATCH(difference, a->shape.type, a->data, b->data, dst, n);
+            break;
+        case FusionMode_SideBySide:
+            side_by_side(a, b, out);
+            break;
+        default:
+            EXPECT(0, "Invalid fusion mode: %d", (int)mode);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+//
+//  Pairing
+//
+
+/// @returns <0 if `a` precedes any frame it could pair with in the other
+///          stream, >0 if `b` does, and 0 if `a` and `b` are a pair.
+static int
+compare_frames(const struct video_fusion_s* self,
+               const struct VideoFrame* a,
+               const struct VideoFrame* b)
+{
+    if (self->pairing == FusionPairing_HardwareTimestamp) {
+        const uint64_t ta = a->timestamps.hardware, tb = b->timestamps.hardware;
+        if (ta + self->max_timestamp_delta < tb)
+            return -1;
+        if (tb + self->max_timestamp_delta < ta)
+            return 1;
+        return 0;
+    }
+    return (a->frame_id > b->frame_id) - (a->frame_id < b->frame_id);
+}
+
+static int
+emit_fused(struct video_fusion_s* self,
+           const struct VideoFrame* a,
+           const struct VideoFrame* b)
+{
+    struct ImageShape shape = { 0 };
+    if (!fusion_shape(self->mode, &a->shape, &b->shape, &shape)) {
+        LOGE("FUSION: Frames %llu and %llu can't be combined.",
+             (unsigned long long)a->frame_id,
+             (unsigned long long)b->frame_id);
+        ++self->stats.unpaired[0];
+        ++self->stats.unpaired[1];
+        return 1;
+    }
+    const size_t nbytes = sizeof(struct VideoFrame) + bytes_of_image(&shape);
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!out)
+        return 1; // Not accepting writes
+    *out = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .shape = shape,
+        .frame_id = a->frame_id,
+        .hardware_frame_id = a->hardware_frame_id,
+        .timestamps = a->timestamps,
+    };
+    if (!fusion_apply(self->mode, a, b, out)) {
+        channel_abort_write(&self->out);
+        return 0;
+    }
+    channel_write_unmap(&self->out);
+    ++self->stats.paired;
+    return 1;
+}
+
+/// Pairs the frames available on both inputs. Frames without a partner yet
+/// are left on their channel, so they are read again next time. When
+/// `is_flushing`, they are dropped instead.
+static int
+fuse_available(struct video_fusion_s* self, int is_flushing)
+{
+    size_t consumed[2] = { 0 };
+    struct slice slices[2] = { 0 };
+    do {
+        for (int i = 0; i < 2; ++i)
+            slices[i] = channel_read_map(self->in[i], self->readers + i);
+        struct VideoFrame* a = slices[0].beg != slices[0].end
+                                 ? (struct VideoFrame*)slices[0].beg
+                                 : 0;
+        struct VideoFrame* b = slices[1].beg != slices[1].end
+                                 ? (struct VideoFrame*)slices[1].beg
+                                 : 0;
+        while (a && b) {
+            // Markers aren't paired. The first stream's are passed on.
+            if (frame_marker_of(a) != FrameMarker_None) {
+                frame_marker_pass_on(&self->out, a);
+                a = next_frame(a, slices + 0);
+                continue;
+            }
+            if (frame_marker_of(b) != FrameMarker_None) {
+                b = next_frame(b, slices + 1);
+                continue;
+            }
+            const int cmp = compare_frames(self, a, b);
+            if (cmp == 0) {
+                CHECK(emit_fused(self, a, b));
+                a = next_frame(a, slices + 0);
+                b = next_frame(b, slices + 1);
+            } else if (cmp < 0) {
+                ++self->stats.unpaired[0];
+                a = next_frame(a, slices + 0);
+            } else {
+                ++self->stats.unpaired[1];
+                b = next_frame(b, slices + 1);
+            }
+        }
+        // A frame left over on one side may still find its partner in the
+        // next read of the other.
+        struct VideoFrame* const rest[2] = { a, b };
+        for (int i = 0; i < 2; ++i) {
+            const int is_other_empty = slices[!i].beg == slices[!i].end;
+            if (rest[i] && is_flushing && is_other_empty) {
+                for (struct VideoFrame* f = rest[i]; f;
+                     f = next_frame(f, slices + i))
+                    if (frame_marker_of(f) == FrameMarker_None)
+                        ++self->stats.unpaired[i];
+                consumed[i] = slices[i].end - slices[i].beg;
+            } else {
+                consumed[i] =
+                  (rest[i] ? (uint8_t*)rest[i] : slices[i].end) - slices[i].beg;
+            }
+        }
+        for (int i = 0; i < 2; ++i)
+            channel_read_unmap(self->in[i], self->readers + i, consumed[i]);
+    } while (consumed[0] || consumed[1]);
+    return 1;
+Error:
+    for (int i = 0; i < 2; ++i)
+        channel_read_unmap(self->in[i], self->readers + i, 0);
+    return 0;
+}
+
+//
+//  Thread
+//
+
+static int
+video_fusion_thread(struct video_fusion_s* self)
+{
+    int ecode = 0;
+    LOG("FUSION: Entering thread");
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping &&
+           !(self->is_input_done[0] && self->is_input_done[1])) {
+        CHECK(fuse_available(self, 0));
+        throttler_wait(&throttler);
+    }
+    TRACE("FUSION: Flushing");
+    CHECK(fuse_available(self, 1));
+Finalize:
+    LOG("FUSION: Exiting thread (%llu paired, %llu and %llu unpaired)",
+        (unsigned long long)self->stats.paired,
+        (unsigned long long)self->stats.unpaired[0],
+        (unsigned long long)self->stats.unpaired[1]);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("FUSION: Error");
+    // Don't hold back the other readers of the input channels.
+    for (int i = 0; i < 2; ++i)
+        channel_reader_detach(self->in[i], self->readers + i);
+    ecode = 1;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_fusion_init(struct video_fusion_s* self,
+                  size_t channel_capacity_bytes,
+                  struct channel* in0,
+                  struct channel* in1,
+                  void (*sig_stop_sink)(const struct video_fusion_s*))
+{
+    CHECK(in0);
+    CHECK(in1);
+    CHECK(sig_stop_sink);
+    *self = (struct video_fusion_s){
+        .in = { in0, in1 },
+        .out_capacity_bytes = channel_capacity_bytes,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_fusion_destroy(struct video_fusion_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+}
+
+enum DeviceStatusCode
+video_fusion_configure(struct video_fusion_s* self,
+                       enum fusion_mode mode,
+                       enum fusion_pairing pairing,
+                       uint64_t max_timestamp_delta,
+                       uint8_t store)
+{
+    EXPECT(mode < FusionMode_Count, "Invalid fusion mode: %d", (int)mode);
+    EXPECT(pairing < FusionPairing_Count,
+           "Invalid fusion pairing: %d",
+           (int)pairing);
+    self->mode = mode;
+    self->pairing = pairing;
+    self->max_timestamp_delta = max_timestamp_delta;
+    self->is_stored = (mode != FusionMode_None) && store;
+
+    if (mode == FusionMode_None) {
+        for (int i = 0; i < 2; ++i)
+            channel_reader_detach(self->in[i], self->readers + i);
+    } else if (!self->out.data) {
+        LOG("Allocating %llu bytes for the fusion queue.",
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+    }
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+uint8_t
+video_fusion_is_enabled(const struct video_fusion_s* self)
+{
+    return self->mode != FusionMode_None;
+}
+
+enum DeviceStatusCode
+video_fusion_start(struct video_fusion_s* self)
+{
+    EXPECT(video_fusion_is_enabled(self), "Expected fusion to be configured.");
+    // Only fuse frames acquired from here on.
+    for (int i = 0; i < 2; ++i)
+        channel_reader_attach(self->in[i], self->readers + i);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_fusion_stats_s){ 0 };
+    self->is_input_done[0] = self->is_input_done[1] = 0;
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_fusion_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+void
+video_fusion_input_done(struct video_fusion_s* self, unsigned i)
+{
+    if (i < 2)
+        self->is_input_done[i] = 1;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__fusion_kernels()
+{
+    enum
+    {
+        W = 11, // not a multiple of the vector width
+        H = 2,
+        N = W * H
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[N];
+    } a = { 0 }, b = { 0 };
+    struct
+    {
+        struct VideoFrame frame;
+        float data[2 * N];
+    } out = { 0 };
+    const struct ImageShape shape = {
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = W, .planes = N },
+        .type = SampleType_u16,
+    };
+    a.frame.shape = b.frame.shape = shape;
+    for (int i = 0; i < N; ++i) {
+        a.data[i] = (uint16_t)(3 * i);
+        b.data[i] = (uint16_t)i; // b[0] is zero
+    }
+
+    CHECK(fusion_shape(
+      FusionMode_Ratio, &a.frame.shape, &b.frame.shape, &out.frame.shape));
+    CHECK(out.frame.shape.type == SampleType_f32);
+    CHECK(fusion_apply(FusionMode_Ratio, &a.frame, &b.frame, &out.frame));
+    CHECK(out.data[0] == 0.0f);
+    for (int i = 1; i < N; ++i)
+        CHECK(out.data[i] == 3.0f);
+
+    CHECK(fusion_apply(FusionMode_Difference, &a.frame, &b.frame, &out.frame));
+    for (int i = 0; i < N; ++i)
+        CHECK(out.data[i] == 2.0f * i);
+
+    CHECK(fusion_shape(FusionMode_SideBySide,
+                       &a.frame.shape,
+                       &b.frame.shape,
+                       &out.frame.shape));
+    CHECK(out.frame.shape.dims.width == 2 * W);
+    CHECK(out.frame.shape.type == SampleType_u16);
+    CHECK(fusion_apply(FusionMode_SideBySide, &a.frame, &b.frame, &out.frame));
+    {
+        const uint16_t* px = (const uint16_t*)out.data;
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                CHECK(px[y * 2 * W + x] == a.data[y * W + x]);
+                CHECK(px[y * 2 * W + W + x] == b.data[y * W + x]);
+            }
+        }
+    }
+
+    // Mismatched shapes can't be combined pixel by pixel.
+    b.frame.shape.dims.width = W - 1;
+    CHECK(!fusion_shape(
+      FusionMode_Ratio, &a.frame.shape, &b.frame.shape, &out.frame.shape));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,140 @@
+//!
+//! # Cross-stream fusion
+//!
+//! Combines the frames of the two video streams. The fusion thread reads the
+//! sink input channel of each stream alongside the other readers, pairs
+//! frames by frame id or by hardware timestamp, and writes one combined frame
+//! per pair to its own output channel. That output can be read through the
+//! public api and, optionally, stored in place of the first stream's frames.
+//!
+
+#ifndef H_ACQUIRE_FUSION_V0
+#define H_ACQUIRE_FUSION_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    enum fusion_mode
+    {
+        FusionMode_None = 0,
+        /// `a/b` per pixel as f32. Pixels where `b` is zero are 0.
+        FusionMode_Ratio,
+        /// `a-b` per pixel as f32.
+        FusionMode_Difference,
+        /// `a` and `b` placed next to each other along x. Keeps the sample
+        /// type.
+        FusionMode_SideBySide,
+        FusionMode_Count,
+    };
+
+    enum fusion_pairing
+    {
+        /// Pair frames with the same `frame_id`.
+        FusionPairing_FrameId = 0,
+        /// Pair frames whose hardware timestamps are within a tolerance.
+        FusionPairing_HardwareTimestamp,
+        FusionPairing_Count,
+    };
+
+    /// Context for the fusion thread
+    struct video_fusion_s
+    {
+        enum fusion_mode mode;
+        enum fusion_pairing pairing;
+        uint64_t max_timestamp_delta;
+
+        /// When set, the first stream's storage receives the fused frames.
+        uint8_t is_stored;
+
+        struct channel* in[2];
+        struct channel_reader readers[2];
+
+        /// Fused frames. Allocated the first time fusion is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        /// Set once the producer of `in[i]` has written its last frame. The
+        /// fusion thread stops after both are set.
+        uint8_t is_input_done[2];
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Called when the fusion thread exits, after the last frame has been
+        /// written to `out`.
+        void (*sig_stop_sink)(const struct video_fusion_s*);
+
+        /// Written by the fusion thread. Reset on start.
+        struct video_fusion_stats_s
+        {
+            uint64_t paired;
+            /// Frames from `in[i]` dropped without a partner.
+            uint64_t unpaired[2];
+        } stats;
+
+        struct parked_thread thread;
+    };
+
+    enum DeviceStatusCode video_fusion_init(
+      struct video_fusion_s* self,
+      size_t channel_capacity_bytes,
+      struct channel* in0,
+      struct channel* in1,
+      void (*sig_stop_sink)(const struct video_fusion_s*));
+
+    void video_fusion_destroy(struct video_fusion_s* self);
+
+    /// @brief Selects how frames are paired and combined.
+    /// @param[in] max_timestamp_delta Largest difference between the hardware
+    ///                                timestamps of paired frames. Only used
+    ///                                when pairing by timestamp.
+    /// @param[in] store Nonzero to send the fused frames to the first
+    ///                  stream's storage.
+    /// Setting `mode` to `FusionMode_None` disables fusion.
+    enum DeviceStatusCode video_fusion_configure(struct video_fusion_s* self,
+                                                 enum fusion_mode mode,
+                                                 enum fusion_pairing pairing,
+                                                 uint64_t max_timestamp_delta,
+                                                 uint8_t store);
+
+    uint8_t video_fusion_is_enabled(const struct video_fusion_s* self);
+
+    enum DeviceStatusCode video_fusion_start(struct video_fusion_s* self);
+
+    /// @brief Signals that the producer of input `i` has stopped.
+    void video_fusion_input_done(struct video_fusion_s* self, unsigned i);
+
+    /// @brief Computes the shape of the frame fused from frames of shape `a`
+    ///        and `b`.
+    /// @returns 1 on success, or 0 if the shapes can't be combined.
+    int fusion_shape(enum fusion_mode mode,
+                     const struct ImageShape* a,
+                     const struct ImageShape* b,
+                     struct ImageShape* out);
+
+    /// @brief Combines `a` and `b` into `out`. `out->shape` must have been
+    ///        computed with `fusion_shape()`.
+    /// @returns 1 on success, otherwise 0.
+    int fusion_apply(enum fusion_mode mode,
+                     const struct VideoFrame* a,
+                     const struct VideoFrame* b,
+                     struct VideoFrame* out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_FUSION_V0
@@ -0,0 +1,495 @@
+#include "gate.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define countof(e) (sizeof(e) / sizeof((e)[0]))
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns The sum of `|a[i]-b[i]|` over `[0,n)`.
+static uint64_t
+sum_of_absolute_differences(const uint16_t* a, const uint16_t* b, size_t n)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        // Each 32-bit lane gains at most 2*65535 per step. Widen to 64 bits
+        // well before that can overflow.
+        const size_t steps_per_flush = 1 << 14;
+        const __m256i z = _mm256_setzero_si256();
+        __m256i acc64 = z;
+        while (i + 16 <= n) {
+            __m256i acc32 = z;
+            for (size_t k = 0; k < steps_per_flush && i + 16 <= n;
+                 ++k, i += 16) {
+                const __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+                const __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+                const __m256i d = _mm256_or_si256(_mm256_subs_epu16(va, vb),
+                                                  _mm256_subs_epu16(vb, va));
+                acc32 = _mm256_add_epi32(acc32, _mm256_unpacklo_epi16(d, z));
+                acc32 = _mm256_add_epi32(acc32, _mm256_unpackhi_epi16(d, z));
+            }
+            acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc32, z));
+            acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc32, z));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc64);
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i < n; ++i)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return sum;
+}
+
+/// Copies the grid samples of `frame` to `dst`, offset by the smallest
+/// value of the sample type.
+#define SAMPLE_GRID(T, lo)                                                     \
+    for (uint32_t y = 0; y < h; y += GATE_GRID) {                              \
+        const T* row = (const T*)frame->data + y * sy;                         \
+        for (uint32_t x = 0; x < w; x += GATE_GRID)                            \
+            *dst++ = (uint16_t)(row[x * sx] - (lo));                           \
+    }
+
+/// Samples `frame` into `self->samples.current`.
+/// @returns The number of samples, or 0 if `frame` can't be gated.
+static size_t
+sample_frame(struct video_gate_s* self, const struct VideoFrame* frame)
+{
+    const uint32_t w = frame->shape.dims.width;
+    const uint32_t h = frame->shape.dims.height;
+    const size_t sx = frame->shape.strides.width;
+    const size_t sy = frame->shape.strides.height;
+    const size_t n = (size_t)((w + GATE_GRID - 1) / GATE_GRID) *
+                     ((h + GATE_GRID - 1) / GATE_GRID);
+    switch (frame->shape.type) {
+        case SampleType_u8:
+        case SampleType_i8:
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+        case SampleType_i16:
+            break;
+        default:
+            return 0;
+    }
+    if (n > self->samples.capacity) {
+        uint16_t* current = (uint16_t*)realloc(self->samples.current,
+                                               n * sizeof(uint16_t));
+        if (current)
+            self->samples.current = current;
+        uint16_t* reference = (uint16_t*)realloc(self->samples.reference,
+                                                 n * sizeof(uint16_t));
+        if (reference)
+            self->samples.reference = reference;
+        EXPECT(current && reference,
+               "[stream %d] Failed to allocate %llu gate samples.",
+               self->stream_id,
+               (unsigned long long)n);
+        self->samples.capacity = n;
+    }
+
+    uint16_t* dst = self->samples.current;
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            SAMPLE_GRID(uint8_t, 0);
+            break;
+        case SampleType_i8:
+            SAMPLE_GRID(int8_t, INT8_MIN);
+            break;
+        case SampleType_i16:
+            SAMPLE_GRID(int16_t, INT16_MIN);
+            break;
+        default:
+            SAMPLE_GRID(uint16_t, 0);
+    }
+    return n;
+Error:
+    return 0;
+}
+
+#undef SAMPLE_GRID
+
+static int
+is_same_shape(const struct ImageShape* a, const struct ImageShape* b)
+{
+    return a->dims.width == b->dims.width && a->dims.height == b->dims.height &&
+           a->type == b->type;
+}
+
+static void
+store_frame(struct video_gate_s* self, const struct VideoFrame* frame)
+{
+    void* dst = channel_write_map(&self->out, frame->bytes_of_frame);
+    if (!dst)
+        return; // Not accepting writes
+    memcpy(dst, frame, frame->bytes_of_frame); // NOLINT
+    channel_write_unmap(&self->out);
+}
+
+static void
+log_frame(struct video_gate_s* self,
+          const struct VideoFrame* frame,
+          float score,
+          uint32_t flags)
+{
+    // The log is best effort. Never hold back storage for it.
+    struct gate_record* record = (struct gate_record*)channel_try_write_map(
+      &self->log, sizeof(struct gate_record));
+    if (!record) {
+        ++self->stats.records_dropped;
+        return;
+    }
+    *record = (struct gate_record){
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamp_hardware = frame->timestamps.hardware,
+        .timestamp_acq_thread = frame->timestamps.acq_thread,
+        .score = score,
+        .flags = flags,
+    };
+    channel_write_unmap(&self->log);
+}
+
+static void
+gate_frame(struct video_gate_s* self, const struct VideoFrame* frame)
+{
+    if (frame_marker_of(frame) != FrameMarker_None) {
+        // The first frame of a burst is a keyframe.
+        frame_marker_pass_on(&self->out, frame);
+        self->samples.has_reference = 0;
+        return;
+    }
+    const size_t n = sample_frame(self, frame);
+    float score = -1.0f;
+    uint32_t flags = 0;
+    if (!n) {
+        // Nothing to compare with. Store every frame.
+        flags = GateRecord_Stored;
+    } else if (!self->samples.has_reference ||
+               !is_same_shape(&self->samples.shape, &frame->shape)) {
+        flags = GateRecord_Stored | GateRecord_Keyframe;
+    } else {
+        score = (float)((double)sum_of_absolute_differences(
+                          self->samples.current, self->samples.reference, n) /
+                        (double)n);
+        if (score >= self->threshold)
+            flags = GateRecord_Stored;
+        else if (self->keyframe_interval &&
+                 self->skipped_in_a_row >= self->keyframe_interval)
+            flags = GateRecord_Stored | GateRecord_Keyframe;
+    }
+
+    ++self->stats.frame_count;
+    if (flags & GateRecord_Stored) {
+        store_frame(self, frame);
+        ++self->stats.stored_count;
+        if (flags & GateRecord_Keyframe)
+            ++self->stats.keyframe_count;
+        self->skipped_in_a_row = 0;
+        if (n) {
+            uint16_t* t = self->samples.reference;
+            self->samples.reference = self->samples.current;
+            self->samples.current = t;
+            self->samples.shape = frame->shape;
+            self->samples.has_reference = 1;
+        }
+    } else {
+        ++self->skipped_in_a_row;
+    }
+    log_frame(self, frame, score, flags);
+}
+
+static void
+gate_available(struct video_gate_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            gate_frame(self, frame);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_gate_thread(struct video_gate_s* self)
+{
+    LOG("[stream %d] GATE: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        gate_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] GATE: Flushing", self->stream_id);
+    gate_available(self);
+    LOG("[stream %d] GATE: Exiting thread (stored %llu of %llu frames)",
+        self->stream_id,
+        (unsigned long long)self->stats.stored_count,
+        (unsigned long long)self->stats.frame_count);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_gate_init(struct video_gate_s* self,
+                uint8_t stream_id,
+                size_t channel_capacity_bytes,
+                size_t log_capacity_bytes,
+                struct channel* in,
+                void (*sig_stop_sink)(const struct video_gate_s*))
+{
+    CHECK(in);
+    CHECK(sig_stop_sink);
+    *self = (struct video_gate_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .log_capacity_bytes = log_capacity_bytes,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_gate_destroy(struct video_gate_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    if (self->log.data)
+        channel_release(&self->log);
+    free(self->samples.current);
+    free(self->samples.reference);
+    self->samples.current = 0;
+    self->samples.reference = 0;
+    self->samples.capacity = 0;
+}
+
+enum DeviceStatusCode
+video_gate_configure(struct video_gate_s* self,
+                     uint8_t enable,
+                     float threshold,
+                     uint32_t keyframe_interval)
+{
+    EXPECT(threshold >= 0.0f,
+           "Expected a non-negative gating threshold. Got %f.",
+           threshold);
+    self->is_enabled = enable != 0;
+    self->threshold = threshold;
+    self->keyframe_interval = keyframe_interval;
+    if (!enable) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the gate queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+        channel_new(&self->log, self->log_capacity_bytes);
+        CHECK(self->log.data);
+    }
+    return Device_Ok;
+Error:
+    self->is_enabled = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_gate_is_enabled(const struct video_gate_s* self)
+{
+    return self->is_enabled;
+}
+
+void
+video_gate_set_input(struct video_gate_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_gate_start(struct video_gate_s* self)
+{
+    EXPECT(video_gate_is_enabled(self),
+           "Expected gating to be configured for stream %d.",
+           self->stream_id);
+    // Only gate frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    channel_accept_writes(&self->log, 1);
+    self->stats = (struct video_gate_stats_s){ 0 };
+    // The first frame of every acquisition is a keyframe.
+    self->samples.has_reference = 0;
+    self->skipped_in_a_row = 0;
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_gate_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+#ifndef NO_UNIT_TESTS
+
+static void
+ignore_stop_sink(const struct video_gate_s* self)
+{
+    (void)self;
+}
+
+int
+unit_test__gate_sum_of_absolute_differences()
+{
+    // Long enough to need more than 32 bits per lane.
+    const size_t n = 16 * 40000 + 7;
+    uint16_t* a = (uint16_t*)malloc(n * sizeof(uint16_t));
+    uint16_t* b = (uint16_t*)malloc(n * sizeof(uint16_t));
+    CHECK(a && b);
+    uint64_t expected = 0;
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = (i & 1) ? 65535 : (uint16_t)(i * 7919);
+        b[i] = (i & 1) ? 0 : (uint16_t)(i * 104729);
+        expected += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+    const uint64_t actual = sum_of_absolute_differences(a, b, n);
+    EXPECT(actual == expected,
+           "Expected %llu. Got %llu.",
+           (unsigned long long)expected,
+           (unsigned long long)actual);
+    CHECK(sum_of_absolute_differences(a, a, n) == 0);
+    free(a);
+    free(b);
+    return 1;
+Error:
+    free(a);
+    free(b);
+    return 0;
+}
+
+int
+unit_test__gate_keeps_changed_frames()
+{
+    enum
+    {
+        W = 32,
+        H = 16
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint8_t data[W * H];
+    } im = { 0 };
+    im.frame.bytes_of_frame = sizeof(im);
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = W,
+                     .planes = W * H },
+        .type = SampleType_u8,
+    };
+    struct channel in = { 0 };
+    struct video_gate_s gate = { 0 };
+    CHECK(video_gate_init(
+            &gate, 0, 1 << 16, 1 << 12, &in, ignore_stop_sink) == Device_Ok);
+    CHECK(video_gate_configure(&gate, 1, 10.0f, 3) == Device_Ok);
+    channel_accept_writes(&gate.out, 1);
+    channel_accept_writes(&gate.log, 1);
+
+    // 0: keyframe. 1-3: unchanged. 4: forced keyframe. 5: changed by less
+    // than the threshold on average. 6: changed.
+    const uint32_t expected[] = {
+        GateRecord_Stored | GateRecord_Keyframe,
+        0,
+        0,
+        0,
+        GateRecord_Stored | GateRecord_Keyframe,
+        0,
+        GateRecord_Stored,
+    };
+    for (uint32_t i = 0; i < countof(expected); ++i) {
+        im.frame.frame_id = i;
+        if (i == 5)
+            memset(im.data, 9, sizeof(im.data)); // NOLINT
+        if (i == 6)
+            memset(im.data, 20, sizeof(im.data)); // NOLINT
+        gate_frame(&gate, &im.frame);
+    }
+    CHECK(gate.stats.frame_count == countof(expected));
+    CHECK(gate.stats.stored_count == 3);
+    CHECK(gate.stats.keyframe_count == 2);
+
+    struct channel_reader reader = { 0 };
+    struct slice slice = channel_read_map(&gate.log, &reader);
+    const struct gate_record* records = (const struct gate_record*)slice.beg;
+    CHECK(slice_size_bytes(&slice) ==
+          countof(expected) * sizeof(struct gate_record));
+    for (uint32_t i = 0; i < countof(expected); ++i) {
+        EXPECT(records[i].flags == expected[i],
+               "Frame %u: expected flags %u. Got %u.",
+               i,
+               expected[i],
+               records[i].flags);
+        CHECK(records[i].frame_id == i);
+    }
+    CHECK(records[0].score < 0.0f);
+    CHECK(records[5].score == 9.0f);
+    CHECK(records[6].score == 20.0f);
+    channel_read_unmap(&gate.log, &reader, slice_size_bytes(&slice));
+
+    slice = channel_read_map(&gate.out, &reader);
+    CHECK(slice_size_bytes(&slice) == 3 * sizeof(im));
+    CHECK(((const struct VideoFrame*)slice.beg)->frame_id == 0);
+    channel_read_unmap(&gate.out, &reader, slice_size_bytes(&slice));
+
+    video_gate_destroy(&gate);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,156 @@
+//!
+//! # Change gating
+//!
+//! Keeps near-identical frames out of storage. The stages on the storage
+//! path run in this order, each skipped while it's disabled:
+//!
+//!     roi -> lut -> gate -> tiler -> encoder -> storage
+//!
+//! So the gate scores frames after bit-depth reduction. Regions of interest
+//! can't be combined with gating.
+//!
+//! Each frame is compared to the last frame that was stored:
+//!
+//! 1. Every `GATE_GRID`'th pixel of every `GATE_GRID`'th row is sampled.
+//! 2. The score is the mean absolute difference between the samples and
+//!    those of the last stored frame, in units of the sample type.
+//! 3. Frames scoring at least `threshold` are copied to `out`. Others are
+//!    skipped.
+//!
+//! A keyframe is stored regardless of its score when `keyframe_interval`
+//! frames have gone by since the last stored frame, and whenever the shape
+//! of the frames changes.
+//!
+//! Every frame, stored or not, gets a `gate_record` in `log` so the timeline
+//! can be reconstructed. Records are best effort. They are dropped, and
+//! counted, while the log is full.
+//!
+
+#ifndef H_ACQUIRE_GATE_V0
+#define H_ACQUIRE_GATE_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define GATE_GRID (4)
+
+    enum gate_record_flags
+    {
+        GateRecord_Stored = 1,
+        /// Stored because of `keyframe_interval` or a change of shape.
+        GateRecord_Keyframe = 2,
+    };
+
+    struct gate_record
+    {
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        /// Mean absolute difference from the last stored frame. Negative
+        /// when there was nothing to compare with.
+        float score;
+        uint32_t flags; //< `enum gate_record_flags`
+    };
+
+    /// Context for the gate thread
+    struct video_gate_s
+    {
+        /// Frames are stored when their score is at least this.
+        float threshold;
+        /// Most frames in a row that may be skipped. 0 for no limit.
+        uint32_t keyframe_interval;
+        uint8_t is_enabled;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Stored frames. Allocated the first time gating is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        /// `gate_record`s. Allocated with `out`.
+        struct channel log;
+        size_t log_capacity_bytes;
+
+        /// Samples of the current frame and of the last stored frame, offset
+        /// to be unsigned.
+        struct
+        {
+            uint16_t* current;
+            uint16_t* reference;
+            size_t capacity;
+            struct ImageShape shape; //< of the last stored frame
+            uint8_t has_reference;
+        } samples;
+
+        /// Frames skipped since the last stored frame.
+        uint32_t skipped_in_a_row;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the gate thread. Reset on start.
+        struct video_gate_stats_s
+        {
+            uint64_t frame_count;
+            uint64_t stored_count;
+            uint64_t keyframe_count;
+            uint64_t records_dropped;
+        } stats;
+
+        /// Called when the gate thread exits, after the last frame has been
+        /// written to `out`.
+        void (*sig_stop_sink)(const struct video_gate_s*);
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_gate_init(
+      struct video_gate_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      size_t log_capacity_bytes,
+      struct channel* in,
+      void (*sig_stop_sink)(const struct video_gate_s*));
+
+    void video_gate_destroy(struct video_gate_s* self);
+
+    /// @param[in] enable Nonzero to gate the frames sent to storage.
+    /// @param[in] threshold Must not be negative.
+    /// @param[in] keyframe_interval Most frames in a row that may be
+    ///                              skipped. 0 for no limit.
+    enum DeviceStatusCode video_gate_configure(struct video_gate_s* self,
+                                               uint8_t enable,
+                                               float threshold,
+                                               uint32_t keyframe_interval);
+
+    uint8_t video_gate_is_enabled(const struct video_gate_s* self);
+
+    /// @brief Selects the channel the gate reads from.
+    /// @see video_encoder_set_input()
+    void video_gate_set_input(struct video_gate_s* self, struct channel* in);
+
+    enum DeviceStatusCode video_gate_start(struct video_gate_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_GATE_V0
@@ -0,0 +1,448 @@
+#include "lut.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Gathers read 4 bytes starting at each entry.
+#define TABLE_PADDING (4)
+
+/// Samples mapped by each job on the worker pool.
+#define SAMPLES_PER_JOB (1 << 16)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns The largest value of `type` if frames of that type are reduced,
+/// otherwise 0.
+static uint32_t
+max_value_of(enum SampleType type)
+{
+    switch (type) {
+        case SampleType_u8:
+            return UINT8_MAX;
+        case SampleType_u10:
+            return (1 << 10) - 1;
+        case SampleType_u12:
+            return (1 << 12) - 1;
+        case SampleType_u14:
+            return (1 << 14) - 1;
+        case SampleType_u16:
+            return UINT16_MAX;
+        default:
+            return 0;
+    }
+}
+
+static float
+clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/// Anscombe transform
+static double
+anscombe(double v)
+{
+    return 2.0 * sqrt((v > 0.0 ? v : 0.0) + 0.375);
+}
+
+static void
+build_table(struct video_lut_s* self, enum SampleType type)
+{
+    self->table_type = type;
+    if (self->curve == LutCurve_Custom) {
+        memcpy(self->table, self->custom, LUT_ENTRIES); // NOLINT
+        return;
+    }
+
+    float lo = self->window_min, hi = self->window_max;
+    if (hi <= lo) {
+        lo = 0.0f;
+        hi = (float)max_value_of(type);
+    }
+    const double a0 = anscombe(0.0), a1 = anscombe((double)hi - lo);
+    for (uint32_t v = 0; v < LUT_ENTRIES; ++v) {
+        float x = clampf(((float)v - lo) / (hi - lo), 0.0f, 1.0f);
+        switch (self->curve) {
+            case LutCurve_Gamma:
+                x = powf(x, self->gamma);
+                break;
+            case LutCurve_Sqrt:
+                x = (float)((anscombe((double)v - lo) - a0) / (a1 - a0));
+                x = clampf(x, 0.0f, 1.0f);
+                break;
+            default:
+                break;
+        }
+        self->table[v] = (uint8_t)(255.0f * x + 0.5f);
+    }
+}
+
+/// Maps `n` 16-bit samples through `table`.
+static void
+map_u16(const uint8_t* table, const uint16_t* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i a = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        const __m256i b = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        const __m256i ta = _mm256_and_si256(
+          _mm256_i32gather_epi32((const int*)table, a, 1), low_byte);
+        const __m256i tb = _mm256_and_si256(
+          _mm256_i32gather_epi32((const int*)table, b, 1), low_byte);
+        // Packing works within 128-bit lanes, so restore the order in
+        // between.
+        __m256i p = _mm256_packus_epi32(ta, tb);
+        p = _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(dst + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(p),
+                                          _mm256_extracti128_si256(p, 1)));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = table[src[i]];
+}
+
+static void
+map_u8(const uint8_t* table, const uint8_t* src, uint8_t* dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = table[src[i]];
+}
+
+struct map_job_s
+{
+    const uint8_t* table;
+    const struct VideoFrame* in;
+    struct VideoFrame* out;
+    size_t n;
+};
+
+static void
+map_job(void* ctx, size_t i)
+{
+    const struct map_job_s* job = (const struct map_job_s*)ctx;
+    const size_t beg = i * SAMPLES_PER_JOB;
+    const size_t n =
+      beg + SAMPLES_PER_JOB < job->n ? SAMPLES_PER_JOB : job->n - beg;
+    if (job->in->shape.type == SampleType_u8)
+        map_u8(job->table, job->in->data + beg, job->out->data + beg, n);
+    else
+        map_u16(job->table,
+                (const uint16_t*)job->in->data + beg,
+                job->out->data + beg,
+                n);
+}
+
+static void
+reduce_frame(struct video_lut_s* self, const struct VideoFrame* in)
+{
+    if (frame_marker_of(in) != FrameMarker_None ||
+        !max_value_of(in->shape.type)) {
+        // A marker, or not reducible. Pass it on as is.
+        void* out = channel_write_map(&self->out, in->bytes_of_frame);
+        if (out) {
+            memcpy(out, in, in->bytes_of_frame); // NOLINT
+            channel_write_unmap(&self->out);
+        }
+        return;
+    }
+    if (self->table_type != in->shape.type)
+        build_table(self, in->shape.type);
+
+    const size_t n = in->shape.strides.planes;
+    const size_t nbytes = (sizeof(*in) + n + 7) & ~(size_t)7;
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!out)
+        return; // Not accepting writes
+    *out = *in;
+    out->bytes_of_frame = nbytes;
+    out->shape = video_lut_output_shape(self, &in->shape);
+    struct map_job_s job = {
+        .table = self->table,
+        .in = in,
+        .out = out,
+        .n = n,
+    };
+    worker_pool_run(
+      self->pool, (n + SAMPLES_PER_JOB - 1) / SAMPLES_PER_JOB, map_job, &job);
+    channel_write_unmap(&self->out);
+}
+
+static void
+reduce_available(struct video_lut_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            reduce_frame(self, frame);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_lut_thread(struct video_lut_s* self)
+{
+    LOG("[stream %d] LUT: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        reduce_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] LUT: Flushing", self->stream_id);
+    reduce_available(self);
+    LOG("[stream %d] LUT: Exiting thread", self->stream_id);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_lut_init(struct video_lut_s* self,
+               uint8_t stream_id,
+               size_t channel_capacity_bytes,
+               struct channel* in,
+               struct worker_pool* pool,
+               void (*sig_stop_sink)(const struct video_lut_s*))
+{
+    CHECK(in);
+    CHECK(pool);
+    CHECK(sig_stop_sink);
+    *self = (struct video_lut_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+        .table_type = SampleTypeCount,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_lut_destroy(struct video_lut_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    free(self->table);
+    free(self->custom);
+    self->table = 0;
+    self->custom = 0;
+}
+
+enum DeviceStatusCode
+video_lut_configure(struct video_lut_s* self,
+                    enum lut_curve curve,
+                    float window_min,
+                    float window_max,
+                    float gamma,
+                    uint8_t storage_only)
+{
+    EXPECT(curve < LutCurve_Count, "Unknown lookup table curve %d.", curve);
+    EXPECT(curve != LutCurve_Gamma || gamma > 0.0f,
+           "Expected a positive gamma. Got %f.",
+           gamma);
+    EXPECT(curve != LutCurve_Custom || self->custom,
+           "[stream %d] Expected a custom lookup table to have been set.",
+           self->stream_id);
+    EXPECT(isfinite(window_min) && isfinite(window_max),
+           "Expected a finite lookup table window.");
+    self->curve = curve;
+    self->window_min = window_min;
+    self->window_max = window_max;
+    self->gamma = gamma;
+    self->storage_only = storage_only != 0;
+    // The table depends on all of the above.
+    self->table_type = SampleTypeCount;
+    if (curve == LutCurve_None) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the lookup table queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        CHECK(self->table = (uint8_t*)calloc(LUT_ENTRIES + TABLE_PADDING, 1));
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->curve = LutCurve_None;
+    channel_reader_detach(self->in, &self->reader);
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_lut_set_table(struct video_lut_s* self,
+                    const uint8_t* table,
+                    uint32_t count)
+{
+    EXPECT(count <= LUT_ENTRIES,
+           "Expected at most %d lookup table entries. Got %u.",
+           LUT_ENTRIES,
+           count);
+    if (!count) {
+        free(self->custom);
+        self->custom = 0;
+        return Device_Ok;
+    }
+    CHECK(table);
+    if (!self->custom)
+        CHECK(self->custom = (uint8_t*)malloc(LUT_ENTRIES));
+    memcpy(self->custom, table, count); // NOLINT
+    memset(self->custom + count, table[count - 1], LUT_ENTRIES - count);
+    self->table_type = SampleTypeCount;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+uint8_t
+video_lut_is_enabled(const struct video_lut_s* self)
+{
+    return self->curve != LutCurve_None;
+}
+
+void
+video_lut_set_input(struct video_lut_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_lut_start(struct video_lut_s* self)
+{
+    EXPECT(video_lut_is_enabled(self),
+           "Expected a lookup table to be configured for stream %d.",
+           self->stream_id);
+    EXPECT(self->curve != LutCurve_Custom || self->custom,
+           "[stream %d] The custom lookup table was cleared.",
+           self->stream_id);
+    // Only reduce frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_lut_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+struct ImageShape
+video_lut_output_shape(const struct video_lut_s* self,
+                       const struct ImageShape* in)
+{
+    struct ImageShape out = *in;
+    if (video_lut_is_enabled(self) && max_value_of(in->type))
+        out.type = SampleType_u8;
+    return out;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__lut_maps_u16_to_u8()
+{
+    struct video_lut_s self = {
+        .curve = LutCurve_Linear,
+        .window_min = 100.0f,
+        .window_max = 1120.0f,
+    };
+    uint8_t* table = (uint8_t*)calloc(LUT_ENTRIES + TABLE_PADDING, 1);
+    CHECK(table);
+    self.table = table;
+
+    build_table(&self, SampleType_u16);
+    CHECK(table[0] == 0 && table[100] == 0);
+    CHECK(table[610] == 128);
+    CHECK(table[1120] == 255 && table[UINT16_MAX] == 255);
+
+    // An empty window spans the range of the type.
+    self.window_max = self.window_min;
+    build_table(&self, SampleType_u12);
+    CHECK(table[4095] == 255 && table[4096] == 255);
+    CHECK(table[2048] == 128);
+
+    // The Anscombe transform expands the low end.
+    self.curve = LutCurve_Sqrt;
+    build_table(&self, SampleType_u16);
+    CHECK(table[0] == 0 && table[UINT16_MAX] == 255);
+    CHECK(table[UINT16_MAX / 4] > 120);
+    for (uint32_t v = 1; v < LUT_ENTRIES; ++v)
+        CHECK(table[v] >= table[v - 1]);
+
+    self.curve = LutCurve_Gamma;
+    self.gamma = 2.0f;
+    build_table(&self, SampleType_u16);
+    CHECK(table[UINT16_MAX / 2] == 64);
+
+    {
+        // Compare the vector path with the definition.
+        const size_t n = 1000 + 5;
+        uint16_t src[1000 + 5];
+        uint8_t dst[1000 + 5];
+        for (size_t i = 0; i < n; ++i)
+            src[i] = (uint16_t)(i * 2654435761u >> 7);
+        src[0] = UINT16_MAX;
+        map_u16(table, src, dst, n);
+        for (size_t i = 0; i < n; ++i)
+            EXPECT(dst[i] == table[src[i]],
+                   "Sample %d: expected %d. Got %d.",
+                   (int)i,
+                   table[src[i]],
+                   dst[i]);
+    }
+    free(table);
+    return 1;
+Error:
+    free(table);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,138 @@
+//!
+//! # Bit-depth reduction
+//!
+//! Maps unsigned 16-bit (including 10, 12 and 14-bit) and 8-bit frames to
+//! 8 bits through a lookup table with an entry for every 16-bit value. Frames
+//! of other sample types pass through unchanged.
+//!
+//! The table is computed from a curve over a window of input values
+//! `[window_min,window_max]`:
+//!
+//! - `LutCurve_Linear` stretches the window over `[0,255]`.
+//! - `LutCurve_Gamma` raises the normalized value to the power `gamma`.
+//! - `LutCurve_Sqrt` applies the Anscombe transform, `2*sqrt(x+3/8)`, which
+//!   makes shot noise roughly uniform across intensities.
+//! - `LutCurve_Custom` uses a table supplied with `video_lut_set_table()`.
+//!
+//! When `window_max <= window_min` the window is the range of the sample
+//! type. Frames are mapped in parallel on the worker pool.
+//!
+
+#ifndef H_ACQUIRE_LUT_V0
+#define H_ACQUIRE_LUT_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define LUT_ENTRIES (1 << 16)
+
+    enum lut_curve
+    {
+        LutCurve_None = 0,
+        LutCurve_Linear,
+        LutCurve_Gamma,
+        LutCurve_Sqrt,
+        LutCurve_Custom,
+        LutCurve_Count,
+    };
+
+    /// Context for the bit-depth reduction thread
+    struct video_lut_s
+    {
+        enum lut_curve curve;
+        float window_min, window_max;
+        /// Exponent for `LutCurve_Gamma`.
+        float gamma;
+        /// When set, only frames sent to storage are reduced. Otherwise the
+        /// monitor reads the reduced frames as well.
+        uint8_t storage_only;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Reduced frames. Allocated the first time reduction is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// The active table. Padded so vector gathers may read past the last
+        /// entry. Computed for `table_type` when a frame of another type
+        /// arrives.
+        uint8_t* table;
+        enum SampleType table_type;
+
+        /// Set with `video_lut_set_table()`. Used by `LutCurve_Custom`.
+        uint8_t* custom;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Called when the thread exits, after the last frame has been
+        /// written to `out`.
+        void (*sig_stop_sink)(const struct video_lut_s*);
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_lut_init(
+      struct video_lut_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      struct channel* in,
+      struct worker_pool* pool,
+      void (*sig_stop_sink)(const struct video_lut_s*));
+
+    void video_lut_destroy(struct video_lut_s* self);
+
+    /// @param[in] curve `LutCurve_None` disables reduction.
+    /// @param[in] gamma Must be positive for `LutCurve_Gamma`.
+    enum DeviceStatusCode video_lut_configure(struct video_lut_s* self,
+                                              enum lut_curve curve,
+                                              float window_min,
+                                              float window_max,
+                                              float gamma,
+                                              uint8_t storage_only);
+
+    /// @brief Sets the table used by `LutCurve_Custom`.
+    /// @param[in] table `count` entries. Input value `v` maps to `table[v]`.
+    ///                  Values past the end map to the last entry.
+    /// @param[in] count At most `LUT_ENTRIES`. 0 clears the table.
+    enum DeviceStatusCode video_lut_set_table(struct video_lut_s* self,
+                                              const uint8_t* table,
+                                              uint32_t count);
+
+    uint8_t video_lut_is_enabled(const struct video_lut_s* self);
+
+    /// @brief Selects the channel the stage reads from.
+    /// @see video_encoder_set_input()
+    void video_lut_set_input(struct video_lut_s* self, struct channel* in);
+
+    enum DeviceStatusCode video_lut_start(struct video_lut_s* self);
+
+    /// @returns The shape of the frames made from frames of shape `in`.
+    struct ImageShape video_lut_output_shape(const struct video_lut_s* self,
+                                             const struct ImageShape* in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_LUT_V0
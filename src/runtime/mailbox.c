@@ -0,0 +1,119 @@
+#include "mailbox.h"
+#include "logger.h"
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+void
+mailbox_init(struct mailbox* self)
+{
+    *self = (struct mailbox){ 0 };
+    lock_init(&self->lock);
+}
+
+void
+mailbox_lock(struct mailbox* self)
+{
+    lock_acquire(&self->lock);
+}
+
+void
+mailbox_unlock(struct mailbox* self)
+{
+    lock_release(&self->lock);
+}
+
+void
+mailbox_post(struct mailbox* self)
+{
+    self->is_full = 1;
+    lock_release(&self->lock);
+}
+
+int
+mailbox_take(struct mailbox* self)
+{
+    // Only the owner empties the mailbox, so it stays full once seen full.
+    if (!self->is_full)
+        return 0;
+    lock_acquire(&self->lock);
+    return 1;
+}
+
+void
+mailbox_release(struct mailbox* self)
+{
+    self->is_full = 0;
+    lock_release(&self->lock);
+}
+
+void
+mailbox_clear(struct mailbox* self)
+{
+    lock_acquire(&self->lock);
+    self->is_full = 0;
+    lock_release(&self->lock);
+}
+
+#ifndef NO_UNIT_TESTS
+
+struct mailbox_test_s
+{
+    struct mailbox mailbox;
+    /// Payload. Posts add to it until it's taken.
+    uint64_t sum;
+    uint64_t count;
+};
+
+static void
+post_values(struct mailbox_test_s* self)
+{
+    for (uint64_t i = 1; i <= self->count; ++i) {
+        mailbox_lock(&self->mailbox);
+        if (!self->mailbox.is_full)
+            self->sum = 0;
+        self->sum += i;
+        mailbox_post(&self->mailbox);
+    }
+}
+
+int
+unit_test__mailbox_merges_updates()
+{
+    struct mailbox_test_s ctx = { .count = 10000 };
+    struct thread poster;
+    mailbox_init(&ctx.mailbox);
+    thread_init(&poster);
+    CHECK(thread_create(&poster, (void (*)(void*))post_values, &ctx));
+
+    // Nothing posted is lost, however posts and takes interleave.
+    const uint64_t expected = ctx.count * (ctx.count + 1) / 2;
+    uint64_t total = 0;
+    while (total < expected) {
+        if (mailbox_take(&ctx.mailbox)) {
+            total += ctx.sum;
+            mailbox_release(&ctx.mailbox);
+        }
+    }
+    thread_join(&poster);
+    CHECK(total == expected);
+    CHECK(!mailbox_take(&ctx.mailbox));
+
+    mailbox_lock(&ctx.mailbox);
+    mailbox_post(&ctx.mailbox);
+    mailbox_clear(&ctx.mailbox);
+    CHECK(!mailbox_take(&ctx.mailbox));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
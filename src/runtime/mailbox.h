@@ -0,0 +1,71 @@
+//!
+//! # Mailboxes
+//!
+//! Hands an update from any thread to the thread that owns a stage. The
+//! owner looks for mail at a frame boundary, between frames, so an update
+//! never lands in the middle of a frame.
+//!
+//! The payload lives next to the mailbox, in the owner's context, and is
+//! only touched with the mailbox locked. The owner checks `is_full` without
+//! the lock, so its frame loop only takes the lock when there's something to
+//! take. A poster that finds the mailbox still full merges its update into
+//! the payload that's waiting.
+//!
+//!     // Any thread:
+//!     mailbox_lock(&mb);
+//!     payload = ...;
+//!     mailbox_post(&mb);
+//!
+//!     // The owner, between frames:
+//!     if (mailbox_take(&mb)) {
+//!         copy = payload;
+//!         mailbox_release(&mb);
+//!     }
+//!
+
+#ifndef H_ACQUIRE_MAILBOX_V0
+#define H_ACQUIRE_MAILBOX_V0
+
+#include <stdint.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct mailbox
+    {
+        struct lock lock;
+        /// Set by `mailbox_post()`. Cleared by `mailbox_release()`.
+        uint8_t is_full;
+    };
+
+    void mailbox_init(struct mailbox* self);
+
+    /// @brief Locks the payload, to write or read it.
+    void mailbox_lock(struct mailbox* self);
+
+    /// @brief Unlocks the payload without changing whether there's mail.
+    void mailbox_unlock(struct mailbox* self);
+
+    /// @brief Marks the payload as mail for the owner and unlocks it. Must
+    /// follow `mailbox_lock()`.
+    void mailbox_post(struct mailbox* self);
+
+    /// @returns 1 with the payload locked when there's mail, otherwise 0.
+    /// Follow a successful take with `mailbox_release()`.
+    int mailbox_take(struct mailbox* self);
+
+    /// @brief Empties the mailbox and unlocks the payload.
+    void mailbox_release(struct mailbox* self);
+
+    /// @brief Discards any mail. Unlike `mailbox_take()`, may be called from
+    /// any thread, but only while the owner isn't running.
+    void mailbox_clear(struct mailbox* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_MAILBOX_V0
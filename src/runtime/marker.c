@@ -0,0 +1,95 @@
+#include "marker.h"
+#include "channel.h"
+#include "platform.h"
+#include "logger.h"
+#include "device/props/components.h"
+
+#include <string.h>
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+size_t
+bytes_of_marker_frame()
+{
+    return sizeof(struct VideoFrame) + sizeof(struct frame_marker);
+}
+
+void
+frame_marker_init(struct VideoFrame* frame,
+                  enum frame_marker_kind kind,
+                  uint64_t frame_id)
+{
+    *frame = (struct VideoFrame){
+        .bytes_of_frame = bytes_of_marker_frame(),
+        .frame_id = frame_id,
+        .timestamps.acq_thread = clock_tic(0),
+    };
+    *(struct frame_marker*)frame->data = (struct frame_marker){
+        .magic = FRAME_MARKER_MAGIC,
+        .kind = kind,
+    };
+}
+
+enum frame_marker_kind
+frame_marker_of(const struct VideoFrame* frame)
+{
+    if (frame->shape.strides.planes != 0 ||
+        frame->bytes_of_frame < bytes_of_marker_frame())
+        return FrameMarker_None;
+    const struct frame_marker* marker =
+      (const struct frame_marker*)frame->data;
+    if (marker->magic != FRAME_MARKER_MAGIC ||
+        marker->kind == FrameMarker_None || marker->kind >= FrameMarker_Count)
+        return FrameMarker_None;
+    return (enum frame_marker_kind)marker->kind;
+}
+
+int
+frame_marker_pass_on(struct channel* out, const struct VideoFrame* marker)
+{
+    void* dst = channel_write_map(out, marker->bytes_of_frame);
+    if (!dst)
+        return 0;
+    memcpy(dst, marker, marker->bytes_of_frame); // NOLINT
+    channel_write_unmap(out);
+    return 1;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__frame_marker_is_distinct_from_frames()
+{
+    uint64_t buf[64] = { 0 };
+    struct VideoFrame* frame = (struct VideoFrame*)buf;
+    CHECK(sizeof(buf) >= bytes_of_marker_frame());
+
+    frame_marker_init(frame, FrameMarker_FilterReset, 3);
+    CHECK(frame->bytes_of_frame == bytes_of_marker_frame());
+    CHECK(frame->frame_id == 3);
+    CHECK(frame_marker_of(frame) == FrameMarker_FilterReset);
+    frame_marker_init(frame, FrameMarker_Burst, 10);
+    CHECK(frame_marker_of(frame) == FrameMarker_Burst);
+
+    // A frame with pixels is never a marker, whatever its data holds.
+    frame->shape.strides.planes = 1;
+    CHECK(frame_marker_of(frame) == FrameMarker_None);
+
+    frame->shape.strides.planes = 0;
+    ((struct frame_marker*)frame->data)->magic = 0;
+    CHECK(frame_marker_of(frame) == FrameMarker_None);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
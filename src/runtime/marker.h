@@ -0,0 +1,70 @@
+//!
+//! # In-band markers
+//!
+//! A marker is a `VideoFrame` without pixel data that a writer places in a
+//! channel to signal its readers. Because it travels with the frames, a
+//! reader acts on it exactly when it reaches that point in the stream, and
+//! the writer doesn't have to wait for anyone.
+//!
+//! A marker's `shape` is zeroed, so it has no pixels, and its `data` holds a
+//! `frame_marker`.
+//!
+
+#ifndef H_ACQUIRE_MARKER_V0
+#define H_ACQUIRE_MARKER_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+    struct channel;
+
+    enum frame_marker_kind
+    {
+        FrameMarker_None = 0,
+        /// Readers should discard any partially processed frames.
+        FrameMarker_FilterReset,
+        /// Starts a burst of frames. The marker's `frame_id` is the id of the
+        /// burst's first frame. Stages that pass frames on pass it on too;
+        /// the others skip it.
+        FrameMarker_Burst,
+        FrameMarker_Count,
+    };
+
+#define FRAME_MARKER_MAGIC (0x4b4d5141) // "AQMK"
+
+    struct frame_marker
+    {
+        uint32_t magic; //< FRAME_MARKER_MAGIC
+        uint32_t kind;  //< enum frame_marker_kind
+    };
+
+    /// @returns the number of bytes to map for a marker frame.
+    size_t bytes_of_marker_frame();
+
+    /// @brief Fills a mapped region of `bytes_of_marker_frame()` bytes with a
+    /// marker of the given `kind`.
+    void frame_marker_init(struct VideoFrame* frame,
+                           enum frame_marker_kind kind,
+                           uint64_t frame_id);
+
+    /// @returns The kind of marker `frame` is, or `FrameMarker_None` if it
+    ///          is a regular frame.
+    enum frame_marker_kind frame_marker_of(const struct VideoFrame* frame);
+
+    /// @brief Passes `marker` on to `out` as it is.
+    /// @returns 1 if the marker was written, otherwise 0 (e.g. `out` isn't
+    ///          accepting writes).
+    int frame_marker_pass_on(struct channel* out,
+                             const struct VideoFrame* marker);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_MARKER_V0
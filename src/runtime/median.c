@@ -0,0 +1,198 @@
+#include "median.h"
+#include "logger.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+// Odd-even transposition sort: `k` rounds of compare-exchanges between
+// neighbors sorts `k` values. Each round is a fixed pattern, so the same
+// network sorts a whole vector of pixels at a time.
+#define SORT_NETWORK(T, v, k, MIN, MAX)                                        \
+    for (unsigned r = 0; r < (k); ++r) {                                       \
+        for (unsigned j = r & 1; j + 1 < (k); j += 2) {                        \
+            const T lo = MIN(v[j], v[j + 1]);                                  \
+            v[j + 1] = MAX(v[j], v[j + 1]);                                    \
+            v[j] = lo;                                                         \
+        }                                                                      \
+    }
+
+#define SCALAR_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define SCALAR_MAX(a, b) ((a) < (b) ? (b) : (a))
+
+/// Scalar kernels. `MID(a,b)` combines the two middle values for even `k`.
+#define DEFINE_SCALAR_MEDIAN(T, suffix, MID)                                   \
+    static void median_scalar_##suffix(const uint8_t* const* srcs,             \
+                                       unsigned k,                             \
+                                       size_t beg,                             \
+                                       size_t end,                             \
+                                       T* dst)                                 \
+    {                                                                          \
+        for (size_t i = beg; i < end; ++i) {                                   \
+            T v[MEDIAN_MAX_WINDOW];                                            \
+            for (unsigned j = 0; j < k; ++j)                                   \
+                v[j] = ((const T*)srcs[j])[i];                                 \
+            SORT_NETWORK(T, v, k, SCALAR_MIN, SCALAR_MAX);                     \
+            dst[i] = (k & 1) ? v[k / 2] : MID(v[k / 2 - 1], v[k / 2]);         \
+        }                                                                      \
+    }
+
+#define MID_UINT(T, a, b) (T)(((uint32_t)(a) + (uint32_t)(b) + 1) >> 1)
+#define MID_U8(a, b) MID_UINT(uint8_t, a, b)
+#define MID_U16(a, b) MID_UINT(uint16_t, a, b)
+#define MID_I8(a, b) (int8_t)(((int32_t)(a) + (int32_t)(b) + 1) >> 1)
+#define MID_I16(a, b) (int16_t)(((int32_t)(a) + (int32_t)(b) + 1) >> 1)
+#define MID_F32(a, b) (0.5f * ((a) + (b)))
+
+DEFINE_SCALAR_MEDIAN(uint8_t, u8, MID_U8)
+DEFINE_SCALAR_MEDIAN(uint16_t, u16, MID_U16)
+DEFINE_SCALAR_MEDIAN(int8_t, i8, MID_I8)
+DEFINE_SCALAR_MEDIAN(int16_t, i16, MID_I16)
+DEFINE_SCALAR_MEDIAN(float, f32, MID_F32)
+
+static void
+median_u8(const uint8_t* const* srcs,
+          unsigned k,
+          size_t beg,
+          size_t end,
+          uint8_t* dst)
+{
+    size_t i = beg;
+#if defined(__AVX2__)
+    for (; i + 32 <= end; i += 32) {
+        __m256i v[MEDIAN_MAX_WINDOW];
+        for (unsigned j = 0; j < k; ++j)
+            v[j] = _mm256_loadu_si256((const __m256i*)(srcs[j] + i));
+        SORT_NETWORK(__m256i, v, k, _mm256_min_epu8, _mm256_max_epu8);
+        const __m256i m =
+          (k & 1) ? v[k / 2] : _mm256_avg_epu8(v[k / 2 - 1], v[k / 2]);
+        _mm256_storeu_si256((__m256i*)(dst + i), m);
+    }
+#endif
+    median_scalar_u8(srcs, k, i, end, dst);
+}
+
+static void
+median_u16(const uint8_t* const* srcs,
+           unsigned k,
+           size_t beg,
+           size_t end,
+           uint16_t* dst)
+{
+    size_t i = beg;
+#if defined(__AVX2__)
+    for (; i + 16 <= end; i += 16) {
+        __m256i v[MEDIAN_MAX_WINDOW];
+        for (unsigned j = 0; j < k; ++j)
+            v[j] = _mm256_loadu_si256(
+              (const __m256i*)((const uint16_t*)srcs[j] + i));
+        SORT_NETWORK(__m256i, v, k, _mm256_min_epu16, _mm256_max_epu16);
+        const __m256i m =
+          (k & 1) ? v[k / 2] : _mm256_avg_epu16(v[k / 2 - 1], v[k / 2]);
+        _mm256_storeu_si256((__m256i*)(dst + i), m);
+    }
+#endif
+    median_scalar_u16(srcs, k, i, end, dst);
+}
+
+int
+temporal_median(const uint8_t* const* srcs,
+                 unsigned k,
+                 enum SampleType type,
+                 size_t beg,
+                 size_t end,
+                 uint8_t* dst)
+{
+    EXPECT(k >= 1 && k <= MEDIAN_MAX_WINDOW, "Unsupported window: %u", k);
+    switch (type) {
+        case SampleType_u8:
+            median_u8(srcs, k, beg, end, dst);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            median_u16(srcs, k, beg, end, (uint16_t*)dst);
+            break;
+        case SampleType_i8:
+            median_scalar_i8(srcs, k, beg, end, (int8_t*)dst);
+            break;
+        case SampleType_i16:
+            median_scalar_i16(srcs, k, beg, end, (int16_t*)dst);
+            break;
+        case SampleType_f32:
+            median_scalar_f32(srcs, k, beg, end, (float*)dst);
+            break;
+        default:
+            EXPECT(0, "Unsupported pixel type for median: %d", (int)type);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__temporal_median()
+{
+    // Enough pixels to use both the vector path and the scalar tail.
+    enum
+    {
+        N = 16 * 5 + 3,
+        K = 5
+    };
+    uint16_t frames[K][N], out[N];
+    const uint8_t* srcs[K];
+    for (unsigned j = 0; j < K; ++j) {
+        for (unsigned i = 0; i < N; ++i)
+            frames[j][i] = (uint16_t)(1000 + ((i * 7 + j * 13) % 11));
+        srcs[j] = (const uint8_t*)frames[j];
+    }
+    frames[2][17] = 65535; // an outlier is rejected
+    frames[4][40] = 0;
+
+    for (unsigned k = 1; k <= K; ++k) {
+        CHECK(temporal_median(srcs, k, SampleType_u16, 0, N, (uint8_t*)out));
+        for (unsigned i = 0; i < N; ++i) {
+            uint16_t v[K];
+            for (unsigned j = 0; j < k; ++j)
+                v[j] = frames[j][i];
+            // insertion sort for reference
+            for (unsigned a = 1; a < k; ++a)
+                for (unsigned b = a; b > 0 && v[b - 1] > v[b]; --b) {
+                    const uint16_t t = v[b];
+                    v[b] = v[b - 1];
+                    v[b - 1] = t;
+                }
+            const uint16_t expected =
+              (k & 1) ? v[k / 2]
+                      : (uint16_t)((v[k / 2 - 1] + v[k / 2] + 1) / 2);
+            EXPECT(out[i] == expected,
+                   "k=%u pixel %u: got %u, expected %u",
+                   k,
+                   i,
+                   out[i],
+                   expected);
+        }
+    }
+    CHECK(out[17] < 1100);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
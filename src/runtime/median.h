@@ -0,0 +1,46 @@
+//!
+//! # Temporal median
+//!
+//! Per-pixel median over a small window of frames. Each group of pixels is
+//! sorted with a compare-exchange network, vectorized across neighboring
+//! pixels.
+//!
+
+#ifndef H_ACQUIRE_MEDIAN_V0
+#define H_ACQUIRE_MEDIAN_V0
+
+#include <stddef.h>
+#include <stdint.h>
+#include "device/props/components.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MEDIAN_MIN_WINDOW (3)
+#define MEDIAN_MAX_WINDOW (9)
+
+    /// @brief Computes the per-pixel median of `k` images.
+    ///
+    /// For an even `k` the result is the mean of the two middle values,
+    /// rounded up for integer types.
+    /// @param[in] srcs `k` pointers to the pixel data of the images.
+    /// @param[in] k The window size, in `[1, MEDIAN_MAX_WINDOW]`.
+    /// @param[in] type The sample type of every image.
+    /// @param[in] beg,end The range of pixels to compute.
+    /// @param[out] dst Pixel data of the result. Pixel `i` is written to
+    ///                 sample `i` of `dst`.
+    /// @returns 1 on success, or 0 if the parameters aren't supported.
+    int temporal_median(const uint8_t* const* srcs,
+                        unsigned k,
+                        enum SampleType type,
+                        size_t beg,
+                        size_t end,
+                        uint8_t* dst);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_MEDIAN_V0
@@ -0,0 +1,151 @@
+#include "meter.h"
+#include "frame_iterator.h"
+#include "frame_stats.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+static void
+measure_frame(struct video_meter_s* self, const struct VideoFrame* frame)
+{
+    if (frame_marker_of(frame) != FrameMarker_None)
+        return;
+    ++self->stats.frame_count;
+    // Statistics are best effort. Never hold back the other readers for them.
+    struct frame_stats* out = (struct frame_stats*)channel_try_write_map(
+      &self->out, sizeof(struct frame_stats));
+    if (!out) {
+        ++self->stats.dropped_count;
+        return;
+    }
+    if (frame_stats_compute(out, frame))
+        channel_write_unmap(&self->out);
+    else
+        channel_abort_write(&self->out);
+}
+
+static void
+measure_available(struct video_meter_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            measure_frame(self, frame);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_meter_thread(struct video_meter_s* self)
+{
+    LOG("[stream %d] METER: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        measure_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] METER: Flushing", self->stream_id);
+    measure_available(self);
+    LOG("[stream %d] METER: Exiting thread (%llu frames, %llu dropped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.dropped_count);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_meter_init(struct video_meter_s* self,
+                 uint8_t stream_id,
+                 size_t channel_capacity_bytes,
+                 struct channel* in)
+{
+    CHECK(in);
+    *self = (struct video_meter_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_meter_destroy(struct video_meter_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+}
+
+enum DeviceStatusCode
+video_meter_configure(struct video_meter_s* self, uint8_t enable)
+{
+    self->is_enabled = enable != 0;
+    if (!enable) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->is_enabled = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_meter_is_enabled(const struct video_meter_s* self)
+{
+    return self->is_enabled;
+}
+
+enum DeviceStatusCode
+video_meter_start(struct video_meter_s* self)
+{
+    EXPECT(video_meter_is_enabled(self),
+           "Expected frame statistics to be configured for stream %d.",
+           self->stream_id);
+    // Only measure frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_meter_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_meter_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
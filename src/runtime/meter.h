@@ -0,0 +1,77 @@
+//!
+//! # Frame statistics
+//!
+//! Publishes the pixel statistics of each frame (see `frame_stats.h`). The
+//! meter thread reads the sink's input channel alongside the other readers,
+//! so turning statistics on doesn't change the path frames take to storage.
+//!
+//! One `frame_stats` record is written to `out` per frame. Records are best
+//! effort. They are dropped, and counted, while `out` is full.
+//!
+
+#ifndef H_ACQUIRE_METER_V0
+#define H_ACQUIRE_METER_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Context for the meter thread
+    struct video_meter_s
+    {
+        uint8_t is_enabled;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// `frame_stats` records. Allocated the first time statistics are
+        /// enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the meter thread. Reset on start.
+        struct video_meter_stats_s
+        {
+            uint64_t frame_count;
+            /// Records dropped because the unread ones filled `out`.
+            uint64_t dropped_count;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_meter_init(struct video_meter_s* self,
+                                           uint8_t stream_id,
+                                           size_t channel_capacity_bytes,
+                                           struct channel* in);
+
+    void video_meter_destroy(struct video_meter_s* self);
+
+    /// @param[in] enable Nonzero to publish per-frame pixel statistics.
+    enum DeviceStatusCode video_meter_configure(struct video_meter_s* self,
+                                                uint8_t enable);
+
+    uint8_t video_meter_is_enabled(const struct video_meter_s* self);
+
+    enum DeviceStatusCode video_meter_start(struct video_meter_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_METER_V0
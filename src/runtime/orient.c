@@ -0,0 +1,695 @@
+#include "orient.h"
+#include "frame_iterator.h"
+#include "logger.h"
+#include "marker.h"
+#include "platform.h"
+#include "throttler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Pixels are transposed in tiles of `TILE` by `TILE`.
+#define TILE (8)
+
+/// Tiles are visited in blocks of `BLOCK` output columns, so the input rows
+/// a block reads stay in cache while its tiles are written.
+#define BLOCK (64)
+
+/// Output rows oriented by each call on the worker pool. A multiple of
+/// `TILE`.
+#define ROWS_PER_STRIP (64)
+
+/// For output pixel `(x',y')`:
+///
+/// - Without `transpose`, the input pixel is `(x',y')`.
+/// - With `transpose`, the input pixel is `(y',x')`.
+///
+/// `flip_x` then mirrors the input column and `flip_y` the input row.
+static const struct orientation_s
+{
+    uint8_t transpose, flip_x, flip_y;
+} orientations[Orientation_Count] = {
+    [Orientation_None] = { 0, 0, 0 },
+    [Orientation_FlipX] = { 0, 1, 0 },
+    [Orientation_FlipY] = { 0, 0, 1 },
+    [Orientation_Rotate90] = { 1, 0, 1 },
+    [Orientation_Rotate180] = { 0, 1, 1 },
+    [Orientation_Rotate270] = { 1, 1, 0 },
+    [Orientation_Transpose] = { 1, 0, 0 },
+};
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns The number of bytes in a pixel of frames of `shape` if they can
+///          be oriented, otherwise 0. Pixels must be packed, with any
+///          channels interleaved.
+static size_t
+bytes_per_pixel(const struct ImageShape* shape)
+{
+    const struct image_dims_s* dims = &shape->dims;
+    const struct image_strides_s* strides = &shape->strides;
+    if (!dims->width || !dims->height || dims->planes > 1)
+        return 0;
+    if (dims->channels > 1 && strides->channels != 1)
+        return 0;
+    if (strides->width != dims->channels ||
+        strides->height != (int64_t)dims->width * dims->channels)
+        return 0;
+    return bytes_of_type(shape->type) * dims->channels;
+}
+
+/// Copies the `n` pixels of `src` to `dst` in reverse order.
+static void
+reverse_row(const uint8_t* src, uint8_t* dst, size_t n, size_t bytes)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (bytes == 1 || bytes == 2 || bytes == 4) {
+        // Reverse the pixels within each 128-bit lane, then swap the lanes.
+        const __m256i reverse_bytes = _mm256_setr_epi8(15, 14, 13, 12, 11, 10,
+                                                       9,  8,  7,  6,  5,  4,
+                                                       3,  2,  1,  0,  15, 14,
+                                                       13, 12, 11, 10, 9,  8,
+                                                       7,  6,  5,  4,  3,  2,
+                                                       1,  0);
+        const __m256i reverse_words = _mm256_setr_epi8(14, 15, 12, 13, 10, 11,
+                                                       8,  9,  6,  7,  4,  5,
+                                                       2,  3,  0,  1,  14, 15,
+                                                       12, 13, 10, 11, 8,  9,
+                                                       6,  7,  4,  5,  2,  3,
+                                                       0,  1);
+        const __m256i reverse_dwords =
+          _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        const size_t per = 32 / bytes;
+        for (; i + per <= n; i += per) {
+            __m256i v = _mm256_loadu_si256(
+              (const __m256i*)(src + (n - i - per) * bytes));
+            if (bytes == 4) {
+                v = _mm256_permutevar8x32_epi32(v, reverse_dwords);
+            } else {
+                v = _mm256_shuffle_epi8(
+                  v, bytes == 1 ? reverse_bytes : reverse_words);
+                v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+            }
+            _mm256_storeu_si256((__m256i*)(dst + i * bytes), v);
+        }
+    }
+#endif
+
+#define REVERSE(T)                                                             \
+    do {                                                                       \
+        const T* s = (const T*)src;                                            \
+        T* d = (T*)dst;                                                        \
+        for (; i < n; ++i)                                                     \
+            d[i] = s[n - 1 - i];                                               \
+    } while (0)
+
+    switch (bytes) {
+        case 1:
+            REVERSE(uint8_t);
+            break;
+        case 2:
+            REVERSE(uint16_t);
+            break;
+        case 4:
+            REVERSE(uint32_t);
+            break;
+        case 8:
+            REVERSE(uint64_t);
+            break;
+        default:
+            for (; i < n; ++i)
+                memcpy(dst + i * bytes, src + (n - 1 - i) * bytes, bytes);
+    }
+#undef REVERSE
+}
+
+#if defined(__AVX2__)
+static void
+transpose_tile_u8(const uint8_t* const src[TILE], uint8_t* const dst[TILE])
+{
+    __m128i r[TILE];
+    for (int k = 0; k < TILE; ++k)
+        r[k] = _mm_loadl_epi64((const __m128i*)src[k]);
+    const __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+    const __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+    const __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+    const __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+    const __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+    const __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+    const __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+    const __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+    // Each holds two columns of the tile.
+    const __m128i c[4] = {
+        _mm_unpacklo_epi32(b0, b2),
+        _mm_unpackhi_epi32(b0, b2),
+        _mm_unpacklo_epi32(b1, b3),
+        _mm_unpackhi_epi32(b1, b3),
+    };
+    for (int j = 0; j < 4; ++j) {
+        _mm_storel_epi64((__m128i*)dst[2 * j], c[j]);
+        _mm_storel_epi64((__m128i*)dst[2 * j + 1],
+                         _mm_unpackhi_epi64(c[j], c[j]));
+    }
+}
+
+static void
+transpose_tile_u16(const uint8_t* const src[TILE], uint8_t* const dst[TILE])
+{
+    __m128i r[TILE];
+    for (int k = 0; k < TILE; ++k)
+        r[k] = _mm_loadu_si128((const __m128i*)src[k]);
+    __m128i a[TILE], b[TILE];
+    for (int k = 0; k < TILE; k += 2) {
+        a[k] = _mm_unpacklo_epi16(r[k], r[k + 1]);
+        a[k + 1] = _mm_unpackhi_epi16(r[k], r[k + 1]);
+    }
+    for (int k = 0; k < TILE; k += 4) {
+        b[k] = _mm_unpacklo_epi32(a[k], a[k + 2]);
+        b[k + 1] = _mm_unpackhi_epi32(a[k], a[k + 2]);
+        b[k + 2] = _mm_unpacklo_epi32(a[k + 1], a[k + 3]);
+        b[k + 3] = _mm_unpackhi_epi32(a[k + 1], a[k + 3]);
+    }
+    for (int j = 0; j < 4; ++j) {
+        _mm_storeu_si128((__m128i*)dst[2 * j],
+                         _mm_unpacklo_epi64(b[j], b[j + 4]));
+        _mm_storeu_si128((__m128i*)dst[2 * j + 1],
+                         _mm_unpackhi_epi64(b[j], b[j + 4]));
+    }
+}
+
+static void
+transpose_tile_u32(const uint8_t* const src[TILE], uint8_t* const dst[TILE])
+{
+    // Shuffles move bits as they are, so any 32-bit sample goes as a float.
+    __m256 r[TILE], t[TILE], u[TILE];
+    for (int k = 0; k < TILE; ++k)
+        r[k] = _mm256_loadu_ps((const float*)src[k]);
+    for (int k = 0; k < TILE; k += 2) {
+        t[k] = _mm256_unpacklo_ps(r[k], r[k + 1]);
+        t[k + 1] = _mm256_unpackhi_ps(r[k], r[k + 1]);
+    }
+    for (int k = 0; k < TILE; k += 4) {
+        u[k] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        u[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        u[k + 2] =
+          _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        u[k + 3] =
+          _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int j = 0; j < 4; ++j) {
+        _mm256_storeu_ps((float*)dst[j],
+                         _mm256_permute2f128_ps(u[j], u[j + 4], 0x20));
+        _mm256_storeu_ps((float*)dst[j + 4],
+                         _mm256_permute2f128_ps(u[j], u[j + 4], 0x31));
+    }
+}
+#endif
+
+/// Transposes a `TILE` by `TILE` tile of pixels. `src[k]` points at row `k`
+/// of the tile and `dst[j]` at where column `j` goes.
+static void
+transpose_tile(const uint8_t* const src[TILE],
+               uint8_t* const dst[TILE],
+               size_t bytes)
+{
+#if defined(__AVX2__)
+    switch (bytes) {
+        case 1:
+            transpose_tile_u8(src, dst);
+            return;
+        case 2:
+            transpose_tile_u16(src, dst);
+            return;
+        case 4:
+            transpose_tile_u32(src, dst);
+            return;
+        default:;
+    }
+#endif
+
+#define TRANSPOSE(T)                                                           \
+    do {                                                                       \
+        for (int k = 0; k < TILE; ++k)                                         \
+            for (int j = 0; j < TILE; ++j)                                     \
+                ((T*)dst[j])[k] = ((const T*)src[k])[j];                       \
+    } while (0)
+
+    switch (bytes) {
+        case 1:
+            TRANSPOSE(uint8_t);
+            break;
+        case 2:
+            TRANSPOSE(uint16_t);
+            break;
+        case 4:
+            TRANSPOSE(uint32_t);
+            break;
+        case 8:
+            TRANSPOSE(uint64_t);
+            break;
+        default:
+            for (int k = 0; k < TILE; ++k)
+                for (int j = 0; j < TILE; ++j)
+                    memcpy(dst[j] + k * bytes, src[k] + j * bytes, bytes);
+    }
+#undef TRANSPOSE
+}
+
+struct orient_job_s
+{
+    struct orientation_s orientation;
+    const struct VideoFrame* in;
+    struct VideoFrame* out;
+    size_t bytes;
+};
+
+/// Copies output pixel `(x,y)` from its input pixel, one at a time. Used at
+/// the edges of the tiled region.
+static void
+orient_pixel(const struct orient_job_s* job, uint32_t x, uint32_t y)
+{
+    const struct orientation_s o = job->orientation;
+    const uint32_t w = job->in->shape.dims.width;
+    const uint32_t h = job->in->shape.dims.height;
+    const uint32_t out_w = job->out->shape.dims.width;
+    uint32_t sx = o.transpose ? y : x;
+    uint32_t sy = o.transpose ? x : y;
+    if (o.flip_x)
+        sx = w - 1 - sx;
+    if (o.flip_y)
+        sy = h - 1 - sy;
+    memcpy(job->out->data + ((size_t)y * out_w + x) * job->bytes,
+           job->in->data + ((size_t)sy * w + sx) * job->bytes,
+           job->bytes);
+}
+
+/// Orients output rows `[y0,y1)` by copying or reversing whole rows.
+static void
+orient_rows(const struct orient_job_s* job, uint32_t y0, uint32_t y1)
+{
+    const uint32_t w = job->in->shape.dims.width;
+    const uint32_t h = job->in->shape.dims.height;
+    const size_t row_bytes = w * job->bytes;
+    for (uint32_t y = y0; y < y1; ++y) {
+        const uint32_t sy = job->orientation.flip_y ? h - 1 - y : y;
+        const uint8_t* src = job->in->data + sy * row_bytes;
+        uint8_t* dst = job->out->data + y * row_bytes;
+        if (job->orientation.flip_x)
+            reverse_row(src, dst, w, job->bytes);
+        else
+            memcpy(dst, src, row_bytes); // NOLINT
+    }
+}
+
+/// Orients output rows `[y0,y1)` of an orientation that swaps rows and
+/// columns. `y0` is a multiple of `TILE`.
+static void
+transpose_rows(const struct orient_job_s* job, uint32_t y0, uint32_t y1)
+{
+    const struct orientation_s o = job->orientation;
+    const size_t bytes = job->bytes;
+    const uint32_t w = job->in->shape.dims.width;
+    const uint32_t h = job->in->shape.dims.height;
+    const uint32_t out_w = job->out->shape.dims.width;
+    const size_t in_row_bytes = w * bytes;
+    const size_t out_row_bytes = out_w * bytes;
+
+    // The tiled region. The rest is done a pixel at a time.
+    const uint32_t x_end = out_w - out_w % TILE;
+    const uint32_t y_end = y0 + (y1 - y0) / TILE * TILE;
+
+    const uint8_t* src[TILE];
+    uint8_t* dst[TILE];
+    for (uint32_t bx = 0; bx < x_end; bx += BLOCK) {
+        const uint32_t bx_end = bx + BLOCK < x_end ? bx + BLOCK : x_end;
+        for (uint32_t ty = y0; ty < y_end; ty += TILE) {
+            // Output rows `[ty,ty+TILE)` come from these input columns.
+            // Mirrored, the tile's columns go to its rows in reverse.
+            const uint32_t sx = o.flip_x ? w - TILE - ty : ty;
+            for (int j = 0; j < TILE; ++j) {
+                const uint32_t y = o.flip_x ? ty + TILE - 1 - j : ty + j;
+                dst[j] = job->out->data + y * out_row_bytes;
+            }
+            for (uint32_t tx = bx; tx < bx_end; tx += TILE) {
+                for (int k = 0; k < TILE; ++k) {
+                    const uint32_t sy = o.flip_y ? h - 1 - (tx + k) : tx + k;
+                    src[k] = job->in->data + sy * in_row_bytes + sx * bytes;
+                }
+                uint8_t* tile_dst[TILE];
+                for (int j = 0; j < TILE; ++j)
+                    tile_dst[j] = dst[j] + tx * bytes;
+                transpose_tile(src, tile_dst, bytes);
+            }
+        }
+    }
+    for (uint32_t y = y0; y < y_end; ++y)
+        for (uint32_t x = x_end; x < out_w; ++x)
+            orient_pixel(job, x, y);
+    for (uint32_t y = y_end; y < y1; ++y)
+        for (uint32_t x = 0; x < out_w; ++x)
+            orient_pixel(job, x, y);
+}
+
+static void
+orient_job(void* ctx, size_t i)
+{
+    const struct orient_job_s* job = (const struct orient_job_s*)ctx;
+    const uint32_t h = job->out->shape.dims.height;
+    const uint32_t y0 = (uint32_t)i * ROWS_PER_STRIP;
+    const uint32_t y1 = y0 + ROWS_PER_STRIP < h ? y0 + ROWS_PER_STRIP : h;
+    if (job->orientation.transpose)
+        transpose_rows(job, y0, y1);
+    else
+        orient_rows(job, y0, y1);
+}
+
+/// Orients `in` into `out`, which has the output shape.
+static void
+orient(struct worker_pool* pool,
+       enum orientation orientation,
+       const struct VideoFrame* in,
+       struct VideoFrame* out,
+       size_t bytes)
+{
+    struct orient_job_s job = {
+        .orientation = orientations[orientation],
+        .in = in,
+        .out = out,
+        .bytes = bytes,
+    };
+    const uint32_t h = out->shape.dims.height;
+    worker_pool_run(
+      pool, (h + ROWS_PER_STRIP - 1) / ROWS_PER_STRIP, orient_job, &job);
+}
+
+static void
+orient_frame(struct video_orient_s* self, const struct VideoFrame* in)
+{
+    size_t bytes = 0;
+    if (frame_marker_of(in) == FrameMarker_None) {
+        ++self->stats.frame_count;
+        bytes = bytes_per_pixel(&in->shape);
+        if (!bytes && !self->stats.skipped_count++)
+            LOGE("[stream %d] ORIENT: Can't orient a %ux%u frame of type %d "
+                 "with strides %lld, %lld, %lld. Passing frames like it on "
+                 "as they are.",
+                 self->stream_id,
+                 in->shape.dims.width,
+                 in->shape.dims.height,
+                 (int)in->shape.type,
+                 (long long)in->shape.strides.channels,
+                 (long long)in->shape.strides.width,
+                 (long long)in->shape.strides.height);
+    }
+
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_write_map(self->out, in->bytes_of_frame);
+    if (!out)
+        return; // Not accepting writes
+    if (!bytes) {
+        memcpy(out, in, in->bytes_of_frame); // NOLINT
+    } else {
+        *out = *in;
+        out->shape = video_orient_output_shape(self, &in->shape);
+        orient(self->pool, self->orientation, in, out, bytes);
+    }
+    channel_write_unmap(self->out);
+}
+
+static void
+orient_available(struct video_orient_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(&self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            orient_frame(self, frame);
+        channel_read_unmap(&self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_orient_thread(struct video_orient_s* self)
+{
+    LOG("[stream %d] ORIENT: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        orient_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] ORIENT: Flushing", self->stream_id);
+    orient_available(self);
+    LOG("[stream %d] ORIENT: Exiting thread (%llu frames, %llu skipped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.skipped_count);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_orient_init(struct video_orient_s* self,
+                  uint8_t stream_id,
+                  size_t channel_capacity_bytes,
+                  struct channel* out,
+                  struct worker_pool* pool,
+                  void (*sig_stop_sink)(const struct video_orient_s*))
+{
+    CHECK(out);
+    CHECK(pool);
+    CHECK(sig_stop_sink);
+    *self = (struct video_orient_s){
+        .stream_id = stream_id,
+        .in_capacity_bytes = channel_capacity_bytes,
+        .out = out,
+        .pool = pool,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_orient_destroy(struct video_orient_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->in.data)
+        channel_release(&self->in);
+}
+
+enum DeviceStatusCode
+video_orient_configure(struct video_orient_s* self,
+                       enum orientation orientation)
+{
+    EXPECT(orientation < Orientation_Count,
+           "Unknown orientation %d.",
+           orientation);
+    self->orientation = orientation;
+    if (orientation != Orientation_None && !self->in.data) {
+        LOG("[stream %d] Allocating %llu bytes for the orientation queue.",
+            self->stream_id,
+            (unsigned long long)self->in_capacity_bytes);
+        channel_new(&self->in, self->in_capacity_bytes);
+        CHECK(self->in.data);
+    }
+    return Device_Ok;
+Error:
+    self->orientation = Orientation_None;
+    return Device_Err;
+}
+
+uint8_t
+video_orient_is_enabled(const struct video_orient_s* self)
+{
+    return self->orientation != Orientation_None;
+}
+
+enum DeviceStatusCode
+video_orient_start(struct video_orient_s* self)
+{
+    EXPECT(video_orient_is_enabled(self),
+           "Expected an orientation to be configured for stream %d.",
+           self->stream_id);
+    channel_reader_attach(&self->in, &self->reader);
+    channel_accept_writes(&self->in, 1);
+    self->stats = (struct video_orient_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_orient_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+struct ImageShape
+video_orient_output_shape(const struct video_orient_s* self,
+                          const struct ImageShape* in)
+{
+    struct ImageShape out = *in;
+    if (!video_orient_is_enabled(self) || !bytes_per_pixel(in) ||
+        !orientations[self->orientation].transpose)
+        return out;
+    out.dims.width = in->dims.height;
+    out.dims.height = in->dims.width;
+    out.strides.height = (int64_t)out.dims.width * out.dims.channels;
+    return out;
+}
+
+#ifndef NO_UNIT_TESTS
+
+/// Orients a frame of distinct pixels and compares every output pixel with
+/// the input pixel the orientation says it comes from.
+static int
+check_orientation(struct worker_pool* pool,
+                  enum orientation orientation,
+                  enum SampleType type,
+                  uint32_t channels,
+                  uint32_t w,
+                  uint32_t h)
+{
+    struct video_orient_s self = { .orientation = orientation };
+    struct VideoFrame* in = 0;
+    struct VideoFrame* out = 0;
+    const struct ImageShape shape = {
+        .dims = { .channels = channels, .width = w, .height = h, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = channels,
+                     .height = (int64_t)w * channels,
+                     .planes = (int64_t)w * h * channels },
+        .type = type,
+    };
+    const size_t bytes = bytes_per_pixel(&shape);
+    CHECK(bytes == bytes_of_type(type) * channels);
+    const size_t nbytes = sizeof(*in) + (size_t)w * h * bytes;
+    CHECK(in = (struct VideoFrame*)malloc(nbytes));
+    CHECK(out = (struct VideoFrame*)malloc(nbytes));
+    in->shape = shape;
+    for (size_t i = 0; i < (size_t)w * h * bytes; ++i)
+        in->data[i] = (uint8_t)(i * 2654435761u >> 13);
+    out->shape = video_orient_output_shape(&self, &in->shape);
+
+    orient(pool, orientation, in, out, bytes);
+
+    const uint32_t out_w = out->shape.dims.width;
+    const uint32_t out_h = out->shape.dims.height;
+    for (uint32_t y = 0; y < out_h; ++y) {
+        for (uint32_t x = 0; x < out_w; ++x) {
+            uint32_t sx = x, sy = y;
+            switch (orientation) {
+                case Orientation_FlipX:
+                    sx = w - 1 - x;
+                    break;
+                case Orientation_FlipY:
+                    sy = h - 1 - y;
+                    break;
+                case Orientation_Rotate90:
+                    sx = y;
+                    sy = h - 1 - x;
+                    break;
+                case Orientation_Rotate180:
+                    sx = w - 1 - x;
+                    sy = h - 1 - y;
+                    break;
+                case Orientation_Rotate270:
+                    sx = w - 1 - y;
+                    sy = x;
+                    break;
+                case Orientation_Transpose:
+                    sx = y;
+                    sy = x;
+                    break;
+                default:;
+            }
+            EXPECT(!memcmp(out->data + ((size_t)y * out_w + x) * bytes,
+                           in->data + ((size_t)sy * w + sx) * bytes,
+                           bytes),
+                   "Orientation %d, %u bytes per pixel, %ux%u: output pixel "
+                   "(%u,%u) doesn't match input pixel (%u,%u).",
+                   (int)orientation,
+                   (unsigned)bytes,
+                   w,
+                   h,
+                   x,
+                   y,
+                   sx,
+                   sy);
+        }
+    }
+    free(in);
+    free(out);
+    return 1;
+Error:
+    free(in);
+    free(out);
+    return 0;
+}
+
+int
+unit_test__orient_matches_definition()
+{
+    struct worker_pool pool = { 0 };
+    CHECK(worker_pool_init(&pool, 2));
+    // 1, 2, 4 and 8 bytes per pixel, on frames with partial tiles and
+    // more than one block and strip.
+    const struct
+    {
+        enum SampleType type;
+        uint32_t channels;
+    } types[] = {
+        { SampleType_u8, 1 },
+        { SampleType_u16, 1 },
+        { SampleType_f32, 1 },
+        { SampleType_u16, 4 },
+        { SampleType_u8, 3 },
+    };
+    const uint32_t sizes[][2] = { { 8, 8 }, { 150, 67 }, { 13, 130 } };
+    for (int o = Orientation_FlipX; o < Orientation_Count; ++o)
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+                CHECK(check_orientation(&pool,
+                                        (enum orientation)o,
+                                        types[t].type,
+                                        types[t].channels,
+                                        sizes[s][0],
+                                        sizes[s][1]));
+    worker_pool_destroy(&pool);
+    return 1;
+Error:
+    worker_pool_destroy(&pool);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
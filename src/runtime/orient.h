@@ -0,0 +1,118 @@
+//!
+//! # Orientation
+//!
+//! Mirrors, rotates or transposes frames for cameras that are mounted
+//! rotated or mirrored, so that every reader of the sink's input sees frames
+//! the right way up. The source, and the filter when it's inline, write to
+//! the stage's input channel and the stage writes to the sink's input.
+//!
+//! Orientations that swap rows and columns work on 8x8 tiles of pixels that
+//! are transposed in registers, visited in 64x64 blocks so the rows a block
+//! reads and writes stay in cache. Strips of output rows are oriented in
+//! parallel on the worker pool.
+//!
+//! Frames with interleaved channels are oriented by pixel. Output frames are
+//! packed. Frames with other layouts, and markers, pass through unchanged.
+//!
+
+#ifndef H_ACQUIRE_ORIENT_V0
+#define H_ACQUIRE_ORIENT_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+    enum orientation
+    {
+        Orientation_None = 0,
+        /// Mirrors left and right.
+        Orientation_FlipX,
+        /// Mirrors top and bottom.
+        Orientation_FlipY,
+        /// Rotates clockwise by a quarter turn.
+        Orientation_Rotate90,
+        Orientation_Rotate180,
+        /// Rotates counterclockwise by a quarter turn.
+        Orientation_Rotate270,
+        /// Swaps rows and columns.
+        Orientation_Transpose,
+        Orientation_Count,
+    };
+
+    /// Context for the orientation thread
+    struct video_orient_s
+    {
+        enum orientation orientation;
+
+        /// Frames to orient. Allocated the first time orientation is
+        /// enabled.
+        struct channel in;
+        size_t in_capacity_bytes;
+        struct channel_reader reader;
+
+        struct channel* out;
+
+        struct worker_pool* pool;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the orientation thread. Reset on start.
+        struct video_orient_stats_s
+        {
+            uint64_t frame_count;
+            /// Frames passed on unchanged because of their layout.
+            uint64_t skipped_count;
+        } stats;
+
+        /// Called when the thread exits, after the last frame has been
+        /// written to `out`.
+        void (*sig_stop_sink)(const struct video_orient_s*);
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_orient_init(
+      struct video_orient_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      struct channel* out,
+      struct worker_pool* pool,
+      void (*sig_stop_sink)(const struct video_orient_s*));
+
+    void video_orient_destroy(struct video_orient_s* self);
+
+    /// @param[in] orientation `Orientation_None` disables the stage.
+    enum DeviceStatusCode video_orient_configure(struct video_orient_s* self,
+                                                 enum orientation orientation);
+
+    uint8_t video_orient_is_enabled(const struct video_orient_s* self);
+
+    enum DeviceStatusCode video_orient_start(struct video_orient_s* self);
+
+    /// @returns The shape of the frames made from frames of shape `in`.
+    struct ImageShape video_orient_output_shape(
+      const struct video_orient_s* self,
+      const struct ImageShape* in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_ORIENT_V0
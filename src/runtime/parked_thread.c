@@ -0,0 +1,121 @@
+#include "parked_thread.h"
+#include "logger.h"
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static void
+parked_thread_main(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    while (1) {
+        while (!self->is_busy && !self->is_exiting)
+            condition_variable_wait(&self->notify, &self->lock);
+        if (!self->is_busy)
+            break; // Exiting, and nothing left to run.
+        void (*fn)(void*) = self->fn;
+        void* args = self->args;
+        lock_release(&self->lock);
+        fn(args);
+        lock_acquire(&self->lock);
+        self->is_busy = 0;
+        condition_variable_notify_all(&self->notify);
+    }
+    lock_release(&self->lock);
+}
+
+void
+parked_thread_init(struct parked_thread* self)
+{
+    *self = (struct parked_thread){ 0 };
+    thread_init(&self->thread);
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify);
+}
+
+void
+parked_thread_destroy(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    const int is_created = self->is_created;
+    self->is_exiting = 1;
+    condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+    if (!is_created)
+        return;
+    thread_join(&self->thread);
+    self->is_created = 0;
+}
+
+int
+parked_thread_create(struct parked_thread* self,
+                     void (*fn)(void*),
+                     void* args)
+{
+    lock_acquire(&self->lock);
+    EXPECT(!self->is_busy, "Expected an idle thread.");
+    if (!self->is_created) {
+        // The new thread waits on the lock until the work is handed over.
+        self->is_exiting = 0;
+        CHECK(thread_create(
+          &self->thread, (void (*)(void*))parked_thread_main, self));
+        self->is_created = 1;
+    }
+    self->fn = fn;
+    self->args = args;
+    self->is_busy = 1;
+    condition_variable_notify_all(&self->notify);
+    lock_release(&self->lock);
+    return 1;
+Error:
+    lock_release(&self->lock);
+    return 0;
+}
+
+void
+parked_thread_join(struct parked_thread* self)
+{
+    lock_acquire(&self->lock);
+    while (self->is_busy)
+        condition_variable_wait(&self->notify, &self->lock);
+    lock_release(&self->lock);
+}
+
+#ifndef NO_UNIT_TESTS
+
+static void
+increment(void* args)
+{
+    ++*(int*)args;
+}
+
+int
+unit_test__parked_thread_runs_work_repeatedly()
+{
+    struct parked_thread thread;
+    int count = 0;
+    parked_thread_init(&thread);
+    parked_thread_join(&thread); // idle
+
+    for (int i = 0; i < 100; ++i) {
+        CHECK(parked_thread_create(&thread, increment, &count));
+        parked_thread_join(&thread);
+        CHECK(count == i + 1);
+    }
+    parked_thread_destroy(&thread);
+    CHECK(!thread.is_created);
+    return 1;
+Error:
+    parked_thread_destroy(&thread);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
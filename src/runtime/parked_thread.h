@@ -0,0 +1,65 @@
+//!
+//! # Parked threads
+//!
+//! A thread that outlives the work it runs. Each stage runs its thread
+//! function once per acquisition. Creating and joining an OS thread for
+//! every stage on every `acquire_start()` and `acquire_stop()` costs more
+//! than a short acquisition, so the thread is created the first time it's
+//! needed, parks on a condition variable when its work returns, and is
+//! woken with the next piece of work.
+//!
+//! `parked_thread_create()` and `parked_thread_join()` stand in for
+//! `thread_create()` and `thread_join()`. Joining waits for the work to
+//! return and leaves the thread parked. `parked_thread_destroy()` ends the
+//! thread.
+//!
+
+#ifndef H_ACQUIRE_PARKED_THREAD_V0
+#define H_ACQUIRE_PARKED_THREAD_V0
+
+#include <stdint.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct parked_thread
+    {
+        struct thread thread;
+        struct lock lock;
+        /// Signaled when work is handed over, when it returns, and on
+        /// exit.
+        struct condition_variable notify;
+
+        void (*fn)(void*);
+        void* args;
+
+        /// The OS thread exists.
+        uint8_t is_created;
+        /// `fn` was handed over and hasn't returned yet.
+        uint8_t is_busy;
+        uint8_t is_exiting;
+    };
+
+    void parked_thread_init(struct parked_thread* self);
+
+    /// @brief Ends the thread once its current work returns.
+    void parked_thread_destroy(struct parked_thread* self);
+
+    /// @brief Runs `fn(args)` on the thread, creating it the first time.
+    /// @returns 1 on success, otherwise 0 (e.g. the thread is still busy).
+    int parked_thread_create(struct parked_thread* self,
+                             void (*fn)(void*),
+                             void* args);
+
+    /// @brief Waits for the work handed to `parked_thread_create()` to
+    /// return. Returns right away when the thread is idle.
+    void parked_thread_join(struct parked_thread* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_PARKED_THREAD_V0
@@ -0,0 +1,475 @@
+#include "preview.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// Enough entries for every value of a 16-bit sample type.
+#define LUT_SIZE (1 << 16)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns 0 if `type` can't be previewed, otherwise 1.
+/// `lo` and `hi` receive the range of the sample type. Floating point
+/// samples are expected in `[0,1]`.
+static int
+sample_range(enum SampleType type, int32_t* lo, int32_t* hi)
+{
+    switch (type) {
+        case SampleType_u8:
+            *lo = 0, *hi = UINT8_MAX;
+            return 1;
+        case SampleType_u10:
+            *lo = 0, *hi = (1 << 10) - 1;
+            return 1;
+        case SampleType_u12:
+            *lo = 0, *hi = (1 << 12) - 1;
+            return 1;
+        case SampleType_u14:
+            *lo = 0, *hi = (1 << 14) - 1;
+            return 1;
+        case SampleType_u16:
+            *lo = 0, *hi = UINT16_MAX;
+            return 1;
+        case SampleType_i8:
+            *lo = INT8_MIN, *hi = INT8_MAX;
+            return 1;
+        case SampleType_i16:
+            *lo = INT16_MIN, *hi = INT16_MAX;
+            return 1;
+        case SampleType_f32:
+            *lo = 0, *hi = 1;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/// Selects the sample values shown as black (`lo`) and white (`hi`).
+static void
+display_window(const struct video_preview_s* self,
+               enum SampleType type,
+               float* lo,
+               float* hi)
+{
+    if (self->display_max > self->display_min) {
+        *lo = self->display_min;
+        *hi = self->display_max;
+    } else {
+        int32_t tlo = 0, thi = 1;
+        sample_range(type, &tlo, &thi);
+        *lo = (float)tlo;
+        *hi = (float)thi;
+    }
+}
+
+static uint8_t
+to_display(float v, float lo, float scale)
+{
+    const float d = (v - lo) * scale;
+    if (!(d > 0.0f)) // also catches NaN
+        return 0;
+    if (d >= 255.0f)
+        return 255;
+    return (uint8_t)(d + 0.5f);
+}
+
+static void
+build_lut(struct video_preview_s* self, enum SampleType type)
+{
+    int32_t tlo = 0, thi = 0;
+    float lo, hi;
+    sample_range(type, &tlo, &thi);
+    display_window(self, type, &lo, &hi);
+    const float scale = 255.0f / (hi - lo);
+    // Fill the whole table, not just [tlo,thi]. Packed types like u12 keep
+    // their samples in 16 bits, so stray high bits can index past `thi`.
+    for (int32_t i = 0; i < LUT_SIZE; ++i)
+        self->lut[i] = to_display((float)(tlo + i), lo, scale);
+    self->lut_type = type;
+}
+
+/// Box averages the pixels of row `y` of the preview and maps them through
+/// `lut`. Sums are offset by the smallest sample value, `lo`, so the lut
+/// index is never negative.
+#define PREVIEW_ROW_INT(T, lo)                                                 \
+    for (uint32_t ox = 0; ox < ow; ++ox) {                                     \
+        const uint32_t x0 = ox * f, x1 = x0 + f < w ? x0 + f : w;              \
+        int64_t sum = 0;                                                       \
+        for (uint32_t yy = y0; yy < y1; ++yy) {                                \
+            const T* row = (const T*)frame->data + yy * sy;                    \
+            for (uint32_t x = x0; x < x1; ++x)                                 \
+                sum += row[x * sx];                                            \
+        }                                                                      \
+        const int64_t n = (int64_t)(x1 - x0) * (y1 - y0);                      \
+        dst[ox] = self->lut[(sum - (int64_t)(lo)*n + n / 2) / n];              \
+    }
+
+/// Writes row `y` of the preview of `frame` to `dst`.
+/// Integer frames require the lut to have been built for their type.
+static void
+preview_row(const struct video_preview_s* self,
+            const struct VideoFrame* frame,
+            uint32_t y,
+            uint8_t* dst)
+{
+    const uint32_t f = self->downscale;
+    const uint32_t w = frame->shape.dims.width;
+    const uint32_t h = frame->shape.dims.height;
+    const uint32_t ow = (w + f - 1) / f;
+    const uint32_t y0 = y * f, y1 = y0 + f < h ? y0 + f : h;
+    const size_t sx = frame->shape.strides.width;
+    const size_t sy = frame->shape.strides.height;
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            PREVIEW_ROW_INT(uint8_t, 0);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            PREVIEW_ROW_INT(uint16_t, 0);
+            break;
+        case SampleType_i8:
+            PREVIEW_ROW_INT(int8_t, INT8_MIN);
+            break;
+        case SampleType_i16:
+            PREVIEW_ROW_INT(int16_t, INT16_MIN);
+            break;
+        case SampleType_f32: {
+            float lo, hi;
+            display_window(self, SampleType_f32, &lo, &hi);
+            const float scale = 255.0f / (hi - lo);
+            for (uint32_t ox = 0; ox < ow; ++ox) {
+                const uint32_t x0 = ox * f, x1 = x0 + f < w ? x0 + f : w;
+                double sum = 0.0;
+                for (uint32_t yy = y0; yy < y1; ++yy) {
+                    const float* row = (const float*)frame->data + yy * sy;
+                    for (uint32_t x = x0; x < x1; ++x)
+                        sum += row[x * sx];
+                }
+                const double n = (double)(x1 - x0) * (y1 - y0);
+                dst[ox] = to_display((float)(sum / n), lo, scale);
+            }
+            break;
+        }
+        default:
+            memset(dst, 0, ow); // NOLINT
+    }
+}
+
+#undef PREVIEW_ROW_INT
+
+struct preview_job_s
+{
+    const struct video_preview_s* self;
+    const struct VideoFrame* frame;
+    struct VideoFrame* out;
+};
+
+static void
+preview_job(void* ctx, size_t i)
+{
+    const struct preview_job_s* job = (const struct preview_job_s*)ctx;
+    const size_t ow = job->out->shape.dims.width;
+    preview_row(job->self, job->frame, (uint32_t)i, job->out->data + i * ow);
+}
+
+static int
+is_due(struct video_preview_s* self)
+{
+    if (!self->has_previewed || self->max_rate_hz <= 0.0f)
+        return 1;
+    return clock_toc_ms(&self->clock) >= 1e3 / self->max_rate_hz;
+}
+
+static void
+preview_frame(struct video_preview_s* self, const struct VideoFrame* frame)
+{
+    int32_t lo, hi;
+    if (!sample_range(frame->shape.type, &lo, &hi) || !is_due(self))
+        return;
+    if (frame->shape.type != SampleType_f32 &&
+        self->lut_type != frame->shape.type)
+        build_lut(self, frame->shape.type);
+
+    const uint32_t f = self->downscale;
+    const uint32_t ow = (frame->shape.dims.width + f - 1) / f;
+    const uint32_t oh = (frame->shape.dims.height + f - 1) / f;
+    const size_t nbytes =
+      (sizeof(struct VideoFrame) + (size_t)ow * oh + 7) & ~(size_t)7;
+    // Previews are best effort. Never wait on the viewer.
+    struct VideoFrame* out =
+      (struct VideoFrame*)channel_try_write_map(&self->out, nbytes);
+    if (!out) {
+        ++self->stats.dropped_count;
+        return;
+    }
+    *out = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .shape = {
+          .dims = { .channels = 1, .width = ow, .height = oh, .planes = 1 },
+          .strides = { .channels = 1,
+                       .width = 1,
+                       .height = ow,
+                       .planes = (int64_t)ow * oh },
+          .type = SampleType_u8,
+        },
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamps = frame->timestamps,
+    };
+    struct preview_job_s job = { .self = self, .frame = frame, .out = out };
+    worker_pool_run(self->pool, oh, preview_job, &job);
+    channel_write_unmap(&self->out);
+
+    clock_tic(&self->clock);
+    self->has_previewed = 1;
+    ++self->stats.frame_count;
+}
+
+static void
+preview_available(struct video_preview_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        const struct VideoFrame* last = 0;
+        // Only the newest frame in the slice is worth showing.
+        while ((frame = frame_iterator_next(&it)))
+            if (frame_marker_of(frame) == FrameMarker_None)
+                last = frame;
+        if (last)
+            preview_frame(self, last);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_preview_thread(struct video_preview_s* self)
+{
+    LOG("[stream %d] PREVIEW: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        preview_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] PREVIEW: Flushing", self->stream_id);
+    preview_available(self);
+    LOG("[stream %d] PREVIEW: Exiting thread (%llu previews, %llu dropped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.dropped_count);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_preview_init(struct video_preview_s* self,
+                   uint8_t stream_id,
+                   size_t channel_capacity_bytes,
+                   struct channel* in,
+                   struct worker_pool* pool)
+{
+    CHECK(in);
+    CHECK(pool);
+    *self = (struct video_preview_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+        .lut_type = SampleTypeCount,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_preview_destroy(struct video_preview_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    free(self->lut);
+    self->lut = 0;
+}
+
+enum DeviceStatusCode
+video_preview_configure(struct video_preview_s* self,
+                        uint8_t downscale,
+                        float max_rate_hz,
+                        float display_min,
+                        float display_max)
+{
+    EXPECT(downscale <= PREVIEW_MAX_DOWNSCALE &&
+             (downscale & (downscale - 1)) == 0,
+           "Expected a preview downscale of 0, 1, 2, 4 or 8. Got %d.",
+           downscale);
+    EXPECT(max_rate_hz >= 0.0f,
+           "Expected a non-negative preview rate. Got %f.",
+           max_rate_hz);
+    EXPECT(isfinite(display_min) && isfinite(display_max),
+           "Expected a finite preview display range.");
+    self->downscale = downscale;
+    self->max_rate_hz = max_rate_hz;
+    self->display_min = display_min;
+    self->display_max = display_max;
+    // The display range may have changed.
+    self->lut_type = SampleTypeCount;
+    if (!downscale) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the preview queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        CHECK(self->lut = (uint8_t*)malloc(LUT_SIZE));
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->downscale = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_preview_is_enabled(const struct video_preview_s* self)
+{
+    return self->downscale > 0;
+}
+
+enum DeviceStatusCode
+video_preview_start(struct video_preview_s* self)
+{
+    EXPECT(video_preview_is_enabled(self),
+           "Expected previews to be configured for stream %d.",
+           self->stream_id);
+    // Only preview frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_preview_stats_s){ 0 };
+    self->has_previewed = 0;
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_preview_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__preview_row()
+{
+    enum
+    {
+        W = 10,
+        H = 5
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[W * H];
+    } im = { 0 };
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = W,
+                     .planes = W * H },
+        .type = SampleType_u16,
+    };
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+            im.data[y * W + x] = (uint16_t)(100 * x + 10 * y);
+
+    uint8_t lut[LUT_SIZE];
+    struct video_preview_s self = {
+        .downscale = 4,
+        .display_min = 0.0f,
+        .display_max = 1020.0f,
+        .lut = lut,
+        .lut_type = SampleTypeCount,
+    };
+    build_lut(&self, SampleType_u16);
+    CHECK(lut[0] == 0);
+    CHECK(lut[510] == 128);
+    CHECK(lut[1020] == 255);
+    CHECK(lut[60000] == 255);
+    self.display_max = self.display_min; // the range of the type
+    build_lut(&self, SampleType_u12);
+    CHECK(lut[4095] == 255);
+    CHECK(lut[LUT_SIZE - 1] == 255);
+    self.display_max = 1020.0f;
+    build_lut(&self, SampleType_u16);
+
+    uint8_t row[3] = { 0 };
+    preview_row(&self, &im.frame, 0, row);
+    // Block means are 100*1.5+10*1.5=165, 100*5.5+15=565 and the partial
+    // block over columns 8 and 9: 100*8.5+15=865.
+    EXPECT(row[0] == 41, "Got %d", row[0]); // 165/4
+    EXPECT(row[1] == 141, "Got %d", row[1]); // 565/4
+    EXPECT(row[2] == 216, "Got %d", row[2]); // 865/4
+    // The last row is a partial block holding only row 4.
+    preview_row(&self, &im.frame, 1, row);
+    EXPECT(row[0] == 48, "Got %d", row[0]); // (150+40)/4
+
+    // Floating point frames are mapped directly.
+    struct
+    {
+        struct VideoFrame frame;
+        float data[4];
+    } fim = { 0 };
+    fim.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = 2, .height = 2, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = 2, .planes = 4 },
+        .type = SampleType_f32,
+    };
+    fim.data[0] = 0.0f;
+    fim.data[1] = 1.0f;
+    fim.data[2] = 0.5f;
+    fim.data[3] = 0.5f;
+    self.downscale = 2;
+    self.display_max = self.display_min; // the range of the type: [0,1]
+    preview_row(&self, &fim.frame, 0, row);
+    CHECK(row[0] == 128);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
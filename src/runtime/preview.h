@@ -0,0 +1,118 @@
+//!
+//! # Live preview
+//!
+//! Produces small 8-bit frames for display so viewers don't have to read
+//! the full resolution frames. The preview thread reads the sink's input
+//! channel alongside the other readers and, at most `max_rate_hz` times a
+//! second:
+//!
+//! 1. Averages each `downscale` by `downscale` block of pixels.
+//! 2. Maps the average through a display lookup table that stretches
+//!    `[display_min,display_max]` over `[0,255]`.
+//!
+//! Rows are processed in parallel on the worker pool. Only the first channel
+//! and plane of a frame are previewed.
+//!
+//! Previews are written to a small channel of their own. Writes never wait:
+//! when the channel is full the preview is dropped.
+//!
+
+#ifndef H_ACQUIRE_PREVIEW_V0
+#define H_ACQUIRE_PREVIEW_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "platform.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+/// Largest supported `downscale` factor.
+#define PREVIEW_MAX_DOWNSCALE (8)
+
+    /// Context for the preview thread
+    struct video_preview_s
+    {
+        /// 1, 2, 4 or 8. 0 when previews are disabled.
+        uint8_t downscale;
+        /// 0 doesn't limit the rate.
+        float max_rate_hz;
+        /// When `display_max <= display_min` the full range of the sample
+        /// type is used.
+        float display_min, display_max;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Preview frames. Allocated the first time previews are enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// Maps integer samples, offset by the smallest value of `lut_type`,
+        /// to display values. Rebuilt when the sample type changes.
+        uint8_t* lut;
+        enum SampleType lut_type;
+
+        /// Time of the last preview.
+        struct clock clock;
+        uint8_t has_previewed;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the preview thread. Reset on start.
+        struct video_preview_stats_s
+        {
+            uint64_t frame_count;
+            /// Previews that didn't fit in `out`.
+            uint64_t dropped_count;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_preview_init(struct video_preview_s* self,
+                                             uint8_t stream_id,
+                                             size_t channel_capacity_bytes,
+                                             struct channel* in,
+                                             struct worker_pool* pool);
+
+    void video_preview_destroy(struct video_preview_s* self);
+
+    /// @param[in] downscale 0 disables previews. Otherwise 1, 2, 4 or 8.
+    /// @param[in] max_rate_hz Most previews per second. 0 for no limit.
+    /// @param[in] display_min Sample value shown as black.
+    /// @param[in] display_max Sample value shown as white. When not more than
+    ///                        `display_min` the range of the sample type is
+    ///                        used.
+    enum DeviceStatusCode video_preview_configure(struct video_preview_s* self,
+                                                  uint8_t downscale,
+                                                  float max_rate_hz,
+                                                  float display_min,
+                                                  float display_max);
+
+    uint8_t video_preview_is_enabled(const struct video_preview_s* self);
+
+    enum DeviceStatusCode video_preview_start(struct video_preview_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_PREVIEW_V0
@@ -0,0 +1,399 @@
+#include "roi.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#define countof(e) (sizeof(e) / sizeof((e)[0]))
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+/// @returns The compact shape of the region `r` cut from frames of shape
+///          `in`.
+static struct ImageShape
+region_shape(const struct ImageShape* in, const struct roi_rect* r)
+{
+    const size_t px = in->strides.width; // samples per pixel
+    return (struct ImageShape){
+        .dims = { .channels = in->dims.channels,
+                  .width = r->width,
+                  .height = r->height,
+                  .planes = 1 },
+        .strides = { .channels = in->strides.channels,
+                     .width = px,
+                     .height = px * r->width,
+                     .planes = px * r->width * r->height },
+        .type = in->type,
+    };
+}
+
+static size_t
+bytes_of_region_frame(const struct ImageShape* shape)
+{
+    return (sizeof(struct VideoFrame) +
+            shape->strides.planes * bytes_of_type(shape->type) + 7) &
+           ~(size_t)7;
+}
+
+static int
+contains_regions(const struct video_roi_s* self, const struct ImageShape* in)
+{
+    for (uint32_t i = 0; i < self->count; ++i) {
+        const struct roi_rect* r = self->rects + i;
+        if ((uint64_t)r->x + r->width > in->dims.width ||
+            (uint64_t)r->y + r->height > in->dims.height)
+            return 0;
+    }
+    return 1;
+}
+
+static void
+extract_frame(struct video_roi_s* self, const struct VideoFrame* in)
+{
+    if (frame_marker_of(in) != FrameMarker_None) {
+        frame_marker_pass_on(&self->out, in);
+        return;
+    }
+    ++self->stats.frame_count;
+    if (!contains_regions(self, &in->shape)) {
+        if (!self->stats.skipped_count++)
+            LOGE("[stream %d] ROI: A %dx%d frame doesn't contain every "
+                 "region. Skipping frames like it.",
+                 self->stream_id,
+                 in->shape.dims.width,
+                 in->shape.dims.height);
+        return;
+    }
+
+    // The frames for every region are written as one group so they reach
+    // storage together and in order.
+    size_t offsets[ROI_MAX_COUNT] = { 0 };
+    size_t nbytes = 0;
+    for (uint32_t i = 0; i < self->count; ++i) {
+        const struct ImageShape shape =
+          region_shape(&in->shape, self->rects + i);
+        offsets[i] = nbytes;
+        nbytes += bytes_of_region_frame(&shape);
+    }
+    uint8_t* group = (uint8_t*)channel_write_map(&self->out, nbytes);
+    if (!group)
+        return; // Not accepting writes
+
+    struct VideoFrame* out[ROI_MAX_COUNT] = { 0 };
+    uint32_t y_beg = UINT32_MAX, y_end = 0;
+    for (uint32_t i = 0; i < self->count; ++i) {
+        const struct roi_rect* r = self->rects + i;
+        const struct ImageShape shape = region_shape(&in->shape, r);
+        out[i] = (struct VideoFrame*)(group + offsets[i]);
+        *out[i] = (struct VideoFrame){
+            .bytes_of_frame = bytes_of_region_frame(&shape),
+            .shape = shape,
+            .frame_id = in->frame_id,
+            .hardware_frame_id = in->hardware_frame_id,
+            .timestamps = in->timestamps,
+        };
+        y_beg = r->y < y_beg ? r->y : y_beg;
+        y_end = r->y + r->height > y_end ? r->y + r->height : y_end;
+    }
+
+    // One pass over the rows the regions cover. Each row is read once and
+    // its spans are copied to every region that overlaps it.
+    const size_t bps = bytes_of_type(in->shape.type);
+    const size_t bytes_per_pixel = in->shape.strides.width * bps;
+    const size_t bytes_per_row = in->shape.strides.height * bps;
+    for (uint32_t y = y_beg; y < y_end; ++y) {
+        const uint8_t* src = in->data + y * bytes_per_row;
+        for (uint32_t i = 0; i < self->count; ++i) {
+            const struct roi_rect* r = self->rects + i;
+            const uint32_t dy = y - r->y; // wraps when y < r->y
+            if (dy >= r->height)
+                continue;
+            const size_t n = r->width * bytes_per_pixel;
+            memcpy(out[i]->data + dy * n, // NOLINT
+                   src + r->x * bytes_per_pixel,
+                   n);
+        }
+    }
+    channel_write_unmap(&self->out);
+}
+
+static void
+extract_available(struct video_roi_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            extract_frame(self, frame);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+}
+
+static int
+video_roi_thread(struct video_roi_s* self)
+{
+    LOG("[stream %d] ROI: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        extract_available(self);
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] ROI: Flushing", self->stream_id);
+    extract_available(self);
+    LOG("[stream %d] ROI: Exiting thread (%llu frames, %llu skipped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.skipped_count);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return 0;
+}
+
+enum DeviceStatusCode
+video_roi_init(struct video_roi_s* self,
+               uint8_t stream_id,
+               size_t channel_capacity_bytes,
+               struct channel* in,
+               void (*sig_stop_sink)(const struct video_roi_s*))
+{
+    CHECK(in);
+    CHECK(sig_stop_sink);
+    *self = (struct video_roi_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_roi_destroy(struct video_roi_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+}
+
+enum DeviceStatusCode
+video_roi_configure(struct video_roi_s* self,
+                    const struct roi_rect* rects,
+                    uint32_t count)
+{
+    EXPECT(count <= ROI_MAX_COUNT,
+           "Expected at most %d regions of interest. Got %u.",
+           ROI_MAX_COUNT,
+           count);
+    EXPECT(rects || !count, "Expected regions of interest.");
+    for (uint32_t i = 0; i < count; ++i) {
+        const struct roi_rect* r = rects + i;
+        EXPECT(r->width && r->height,
+               "Region of interest %u is empty (%ux%u).",
+               i,
+               r->width,
+               r->height);
+        EXPECT((uint64_t)r->x + r->width <= UINT32_MAX &&
+                 (uint64_t)r->y + r->height <= UINT32_MAX,
+               "Region of interest %u is out of range.",
+               i);
+    }
+    memset(self->rects, 0, sizeof(self->rects)); // NOLINT
+    if (count)
+        memcpy(self->rects, rects, count * sizeof(*rects)); // NOLINT
+    self->count = count;
+    if (!count) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the region of interest "
+            "queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->count = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_roi_is_enabled(const struct video_roi_s* self)
+{
+    return self->count > 0;
+}
+
+void
+video_roi_set_input(struct video_roi_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_roi_start(struct video_roi_s* self)
+{
+    EXPECT(video_roi_is_enabled(self),
+           "Expected regions of interest to be configured for stream %d.",
+           self->stream_id);
+    // Only extract from frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_roi_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_roi_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+struct ImageShape
+video_roi_output_shape(const struct video_roi_s* self,
+                       const struct ImageShape* in)
+{
+    if (!video_roi_is_enabled(self))
+        return *in;
+    uint32_t largest = 0;
+    for (uint32_t i = 1; i < self->count; ++i) {
+        const struct roi_rect* a = self->rects + i;
+        const struct roi_rect* b = self->rects + largest;
+        if ((uint64_t)a->width * a->height > (uint64_t)b->width * b->height)
+            largest = i;
+    }
+    return region_shape(in, self->rects + largest);
+}
+
+#ifndef NO_UNIT_TESTS
+
+static void
+ignore_stop_sink(const struct video_roi_s* self)
+{
+    (void)self;
+}
+
+int
+unit_test__roi_extracts_regions()
+{
+    enum
+    {
+        W = 16,
+        H = 12
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[W * H];
+    } im = { 0 };
+    im.frame.bytes_of_frame = sizeof(im);
+    im.frame.frame_id = 3;
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = W,
+                     .planes = W * H },
+        .type = SampleType_u16,
+    };
+    for (uint16_t i = 0; i < W * H; ++i)
+        im.data[i] = i;
+
+    // Overlapping regions, one touching the bottom right corner.
+    const struct roi_rect rects[] = {
+        { .x = 1, .y = 2, .width = 5, .height = 3 },
+        { .x = 4, .y = 0, .width = 12, .height = 12 },
+        { .x = 0, .y = 11, .width = 1, .height = 1 },
+    };
+    struct channel in = { 0 };
+    struct video_roi_s roi = { 0 };
+    CHECK(video_roi_init(&roi, 0, 1 << 16, &in, ignore_stop_sink) ==
+          Device_Ok);
+    CHECK(video_roi_configure(&roi, rects, countof(rects)) == Device_Ok);
+    channel_accept_writes(&roi.out, 1);
+
+    extract_frame(&roi, &im.frame);
+    // Too small to contain the second region.
+    im.frame.shape.dims.width = W - 1;
+    extract_frame(&roi, &im.frame);
+    CHECK(roi.stats.frame_count == 2);
+    CHECK(roi.stats.skipped_count == 1);
+
+    struct channel_reader reader = { 0 };
+    struct slice slice = channel_read_map(&roi.out, &reader);
+    struct frame_iterator it = frame_iterator_init(&slice);
+    const struct VideoFrame* frame = 0;
+    uint32_t iregion = 0;
+    while ((frame = frame_iterator_next(&it))) {
+        CHECK(iregion < countof(rects));
+        const struct roi_rect* r = rects + iregion;
+        CHECK(frame->frame_id == 3);
+        CHECK(frame->shape.type == SampleType_u16);
+        CHECK(frame->shape.dims.width == r->width);
+        CHECK(frame->shape.dims.height == r->height);
+        CHECK(frame->shape.strides.height == r->width);
+        const uint16_t* data = (const uint16_t*)frame->data;
+        for (uint32_t y = 0; y < r->height; ++y) {
+            for (uint32_t x = 0; x < r->width; ++x) {
+                const uint16_t expected = (uint16_t)((r->y + y) * W + r->x + x);
+                EXPECT(data[y * r->width + x] == expected,
+                       "Region %u (%u,%u): expected %u. Got %u.",
+                       iregion,
+                       x,
+                       y,
+                       expected,
+                       data[y * r->width + x]);
+            }
+        }
+        ++iregion;
+    }
+    CHECK(iregion == countof(rects));
+    channel_read_unmap(&roi.out, &reader, slice_size_bytes(&slice));
+
+    // Empty regions are rejected.
+    {
+        const struct roi_rect empty = { .width = 0, .height = 4 };
+        CHECK(video_roi_configure(&roi, &empty, 1) == Device_Err);
+        CHECK(!video_roi_is_enabled(&roi));
+    }
+
+    video_roi_destroy(&roi);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,109 @@
+//!
+//! # Region of interest extraction
+//!
+//! Copies a list of rectangles out of each frame sent to storage so storage
+//! scales with the area of interest rather than the sensor.
+//!
+//! For every input frame the stage writes one compact frame per region, in
+//! the order the regions were configured. The frames for one input frame
+//! are written together and share its `frame_id` and timestamps, so the
+//! region a frame came from is its position in that group.
+//!
+//! All of a frame's regions are copied in a single pass over its rows. Input
+//! frames that don't contain every region are skipped and counted.
+//!
+
+#ifndef H_ACQUIRE_ROI_V0
+#define H_ACQUIRE_ROI_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "device/props/components.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define ROI_MAX_COUNT (8)
+
+    struct roi_rect
+    {
+        uint32_t x, y, width, height;
+    };
+
+    /// Context for the region of interest thread
+    struct video_roi_s
+    {
+        struct roi_rect rects[ROI_MAX_COUNT];
+        /// 0 disables extraction.
+        uint32_t count;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Extracted frames. Allocated the first time extraction is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the region of interest thread. Reset on start.
+        struct video_roi_stats_s
+        {
+            uint64_t frame_count;
+            /// Input frames that didn't contain every region.
+            uint64_t skipped_count;
+        } stats;
+
+        /// Called when the thread exits, after the last frame has been
+        /// written to `out`.
+        void (*sig_stop_sink)(const struct video_roi_s*);
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_roi_init(
+      struct video_roi_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      struct channel* in,
+      void (*sig_stop_sink)(const struct video_roi_s*));
+
+    void video_roi_destroy(struct video_roi_s* self);
+
+    /// @param[in] rects `count` non-empty rectangles.
+    /// @param[in] count At most `ROI_MAX_COUNT`. 0 disables extraction.
+    enum DeviceStatusCode video_roi_configure(struct video_roi_s* self,
+                                              const struct roi_rect* rects,
+                                              uint32_t count);
+
+    uint8_t video_roi_is_enabled(const struct video_roi_s* self);
+
+    /// @brief Selects the channel the stage reads from.
+    /// @see video_encoder_set_input()
+    void video_roi_set_input(struct video_roi_s* self, struct channel* in);
+
+    enum DeviceStatusCode video_roi_start(struct video_roi_s* self);
+
+    /// @returns The shape of the largest region cut from frames of shape
+    ///          `in`, or `in` when extraction is disabled.
+    struct ImageShape video_roi_output_shape(const struct video_roi_s* self,
+                                             const struct ImageShape* in);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_ROI_V0
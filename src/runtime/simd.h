@@ -0,0 +1,51 @@
+//!
+//! # SIMD helpers
+//!
+//! Loads 8 samples of any integer sample type as 8 floats. Used by kernels
+//! that compute in f32 regardless of the input type.
+//!
+
+#ifndef H_ACQUIRE_SIMD_V0
+#define H_ACQUIRE_SIMD_V0
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+static inline __m256
+load8_u8(const uint8_t* p)
+{
+    return _mm256_cvtepi32_ps(
+      _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+static inline __m256
+load8_u16(const uint16_t* p)
+{
+    return _mm256_cvtepi32_ps(
+      _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)));
+}
+
+static inline __m256
+load8_i8(const int8_t* p)
+{
+    return _mm256_cvtepi32_ps(
+      _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+static inline __m256
+load8_i16(const int16_t* p)
+{
+    return _mm256_cvtepi32_ps(
+      _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p)));
+}
+
+static inline __m256
+load8_f32(const float* p)
+{
+    return _mm256_loadu_ps(p);
+}
+#endif // __AVX2__
+
+#endif // H_ACQUIRE_SIMD_V0
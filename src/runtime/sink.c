@@ -1,9 +1,11 @@
 #include "sink.h"
+#include "marker.h"
 #include "vfslice.h"
 #include "platform.h"
 #include "logger.h"
 #include "throttler.h"
 #include "device/hal/storage.h"
+#include <stdio.h>
 #include <string.h>
 
 #define L (aq_logger)
@@ -38,18 +40,248 @@ video_sink_init(struct video_sink_s* self,
     memset(self, 0, sizeof(*self));
     self->stream_id = stream_id;
     self->sig_stop_source = sig_stop_source;
+    self->in_capacity_bytes = channel_capacity_bytes;
+    self->from = &self->in;
 
-    LOG("Video[%2d]: Allocating %llu bytes for the queue.",
-        stream_id,
-        channel_capacity_bytes);
-    channel_new(&self->in, channel_capacity_bytes);
+    parked_thread_init(&self->thread);
+    mailbox_init(&self->updates);
+    return Device_Ok;
+}
 
-    thread_init(&self->thread);
+enum DeviceStatusCode
+video_sink_reserve(struct video_sink_s* self)
+{
+    if (!self->in.data) {
+        LOG("Video[%2d]: Allocating %llu bytes for the queue.",
+            self->stream_id,
+            (unsigned long long)self->in_capacity_bytes);
+        channel_new(&self->in, self->in_capacity_bytes);
+        CHECK(self->in.data);
+    }
     return Device_Ok;
 Error:
     return Device_Err;
 }
 
+static int
+is_string_equal(const struct String* const a, const struct String* const b)
+{
+    if (!a->str || !b->str)
+        return a->str == b->str || (a->nbytes <= 1 && b->nbytes <= 1);
+    return strcmp(a->str, b->str) == 0;
+}
+
+/// Strings are compared by content. The rest is compared byte for byte, so
+/// bytes of padding that differ just mean the settings are applied again.
+static int
+is_storage_properties_equal(const struct StorageProperties* const a,
+                            const struct StorageProperties* const b)
+{
+    if (!is_string_equal(&a->filename, &b->filename) ||
+        !is_string_equal(&a->external_metadata_json,
+                         &b->external_metadata_json))
+        return 0;
+    struct StorageProperties x, y;
+    memcpy(&x, a, sizeof(x)); // NOLINT
+    memcpy(&y, b, sizeof(y)); // NOLINT
+    x.filename = y.filename = (struct String){ 0 };
+    x.external_metadata_json = y.external_metadata_json = (struct String){ 0 };
+    return memcmp(&x, &y, sizeof(x)) == 0;
+}
+
+/// @returns 1 when `settings` don't need to go to storage.
+static int
+is_storage_configured(const struct video_sink_s* const self,
+                      const struct StorageProperties* const settings)
+{
+    return self->has_settings &&
+           storage_get_state(self->storage) == DeviceState_Armed &&
+           (is_storage_properties_equal(settings, &self->requested) ||
+            is_storage_properties_equal(settings, &self->applied));
+}
+
+/// Writes `filename` with `_<burst>` inserted before its extension to `out`.
+/// @returns 1 on success, otherwise 0 (`out` is too small).
+static int
+burst_filename(char* out,
+               size_t capacity,
+               const char* filename,
+               uint64_t burst)
+{
+    const char* ext = strrchr(filename, '.');
+    const char* sep = strrchr(filename, '/');
+    const char* bsep = strrchr(filename, '\\');
+    if (bsep > sep)
+        sep = bsep;
+    if (!ext || ext < sep)
+        ext = filename + strlen(filename);
+    const int n = snprintf(out,
+                           capacity,
+                           "%.*s_%llu%s",
+                           (int)(ext - filename),
+                           filename,
+                           (unsigned long long)burst,
+                           ext);
+    return n > 0 && (size_t)n < capacity;
+}
+
+/// Points storage at `settings`, restarting it if it's running.
+static int
+restart_storage(struct video_sink_s* self,
+                const struct StorageProperties* settings)
+{
+    if (storage_get_state(self->storage) == DeviceState_Running)
+        CHECK(storage_stop(self->storage) == Device_Ok);
+    CHECK(storage_set(self->storage, settings) == Device_Ok);
+    CHECK(storage_start(self->storage) == Device_Ok);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Called for the marker that starts a burst. When bursts are split, every
+/// burst after the first goes to a new output, named after the first.
+static int
+start_burst(struct video_sink_s* self, const struct VideoFrame* marker)
+{
+    struct StorageProperties settings = { 0 };
+    if (!self->is_split_by_burst || self->burst_count++ == 0)
+        return 1;
+
+    const struct String* first = &self->first_burst_settings.filename;
+    char filename[4096] = { 0 };
+    CHECK(burst_filename(filename,
+                         sizeof(filename),
+                         first->str ? first->str : "",
+                         self->burst_count - 1));
+    CHECK(storage_properties_copy(&settings, &self->first_burst_settings));
+    CHECK(storage_properties_set_filename(
+      &settings, filename, strlen(filename) + 1));
+    settings.first_frame_id = (uint32_t)marker->frame_id;
+    LOG("[stream %d]: SINK: Burst %llu to %s",
+        self->stream_id,
+        (unsigned long long)(self->burst_count - 1),
+        filename);
+    CHECK(restart_storage(self, &settings));
+    storage_properties_destroy(&settings);
+    return 1;
+Error:
+    storage_properties_destroy(&settings);
+    return 0;
+}
+
+/// Sends the frames in `[beg,end)` to storage, keeping only every
+/// `store_every`'th frame and the frames `decimator` keeps. Markers aren't
+/// stored.
+static int
+append_frames(struct video_sink_s* self,
+              const struct VideoFrame* beg,
+              const struct VideoFrame* end)
+{
+    const int is_every_frame_stored =
+      self->store_every <= 1 && !decimator_is_enabled(&self->decimator);
+    // Consecutive stored frames are appended together.
+    const struct VideoFrame* run = beg;
+    const struct VideoFrame* cur = beg;
+    while (cur < end) {
+        const struct VideoFrame* next =
+          (const struct VideoFrame*)((const uint8_t*)cur + cur->bytes_of_frame);
+        const int is_marker = frame_marker_of(cur) != FrameMarker_None;
+        if (is_marker || !is_every_frame_stored) {
+            if (run < cur)
+                CHECK(storage_append(self->storage, run, cur) == Device_Ok);
+            run = next;
+        }
+        if (is_marker) {
+            if (frame_marker_of(cur) == FrameMarker_Burst)
+                CHECK(start_burst(self, cur));
+        } else if (!is_every_frame_stored) {
+            const int is_stored = self->store_every <= 1 ||
+                                  self->frame_count % self->store_every == 0;
+            ++self->frame_count;
+            if (is_stored && decimator_keep(&self->decimator, cur, next == end))
+                CHECK(storage_append(self->storage, cur, next) == Device_Ok);
+        }
+        cur = next;
+    }
+    if (run < end)
+        CHECK(storage_append(self->storage, run, end) == Device_Ok);
+    return 1;
+Error:
+    return 0;
+}
+
+/// Points storage back at the first burst's output, so the next start
+/// begins there again.
+static void
+end_bursts(struct video_sink_s* self)
+{
+    if (self->burst_count > 1 &&
+        storage_set(self->storage, &self->first_burst_settings) != Device_Ok) {
+        LOGE("[stream %d]: SINK: Failed to restore the storage settings",
+             self->stream_id);
+        // The next configuration has to go to storage.
+        self->has_settings = 0;
+    }
+}
+
+/// Applies the changes posted by `video_sink_update_live()`, if any.
+static int
+apply_live_updates(struct video_sink_s* self)
+{
+    struct StorageProperties settings = { 0 };
+    if (!mailbox_take(&self->updates))
+        return 1;
+    const uint8_t is_rollover = self->is_rollover_pending;
+    const int is_copied =
+      storage_properties_copy(&settings, &self->next_settings);
+    mailbox_release(&self->updates);
+    CHECK(is_copied);
+
+    if (is_rollover) {
+        LOG("[stream %d]: SINK: Rolling over to %s",
+            self->stream_id,
+            settings.filename.str ? settings.filename.str : "");
+        CHECK(restart_storage(self, &settings));
+    }
+    // Later bursts are named after the new settings.
+    if (self->is_split_by_burst)
+        CHECK(storage_properties_copy(&self->first_burst_settings, &settings));
+    mailbox_lock(&self->updates);
+    const int is_cached =
+      storage_properties_copy(&self->requested, &settings) &&
+      storage_properties_copy(&self->applied, &settings);
+    mailbox_unlock(&self->updates);
+    CHECK(is_cached);
+    self->is_live_updated = 1;
+    storage_properties_destroy(&settings);
+    return 1;
+Error:
+    storage_properties_destroy(&settings);
+    return 0;
+}
+
+/// Points storage at the live updated settings, so the next start uses
+/// them. Metadata changed without a new file name hasn't reached storage
+/// yet.
+static void
+end_live_updates(struct video_sink_s* self)
+{
+    struct StorageProperties settings = { 0 };
+    if (!self->is_live_updated)
+        return;
+    mailbox_lock(&self->updates);
+    const int is_copied = storage_properties_copy(&settings, &self->applied);
+    mailbox_unlock(&self->updates);
+    if (!is_copied || storage_set(self->storage, &settings) != Device_Ok) {
+        LOGE("[stream %d]: SINK: Failed to apply the updated storage settings",
+             self->stream_id);
+        // The next configuration has to go to storage.
+        self->has_settings = 0;
+    }
+    storage_properties_destroy(&settings);
+}
+
 static int
 video_sink_thread(struct video_sink_s* const self)
 {
@@ -62,12 +294,12 @@ video_sink_thread(struct video_sink_s* const self)
     while (!self->is_stopping && self->storage &&
            storage_get_state(self->storage) == DeviceState_Running) {
         do {
-            slice = make_vfslice(channel_read_map(&self->in, &self->reader));
+            CHECK(apply_live_updates(self));
+            slice = make_vfslice(channel_read_map(self->from, &self->reader));
             struct vfslice remaining =
               vfslice_split_at_delay_ms(&slice, self->write_delay_ms);
-            CHECK(storage_append(self->storage, slice.beg, remaining.beg) ==
-                  Device_Ok);
-            channel_read_unmap(&self->in,
+            CHECK(append_frames(self, slice.beg, remaining.beg));
+            channel_read_unmap(self->from,
                                &self->reader,
                                (uint8_t*)remaining.beg - (uint8_t*)slice.beg);
         } while (slice.end > slice.beg);
@@ -75,13 +307,16 @@ video_sink_thread(struct video_sink_s* const self)
     }
     TRACE("[stream %d]: SINK: Flushing", self->stream_id);
     do {
-        slice = make_vfslice(channel_read_map(&self->in, &self->reader));
-        CHECK(storage_append(self->storage, slice.beg, slice.end) == Device_Ok);
-        channel_read_unmap(
-          &self->in, &self->reader, (uint8_t*)slice.end - (uint8_t*)slice.beg);
+        slice = make_vfslice(channel_read_map(self->from, &self->reader));
+        CHECK(append_frames(self, slice.beg, slice.end));
+        channel_read_unmap(self->from,
+                           &self->reader,
+                           (uint8_t*)slice.end - (uint8_t*)slice.beg);
     } while (slice.end > slice.beg);
 
     CHECK(storage_stop(self->storage) == Device_Ok);
+    end_bursts(self);
+    end_live_updates(self);
     LOG("[stream %d]: SINK: Exiting thread", self->stream_id);
     self->is_running = 0;
     self->is_stopping = 0;
@@ -89,8 +324,10 @@ video_sink_thread(struct video_sink_s* const self)
 Error:
     LOGE("[stream %d]: SINK: Exiting thread (Error)", self->stream_id);
     self->sig_stop_source(self);
-    channel_read_unmap(&self->in, &self->reader, 0);
+    channel_read_unmap(self->from, &self->reader, 0);
     storage_stop(self->storage);
+    end_bursts(self);
+    end_live_updates(self);
     self->is_running = 0;
     self->is_stopping = 0;
     return 1;
@@ -107,6 +344,11 @@ video_sink_start(struct video_sink_s* self)
            "Storage device should be armed for stream %d. State is %s.",
            self->stream_id,
            device_state_as_string(storage_get_state(self->storage)));
+    self->burst_count = 0;
+    self->is_live_updated = 0;
+    if (self->is_split_by_burst)
+        CHECK(storage_get(self->storage, &self->first_burst_settings) ==
+              Device_Ok);
     CHECK(storage_start(self->storage) == Device_Ok);
     EXPECT(storage_get_state(self->storage) == DeviceState_Running,
            "Storage device should be running for stream %d. State is %s.",
@@ -114,10 +356,13 @@ video_sink_start(struct video_sink_s* self)
            device_state_as_string(storage_get_state(self->storage)));
 
     channel_accept_writes(&self->in, 1);
+    channel_reader_attach(self->from, &self->reader);
+    self->frame_count = 0;
+    decimator_reset(&self->decimator);
     self->is_stopping = 0;
     self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_sink_thread, self));
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_sink_thread, self));
 
     return Device_Ok;
 Error:
@@ -132,27 +377,56 @@ video_sink_get(const struct video_sink_s* const self,
 {
     *identifier = self->identifier;
     *write_delay_ms = self->write_delay_ms;
-
-    return self->storage ? storage_get(self->storage, settings) : Device_Ok;
+    if (!self->storage)
+        return Device_Ok;
+    struct mailbox* const updates = (struct mailbox*)&self->updates;
+    mailbox_lock(updates);
+    const uint8_t has_settings = self->has_settings;
+    const int is_copied =
+      has_settings && storage_properties_copy(settings, &self->applied);
+    mailbox_unlock(updates);
+    if (has_settings)
+        return is_copied ? Device_Ok : Device_Err;
+    return storage_get(self->storage, settings);
 }
 
 void
 video_sink_destroy(struct video_sink_s* self)
 {
-    thread_join(&self->thread);
+    parked_thread_destroy(&self->thread);
     if (self->storage) {
         storage_close(self->storage);
     }
-    channel_release(&self->in);
+    storage_properties_destroy(&self->first_burst_settings);
+    storage_properties_destroy(&self->requested);
+    storage_properties_destroy(&self->applied);
+    storage_properties_destroy(&self->next_settings);
+    if (self->in.data)
+        channel_release(&self->in);
+}
+
+void
+video_sink_set_split_by_burst(struct video_sink_s* self, uint8_t enable)
+{
+    self->is_split_by_burst = enable;
+}
+
+void
+video_sink_set_input(struct video_sink_s* self, struct channel* from)
+{
+    if (from == self->from)
+        return;
+    channel_reader_detach(self->from, &self->reader);
+    self->from = from;
 }
 
 size_t
 video_sink_bytes_waiting(const struct video_sink_s* self)
 {
     if (self->reader.id > 0) {
-        size_t pos = self->in.holds.pos[self->reader.id - 1];
-        size_t head = self->in.head;
-        size_t high = self->in.high;
+        size_t pos = self->from->holds.pos[self->reader.id - 1];
+        size_t head = self->from->head;
+        size_t high = self->from->high;
         if (pos > head) {
             return (high - pos) + head;
         } else {
@@ -167,20 +441,124 @@ video_sink_configure(struct video_sink_s* self,
                      const struct DeviceManager* device_manager,
                      struct DeviceIdentifier* identifier,
                      struct StorageProperties* settings,
-                     float write_delay_ms)
+                     float write_delay_ms,
+                     uint32_t store_every)
 {
     self->write_delay_ms = write_delay_ms;
-    self->identifier = *identifier;
+    self->store_every = store_every;
+    // Live updates that didn't make it to storage are superseded. The sink
+    // thread is idle while its stream is configured.
+    mailbox_clear(&self->updates);
     if (self->storage && !is_equal(&self->identifier, identifier)) {
         storage_close(self->storage);
         self->storage = NULL;
+        self->has_settings = 0;
     }
-    if (!self->storage) {
+    self->identifier = *identifier;
+    if (!self->storage)
         CHECK(self->storage = storage_open(device_manager, identifier));
-        self->identifier = *identifier;
+    if (is_storage_configured(self, settings)) {
+        TRACE("[stream %d] Storage settings unchanged.", self->stream_id);
+        return Device_Ok;
     }
+    self->has_settings = 0;
     CHECK(Device_Ok == storage_set(self->storage, settings));
+    mailbox_lock(&self->updates);
+    const int is_cached =
+      storage_properties_copy(&self->requested, settings) &&
+      Device_Ok == storage_get(self->storage, &self->applied);
+    self->has_settings = (uint8_t)is_cached;
+    mailbox_unlock(&self->updates);
+    CHECK(is_cached);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_sink_update_live(struct video_sink_s* self,
+                       const char* filename,
+                       size_t bytes_of_filename,
+                       const char* external_metadata_json,
+                       size_t bytes_of_external_metadata_json)
+{
+    mailbox_lock(&self->updates);
+    EXPECT(self->has_settings,
+           "[stream %d] Expected configured storage.",
+           self->stream_id);
+    if (!self->updates.is_full) {
+        self->is_rollover_pending = 0;
+        CHECK(storage_properties_copy(&self->next_settings, &self->applied));
+    }
+    if (filename) {
+        CHECK(storage_properties_set_filename(
+          &self->next_settings, filename, bytes_of_filename));
+        self->is_rollover_pending = 1;
+    }
+    if (external_metadata_json)
+        CHECK(storage_properties_set_external_metadata(
+          &self->next_settings,
+          external_metadata_json,
+          bytes_of_external_metadata_json));
+    mailbox_post(&self->updates);
     return Device_Ok;
 Error:
+    mailbox_unlock(&self->updates);
     return Device_Err;
 }
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__sink_names_burst_outputs()
+{
+    char out[32] = { 0 };
+    CHECK(burst_filename(out, sizeof(out), "out.tif", 3));
+    CHECK(strcmp(out, "out_3.tif") == 0);
+    CHECK(burst_filename(out, sizeof(out), "a.b/out", 12));
+    CHECK(strcmp(out, "a.b/out_12") == 0);
+    CHECK(burst_filename(out, sizeof(out), "", 1));
+    CHECK(strcmp(out, "_1") == 0);
+    CHECK(!burst_filename(out, 8, "too-long.zarr", 1));
+    return 1;
+Error:
+    return 0;
+}
+
+/// Expands to `str, sizeof(str)`.
+#define SIZED(str) str, sizeof(str)
+
+int
+unit_test__sink_compares_storage_settings()
+{
+    struct StorageProperties a = { 0 }, b = { 0 };
+    const struct PixelScale scale = { .x = 1.0, .y = 1.0 };
+    CHECK(storage_properties_init(
+      &a, 0, SIZED("out.tif"), SIZED("{\"a\":1}"), scale));
+    CHECK(storage_properties_init(
+      &b, 0, SIZED("out.tif"), SIZED("{\"a\":1}"), scale));
+    CHECK(a.filename.str != b.filename.str);
+    CHECK(is_storage_properties_equal(&a, &b));
+
+    CHECK(storage_properties_set_filename(&b, SIZED("other.tif")));
+    CHECK(!is_storage_properties_equal(&a, &b));
+    CHECK(storage_properties_set_filename(&b, SIZED("out.tif")));
+    CHECK(is_storage_properties_equal(&a, &b));
+
+    b.first_frame_id = 1;
+    CHECK(!is_storage_properties_equal(&a, &b));
+    b.first_frame_id = 0;
+
+    CHECK(storage_properties_set_external_metadata(&b, SIZED("{}")));
+    CHECK(!is_storage_properties_equal(&a, &b));
+
+    storage_properties_destroy(&a);
+    storage_properties_destroy(&b);
+    return 1;
+Error:
+    storage_properties_destroy(&a);
+    storage_properties_destroy(&b);
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
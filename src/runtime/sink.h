@@ -3,6 +3,9 @@
 
 #include "platform.h"
 #include "channel.h"
+#include "mailbox.h"
+#include "parked_thread.h"
+#include "decimator.h"
 #include "device/props/device.h"
 #include "device/props/storage.h"
 #include "device/hal/storage.h"
@@ -27,8 +30,51 @@ extern "C"
         float write_delay_ms;
         void (*sig_stop_source)(const struct video_sink_s*);
         struct Storage* storage;
+        /// Allocated by `video_sink_reserve()`.
         struct channel in;
-        struct thread thread;
+        size_t in_capacity_bytes;
+
+        /// The channel the sink thread reads from. This is `in` unless a
+        /// stage, like an encoder, sits between `in` and storage.
+        struct channel* from;
+
+        /// Only every `store_every`'th frame read from `from` is sent to
+        /// storage. 0 and 1 store every frame.
+        uint32_t store_every;
+        /// Frames read since the sink started.
+        uint64_t frame_count;
+        /// Applied to the frames `store_every` keeps.
+        struct decimator decimator;
+
+        /// When set, storage is restarted on a new output at the start of
+        /// each burst after the first. See `FrameMarker_Burst`.
+        uint8_t is_split_by_burst;
+        /// Bursts started since the sink started.
+        uint64_t burst_count;
+        /// The storage settings of the first burst. The outputs of later
+        /// bursts are named after its file name.
+        struct StorageProperties first_burst_settings;
+
+        /// The settings last sent to storage and the settings it reported
+        /// back. Configuring the same settings again doesn't go to storage,
+        /// and `video_sink_get()` reads `applied` instead of asking storage.
+        /// Cleared when the storage device changes or a `storage_set()`
+        /// fails. Locked with `updates`.
+        uint8_t has_settings;
+        struct StorageProperties requested;
+        struct StorageProperties applied;
+
+        /// Changes to apply while running. The sink thread applies them
+        /// between frames. See `video_sink_update_live()`.
+        struct mailbox updates;
+        struct StorageProperties next_settings;
+        /// Set when `next_settings` has a new file name.
+        uint8_t is_rollover_pending;
+        /// Set once the sink thread has applied a live update. Reset on
+        /// start.
+        uint8_t is_live_updated;
+
+        struct parked_thread thread;
         struct DeviceIdentifier identifier;
         struct channel_reader reader;
     };
@@ -41,13 +87,49 @@ extern "C"
 
     void video_sink_destroy(struct video_sink_s* self);
 
+    /// @brief Allocates the sink's `in` queue if it isn't allocated yet.
+    enum DeviceStatusCode video_sink_reserve(struct video_sink_s* self);
+
+    /// @brief Selects the channel the sink thread reads from.
+    /// @param[in] from Either the sink's own `in` channel or the output of a
+    ///                 stage that reads from `in`.
+    ///
+    /// The sink's reader is detached from the previous channel so it no
+    /// longer holds back that channel's writer.
+    void video_sink_set_input(struct video_sink_s* self, struct channel* from);
+
+    /// @brief Stores each burst in an output of its own when `enable` is
+    /// set.
+    void video_sink_set_split_by_burst(struct video_sink_s* self,
+                                       uint8_t enable);
+
     enum DeviceStatusCode video_sink_start(struct video_sink_s* self);
 
+    /// @brief Changes the storage settings while the sink is running.
+    /// @param[in] filename NULL to keep the file name. Otherwise the sink
+    ///                     thread stops storage between two frames and
+    ///                     restarts it on the new file. Frames wait in the
+    ///                     sink's input meanwhile, so none are lost.
+    /// @param[in] external_metadata_json NULL to keep the metadata.
+    ///                                   Otherwise the new metadata goes to
+    ///                                   the next output storage starts: on
+    ///                                   a new file name, a new burst or the
+    ///                                   next acquisition.
+    ///
+    /// Updates posted before the sink thread gets to them are merged.
+    enum DeviceStatusCode video_sink_update_live(
+      struct video_sink_s* self,
+      const char* filename,
+      size_t bytes_of_filename,
+      const char* external_metadata_json,
+      size_t bytes_of_external_metadata_json);
+
     /// @brief Query the video sink controller's properties.
     /// @param [in] self A `video_sink_s` context.
     /// @param [out] identifier The`DeviceIdentifier` of the current video sink
     /// device.
-    /// @param [out] settings The current `StorageProperties`.
+    /// @param [out] settings The current `StorageProperties`, as last
+    /// applied by `video_sink_configure()`.
     /// @param [out] write_delay_ms The current write delay.
     /// @return Device_Ok on success, otherwise Device_Err
     enum DeviceStatusCode video_sink_get(const struct video_sink_s* self,
@@ -55,12 +137,18 @@ extern "C"
                                          struct StorageProperties* settings,
                                          float* write_delay_ms);
 
+    /// @brief Opens the storage device named by `identifier` and applies
+    /// `settings`.
+    ///
+    /// Storage isn't reopened when `identifier` names the open device, and
+    /// isn't touched when `settings` match those last applied.
     enum DeviceStatusCode video_sink_configure(
       struct video_sink_s* self,
       const struct DeviceManager* device_manager,
       struct DeviceIdentifier* identifier,
       struct StorageProperties* settings,
-      float write_delay_ms);
+      float write_delay_ms,
+      uint32_t store_every);
 
     size_t video_sink_bytes_waiting(const struct video_sink_s* self);
 
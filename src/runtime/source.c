@@ -4,6 +4,9 @@
 #include "logger.h"
 #include "platform.h"
 #include "runtime/channel.h"
+#include "runtime/marker.h"
+
+#include <string.h>
 
 #define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
 #define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
@@ -50,6 +53,119 @@ Error:
     return 0;
 }
 
+/// @param[in] map `channel_try_write_map()` to give up when the channel is
+///                full, or `channel_write_map()` to wait for room.
+/// @returns 1 if the marker was written, otherwise 0 (e.g. the channel is
+///          full, or stopped accepting writes).
+static int
+write_marker(struct channel* channel,
+             void* (*map)(struct channel*, size_t),
+             enum frame_marker_kind kind,
+             uint64_t frame_id)
+{
+    struct VideoFrame* marker =
+      (struct VideoFrame*)map(channel, bytes_of_marker_frame());
+    if (!marker)
+        return 0;
+    frame_marker_init(marker, kind, frame_id);
+    channel_write_unmap(channel);
+    return 1;
+}
+
+/// @returns Why not to acquire another frame of `bytes_of_pixels`, or
+///          `SourceStop_None`.
+static enum source_stop_reason
+limit_before_frame(const struct video_source_s* self,
+                   uint64_t iframe,
+                   size_t bytes_of_pixels,
+                   struct clock* clock)
+{
+    const struct video_source_limits_s* limits = &self->limits;
+    const struct video_source_sequence_s* sequence = &self->sequence;
+    if (iframe >= self->max_frame_count)
+        return SourceStop_FrameCount;
+    if (sequence->frames_per_burst && sequence->burst_count &&
+        iframe >= sequence->frames_per_burst * sequence->burst_count)
+        return SourceStop_BurstCount;
+    if (limits->max_duration_s > 0 &&
+        clock_toc_ms(clock) >= 1e3 * limits->max_duration_s)
+        return SourceStop_Duration;
+    if (limits->max_bytes &&
+        self->stats.bytes + bytes_of_pixels > limits->max_bytes)
+        return SourceStop_Bytes;
+    return SourceStop_None;
+}
+
+/// @returns Why the frame described by `info`, just read from the camera,
+///          falls past a limit and must not be written, or
+///          `SourceStop_None`.
+static enum source_stop_reason
+limit_of_frame(const struct video_source_s* self,
+               const struct ImageInfo* info,
+               struct clock* clock)
+{
+    const struct video_source_limits_s* limits = &self->limits;
+    if (limits->max_duration_s > 0 &&
+        clock_toc_ms(clock) >= 1e3 * limits->max_duration_s)
+        return SourceStop_Duration;
+    if (limits->has_last_hardware_frame_id &&
+        info->hardware_frame_id > limits->last_hardware_frame_id)
+        return SourceStop_HardwareFrameId;
+    if (limits->has_last_hardware_timestamp &&
+        info->hardware_timestamp > limits->last_hardware_timestamp)
+        return SourceStop_HardwareTimestamp;
+    return SourceStop_None;
+}
+
+/// @returns Why the frame described by `info`, just written, is the last
+///          one, or `SourceStop_None`.
+static enum source_stop_reason
+limit_after_frame(const struct video_source_s* self,
+                  const struct ImageInfo* info)
+{
+    const struct video_source_limits_s* limits = &self->limits;
+    if (limits->has_last_hardware_frame_id &&
+        info->hardware_frame_id >= limits->last_hardware_frame_id)
+        return SourceStop_HardwareFrameId;
+    if (limits->has_last_hardware_timestamp &&
+        info->hardware_timestamp >= limits->last_hardware_timestamp)
+        return SourceStop_HardwareTimestamp;
+    return SourceStop_None;
+}
+
+/// Applies the changes posted by `video_source_update_live()`, if any. A
+/// change the camera rejects is logged and acquisition goes on with the old
+/// settings.
+static void
+apply_live_updates(struct video_source_s* self)
+{
+    if (!mailbox_take(&self->updates))
+        return;
+    struct CameraProperties settings = self->applied;
+    const uint8_t has_settings = self->has_settings;
+    const float exposure_time_us = self->next_exposure_time_us;
+    mailbox_release(&self->updates);
+
+    if (!has_settings)
+        CHECK(camera_get(self->camera, &settings) == Device_Ok);
+    settings.exposure_time_us = exposure_time_us;
+    CHECK(camera_set(self->camera, &settings) == Device_Ok);
+    CHECK(camera_get(self->camera, &settings) == Device_Ok);
+    LOG("[stream %d] SOURCE: Exposure changed to %f us",
+        (int)self->stream_id,
+        settings.exposure_time_us);
+
+    mailbox_lock(&self->updates);
+    // Configuring the settings from before the change applies them again.
+    self->requested = self->applied = settings;
+    self->has_settings = 1;
+    mailbox_unlock(&self->updates);
+    return;
+Error:
+    LOGE("[stream %d] SOURCE: Failed to change the exposure",
+         (int)self->stream_id);
+}
+
 static int
 video_source_thread(struct video_source_s* self)
 {
@@ -59,28 +175,67 @@ video_source_thread(struct video_source_s* self)
     uint64_t iframe = 0;
     uint64_t last_hardware_frame_id = 0;
     struct channel* last_stream = 0;
-    while (!self->is_stopping && iframe < self->max_frame_count) {
+    int is_filter_reset_pending = 0;
+    enum source_stop_reason stop_reason = SourceStop_None;
+    struct clock clock;
+    clock_init(&clock);
+    while (!self->is_stopping && !stop_reason) {
+        apply_live_updates(self);
         EXPECT(camera_get_image_shape(self->camera, &info.shape) == Device_Ok,
                "[stream %d] SOURCE: Failed to query image shape",
                (int)self->stream_id);
 
         size_t sz = bytes_of_image(&info.shape);
         size_t nbytes = sizeof(struct VideoFrame) + sz;
+        if ((stop_reason = limit_before_frame(self, iframe, sz, &clock)))
+            break;
 
         struct channel* channel =
           (self->enable_filter) ? self->to_filter : self->to_sink;
 
         if (channel != last_stream && last_stream == self->to_filter) {
-            self->await_filter_reset(self);
+            is_filter_reset_pending = 1;
         }
         last_stream = channel;
 
+        // The filter drops its partial state when it reaches the marker, so
+        // acquisition doesn't have to wait on the filter thread. While
+        // frames go to the sink, a full filter channel doesn't stall them:
+        // the marker is retried on the next frame. Frames for the filter
+        // would wait for room anyway.
+        if (is_filter_reset_pending) {
+            if (write_marker(self->to_filter,
+                             channel == self->to_filter ? channel_write_map
+                                                        : channel_try_write_map,
+                             FrameMarker_FilterReset,
+                             iframe))
+                is_filter_reset_pending = 0;
+            else if (channel == self->to_filter)
+                continue; // the marker must precede any new filter input
+        }
+
+        // Each burst starts with a marker. Readers find the boundaries in
+        // the stream while every thread and device keeps running.
+        const uint64_t frames_per_burst = self->sequence.frames_per_burst;
+        if (frames_per_burst &&
+            iframe == self->stats.burst_count * frames_per_burst) {
+            // The frame after it would wait for room anyway.
+            if (!write_marker(
+                  channel, channel_write_map, FrameMarker_Burst, iframe))
+                continue;
+            ++self->stats.burst_count;
+        }
+
         struct VideoFrame* im =
           (struct VideoFrame*)channel_write_map(channel, nbytes);
         if (im) {
             CHECK(camera_get_frame(self->camera, im->data, &sz, &info) ==
                   Device_Ok);
-            if (!sz) {
+            // A frame past a limit is dropped before any reader sees it, so
+            // the acquisition ends exactly on the last frame within limits.
+            if (sz)
+                stop_reason = limit_of_frame(self, &info, &clock);
+            if (!sz || stop_reason) {
                 channel_abort_write(channel);
             } else {
                 check_frame_id(
@@ -94,7 +249,11 @@ video_source_thread(struct video_source_s* self)
                     .timestamps.hardware = info.hardware_timestamp,
                     .timestamps.acq_thread = clock_tic(0)
                 };
+                CHECK(defect_map_apply(&self->defects, im));
                 ++iframe;
+                self->stats.frame_count = iframe;
+                self->stats.bytes += sz;
+                stop_reason = limit_after_frame(self, &info);
             }
             channel_write_unmap(channel);
             LOG("[stream %d] SOURCE: wrote frame %d",
@@ -103,9 +262,13 @@ video_source_thread(struct video_source_s* self)
         }
     }
 Finalize:
-    LOG("[stream %d] SOURCE: Stopping on frame %d",
+    if (!stop_reason)
+        stop_reason = ecode ? SourceStop_Error : SourceStop_Requested;
+    self->stats.stop_reason = stop_reason;
+    LOG("[stream %d] SOURCE: Stopping on frame %d (reason %d)",
         (int)self->stream_id,
-        (int)iframe);
+        (int)iframe,
+        (int)stop_reason);
     self->sig_stop_filter(self);
     self->sig_stop_sink(self);
 
@@ -125,7 +288,6 @@ video_source_init(struct video_source_s* self,
                   uint64_t max_frame_count,
                   struct channel* to_sink,
                   struct channel* to_filter,
-                  void (*await_filter_reset)(const struct video_source_s*),
                   void (*sig_stop_filter)(const struct video_source_s*),
                   void (*sig_stop_sink)(const struct video_source_s*))
 {
@@ -135,20 +297,21 @@ video_source_init(struct video_source_s* self,
         .to_filter = to_filter,
         .to_sink = to_sink,
         .enable_filter = 0,
-        .await_filter_reset = await_filter_reset,
         .sig_stop_filter = sig_stop_filter,
         .sig_stop_sink = sig_stop_sink,
     };
-    thread_init(&self->thread);
+    parked_thread_init(&self->thread);
+    mailbox_init(&self->updates);
     return Device_Ok;
 }
 
 void
 video_source_destroy(struct video_source_s* self)
 {
-    thread_join(&self->thread);
+    parked_thread_destroy(&self->thread);
     if (self->camera)
         camera_close(self->camera);
+    defect_map_destroy(&self->defects);
 }
 
 enum DeviceStatusCode
@@ -159,7 +322,62 @@ video_source_get(const struct video_source_s* self,
 {
     *max_frame_count = self->max_frame_count;
     *source_device_identifier = self->last_camera_id;
-    return self->camera ? camera_get(self->camera, settings) : Device_Ok;
+    struct mailbox* const updates = (struct mailbox*)&self->updates;
+    mailbox_lock(updates);
+    const uint8_t has_settings = self->has_settings;
+    if (has_settings)
+        *settings = self->applied;
+    mailbox_unlock(updates);
+    if (!self->camera || has_settings)
+        return Device_Ok;
+    return camera_get(self->camera, settings);
+}
+
+enum DeviceStatusCode
+video_source_set_defect_fill(struct video_source_s* self,
+                             enum defect_fill fill)
+{
+    EXPECT(fill < DefectFill_Count,
+           "[stream %d] Invalid defect correction mode: %d",
+           (int)self->stream_id,
+           (int)fill);
+    self->defects.fill = fill;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_source_set_limits(struct video_source_s* self,
+                        const struct video_source_limits_s* limits)
+{
+    EXPECT(limits->max_duration_s >= 0 &&
+             limits->max_duration_s < (double)UINT64_MAX,
+           "[stream %d] Expected a finite, non-negative duration limit. Got "
+           "%f s.",
+           (int)self->stream_id,
+           limits->max_duration_s);
+    self->limits = *limits;
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_source_set_sequence(struct video_source_s* self,
+                          uint64_t frames_per_burst,
+                          uint64_t burst_count)
+{
+    self->sequence = (struct video_source_sequence_s){
+        .frames_per_burst = frames_per_burst,
+        .burst_count = burst_count,
+    };
+}
+
+void
+video_source_set_output(struct video_source_s* self, struct channel* to_sink)
+{
+    self->to_sink = to_sink;
 }
 
 enum DeviceStatusCode
@@ -180,13 +398,22 @@ video_source_start(struct video_source_s* self)
 
     self->is_stopping = 0;
     self->is_running = 1;
-    CHECK(
-      thread_create(&self->thread, (void (*)(void*))video_source_thread, self));
+    self->stats = (struct video_source_stats_s){ 0 };
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_source_thread, self));
     return Device_Ok;
 Error:
     return Device_Err;
 }
 
+void
+video_source_update_live(struct video_source_s* self, float exposure_time_us)
+{
+    mailbox_lock(&self->updates);
+    self->next_exposure_time_us = exposure_time_us;
+    mailbox_post(&self->updates);
+}
+
 static int
 is_equal(const struct DeviceIdentifier* const a,
          const struct DeviceIdentifier* const b)
@@ -194,6 +421,29 @@ is_equal(const struct DeviceIdentifier* const a,
     return (a->driver_id == b->driver_id) && (a->device_id == b->device_id);
 }
 
+/// Byte for byte, so bytes of padding that differ just mean the settings
+/// are applied again.
+static int
+is_camera_properties_equal(const struct CameraProperties* const a,
+                           const struct CameraProperties* const b)
+{
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+/// @returns 1 when `settings` don't need to go to the camera.
+static int
+is_camera_configured(const struct video_source_s* const self,
+                     const struct CameraProperties* const settings)
+{
+    if (!self->has_settings)
+        return 0;
+    const enum DeviceState state = camera_get_state(self->camera);
+    if (state != DeviceState_Armed && state != DeviceState_Running)
+        return 0;
+    return is_camera_properties_equal(settings, &self->requested) ||
+           is_camera_properties_equal(settings, &self->applied);
+}
+
 static unsigned
 try_camera_set(struct video_source_s* const self,
                struct CameraProperties* settings)
@@ -224,15 +474,33 @@ video_source_configure(struct video_source_s* self,
 {
     self->max_frame_count = max_frame_count;
     self->enable_filter = enable_filter;
+    // Live updates that didn't make it to the camera are superseded. Only
+    // called while the source thread is stopped.
+    mailbox_clear(&self->updates);
     if (self->camera && !is_equal(&self->last_camera_id, identifier)) {
         camera_close(self->camera);
         self->camera = 0;
+        self->has_settings = 0;
     }
     if (!self->camera) {
         CHECK(self->camera = camera_open(device_manager, identifier));
         self->last_camera_id = *identifier;
     }
+    if (is_camera_configured(self, settings)) {
+        TRACE("[stream %d] Camera settings unchanged.", self->stream_id);
+        *settings = self->applied;
+        return Device_Ok;
+    }
+    const struct CameraProperties requested = *settings;
+    mailbox_lock(&self->updates);
+    self->has_settings = 0;
+    mailbox_unlock(&self->updates);
     CHECK(try_camera_set(self, settings));
+    mailbox_lock(&self->updates);
+    self->requested = requested;
+    self->applied = *settings;
+    self->has_settings = 1;
+    mailbox_unlock(&self->updates);
     return Device_Ok;
 Error:
     return Device_Err;
@@ -6,18 +6,100 @@
 #include "device/hal/device.manager.h"
 #include "platform.h"
 #include "runtime/channel.h"
+#include "runtime/defects.h"
+#include "runtime/mailbox.h"
+#include "runtime/parked_thread.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    /// Why the video source thread last stopped.
+    enum source_stop_reason
+    {
+        /// Still running, or never started.
+        SourceStop_None = 0,
+        /// Stopped from outside, e.g. by `acquire_stop()` or by storage.
+        SourceStop_Requested,
+        SourceStop_Error,
+        SourceStop_FrameCount,
+        SourceStop_Duration,
+        SourceStop_Bytes,
+        SourceStop_HardwareFrameId,
+        SourceStop_HardwareTimestamp,
+        SourceStop_BurstCount,
+        SourceStop_Count,
+    };
+
+    /// Conditions that end an acquisition, besides `max_frame_count`. They
+    /// are checked by the source thread for each frame, so the last frame
+    /// written is exactly the last one within every limit.
+    struct video_source_limits_s
+    {
+        /// Seconds since the source started. Frames that arrive later
+        /// aren't written. 0 for no limit.
+        double max_duration_s;
+        /// Bytes of pixel data. A frame that would go past the limit isn't
+        /// written. 0 for no limit.
+        uint64_t max_bytes;
+        /// When set, the source stops after the frame with
+        /// `last_hardware_frame_id`, and frames past it aren't written.
+        uint8_t has_last_hardware_frame_id;
+        uint64_t last_hardware_frame_id;
+        /// When set, the source stops after the last frame stamped at or
+        /// before `last_hardware_timestamp`.
+        uint8_t has_last_hardware_timestamp;
+        uint64_t last_hardware_timestamp;
+    };
+
     /// Context for video source threads
     struct video_source_s
     {
         struct Camera* camera;
         struct DeviceIdentifier last_camera_id;
+
+        /// The settings last sent to the camera and the settings it
+        /// reported back. Configuring the same settings again doesn't go to
+        /// the camera, and `video_source_get()` reads `applied` instead of
+        /// asking the camera. Cleared when the camera changes or a
+        /// `camera_set()` fails. Locked with `updates`.
+        uint8_t has_settings;
+        struct CameraProperties requested;
+        struct CameraProperties applied;
+
+        /// Changes to apply while running. The source thread applies them
+        /// between frames. See `video_source_update_live()`.
+        struct mailbox updates;
+        float next_exposure_time_us;
+
         uint64_t max_frame_count;
+        struct video_source_limits_s limits;
+
+        /// Defective pixels are corrected in place, in the frame just
+        /// written to the output channel, before any reader sees it. This
+        /// costs time in proportion to the number of defects.
+        struct defect_map defects;
+
+        /// Splits the acquisition into bursts of `frames_per_burst` frames,
+        /// each started by a `FrameMarker_Burst`. 0 turns bursts off. The
+        /// source stops after `burst_count` bursts, unless it's 0.
+        struct video_source_sequence_s
+        {
+            uint64_t frames_per_burst;
+            uint64_t burst_count;
+        } sequence;
+
+        /// Written by the source thread. Reset on start.
+        struct video_source_stats_s
+        {
+            uint64_t frame_count;
+            /// Bytes of pixel data written.
+            uint64_t bytes;
+            /// Bursts started.
+            uint64_t burst_count;
+            enum source_stop_reason stop_reason;
+        } stats;
 
         /// Used by external threads to signal the controller thread to stop
         /// Other threads may write.
@@ -28,15 +110,11 @@ extern "C"
         uint8_t is_running;
 
         uint8_t stream_id;
-        struct thread thread;
+        struct parked_thread thread;
         struct channel* to_sink;
         struct channel* to_filter;
         uint8_t enable_filter;
 
-        /// Signals stream filters to reset any internal state and blocks until
-        /// the reset is completed.
-        void (*await_filter_reset)(const struct video_source_s*);
-
         void (*sig_stop_filter)(const struct video_source_s*);
         void (*sig_stop_sink)(const struct video_source_s*);
     };
@@ -52,14 +130,16 @@ extern "C"
     ///
     /// The video source may output to either the `to_sink` channel or the
     /// `to_filter` channel on any given frame depending on whether or not the
-    /// filter stream is enabled. Initially filtering is disabled.
+    /// filter stream is enabled. Initially filtering is disabled. When the
+    /// source stops sending frames to `to_filter` it writes a
+    /// `FrameMarker_FilterReset` marker to it, so the filter discards any
+    /// partially averaged frame.
     enum DeviceStatusCode video_source_init(
       struct video_source_s* self,
       uint8_t stream_id,
       uint64_t max_frame_count,
       struct channel* to_sink,
       struct channel* to_filter,
-      void (*await_filter_reset)(const struct video_source_s*),
       void (*sig_stop_filter)(const struct video_source_s*),
       void (*sig_stop_sink)(const struct video_source_s*));
 
@@ -69,8 +149,8 @@ extern "C"
     /// @param[in] self video source context
     /// @param[out] source_device_identifier The `DeviceIdentifier` of the last
     /// source device.
-    /// @param[out] settings The current device properties. Only updated if
-    /// a device is open.
+    /// @param[out] settings The current device properties, as last applied
+    /// by `video_source_configure()`. Only updated if a device is open.
     /// @param[out] max_frame_count The number of frames to acquire for a finite
     /// acquisition.
     /// @return `Device_Ok` on success, otherwise `Device_Err`.
@@ -80,6 +160,11 @@ extern "C"
       struct CameraProperties* settings,
       uint64_t* max_frame_count);
 
+    /// @brief Opens the camera named by `identifier` and applies
+    /// `settings`, which are updated to the settings the camera applied.
+    ///
+    /// The camera isn't reopened when `identifier` names the open camera,
+    /// and isn't touched when `settings` match those last applied.
     enum DeviceStatusCode video_source_configure(
       struct video_source_s* self,
       const struct DeviceManager* device_manager,
@@ -88,8 +173,39 @@ extern "C"
       uint64_t max_frame_count,
       uint8_t enable_filter);
 
+    /// @param[in] fill How to replace defective pixels. The defects
+    ///                 themselves are set on `defects`.
+    enum DeviceStatusCode video_source_set_defect_fill(
+      struct video_source_s* self,
+      enum defect_fill fill);
+
+    /// @brief Sets the conditions that end an acquisition, besides the
+    /// frame count.
+    enum DeviceStatusCode video_source_set_limits(
+      struct video_source_s* self,
+      const struct video_source_limits_s* limits);
+
+    /// @brief Sets how the acquisition is split into bursts.
+    /// @see video_source_s::sequence
+    void video_source_set_sequence(struct video_source_s* self,
+                                   uint64_t frames_per_burst,
+                                   uint64_t burst_count);
+
+    /// @brief Selects the channel unfiltered frames are written to, in place
+    /// of the `to_sink` given to `video_source_init()`.
+    void video_source_set_output(struct video_source_s* self,
+                                 struct channel* to_sink);
+
     enum DeviceStatusCode video_source_start(struct video_source_s* self);
 
+    /// @brief Changes the camera's exposure while the source is running.
+    ///
+    /// The source thread applies the change before it acquires its next
+    /// frame. Updates posted before then are merged, so only the last one
+    /// reaches the camera.
+    void video_source_update_live(struct video_source_s* self,
+                                  float exposure_time_us);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,593 @@
+#include "tiler.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#include <string.h>
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+static size_t
+bytes_of_image(const struct ImageShape* const shape)
+{
+    return shape->strides.planes * bytes_of_type(shape->type);
+}
+
+static struct tiled_frame_header*
+group_header(const struct video_tiler_s* self)
+{
+    return (struct tiled_frame_header*)self->group->data;
+}
+
+static uint8_t*
+group_chunks(const struct video_tiler_s* self)
+{
+    return self->group->data + sizeof(struct tiled_frame_header);
+}
+
+/// Bytes of one frame's slot in a chunk.
+static size_t
+bytes_per_slot(const struct tiled_frame_header* header)
+{
+    return (size_t)header->tile_x * header->tile_y * header->channels *
+           header->planes * header->bytes_per_sample;
+}
+
+/// Copies the samples of pixels `[x0,x0+n)` of row `y` of plane `p` of the
+/// image at `data` to or from `row`, where they're packed channel by channel.
+static void
+copy_row(const struct tiled_frame_header* header,
+         const struct ImageShape* shape,
+         uint8_t* data,
+         int64_t x0,
+         int64_t y,
+         int64_t p,
+         size_t n,
+         uint8_t* row,
+         int is_read)
+{
+    const size_t bps = header->bytes_per_sample;
+    const size_t nc = header->channels;
+    const int64_t sc = shape->strides.channels;
+    const int64_t sx = shape->strides.width;
+    uint8_t* const s =
+      data +
+      (x0 * sx + y * shape->strides.height + p * shape->strides.planes) * bps;
+    // Interleaved samples are contiguous.
+    if (sc == 1 && sx == (int64_t)nc) {
+        if (is_read)
+            memcpy(s, row, n * nc * bps); // NOLINT
+        else
+            memcpy(row, s, n * nc * bps); // NOLINT
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < nc; ++c) {
+            uint8_t* const a = row + (i * nc + c) * bps;
+            uint8_t* const b = s + (i * sx + c * sc) * bps;
+            if (is_read)
+                memcpy(b, a, bps); // NOLINT
+            else
+                memcpy(a, b, bps); // NOLINT
+        }
+    }
+}
+
+/// Copies between tile `itile` of the image at `data` and slot `k` of that
+/// tile's chunk. Writing to the chunk pads it with zeros. Reading from it
+/// skips the padding. A NULL `data` zeros the slot.
+static void
+transfer_tile(const struct tiled_frame_header* header,
+              const struct ImageShape* shape,
+              uint8_t* data,
+              uint32_t k,
+              uint32_t itile,
+              uint8_t* chunks,
+              int is_read)
+{
+    const size_t bps = header->bytes_per_sample;
+    const size_t row_bytes = (size_t)header->tile_x * header->channels * bps;
+    uint8_t* const slot =
+      chunks + itile * header->bytes_per_chunk + k * bytes_per_slot(header);
+    if (!data) {
+        memset(slot, 0, bytes_per_slot(header)); // NOLINT
+        return;
+    }
+
+    const int64_t w = shape->dims.width;
+    const int64_t h = shape->dims.height;
+    const int64_t x0 = (int64_t)(itile % header->tiles_x) * header->tile_x;
+    const int64_t y0 = (int64_t)(itile / header->tiles_x) * header->tile_y;
+    const size_t n =
+      (size_t)(x0 + header->tile_x < w ? header->tile_x : w - x0);
+    const size_t nbytes = n * header->channels * bps;
+    for (uint32_t p = 0; p < header->planes; ++p) {
+        for (uint32_t r = 0; r < header->tile_y; ++r) {
+            const int64_t y = y0 + r;
+            uint8_t* const d =
+              slot + ((size_t)p * header->tile_y + r) * row_bytes;
+            if (y >= h) {
+                if (!is_read)
+                    memset(d, 0, row_bytes); // NOLINT
+                continue;
+            }
+            copy_row(header, shape, data, x0, y, p, n, d, is_read);
+            if (!is_read)
+                memset(d + nbytes, 0, row_bytes - nbytes); // NOLINT
+        }
+    }
+}
+
+void
+tiler_copy_tile(const struct tiled_frame_header* header,
+                const struct VideoFrame* frame,
+                uint32_t k,
+                uint32_t itile,
+                uint8_t* chunks)
+{
+    transfer_tile(header,
+                  frame ? &frame->shape : 0,
+                  frame ? (uint8_t*)frame->data : 0,
+                  k,
+                  itile,
+                  chunks,
+                  0);
+}
+
+struct tile_job_s
+{
+    const struct tiled_frame_header* header;
+    const struct VideoFrame* frame;
+    uint32_t k;
+    uint8_t* chunks;
+};
+
+static void
+tile_job(void* ctx, size_t i)
+{
+    const struct tile_job_s* job = (const struct tile_job_s*)ctx;
+    tiler_copy_tile(job->header, job->frame, job->k, (uint32_t)i, job->chunks);
+}
+
+/// Copies `frame`, or zeros when `frame` is NULL, into slot `k` of every
+/// chunk of the current group.
+static void
+fill_slot(struct video_tiler_s* self,
+          const struct VideoFrame* frame,
+          uint32_t k)
+{
+    const struct tiled_frame_header* header = group_header(self);
+    struct tile_job_s job = {
+        .header = header,
+        .frame = frame,
+        .k = k,
+        .chunks = group_chunks(self),
+    };
+    worker_pool_run(self->pool,
+                    (size_t)header->tiles_x * header->tiles_y,
+                    tile_job,
+                    &job);
+}
+
+/// Pads and writes out the current group.
+static void
+finish_group(struct video_tiler_s* self)
+{
+    if (!self->group)
+        return;
+    const struct tiled_frame_header* header = group_header(self);
+    for (uint32_t k = header->frame_count; k < header->tile_t; ++k)
+        fill_slot(self, 0, k);
+    channel_write_unmap(&self->out);
+    self->group = 0;
+}
+
+static void
+begin_group(struct video_tiler_s* self, const struct VideoFrame* first)
+{
+    const size_t bps = bytes_of_type(first->shape.type);
+    const uint32_t channels = first->shape.dims.channels;
+    const uint32_t planes = first->shape.dims.planes;
+    const struct tiled_frame_header header = {
+        .magic = TILED_FRAME_MAGIC,
+        .tile_x = self->tile_x,
+        .tile_y = self->tile_y,
+        .tile_t = self->tile_t,
+        .tiles_x = (first->shape.dims.width + self->tile_x - 1) / self->tile_x,
+        .tiles_y =
+          (first->shape.dims.height + self->tile_y - 1) / self->tile_y,
+        .bytes_per_sample = (uint32_t)bps,
+        .channels = channels,
+        .planes = planes,
+        .bytes_per_chunk = (uint64_t)self->tile_x * self->tile_y *
+                           self->tile_t * channels * planes * bps,
+    };
+    const size_t nbytes =
+      (sizeof(struct VideoFrame) + sizeof(header) +
+       (size_t)header.tiles_x * header.tiles_y * header.bytes_per_chunk + 7) &
+      ~(size_t)7;
+    self->group = (struct VideoFrame*)channel_write_map(&self->out, nbytes);
+    if (!self->group)
+        return; // Not accepting writes
+    *self->group = (struct VideoFrame){
+        .bytes_of_frame = nbytes,
+        .shape = first->shape,
+        .frame_id = first->frame_id,
+        .hardware_frame_id = first->hardware_frame_id,
+        .timestamps = first->timestamps,
+    };
+    memcpy(self->group->data, &header, sizeof(header)); // NOLINT
+}
+
+static void
+add_frame(struct video_tiler_s* self, const struct VideoFrame* frame)
+{
+    if (frame_marker_of(frame) != FrameMarker_None) {
+        // Groups don't span bursts.
+        finish_group(self);
+        frame_marker_pass_on(&self->out, frame);
+        return;
+    }
+    if (self->group &&
+        (self->group->shape.dims.width != frame->shape.dims.width ||
+         self->group->shape.dims.height != frame->shape.dims.height ||
+         self->group->shape.dims.channels != frame->shape.dims.channels ||
+         self->group->shape.dims.planes != frame->shape.dims.planes ||
+         self->group->shape.type != frame->shape.type)) {
+        LOG("[stream %d] TILER: shape changed -- ending group early",
+            self->stream_id);
+        finish_group(self);
+    }
+    if (!self->group)
+        begin_group(self, frame);
+    if (!self->group)
+        return;
+    struct tiled_frame_header* header = group_header(self);
+    fill_slot(self, frame, header->frame_count++);
+    if (header->frame_count == header->tile_t)
+        finish_group(self);
+}
+
+static int
+tile_available(struct video_tiler_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        CHECK(self->reader.status == Channel_Ok);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            add_frame(self, frame);
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+    return 1;
+Error:
+    channel_read_unmap(self->in, &self->reader, 0);
+    return 0;
+}
+
+static int
+video_tiler_thread(struct video_tiler_s* self)
+{
+    int ecode = 0;
+    LOG("[stream %d] TILER: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        CHECK(tile_available(self));
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] TILER: Flushing", self->stream_id);
+    CHECK(tile_available(self));
+Finalize:
+    // A short last group is padded and kept.
+    finish_group(self);
+    LOG("[stream %d] TILER: Exiting thread", self->stream_id);
+    self->sig_stop_sink(self);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("[stream %d] TILER: Error", self->stream_id);
+    // Don't hold back the other readers of the input channel.
+    channel_reader_detach(self->in, &self->reader);
+    ecode = 1;
+    goto Finalize;
+}
+
+enum DeviceStatusCode
+video_tiler_init(struct video_tiler_s* self,
+                 uint8_t stream_id,
+                 size_t channel_capacity_bytes,
+                 struct channel* in,
+                 struct worker_pool* pool,
+                 void (*sig_stop_sink)(const struct video_tiler_s*))
+{
+    CHECK(in);
+    CHECK(pool);
+    CHECK(sig_stop_sink);
+    *self = (struct video_tiler_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+        .sig_stop_sink = sig_stop_sink,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_tiler_destroy(struct video_tiler_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+}
+
+enum DeviceStatusCode
+video_tiler_configure(struct video_tiler_s* self,
+                      uint32_t tile_x,
+                      uint32_t tile_y,
+                      uint32_t tile_t)
+{
+    const uint8_t enable = tile_x && tile_y;
+    self->tile_x = enable ? tile_x : 0;
+    self->tile_y = enable ? tile_y : 0;
+    self->tile_t = tile_t ? tile_t : 1;
+    if (!enable) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the tiler queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->tile_x = self->tile_y = 0;
+    return Device_Err;
+}
+
+uint8_t
+video_tiler_is_enabled(const struct video_tiler_s* self)
+{
+    return self->tile_x && self->tile_y;
+}
+
+void
+video_tiler_set_input(struct video_tiler_s* self, struct channel* in)
+{
+    if (in == self->in)
+        return;
+    channel_reader_detach(self->in, &self->reader);
+    self->in = in;
+}
+
+enum DeviceStatusCode
+video_tiler_start(struct video_tiler_s* self)
+{
+    EXPECT(video_tiler_is_enabled(self),
+           "Expected tiling to be configured for stream %d.",
+           self->stream_id);
+    // Only tile frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->group = 0;
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_tiler_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+const struct tiled_frame_header*
+tiled_frame_header_of(const struct VideoFrame* frame)
+{
+    const size_t bytes_of_raw = bytes_of_image(&frame->shape);
+    if (frame->bytes_of_frame == sizeof(*frame) + bytes_of_raw ||
+        frame->bytes_of_frame <
+          sizeof(*frame) + sizeof(struct tiled_frame_header))
+        return 0;
+    const struct tiled_frame_header* header =
+      (const struct tiled_frame_header*)frame->data;
+    return header->magic == TILED_FRAME_MAGIC ? header : 0;
+}
+
+int
+tiler_read_frame(const struct VideoFrame* record,
+                 uint32_t k,
+                 uint8_t* dst,
+                 size_t capacity)
+{
+    const struct tiled_frame_header* header = tiled_frame_header_of(record);
+    CHECK(header);
+    EXPECT(k < header->frame_count,
+           "Expected one of the %u frames of the record. Got %u.",
+           header->frame_count,
+           k);
+    const size_t ntiles = (size_t)header->tiles_x * header->tiles_y;
+    EXPECT(record->bytes_of_frame >= sizeof(*record) + sizeof(*header) +
+                                       ntiles * header->bytes_per_chunk,
+           "Tiled record is truncated.");
+    const uint32_t w = record->shape.dims.width;
+    const uint32_t h = record->shape.dims.height;
+    const uint32_t nc = header->channels;
+    const size_t nbytes =
+      (size_t)w * h * nc * header->planes * header->bytes_per_sample;
+    EXPECT(capacity >= nbytes,
+           "Expected at least %llu bytes for the frame. Got %llu.",
+           (unsigned long long)nbytes,
+           (unsigned long long)capacity);
+
+    const struct ImageShape shape = {
+        .dims = record->shape.dims,
+        .strides = { .channels = 1,
+                     .width = nc,
+                     .height = (int64_t)nc * w,
+                     .planes = (int64_t)nc * w * h },
+        .type = record->shape.type,
+    };
+    uint8_t* const chunks = (uint8_t*)(header + 1);
+    for (size_t i = 0; i < ntiles; ++i)
+        transfer_tile(header, &shape, dst, k, (uint32_t)i, chunks, 1);
+    return 1;
+Error:
+    return 0;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__tiler_copy_tile()
+{
+    // A 5x3 u16 frame in 2x2 tiles, 2 frames per chunk: 3x2 tiles, the last
+    // column and row of tiles hang over the edge.
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[5 * 3];
+    } im = { 0 };
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = 5, .height = 3, .planes = 1 },
+        .strides = { .channels = 1, .width = 1, .height = 5, .planes = 15 },
+        .type = SampleType_u16,
+    };
+    im.frame.bytes_of_frame = sizeof(im);
+    for (uint16_t i = 0; i < 15; ++i)
+        im.data[i] = (uint16_t)(i + 1);
+    const struct tiled_frame_header header = {
+        .magic = TILED_FRAME_MAGIC,
+        .tile_x = 2,
+        .tile_y = 2,
+        .tile_t = 2,
+        .tiles_x = 3,
+        .tiles_y = 2,
+        .frame_count = 1,
+        .bytes_per_sample = 2,
+        .channels = 1,
+        .planes = 1,
+        .bytes_per_chunk = 2 * 2 * 2 * 2,
+    };
+    uint16_t chunks[6][2][2][2];
+    memset(chunks, 0xff, sizeof(chunks)); // NOLINT
+    for (uint32_t i = 0; i < 6; ++i) {
+        tiler_copy_tile(&header, &im.frame, 0, i, (uint8_t*)chunks);
+        tiler_copy_tile(&header, 0, 1, i, (uint8_t*)chunks);
+    }
+    for (uint32_t i = 0; i < 6; ++i) {
+        for (uint32_t r = 0; r < 2; ++r) {
+            for (uint32_t c = 0; c < 2; ++c) {
+                const uint32_t x = (i % 3) * 2 + c, y = (i / 3) * 2 + r;
+                const uint16_t expected =
+                  (x < 5 && y < 3) ? im.data[y * 5 + x] : 0;
+                EXPECT(chunks[i][0][r][c] == expected,
+                       "Tile %u (%u,%u): got %u, expected %u",
+                       i,
+                       x,
+                       y,
+                       chunks[i][0][r][c],
+                       expected);
+                CHECK(chunks[i][1][r][c] == 0);
+            }
+        }
+    }
+    CHECK(tiled_frame_header_of(&im.frame) == 0);
+    return 1;
+Error:
+    return 0;
+}
+
+int
+unit_test__tiler_read_frame()
+{
+    // A 3x3 u8 frame with 2 planar channels, in 2x2 tiles, 2 frames per
+    // chunk.
+    struct
+    {
+        struct VideoFrame frame;
+        uint8_t data[2 * 3 * 3];
+    } im = { 0 };
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 2, .width = 3, .height = 3, .planes = 1 },
+        .strides = { .channels = 9, .width = 1, .height = 3, .planes = 18 },
+        .type = SampleType_u8,
+    };
+    im.frame.bytes_of_frame = sizeof(im);
+    for (uint8_t i = 0; i < 18; ++i)
+        im.data[i] = (uint8_t)(i + 1);
+
+    struct
+    {
+        struct VideoFrame frame;
+        struct tiled_frame_header header;
+        uint8_t chunks[4][2][2 * 2 * 2];
+    } rec = { 0 };
+    rec.frame.shape = im.frame.shape;
+    rec.frame.bytes_of_frame = sizeof(rec);
+    rec.header = (struct tiled_frame_header){
+        .magic = TILED_FRAME_MAGIC,
+        .tile_x = 2,
+        .tile_y = 2,
+        .tile_t = 2,
+        .tiles_x = 2,
+        .tiles_y = 2,
+        .frame_count = 1,
+        .bytes_per_sample = 1,
+        .channels = 2,
+        .planes = 1,
+        .bytes_per_chunk = sizeof(rec.chunks[0]),
+    };
+    for (uint32_t i = 0; i < 4; ++i) {
+        tiler_copy_tile(&rec.header, &im.frame, 0, i, (uint8_t*)rec.chunks);
+        tiler_copy_tile(&rec.header, 0, 1, i, (uint8_t*)rec.chunks);
+    }
+    // Channels are interleaved within a tile row.
+    CHECK(rec.chunks[0][0][0] == 1 && rec.chunks[0][0][1] == 10);
+    CHECK(rec.chunks[1][0][2] == 0); // padding past column 2
+
+    uint8_t out[18] = { 0 };
+    CHECK(tiled_frame_header_of(&rec.frame) == &rec.header);
+    CHECK(tiler_read_frame(&rec.frame, 0, out, sizeof(out)));
+    for (uint32_t y = 0; y < 3; ++y)
+        for (uint32_t x = 0; x < 3; ++x)
+            for (uint32_t c = 0; c < 2; ++c)
+                CHECK(out[(y * 3 + x) * 2 + c] == im.data[c * 9 + y * 3 + x]);
+    // Only one frame was added, and `out` must hold a whole frame.
+    CHECK(!tiler_read_frame(&rec.frame, 1, out, sizeof(out)));
+    CHECK(!tiler_read_frame(&rec.frame, 0, out, sizeof(out) - 1));
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,147 @@
+//!
+//! # Tile-major reordering
+//!
+//! Rearranges frames on their way to storage so every chunk of a chunked
+//! storage format is contiguous. A chunk is a `tile_x` by `tile_y` tile of
+//! `tile_t` consecutive frames. Groups of `tile_t` frames are written as one
+//! record:
+//!
+//! ~~~
+//!     VideoFrame | tiled_frame_header | chunk 0 | chunk 1 | ...
+//! ~~~
+//!
+//! The `VideoFrame` header is that of the first frame in the group, and its
+//! `shape` still describes a single frame. Chunks are in raster order over
+//! the tiles. Within a chunk, samples are ordered by frame, then plane, then
+//! row, then column, then channel. Tiles that hang over the edge of the
+//! frame, and the frames missing from a short last group, are padded with
+//! zeros so every chunk has the same size.
+//!
+//! Use `tiled_frame_header_of()` to tell a tiled record from a raw frame, and
+//! `tiler_read_frame()` to copy a frame back out of one.
+//!
+
+#ifndef H_ACQUIRE_TILER_V0
+#define H_ACQUIRE_TILER_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+#define TILED_FRAME_MAGIC (0x4c545141) // "AQTL"
+
+    struct tiled_frame_header
+    {
+        uint32_t magic; //< TILED_FRAME_MAGIC
+        uint32_t tile_x, tile_y, tile_t;
+        uint32_t tiles_x, tiles_y;
+        /// Frames in this group. At most `tile_t`.
+        uint32_t frame_count;
+        uint32_t bytes_per_sample;
+        uint32_t channels, planes;
+        uint64_t bytes_per_chunk;
+    };
+
+    /// Context for the tiler thread
+    ///
+    /// Like the encoder, the tiler sits on the storage path. It reads frames
+    /// from the sink's input channel alongside any other reader and writes
+    /// tiled records to `out` for the next stage on the storage path.
+    struct video_tiler_s
+    {
+        uint32_t tile_x, tile_y, tile_t;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// Tiled records. Allocated the first time tiling is enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// The record being filled. Stays mapped on `out` until `tile_t`
+        /// frames have been added to it.
+        struct VideoFrame* group;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Called when the tiler thread exits, after the last record has
+        /// been written to `out`.
+        void (*sig_stop_sink)(const struct video_tiler_s*);
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_tiler_init(
+      struct video_tiler_s* self,
+      uint8_t stream_id,
+      size_t channel_capacity_bytes,
+      struct channel* in,
+      struct worker_pool* pool,
+      void (*sig_stop_sink)(const struct video_tiler_s*));
+
+    void video_tiler_destroy(struct video_tiler_s* self);
+
+    /// @brief Selects the chunk shape.
+    /// Setting `tile_x` or `tile_y` to 0 disables tiling. A `tile_t` of 0 is
+    /// treated as 1.
+    enum DeviceStatusCode video_tiler_configure(struct video_tiler_s* self,
+                                                uint32_t tile_x,
+                                                uint32_t tile_y,
+                                                uint32_t tile_t);
+
+    uint8_t video_tiler_is_enabled(const struct video_tiler_s* self);
+
+    /// @brief Selects the channel the tiler reads from.
+    /// @see video_encoder_set_input()
+    void video_tiler_set_input(struct video_tiler_s* self, struct channel* in);
+
+    enum DeviceStatusCode video_tiler_start(struct video_tiler_s* self);
+
+    /// @returns The header of a tiled record, or NULL if `frame` holds raw
+    ///          pixel data.
+    const struct tiled_frame_header* tiled_frame_header_of(
+      const struct VideoFrame* frame);
+
+    /// @brief Copies the pixels of tile `itile` of `frame` into slot `k` of
+    ///        that tile's chunk.
+    /// @param[in] header Describes the layout of `chunks`.
+    /// @param[in] frame The frame to copy from, or NULL to zero the slot.
+    /// @param[out] chunks The first chunk of a tiled record.
+    void tiler_copy_tile(const struct tiled_frame_header* header,
+                         const struct VideoFrame* frame,
+                         uint32_t k,
+                         uint32_t itile,
+                         uint8_t* chunks);
+
+    /// @brief Copies the `k`'th frame of a tiled record out of its chunks.
+    /// @param[out] dst,capacity Receives the frame's samples, densely packed:
+    ///                          channels, then columns, rows and planes.
+    /// @returns 1 on success, otherwise 0.
+    int tiler_read_frame(const struct VideoFrame* record,
+                         uint32_t k,
+                         uint8_t* dst,
+                         size_t capacity);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_TILER_V0
@@ -0,0 +1,581 @@
+#include "traces.h"
+#include "frame_iterator.h"
+#include "marker.h"
+#include "logger.h"
+#include "platform.h"
+#include "throttler.h"
+#include "device/props/components.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+// #define TRACE(...) LOG(__VA_ARGS__)
+#define TRACE(...)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+static size_t
+slice_size_bytes(const struct slice* slice)
+{
+    return (uint8_t*)slice->end - (uint8_t*)slice->beg;
+}
+
+static uint64_t
+sum_u8(const uint8_t* p, size_t n)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        // Summing absolute differences from zero adds up groups of 8 bytes
+        // into 64-bit lanes, which can't overflow.
+        const __m256i z = _mm256_setzero_si256();
+        __m256i acc = z;
+        for (; i + 32 <= n; i += 32)
+            acc = _mm256_add_epi64(
+              acc,
+              _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(p + i)), z));
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i < n; ++i)
+        sum += p[i];
+    return sum;
+}
+
+static uint64_t
+sum_u16(const uint16_t* p, size_t n)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        // Each 32-bit lane gains at most 2*65535 per step. Widen to 64 bits
+        // well before that can overflow.
+        const size_t steps_per_flush = 1 << 14;
+        const __m256i z = _mm256_setzero_si256();
+        __m256i acc64 = z;
+        while (i + 16 <= n) {
+            __m256i acc32 = z;
+            for (size_t k = 0; k < steps_per_flush && i + 16 <= n;
+                 ++k, i += 16) {
+                const __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+                acc32 = _mm256_add_epi32(acc32, _mm256_unpacklo_epi16(v, z));
+                acc32 = _mm256_add_epi32(acc32, _mm256_unpackhi_epi16(v, z));
+            }
+            acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc32, z));
+            acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc32, z));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc64);
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i < n; ++i)
+        sum += p[i];
+    return sum;
+}
+
+#define SUM_SCALAR(T, acc)                                                     \
+    {                                                                          \
+        acc s = 0;                                                             \
+        const T* p = (const T*)frame->data + offset;                           \
+        for (uint32_t i = 0; i < r->length; ++i)                               \
+            s += p[i];                                                         \
+        return (double)s;                                                      \
+    }
+
+/// @returns The sum of the pixels of `frame` in run `r`.
+static double
+sum_run(const struct VideoFrame* frame, const struct trace_run* r)
+{
+    const size_t offset = (size_t)r->y * frame->shape.strides.height + r->x;
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            return (double)sum_u8(frame->data + offset, r->length);
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            return (double)sum_u16((const uint16_t*)frame->data + offset,
+                                   r->length);
+        case SampleType_i8:
+            SUM_SCALAR(int8_t, int64_t);
+        case SampleType_i16:
+            SUM_SCALAR(int16_t, int64_t);
+        case SampleType_f32:
+            SUM_SCALAR(float, double);
+        default:
+            return 0.0;
+    }
+}
+
+#undef SUM_SCALAR
+
+/// @returns True if `frame` can be traced with the label mask.
+static int
+matches_labels(const struct video_traces_s* self,
+               const struct VideoFrame* frame)
+{
+    switch (frame->shape.type) {
+        case SampleType_u8:
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+        case SampleType_i8:
+        case SampleType_i16:
+        case SampleType_f32:
+            break;
+        default:
+            return 0;
+    }
+    return frame->shape.dims.width == self->labels.width &&
+           frame->shape.dims.height == self->labels.height &&
+           frame->shape.strides.width == 1;
+}
+
+struct band_job_s
+{
+    const struct video_traces_s* self;
+    const struct VideoFrame* frame;
+    uint32_t rows_per_band;
+    double* sums;
+};
+
+static void
+band_job(void* ctx, size_t i)
+{
+    const struct band_job_s* job = (const struct band_job_s*)ctx;
+    const struct video_traces_s* self = job->self;
+    const uint32_t h = self->labels.height;
+    const uint32_t y0 = (uint32_t)i * job->rows_per_band;
+    const uint32_t y1 = y0 + job->rows_per_band < h ? y0 + job->rows_per_band
+                                                    : h;
+    double* sums = job->sums + i * self->labels.label_count;
+    memset(sums, 0, self->labels.label_count * sizeof(*sums)); // NOLINT
+    const struct trace_run* runs = self->labels.runs;
+    for (size_t k = self->labels.row_begin[y0]; k < self->labels.row_begin[y1];
+         ++k)
+        sums[runs[k].label - 1] += sum_run(job->frame, runs + k);
+}
+
+static int
+reserve_scratch(struct video_traces_s* self, size_t n)
+{
+    if (self->scratch.capacity >= n)
+        return 1;
+    free(self->scratch.sums);
+    self->scratch.capacity = 0;
+    CHECK(self->scratch.sums = (double*)malloc(n * sizeof(double)));
+    self->scratch.capacity = n;
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+trace_frame(struct video_traces_s* self, const struct VideoFrame* frame)
+{
+    if (frame_marker_of(frame) != FrameMarker_None)
+        return 1;
+    ++self->stats.frame_count;
+    if (!matches_labels(self, frame)) {
+        if (!self->stats.skipped_count++)
+            LOGE("[stream %d] TRACES: A %dx%d frame doesn't match the %dx%d "
+                 "label mask. Skipping frames like it.",
+                 self->stream_id,
+                 frame->shape.dims.width,
+                 frame->shape.dims.height,
+                 self->labels.width,
+                 self->labels.height);
+        return 1;
+    }
+
+    const uint32_t h = self->labels.height;
+    const uint32_t nlabels = self->labels.label_count;
+    const uint32_t rows_per_band =
+      (h + TRACES_MAX_BANDS - 1) / TRACES_MAX_BANDS;
+    const uint32_t nbands = (h + rows_per_band - 1) / rows_per_band;
+    CHECK(reserve_scratch(self, (size_t)nbands * nlabels));
+    struct band_job_s job = {
+        .self = self,
+        .frame = frame,
+        .rows_per_band = rows_per_band,
+        .sums = self->scratch.sums,
+    };
+    worker_pool_run(self->pool, nbands, band_job, &job);
+
+    // Traces are best effort. Never hold back the other readers for them.
+    const size_t nbytes =
+      (sizeof(struct trace_record) + nlabels * sizeof(float) + 7) & ~7ULL;
+    struct trace_record* out =
+      (struct trace_record*)channel_try_write_map(&self->out, nbytes);
+    if (!out) {
+        ++self->stats.dropped_count;
+        return 1;
+    }
+    *out = (struct trace_record){
+        .bytes_of_record = nbytes,
+        .frame_id = frame->frame_id,
+        .hardware_frame_id = frame->hardware_frame_id,
+        .timestamp_hardware = frame->timestamps.hardware,
+        .timestamp_acq_thread = frame->timestamps.acq_thread,
+        .label_count = nlabels,
+        .statistic = self->statistic,
+    };
+    for (uint32_t i = 0; i < nlabels; ++i) {
+        double sum = 0.0;
+        for (uint32_t b = 0; b < nbands; ++b)
+            sum += job.sums[(size_t)b * nlabels + i];
+        const uint64_t npx = self->labels.pixel_count[i];
+        out->values[i] =
+          self->statistic == TraceStatistic_Sum ? (float)sum
+          : npx                                 ? (float)(sum / (double)npx)
+                                                : 0.0f;
+    }
+    channel_write_unmap(&self->out);
+    return 1;
+Error:
+    return 0;
+}
+
+static int
+trace_available(struct video_traces_s* self)
+{
+    size_t nbytes = 0;
+    do {
+        struct slice slice = channel_read_map(self->in, &self->reader);
+        nbytes = slice_size_bytes(&slice);
+        struct frame_iterator it = frame_iterator_init(&slice);
+        const struct VideoFrame* frame = 0;
+        while ((frame = frame_iterator_next(&it)))
+            CHECK(trace_frame(self, frame));
+        channel_read_unmap(self->in, &self->reader, nbytes);
+    } while (nbytes);
+    return 1;
+Error:
+    channel_read_unmap(self->in, &self->reader, 0);
+    return 0;
+}
+
+static int
+video_traces_thread(struct video_traces_s* self)
+{
+    int ecode = 0;
+    LOG("[stream %d] TRACES: Entering thread", self->stream_id);
+    struct throttler throttler = throttler_init(10e-3f);
+    while (!self->is_stopping) {
+        CHECK(trace_available(self));
+        throttler_wait(&throttler);
+    }
+    TRACE("[stream %d] TRACES: Flushing", self->stream_id);
+    CHECK(trace_available(self));
+Finalize:
+    LOG("[stream %d] TRACES: Exiting thread (%llu frames, %llu dropped)",
+        self->stream_id,
+        (unsigned long long)self->stats.frame_count,
+        (unsigned long long)self->stats.dropped_count);
+    self->is_running = 0;
+    self->is_stopping = 0;
+    return ecode;
+Error:
+    LOGE("[stream %d] TRACES: Error", self->stream_id);
+    // Don't hold back the other readers of the input channel.
+    channel_reader_detach(self->in, &self->reader);
+    ecode = 1;
+    goto Finalize;
+}
+
+static void
+clear_labels(struct video_traces_s* self)
+{
+    free(self->labels.runs);
+    free(self->labels.row_begin);
+    free(self->labels.pixel_count);
+    memset(&self->labels, 0, sizeof(self->labels)); // NOLINT
+}
+
+enum DeviceStatusCode
+video_traces_init(struct video_traces_s* self,
+                  uint8_t stream_id,
+                  size_t channel_capacity_bytes,
+                  struct channel* in,
+                  struct worker_pool* pool)
+{
+    CHECK(in);
+    CHECK(pool);
+    *self = (struct video_traces_s){
+        .stream_id = stream_id,
+        .in = in,
+        .out_capacity_bytes = channel_capacity_bytes,
+        .pool = pool,
+    };
+    parked_thread_init(&self->thread);
+    return Device_Ok;
+Error:
+    return Device_Err;
+}
+
+void
+video_traces_destroy(struct video_traces_s* self)
+{
+    parked_thread_destroy(&self->thread);
+    if (self->out.data)
+        channel_release(&self->out);
+    clear_labels(self);
+    free(self->scratch.sums);
+    self->scratch.sums = 0;
+    self->scratch.capacity = 0;
+}
+
+enum DeviceStatusCode
+video_traces_configure(struct video_traces_s* self,
+                       uint8_t enable,
+                       enum trace_statistic statistic)
+{
+    EXPECT(statistic < TraceStatistic_Count,
+           "Unknown trace statistic %d.",
+           statistic);
+    EXPECT(!enable || self->labels.label_count,
+           "[stream %d] Expected a label mask with at least one region.",
+           self->stream_id);
+    self->is_enabled = enable != 0;
+    self->statistic = statistic;
+    if (!enable) {
+        channel_reader_detach(self->in, &self->reader);
+    } else if (!self->out.data) {
+        LOG("[stream %d] Allocating %llu bytes for the traces queue.",
+            self->stream_id,
+            (unsigned long long)self->out_capacity_bytes);
+        channel_new(&self->out, self->out_capacity_bytes);
+        CHECK(self->out.data);
+    }
+    return Device_Ok;
+Error:
+    self->is_enabled = 0;
+    return Device_Err;
+}
+
+enum DeviceStatusCode
+video_traces_set_labels(struct video_traces_s* self,
+                        const uint16_t* labels,
+                        uint32_t width,
+                        uint32_t height)
+{
+    clear_labels(self);
+    if (!labels || !width || !height)
+        return Device_Ok;
+
+    // Count the runs and labels first so everything is allocated once.
+    size_t nruns = 0;
+    uint32_t nlabels = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint16_t* row = labels + (size_t)y * width;
+        for (uint32_t x = 0; x < width; ++x) {
+            if (row[x] && (x == 0 || row[x] != row[x - 1]))
+                ++nruns;
+            nlabels = row[x] > nlabels ? row[x] : nlabels;
+        }
+    }
+    CHECK(self->labels.row_begin =
+            (size_t*)malloc((height + 1) * sizeof(size_t)));
+    CHECK(self->labels.pixel_count =
+            (uint64_t*)calloc(nlabels ? nlabels : 1, sizeof(uint64_t)));
+    CHECK(self->labels.runs = (struct trace_run*)malloc(
+            (nruns ? nruns : 1) * sizeof(struct trace_run)));
+
+    struct trace_run* run = self->labels.runs;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint16_t* row = labels + (size_t)y * width;
+        self->labels.row_begin[y] = run - self->labels.runs;
+        for (uint32_t x = 0; x < width;) {
+            const uint16_t label = row[x];
+            uint32_t end = x + 1;
+            while (end < width && row[end] == label)
+                ++end;
+            if (label) {
+                *run++ = (struct trace_run){
+                    .y = y,
+                    .x = x,
+                    .length = end - x,
+                    .label = label,
+                };
+                self->labels.pixel_count[label - 1] += end - x;
+            }
+            x = end;
+        }
+    }
+    self->labels.row_begin[height] = nruns;
+    self->labels.run_count = nruns;
+    self->labels.label_count = nlabels;
+    self->labels.width = width;
+    self->labels.height = height;
+    LOG("[stream %d] Traces: %u labels in %llu runs.",
+        self->stream_id,
+        nlabels,
+        (unsigned long long)nruns);
+    return Device_Ok;
+Error:
+    LOGE("[stream %d] Failed to allocate the label mask.", self->stream_id);
+    clear_labels(self);
+    return Device_Err;
+}
+
+uint8_t
+video_traces_is_enabled(const struct video_traces_s* self)
+{
+    return self->is_enabled;
+}
+
+enum DeviceStatusCode
+video_traces_start(struct video_traces_s* self)
+{
+    EXPECT(video_traces_is_enabled(self),
+           "Expected traces to be configured for stream %d.",
+           self->stream_id);
+    EXPECT(self->labels.label_count,
+           "[stream %d] The label mask was cleared.",
+           self->stream_id);
+    // Only trace frames acquired from here on.
+    channel_reader_attach(self->in, &self->reader);
+    channel_accept_writes(&self->out, 1);
+    self->stats = (struct video_traces_stats_s){ 0 };
+    self->is_stopping = 0;
+    self->is_running = 1;
+    CHECK(parked_thread_create(
+      &self->thread, (void (*)(void*))video_traces_thread, self));
+    return Device_Ok;
+Error:
+    self->is_running = 0;
+    return Device_Err;
+}
+
+#ifndef NO_UNIT_TESTS
+
+int
+unit_test__traces_reduce_labeled_regions()
+{
+    enum
+    {
+        W = 100,
+        H = 70
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[W * H];
+    } im = { 0 };
+    im.frame.bytes_of_frame = sizeof(im);
+    im.frame.frame_id = 5;
+    im.frame.shape = (struct ImageShape){
+        .dims = { .channels = 1, .width = W, .height = H, .planes = 1 },
+        .strides = { .channels = 1,
+                     .width = 1,
+                     .height = W,
+                     .planes = W * H },
+        .type = SampleType_u16,
+    };
+    // 16 blocks of labels, with background pixels scattered through them.
+    // Label 16 isn't used, so it has no pixels.
+    static uint16_t labels[W * H];
+    double sums[16] = { 0 };
+    uint64_t counts[16] = { 0 };
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            const uint32_t i = y * W + x;
+            im.data[i] = (uint16_t)(60000 + x * 5 + y * 7);
+            uint16_t label = (uint16_t)(1 + x / 25 + 4 * (y / 20));
+            if ((x + y) % 7 == 0 || label == 16)
+                label = 0;
+            labels[i] = label;
+            if (label) {
+                sums[label - 1] += im.data[i];
+                ++counts[label - 1];
+            }
+        }
+    }
+
+    struct channel in = { 0 };
+    struct worker_pool pool = { 0 };
+    struct video_traces_s traces = { 0 };
+    CHECK(worker_pool_init(&pool, 0));
+    CHECK(video_traces_init(&traces, 0, 1 << 16, &in, &pool) == Device_Ok);
+    CHECK(video_traces_configure(&traces, 1, TraceStatistic_Mean) ==
+          Device_Err); // no labels yet
+    CHECK(video_traces_set_labels(&traces, labels, W, H) == Device_Ok);
+    CHECK(traces.labels.label_count == 15);
+    CHECK(video_traces_configure(&traces, 1, TraceStatistic_Mean) ==
+          Device_Ok);
+    channel_accept_writes(&traces.out, 1);
+
+    CHECK(trace_frame(&traces, &im.frame));
+    traces.statistic = TraceStatistic_Sum;
+    CHECK(trace_frame(&traces, &im.frame));
+    // Doesn't match the mask.
+    im.frame.shape.dims.height = H - 1;
+    CHECK(trace_frame(&traces, &im.frame));
+    CHECK(traces.stats.frame_count == 3);
+    CHECK(traces.stats.skipped_count == 1);
+
+    struct channel_reader reader = { 0 };
+    struct slice slice = channel_read_map(&traces.out, &reader);
+    const struct trace_record* record = (const struct trace_record*)slice.beg;
+    for (int irecord = 0; irecord < 2; ++irecord) {
+        CHECK((const uint8_t*)record < (const uint8_t*)slice.end);
+        CHECK(record->frame_id == 5);
+        CHECK(record->label_count == 15);
+        CHECK(record->statistic == (irecord ? TraceStatistic_Sum
+                                            : TraceStatistic_Mean));
+        for (uint32_t i = 0; i < record->label_count; ++i) {
+            const double expected =
+              irecord ? sums[i] : sums[i] / (double)counts[i];
+            EXPECT(fabs(record->values[i] - expected) <= 1e-6 * expected,
+                   "Record %d label %u: expected %f. Got %f.",
+                   irecord,
+                   i + 1,
+                   expected,
+                   record->values[i]);
+        }
+        record = (const struct trace_record*)((const uint8_t*)record +
+                                              record->bytes_of_record);
+    }
+    CHECK((const uint8_t*)record == (const uint8_t*)slice.end);
+    channel_read_unmap(&traces.out, &reader, slice_size_bytes(&slice));
+
+    // Long runs, to exercise the vectorized sums.
+    {
+        static uint8_t bytes[1000];
+        uint64_t expected = 0;
+        for (int i = 0; i < 1000; ++i)
+            expected += bytes[i] = (uint8_t)(255 - i % 13);
+        CHECK(sum_u8(bytes, 1000) == expected);
+        CHECK(sum_u16(im.data, W * H) == sum_u16(im.data, 17) +
+                                           sum_u16(im.data + 17, W * H - 17));
+    }
+
+    video_traces_destroy(&traces);
+    worker_pool_destroy(&pool);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
@@ -0,0 +1,158 @@
+//!
+//! # Region traces
+//!
+//! Reduces each frame to one number per labeled region, for time series like
+//! calcium traces that don't need the pixels. The traces thread reads the
+//! sink's input channel alongside the other readers.
+//!
+//! Regions are given as a mask of 16-bit labels the size of a frame. Label 0
+//! is background. Labels `1..label_count` are regions, and needn't be
+//! contiguous. The mask is compiled to runs of pixels sharing a label along
+//! each row, so each run is summed as one contiguous span. Bands of rows are
+//! summed in parallel on the worker pool and the bands are added up per
+//! frame.
+//!
+//! One `trace_record`, holding the sum or mean of every label, is written to
+//! `out` per frame. Records are best effort. They are dropped, and counted,
+//! while `out` is full. Frames whose shape doesn't match the mask are
+//! skipped and counted.
+//!
+
+#ifndef H_ACQUIRE_TRACES_V0
+#define H_ACQUIRE_TRACES_V0
+
+#include <stdint.h>
+#include "channel.h"
+#include "parked_thread.h"
+#include "worker_pool.h"
+#include "device/props/device.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+/// Upper bound on the number of bands a frame's rows are split into.
+#define TRACES_MAX_BANDS (64)
+
+    enum trace_statistic
+    {
+        TraceStatistic_Mean = 0,
+        TraceStatistic_Sum,
+        TraceStatistic_Count,
+    };
+
+    /// The traces of one frame.
+    struct trace_record
+    {
+        /// Size of this record, including `values`. A multiple of 8.
+        uint64_t bytes_of_record;
+        uint64_t frame_id;
+        uint64_t hardware_frame_id;
+        uint64_t timestamp_hardware;
+        uint64_t timestamp_acq_thread;
+        uint32_t label_count;
+        uint32_t statistic; //< `enum trace_statistic`
+        /// `values[i]` is the statistic of label `i+1`. Labels without
+        /// pixels are 0.
+        float values[];
+    };
+
+    /// Pixels `[x,x+length)` of row `y` all belong to `label`.
+    struct trace_run
+    {
+        uint32_t y, x, length, label;
+    };
+
+    /// Context for the traces thread
+    struct video_traces_s
+    {
+        enum trace_statistic statistic;
+        uint8_t is_enabled;
+
+        struct channel* in;
+        struct channel_reader reader;
+
+        /// `trace_record`s. Allocated the first time traces are enabled.
+        struct channel out;
+        size_t out_capacity_bytes;
+
+        struct worker_pool* pool;
+
+        /// The compiled label mask. Set with `video_traces_set_labels()`.
+        struct
+        {
+            uint32_t width, height;
+            uint32_t label_count;
+            /// Runs in raster order.
+            struct trace_run* runs;
+            size_t run_count;
+            /// `height+1` entries. The runs of row `y` are
+            /// `runs[row_begin[y],row_begin[y+1])`.
+            size_t* row_begin;
+            /// Pixels per label.
+            uint64_t* pixel_count;
+        } labels;
+
+        /// Per-band sums. `label_count` per band.
+        struct
+        {
+            double* sums;
+            size_t capacity;
+        } scratch;
+
+        /// Used by external threads to signal the controller thread to stop
+        /// Other threads may write.
+        uint8_t is_stopping;
+
+        /// When true, the controller thread has completed it's work.
+        /// Other threads should only read.
+        uint8_t is_running;
+
+        /// Written by the traces thread. Reset on start.
+        struct video_traces_stats_s
+        {
+            uint64_t frame_count;
+            /// Frames whose shape didn't match the label mask.
+            uint64_t skipped_count;
+            /// Records dropped because the unread ones filled `out`.
+            uint64_t dropped_count;
+        } stats;
+
+        struct parked_thread thread;
+        uint8_t stream_id;
+    };
+
+    enum DeviceStatusCode video_traces_init(struct video_traces_s* self,
+                                            uint8_t stream_id,
+                                            size_t channel_capacity_bytes,
+                                            struct channel* in,
+                                            struct worker_pool* pool);
+
+    void video_traces_destroy(struct video_traces_s* self);
+
+    /// @param[in] enable Nonzero to publish traces. Requires a label mask.
+    enum DeviceStatusCode video_traces_configure(
+      struct video_traces_s* self,
+      uint8_t enable,
+      enum trace_statistic statistic);
+
+    /// @brief Sets the label mask.
+    /// @param[in] labels `width*height` labels in raster order. NULL, or an
+    ///                   empty shape, clears the mask.
+    enum DeviceStatusCode video_traces_set_labels(struct video_traces_s* self,
+                                                  const uint16_t* labels,
+                                                  uint32_t width,
+                                                  uint32_t height);
+
+    uint8_t video_traces_is_enabled(const struct video_traces_s* self);
+
+    enum DeviceStatusCode video_traces_start(struct video_traces_s* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_TRACES_V0
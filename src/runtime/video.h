@@ -6,6 +6,18 @@
 #include "sink.h"
 #include "source.h"
 #include "filter.h"
+#include "encoder.h"
+#include "tiler.h"
+#include "detector.h"
+#include "preview.h"
+#include "gate.h"
+#include "lut.h"
+#include "roi.h"
+#include "traces.h"
+#include "meter.h"
+#include "decimator.h"
+#include "demosaic.h"
+#include "orient.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -13,7 +25,17 @@ extern "C"
 #endif
     struct video_monitor_s
     {
+        /// The channel `reader` reads. One of `sink.in`, `lut.out`,
+        /// `filtered_sink.in` or `demosaic.out`.
+        struct channel* from;
         struct channel_reader reader;
+        /// Skips frames before `reader` maps them. See `acquire_map_read()`.
+        struct decimator decimator;
+        struct channel_reader stats_reader;   //< reads `meter.out`
+        struct channel_reader spots_reader;   //< reads `detector.out`
+        struct channel_reader preview_reader; //< reads `preview.out`
+        struct channel_reader gating_reader;  //< reads `gate.log`
+        struct channel_reader traces_reader;  //< reads `traces.out`
     };
 
     struct video_s
@@ -21,12 +43,59 @@ extern "C"
         /// The index of this in the `videos[]` array.
         /// Set in `acquire_init()`
         uint8_t stream_id;
+
+        /// `DeviceState_Running` from the stream's start until its stop.
+        /// Otherwise, whether the stream is configured.
+        enum DeviceState state;
+
         struct video_monitor_s
           monitor; //< A reader exposed through the public api
 
-        struct video_source_s source; //< context for the video source thread
-        struct video_filter_s filter; //< context for the video filter thread
-        struct video_sink_s sink;     //< context for the video sink thread
+        struct video_source_s source;   //< context for the video source thread
+        struct video_filter_s filter;   //< context for the video filter thread
+        struct video_tiler_s tiler;     //< context for the tiler thread
+        struct video_encoder_s encoder; //< context for the encoder thread
+        struct video_sink_s sink;       //< context for the video sink thread
+
+        /// Context for the orientation thread. Writes the sink's input when
+        /// orientation is enabled.
+        struct video_orient_s orient;
+
+        /// Where the filter's frames go. See `enum filter_routing`.
+        enum filter_routing filter_routing;
+
+        /// When the filter is routed next to storage, its output is this
+        /// sink's input channel, and the monitor reads it. The sink itself
+        /// only runs for `FilterRouting_Split`.
+        struct video_sink_s filtered_sink;
+
+        /// Context for the spot detector thread. Reads the sink's input.
+        struct video_detector_s detector;
+
+        /// Context for the preview thread. Reads the sink's input.
+        struct video_preview_s preview;
+
+        /// Context for the gate thread. On the storage path, which runs
+        /// roi, lut, gate, tiler, encoder, then sink.
+        struct video_gate_s gate;
+
+        /// Context for the bit-depth reduction thread. After the roi and
+        /// ahead of the gate on the storage path.
+        struct video_lut_s lut;
+
+        /// Context for the region of interest thread. First on the storage
+        /// path, ahead of the lut.
+        struct video_roi_s roi;
+
+        /// Context for the region traces thread. Reads `sink.in`.
+        struct video_traces_s traces;
+
+        /// Context for the frame statistics thread. Reads `sink.in`.
+        struct video_meter_s meter;
+
+        /// Context for the demosaic thread. Reads what the monitor would
+        /// otherwise read, and the monitor reads its output.
+        struct video_demosaic_s demosaic;
     };
 
 #ifdef __cplusplus
@@ -0,0 +1,170 @@
+#include "welford.h"
+#include "logger.h"
+#include "simd.h"
+#include "device/props/components.h"
+
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+#if defined(__AVX2__)
+#define UPDATE_SIMD(suffix)                                                    \
+    {                                                                          \
+        const __m256 inv_n = _mm256_set1_ps(inv);                              \
+        for (; i + 8 <= npx; i += 8) {                                         \
+            const __m256 v = load8_##suffix(x + i);                            \
+            const __m256 m = _mm256_loadu_ps(mean + i);                        \
+            const __m256 d = _mm256_sub_ps(v, m);                              \
+            const __m256 m1 = _mm256_add_ps(m, _mm256_mul_ps(d, inv_n));      \
+            const __m256 d1 = _mm256_sub_ps(v, m1);                            \
+            _mm256_storeu_ps(mean + i, m1);                                    \
+            _mm256_storeu_ps(                                                  \
+              m2 + i,                                                          \
+              _mm256_add_ps(_mm256_loadu_ps(m2 + i), _mm256_mul_ps(d, d1)));   \
+        }                                                                      \
+    }
+#else
+#define UPDATE_SIMD(suffix)
+#endif
+
+/// Defines `update_<suffix>()` for inputs of type `T`.
+#define DEFINE_UPDATE(T, suffix)                                               \
+    static void update_##suffix(                                               \
+      float* mean, float* m2, size_t npx, const T* x, uint32_t n)              \
+    {                                                                          \
+        size_t i = 0;                                                          \
+        if (n == 1) {                                                          \
+            for (; i < npx; ++i) {                                             \
+                mean[i] = (float)x[i];                                         \
+                m2[i] = 0.0f;                                                  \
+            }                                                                  \
+            return;                                                            \
+        }                                                                      \
+        const float inv = 1.0f / (float)n;                                     \
+        UPDATE_SIMD(suffix)                                                    \
+        for (; i < npx; ++i) {                                                 \
+            const float d = (float)x[i] - mean[i];                             \
+            mean[i] += d * inv;                                                \
+            m2[i] += d * ((float)x[i] - mean[i]);                              \
+        }                                                                      \
+    }
+
+DEFINE_UPDATE(uint8_t, u8)
+DEFINE_UPDATE(uint16_t, u16)
+DEFINE_UPDATE(int8_t, i8)
+DEFINE_UPDATE(int16_t, i16)
+DEFINE_UPDATE(float, f32)
+
+int
+welford_update(float* mean,
+               float* m2,
+               size_t npx,
+               const struct VideoFrame* in,
+               uint32_t n)
+{
+    EXPECT(n > 0, "Expected a window of at least one frame.");
+    switch (in->shape.type) {
+        case SampleType_u8:
+            update_u8(mean, m2, npx, in->data, n);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            update_u16(mean, m2, npx, (const uint16_t*)in->data, n);
+            break;
+        case SampleType_i8:
+            update_i8(mean, m2, npx, (const int8_t*)in->data, n);
+            break;
+        case SampleType_i16:
+            update_i16(mean, m2, npx, (const int16_t*)in->data, n);
+            break;
+        case SampleType_f32:
+            update_f32(mean, m2, npx, (const float*)in->data, n);
+            break;
+        default:
+            EXPECT(0, "Unsupported pixel type: %d", (int)in->shape.type);
+    }
+    return 1;
+Error:
+    return 0;
+}
+
+void
+welford_finalize(float* m2, size_t npx, uint32_t n)
+{
+    const float inv = (n > 1) ? 1.0f / (float)(n - 1) : 0.0f;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 v = _mm256_set1_ps(inv);
+    for (; i + 8 <= npx; i += 8)
+        _mm256_storeu_ps(m2 + i, _mm256_mul_ps(_mm256_loadu_ps(m2 + i), v));
+#endif
+    for (; i < npx; ++i)
+        m2[i] *= inv;
+}
+
+#ifndef NO_UNIT_TESTS
+
+#include <math.h>
+
+int
+unit_test__welford_matches_two_pass()
+{
+    enum
+    {
+        N = 8 * 3 + 5, // vector path and scalar tail
+        K = 7
+    };
+    struct
+    {
+        struct VideoFrame frame;
+        uint16_t data[N];
+    } frames[K] = { 0 };
+    float mean[N], m2[N];
+    for (unsigned k = 0; k < K; ++k) {
+        frames[k].frame.shape.type = SampleType_u16;
+        for (unsigned i = 0; i < N; ++i)
+            frames[k].data[i] = (uint16_t)(1000 + ((i * 31 + k * 17) % 23));
+    }
+    for (unsigned k = 0; k < K; ++k)
+        CHECK(welford_update(mean, m2, N, &frames[k].frame, k + 1));
+    welford_finalize(m2, N, K);
+
+    for (unsigned i = 0; i < N; ++i) {
+        double mu = 0.0, var = 0.0;
+        for (unsigned k = 0; k < K; ++k)
+            mu += frames[k].data[i];
+        mu /= K;
+        for (unsigned k = 0; k < K; ++k)
+            var += (frames[k].data[i] - mu) * (frames[k].data[i] - mu);
+        var /= K - 1;
+        EXPECT(fabs(mean[i] - mu) < 1e-3,
+               "pixel %u: mean %f, expected %f",
+               i,
+               mean[i],
+               mu);
+        EXPECT(fabs(m2[i] - var) < 1e-2 * (1.0 + var),
+               "pixel %u: variance %f, expected %f",
+               i,
+               m2[i],
+               var);
+    }
+
+    // A window of one frame has no variance.
+    CHECK(welford_update(mean, m2, N, &frames[0].frame, 1));
+    welford_finalize(m2, N, 1);
+    CHECK(m2[3] == 0.0f && mean[3] == frames[0].data[3]);
+    return 1;
+Error:
+    return 0;
+}
+
+#endif // NO_UNIT_TESTS
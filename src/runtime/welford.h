@@ -0,0 +1,43 @@
+//!
+//! # Running mean and variance
+//!
+//! Per-pixel mean and variance over a window of frames, accumulated one frame
+//! at a time with Welford's method. The accumulator is an f32 image of the
+//! running mean followed by an f32 image of the running sum of squared
+//! deviations from the mean (M2).
+//!
+
+#ifndef H_ACQUIRE_WELFORD_V0
+#define H_ACQUIRE_WELFORD_V0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct VideoFrame;
+
+    /// @brief Adds the `n`'th frame of a window to the accumulator.
+    /// @param[in,out] mean,m2 `npx` samples each. When `n` is 1 they are
+    ///                        initialized from `in`.
+    /// @param[in] in A frame with at least `npx` samples.
+    /// @param[in] n The number of frames in the window, including `in`.
+    /// @returns 1 on success, or 0 if the sample type isn't supported.
+    int welford_update(float* mean,
+                       float* m2,
+                       size_t npx,
+                       const struct VideoFrame* in,
+                       uint32_t n);
+
+    /// @brief Replaces M2 with the sample variance of a window of `n`
+    ///        frames. The variance is 0 when `n` is less than 2.
+    void welford_finalize(float* m2, size_t npx, uint32_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_WELFORD_V0
@@ -0,0 +1,184 @@
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define countof(e) (sizeof(e) / sizeof((e)[0]))
+
+#define LOG(...) aq_logger(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) aq_logger(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            LOGE(__VA_ARGS__);                                                 \
+            goto Error;                                                        \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false:\n\t%s", #e)
+
+/// A unit of submitted work. Lives on the submitting thread's stack for the
+/// duration of `worker_pool_run()`.
+struct worker_pool_batch
+{
+    void (*fn)(void* ctx, size_t i);
+    void* ctx;
+    size_t count;
+    size_t next;  //< index of the next unclaimed item
+    size_t ndone; //< number of completed items
+    struct worker_pool_batch* next_batch;
+};
+
+static unsigned
+processor_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info = { 0 };
+    GetSystemInfo(&info);
+    return (unsigned)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+#endif
+}
+
+/// Removes `batch` from the queue. Caller must hold the lock.
+static void
+dequeue(struct worker_pool* self, struct worker_pool_batch* batch)
+{
+    struct worker_pool_batch** cur = &self->queue;
+    while (*cur && *cur != batch)
+        cur = &(*cur)->next_batch;
+    if (*cur)
+        *cur = batch->next_batch;
+}
+
+/// Claims the next item of `batch`. Caller must hold the lock.
+/// @returns 1 if an item was claimed, otherwise 0.
+static int
+claim(struct worker_pool* self, struct worker_pool_batch* batch, size_t* i)
+{
+    if (batch->next >= batch->count)
+        return 0;
+    *i = batch->next++;
+    if (batch->next == batch->count)
+        dequeue(self, batch);
+    return 1;
+}
+
+/// Runs item `i` of `batch`. Caller must hold the lock, which is released
+/// while the item runs.
+static void
+execute(struct worker_pool* self, struct worker_pool_batch* batch, size_t i)
+{
+    lock_release(&self->lock);
+    batch->fn(batch->ctx, i);
+    lock_acquire(&self->lock);
+    if (++batch->ndone == batch->count)
+        condition_variable_notify_all(&self->notify_done);
+}
+
+static void
+worker_thread(struct worker_pool* self)
+{
+    lock_acquire(&self->lock);
+    while (!self->is_stopping) {
+        size_t i = 0;
+        struct worker_pool_batch* batch = self->queue;
+        if (batch && claim(self, batch, &i)) {
+            execute(self, batch, i);
+        } else {
+            condition_variable_wait(&self->notify_work, &self->lock);
+        }
+    }
+    lock_release(&self->lock);
+}
+
+int
+worker_pool_init(struct worker_pool* self, unsigned thread_count)
+{
+    memset(self, 0, sizeof(*self)); // NOLINT
+    lock_init(&self->lock);
+    condition_variable_init(&self->notify_work);
+    condition_variable_init(&self->notify_done);
+
+    if (!thread_count) {
+        // The submitting thread does some of the work.
+        const unsigned n = processor_count();
+        thread_count = n > 1 ? n - 1 : 0;
+    }
+    if (thread_count > countof(self->threads))
+        thread_count = countof(self->threads);
+
+    for (unsigned i = 0; i < thread_count; ++i) {
+        thread_init(self->threads + i);
+        CHECK(thread_create(
+          self->threads + i, (void (*)(void*))worker_thread, self));
+        self->thread_count = i + 1;
+    }
+    LOG("Started %u worker threads.", self->thread_count);
+    return 1;
+Error:
+    worker_pool_destroy(self);
+    return 0;
+}
+
+void
+worker_pool_destroy(struct worker_pool* self)
+{
+    lock_acquire(&self->lock);
+    self->is_stopping = 1;
+    condition_variable_notify_all(&self->notify_work);
+    lock_release(&self->lock);
+    for (unsigned i = 0; i < self->thread_count; ++i)
+        thread_join(self->threads + i);
+    self->thread_count = 0;
+}
+
+void
+worker_pool_run(struct worker_pool* self,
+                size_t count,
+                void (*fn)(void* ctx, size_t i),
+                void* ctx)
+{
+    if (!count)
+        return;
+    if (!self || !self->thread_count || count == 1) {
+        for (size_t i = 0; i < count; ++i)
+            fn(ctx, i);
+        return;
+    }
+
+    struct worker_pool_batch batch = {
+        .fn = fn,
+        .ctx = ctx,
+        .count = count,
+    };
+    lock_acquire(&self->lock);
+    {
+        struct worker_pool_batch** tail = &self->queue;
+        while (*tail)
+            tail = &(*tail)->next_batch;
+        *tail = &batch;
+    }
+    condition_variable_notify_all(&self->notify_work);
+
+    size_t i = 0;
+    while (claim(self, &batch, &i))
+        execute(self, &batch, i);
+    while (batch.ndone < batch.count)
+        condition_variable_wait(&self->notify_done, &self->lock);
+    lock_release(&self->lock);
+}
+
+unsigned
+worker_pool_concurrency(const struct worker_pool* self)
+{
+    return self ? self->thread_count + 1 : 1;
+}
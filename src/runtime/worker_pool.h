@@ -0,0 +1,71 @@
+//! A pool of worker threads for data-parallel kernels.
+//!
+//! Pipeline stages each run on a single controller thread. When a stage has
+//! work that splits into independent pieces (blocks of a frame, tiles, rows)
+//! it hands those pieces to the pool with `worker_pool_run()`. The calling
+//! thread participates, so a pool with no workers just runs the pieces
+//! serially.
+//!
+//! Several stages may submit work at the same time. The pool is shared by
+//! all the video streams.
+//!
+//! Example:
+//!
+//! ~~~{.c}
+//!     static void work(void* ctx, size_t i) { ... }
+//!     worker_pool_run(pool, nblocks, work, ctx); // returns when all are done
+//! ~~~
+#ifndef H_ACQUIRE_WORKER_POOL_V0
+#define H_ACQUIRE_WORKER_POOL_V0
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct worker_pool_batch;
+
+    struct worker_pool
+    {
+        struct lock lock;
+        struct condition_variable notify_work;
+        struct condition_variable notify_done;
+
+        /// Batches that still have unclaimed items.
+        struct worker_pool_batch* queue;
+
+        struct thread threads[32];
+        unsigned thread_count;
+
+        /// Set by `worker_pool_destroy()` to release the workers.
+        uint8_t is_stopping;
+    };
+
+    /// @brief Starts `thread_count` worker threads.
+    /// @param[out] self The pool. Memory is zeroed.
+    /// @param[in] thread_count Number of workers. Use 0 to size the pool to
+    ///                         the number of processors.
+    /// @return 1 on success, otherwise 0.
+    int worker_pool_init(struct worker_pool* self, unsigned thread_count);
+
+    /// Joins the worker threads. Work must not be submitted concurrently.
+    void worker_pool_destroy(struct worker_pool* self);
+
+    /// @brief Calls `fn(ctx,i)` for each `i` in `[0,count)` on the pool.
+    /// Blocks until every call has returned.
+    void worker_pool_run(struct worker_pool* self,
+                         size_t count,
+                         void (*fn)(void* ctx, size_t i),
+                         void* ctx);
+
+    /// @returns The number of threads that can work on a batch at once,
+    ///          including the caller.
+    unsigned worker_pool_concurrency(const struct worker_pool* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // H_ACQUIRE_WORKER_POOL_V0
@@ -0,0 +1,137 @@
+//! Measures how long it takes to get the first frame after `acquire_start()`
+//! and for `acquire_stop()` to return once the last frame is in, over
+//! repeated cycles.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+static const int ncycles = 20;
+static const uint64_t nframes = 4;
+
+/// Sorts `ms` and logs its minimum, median and maximum.
+static void
+log_latencies(const char* name, double* ms, int n)
+{
+    std::sort(ms, ms + n);
+    LOG("%s: min %f ms, median %f ms, max %f ms",
+        name,
+        ms[0],
+        ms[n / 2],
+        ms[n - 1]);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = nframes;
+    OK(acquire_configure(runtime, &props));
+
+    double start_ms[ncycles] = { 0 }, stop_ms[ncycles] = { 0 };
+    for (int i = 0; i < ncycles; ++i) {
+        struct clock clock
+        {};
+        static double time_limit_ms = 20000.0;
+        clock_init(&clock);
+        clock_shift_ms(&clock, time_limit_ms);
+
+        // Start to first frame. The rest are read so `acquire_stop()` only
+        // waits for the threads to wind down.
+        struct clock timer
+        {};
+        clock_init(&timer);
+        OK(acquire_start(runtime));
+        uint64_t nread = 0;
+        while (nread < nframes) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg = 0, *end = 0, *cur;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            if (beg != end && !nread)
+                start_ms[i] = clock_toc_ms(&timer);
+            for (cur = beg; cur < end;
+                 cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame))
+                ++nread;
+            OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        }
+        CHECK(nread == nframes);
+
+        // Stop to idle.
+        clock_init(&timer);
+        OK(acquire_stop(runtime));
+        stop_ms[i] = clock_toc_ms(&timer);
+        CHECK(DeviceState_Armed == acquire_get_state(runtime));
+        CHECK(start_ms[i] >= 0.0 && stop_ms[i] >= 0.0);
+    }
+    log_latencies("Start to first frame", start_ms, ncycles);
+    log_latencies("Stop to idle", stop_ms, ncycles);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,149 @@
+//! Acquires several bursts in one run and checks each starts with a marker
+//! followed by the burst's frames.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].sequence.frames_per_burst.writable);
+    CHECK(metadata.video[0].sequence.split_storage.high == 1.0f);
+
+    const uint64_t frames_per_burst = 5, burst_count = 4;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].max_frame_count = 1 << 30;
+    props.video[0].sequence.frames_per_burst = frames_per_burst;
+    props.video[0].sequence.burst_count = burst_count;
+    props.video[0].sequence.split_storage = 1;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].sequence.frames_per_burst == frames_per_burst);
+        CHECK(actual.video[0].sequence.burst_count == burst_count);
+        CHECK(actual.video[0].sequence.split_storage == 1);
+    }
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t nmarkers = 0, nframes = 0, in_burst = 0;
+    while (nframes < frames_per_burst * burst_count) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            if (acquire_is_burst_marker(cur)) {
+                // The previous burst is complete.
+                CHECK(nmarkers == 0 || in_burst == frames_per_burst);
+                CHECK(cur->frame_id == nmarkers * frames_per_burst);
+                ++nmarkers;
+                in_burst = 0;
+            } else {
+                CHECK(nmarkers > 0);
+                CHECK(cur->frame_id == nframes);
+                CHECK(cur->shape.dims.width == 64);
+                ++in_burst;
+                ++nframes;
+            }
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    CHECK(nmarkers == burst_count);
+    CHECK(in_burst == frames_per_burst);
+
+    // Acquisition ends on its own after the last burst.
+    while (DeviceState_Running == acquire_get_state(runtime)) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        clock_sleep_ms(0, 10.0);
+    }
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.acquisition.burst_count == burst_count);
+    CHECK(stats.acquisition.frame_count == frames_per_burst * burst_count);
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_BurstCount);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,238 @@
+//! Frames sent to storage are compressed when a codec is configured, while
+//! the monitor keeps seeing raw frames. Compressed frames stored with raw
+//! storage decode to the frames the monitor saw.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/props/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads back a file written by raw storage: the frames, headers and all.
+static std::vector<uint8_t>
+read_file(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(path, "rb");
+    EXPECT(fp, "Failed to open %s", path);
+    uint8_t buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)))
+        data.insert(data.end(), buf, buf + n);
+    fclose(fp);
+    return data;
+}
+
+/// Stores frames from a camera with structure, so blocks compress, and
+/// checks every stored frame decodes to what the monitor saw.
+static void
+round_trip(AcquireRuntime* runtime, AcquireProperties& props)
+{
+    auto dm = acquire_device_manager(runtime);
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*sin.*") - 1,
+                                &props.video[0].camera.identifier));
+    props.video[0].camera.settings.shape = { .x = 640, .y = 480 };
+
+    // Tiff would write each compressed frame as a full image.
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+    CHECK(AcquireStatus_Error == acquire_configure(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    storage_properties_init(&props.video[0].storage.settings,
+                            0,
+                            SIZED("compress-frames.raw"),
+                            0,
+                            0,
+                            { 1, 1 });
+    OK(acquire_configure(runtime, &props));
+
+    const size_t bytes_of_raw = 2ULL * 640 * 480;
+    std::map<uint64_t, std::vector<uint8_t>> seen;
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    while (seen.size() < props.video[0].max_frame_count) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame))
+            seen[cur->frame_id].assign(cur->data, cur->data + bytes_of_raw);
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    OK(acquire_stop(runtime));
+
+    const std::vector<uint8_t> stored = read_file("compress-frames.raw");
+    std::vector<uint8_t> decoded(bytes_of_raw);
+    size_t nframes = 0;
+    for (size_t offset = 0; offset < stored.size();) {
+        const auto* frame = (const VideoFrame*)(stored.data() + offset);
+        CHECK(offset + sizeof(*frame) <= stored.size());
+        CHECK(offset + frame->bytes_of_frame <= stored.size());
+        CHECK(acquire_is_encoded_frame(frame));
+        // Decoding checks the stored sizes don't overrun the frame.
+        OK(acquire_decode_frame(frame, decoded.data(), decoded.size()));
+        const auto it = seen.find(frame->frame_id);
+        EXPECT(it != seen.end(),
+               "Unexpected frame %llu",
+               (unsigned long long)frame->frame_id);
+        EXPECT(0 == memcmp(decoded.data(), it->second.data(), bytes_of_raw),
+               "Frame %llu didn't decode to the acquired frame",
+               (unsigned long long)frame->frame_id);
+        offset += frame->bytes_of_frame;
+        ++nframes;
+    }
+    CHECK(nframes == props.video[0].max_frame_count);
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].compression.codec.writable);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = {
+        .x = 1920,
+        .y = 1080,
+    };
+    props.video[0].max_frame_count = 10;
+    props.video[0].compression.codec = AcquireCodec_Lz;
+    props.video[0].compression.shuffle = AcquireShuffle_Byte;
+    props.video[0].compression.bytes_per_block = 1 << 16;
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].compression.codec == AcquireCodec_Lz);
+        CHECK(actual.video[0].compression.shuffle == AcquireShuffle_Byte);
+        CHECK(actual.video[0].compression.bytes_per_block == 1 << 16);
+    }
+
+    const size_t bytes_of_raw = 2ULL * props.video[0].camera.settings.shape.x *
+                                props.video[0].camera.settings.shape.y;
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    {
+        uint64_t nframes = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end;
+                 cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+                // The monitor sees raw frames.
+                CHECK(cur->bytes_of_frame >= sizeof(*cur) + bytes_of_raw);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(
+              runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            clock_sleep_ms(0, 10.0);
+        }
+        CHECK(nframes == props.video[0].max_frame_count);
+    }
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    LOG("Compressed %llu frames. Ratio: %f. Throughput: %f MB/s",
+        (unsigned long long)stats.compression.frame_count,
+        stats.compression.ratio,
+        stats.compression.throughput_mb_per_s);
+    CHECK(stats.compression.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.compression.bytes_in ==
+          props.video[0].max_frame_count * bytes_of_raw);
+    // Empty frames should compress very well.
+    CHECK(stats.compression.ratio > 10.0f);
+
+    round_trip(runtime, props);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,233 @@
+//! The sparse codec keeps only the bright pixels of the frames sent to
+//! storage. Pixels from the random camera are above the threshold about 2% of
+//! the time, so the frames shrink even though they don't compress otherwise.
+//! The stored frames are read back from raw storage and decoded.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/props/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads back a file written by raw storage: the frames, headers and all.
+static std::vector<uint8_t>
+read_file(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(path, "rb");
+    EXPECT(fp, "Failed to open %s", path);
+    uint8_t buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)))
+        data.insert(data.end(), buf, buf + n);
+    fclose(fp);
+    return data;
+}
+
+/// Acquires `max_frame_count` frames to `path`, keeping a copy of each frame
+/// the monitor sees. Then decodes every stored frame into `decoded`, which
+/// still holds the last frame of the previous call, so any pixel decoding
+/// failed to write shows up as stale.
+static void
+acquire_and_decode(AcquireRuntime* runtime,
+                   AcquireProperties& props,
+                   const char* path,
+                   std::vector<uint8_t>& decoded)
+{
+    const auto& video = props.video[0];
+    const size_t bytes_of_raw =
+      1ULL * video.camera.settings.shape.x * video.camera.settings.shape.y;
+    const size_t bytes_per_block = video.compression.bytes_per_block;
+    const uint32_t threshold = video.compression.sparse_threshold;
+    std::map<uint64_t, std::vector<uint8_t>> seen;
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    while (seen.size() < video.max_frame_count) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            // The monitor sees raw frames.
+            CHECK(cur->bytes_of_frame >= sizeof(*cur) + bytes_of_raw);
+            seen[cur->frame_id].assign(cur->data, cur->data + bytes_of_raw);
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    OK(acquire_stop(runtime));
+
+    const std::vector<uint8_t> stored = read_file(path);
+    decoded.resize(bytes_of_raw);
+    size_t nframes = 0;
+    for (size_t offset = 0; offset < stored.size(); ++nframes) {
+        const auto* frame = (const VideoFrame*)(stored.data() + offset);
+        CHECK(offset + sizeof(*frame) <= stored.size());
+        CHECK(offset + frame->bytes_of_frame <= stored.size());
+        CHECK(acquire_is_encoded_frame(frame));
+        OK(acquire_decode_frame(frame, decoded.data(), decoded.size()));
+        const auto it = seen.find(frame->frame_id);
+        EXPECT(it != seen.end(),
+               "Unexpected frame %llu",
+               (unsigned long long)frame->frame_id);
+        const uint8_t* raw = it->second.data();
+        // A block keeps the samples above the threshold, or all of them when
+        // too many are.
+        for (size_t b = 0; b < bytes_of_raw; b += bytes_per_block) {
+            const size_t n = std::min(bytes_per_block, bytes_of_raw - b);
+            const uint8_t* d = decoded.data() + b;
+            if (0 == memcmp(d, raw + b, n))
+                continue;
+            for (size_t i = 0; i < n; ++i) {
+                const uint8_t expected =
+                  raw[b + i] > threshold ? raw[b + i] : 0;
+                EXPECT(d[i] == expected,
+                       "Frame %llu pixel %llu: got %d, expected %d",
+                       (unsigned long long)frame->frame_id,
+                       (unsigned long long)(b + i),
+                       d[i],
+                       expected);
+            }
+        }
+        offset += frame->bytes_of_frame;
+    }
+    CHECK(nframes == video.max_frame_count);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    storage_properties_init(&props.video[0].storage.settings,
+                            0,
+                            SIZED("compress-sparse-frames.raw"),
+                            0,
+                            0,
+                            { 1, 1 });
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].compression.codec.writable);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 1920,
+        .y = 1080,
+    };
+    props.video[0].max_frame_count = 10;
+    props.video[0].compression.codec = AcquireCodec_Sparse;
+    props.video[0].compression.shuffle = AcquireShuffle_None;
+    props.video[0].compression.bytes_per_block = 1 << 16;
+    props.video[0].compression.sparse_threshold = 250;
+    props.video[0].compression.sparse_max_density = 0.05f;
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].compression.codec == AcquireCodec_Sparse);
+        CHECK(actual.video[0].compression.sparse_threshold == 250);
+        CHECK(actual.video[0].compression.sparse_max_density == 0.05f);
+    }
+
+    const size_t bytes_of_raw = 1ULL * props.video[0].camera.settings.shape.x *
+                                props.video[0].camera.settings.shape.y;
+
+    std::vector<uint8_t> decoded;
+    acquire_and_decode(runtime, props, "compress-sparse-frames.raw", decoded);
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    LOG("Sparse encoded %llu frames. Ratio: %f. Throughput: %f MB/s",
+        (unsigned long long)stats.compression.frame_count,
+        stats.compression.ratio,
+        stats.compression.throughput_mb_per_s);
+    CHECK(stats.compression.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.compression.bytes_in ==
+          props.video[0].max_frame_count * bytes_of_raw);
+    // Each kept pixel costs at most 9 bytes.
+    CHECK(stats.compression.ratio > 4.0f);
+
+    // The empty camera repeats the previous frame. Decoding still writes
+    // every pixel, over what's left of the last random frame.
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    storage_properties_set_filename(&props.video[0].storage.settings,
+                                    SIZED("compress-sparse-empty.raw"));
+    OK(acquire_configure(runtime, &props));
+    acquire_and_decode(runtime, props, "compress-sparse-empty.raw", decoded);
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
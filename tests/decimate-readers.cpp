@@ -0,0 +1,146 @@
+//! Decimated readers see a subset of the frames.
+//! The monitor keeps every 5th frame and storage at most 1 frame per second.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].monitor_decimation.policy.writable);
+    CHECK(metadata.video[0].storage_decimation.policy.high ==
+          (float)AcquireDecimation_LatestOnly);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].max_frame_count = 50;
+
+    // Every Nth frame needs an interval.
+    props.video[0].monitor_decimation = {
+        .policy = AcquireDecimation_EveryN,
+        .every = 0,
+    };
+    CHECK(AcquireStatus_Error == acquire_configure(runtime, &props));
+
+    props.video[0].monitor_decimation.every = 5;
+    props.video[0].storage_decimation = {
+        .policy = AcquireDecimation_MaxRate,
+        .max_rate_hz = 1.0f,
+    };
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].monitor_decimation.policy ==
+              AcquireDecimation_EveryN);
+        CHECK(actual.video[0].monitor_decimation.every == 5);
+        CHECK(actual.video[0].storage_decimation.policy ==
+              AcquireDecimation_MaxRate);
+        CHECK(actual.video[0].storage_decimation.max_rate_hz == 1.0f);
+    }
+
+    OK(acquire_start(runtime));
+    {
+        struct clock clock
+        {};
+        static double time_limit_ms = 20000.0;
+        clock_init(&clock);
+        clock_shift_ms(&clock, time_limit_ms);
+        const uint64_t expected_count =
+          props.video[0].max_frame_count /
+          props.video[0].monitor_decimation.every;
+        uint64_t nframes = 0, last_frame_id = 0;
+        while (nframes < expected_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            if (beg < end) {
+                // At most one frame is mapped at a time.
+                CHECK((uint8_t*)beg + beg->bytes_of_frame == (uint8_t*)end);
+                if (nframes > 0)
+                    EXPECT(beg->frame_id - last_frame_id == 5,
+                           "Expected frame %llu. Got %llu.",
+                           (unsigned long long)last_frame_id + 5,
+                           (unsigned long long)beg->frame_id);
+                last_frame_id = beg->frame_id;
+                ++nframes;
+            }
+            OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            clock_sleep_ms(0, 5.0);
+        }
+        CHECK(nframes == expected_count);
+    }
+    OK(acquire_stop(runtime));
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,140 @@
+//! Listed defective pixels are replaced by the median of their neighbors.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 64,
+        .y = 48,
+    };
+    props.video[0].max_frame_count = 10;
+    props.video[0].defect_correction = AcquireDefectFill_Median;
+
+    OK(acquire_configure(runtime, &props));
+
+    const uint32_t xs[] = { 10, 20, 63 }, ys[] = { 5, 30, 47 };
+    OK(acquire_set_defect_pixels(runtime, 0, xs, ys, 3));
+
+    const auto expect_corrected = [&](const VideoFrame* frame) {
+        const auto w = (int)frame->shape.dims.width;
+        const auto h = (int)frame->shape.dims.height;
+        const auto at = [&](int x, int y) {
+            return frame->data[x * frame->shape.strides.width +
+                               y * frame->shape.strides.height];
+        };
+        for (size_t i = 0; i < 3; ++i) {
+            int x = (int)xs[i], y = (int)ys[i];
+            uint8_t v[8];
+            int n = 0;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx)
+                    if ((dx || dy) && x + dx >= 0 && x + dx < w &&
+                        y + dy >= 0 && y + dy < h)
+                        v[n++] = at(x + dx, y + dy);
+            std::sort(v, v + n);
+            const int median =
+              (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2] + 1) / 2;
+            EXPECT(at(x, y) == median,
+                   "Frame %d: pixel (%d,%d) is %d. Expected %d.",
+                   (int)frame->frame_id,
+                   x,
+                   y,
+                   (int)at(x, y),
+                   median);
+        }
+    };
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    {
+        uint64_t nframes = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end;
+                 cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+                expect_corrected(cur);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(
+              runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            clock_sleep_ms(0, 10.0);
+        }
+    }
+    OK(acquire_stop(runtime));
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,182 @@
+//! Demosaics the monitor's frames and checks they have 3 channels laid out
+//! as configured.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+/// Reads `nframes` frames from the monitor, checking they're color frames of
+/// the right layout.
+static void
+read_color_frames(AcquireRuntime* runtime,
+                  uint64_t nframes,
+                  uint32_t width,
+                  uint32_t height,
+                  SampleType type,
+                  AcquireColorLayout layout)
+{
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    const int64_t npx = (int64_t)width * height;
+    uint64_t iframe = 0;
+    while (iframe < nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            CHECK(cur->shape.type == type);
+            CHECK(cur->shape.dims.channels == 3);
+            CHECK(cur->shape.dims.width == width);
+            CHECK(cur->shape.dims.height == height);
+            CHECK(cur->shape.strides.planes == 3 * npx);
+            if (layout == AcquireColorLayout_Planar) {
+                CHECK(cur->shape.strides.channels == npx);
+                CHECK(cur->shape.strides.width == 1);
+            } else {
+                CHECK(cur->shape.strides.channels == 1);
+                CHECK(cur->shape.strides.width == 3);
+            }
+            CHECK(cur->bytes_of_frame >=
+                  sizeof(*cur) + 3 * npx * bytes_of_type(type));
+            ++iframe;
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    CHECK(iframe == nframes);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].demosaic.method.writable);
+    CHECK(metadata.video[0].demosaic.method.high ==
+          (float)AcquireDemosaic_EdgeAware);
+    CHECK(metadata.video[0].demosaic.pattern.high ==
+          (float)AcquireBayerPattern_GBRG);
+
+    const uint32_t width = 64, height = 48;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 40;
+    props.video[0].demosaic = {
+        .method = AcquireDemosaic_Bilinear,
+        .pattern = AcquireBayerPattern_RGGB,
+        .layout = AcquireColorLayout_Interleaved,
+    };
+    OK(acquire_configure(runtime, &props));
+
+    OK(acquire_start(runtime));
+    read_color_frames(runtime,
+                      10,
+                      width,
+                      height,
+                      SampleType_u8,
+                      AcquireColorLayout_Interleaved);
+    OK(acquire_stop(runtime));
+
+    // Planes of 16-bit samples.
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].demosaic = {
+        .method = AcquireDemosaic_EdgeAware,
+        .pattern = AcquireBayerPattern_GBRG,
+        .layout = AcquireColorLayout_Planar,
+    };
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].demosaic.method == AcquireDemosaic_EdgeAware);
+        CHECK(actual.video[0].demosaic.pattern == AcquireBayerPattern_GBRG);
+        CHECK(actual.video[0].demosaic.layout == AcquireColorLayout_Planar);
+    }
+
+    OK(acquire_start(runtime));
+    read_color_frames(runtime,
+                      10,
+                      width,
+                      height,
+                      SampleType_u16,
+                      AcquireColorLayout_Planar);
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.demosaic.frame_count >= 10);
+    CHECK(stats.demosaic.skipped_count == 0);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
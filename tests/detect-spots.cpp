@@ -0,0 +1,153 @@
+//! Spots detected in each frame are published as one record per frame, and
+//! only every Nth frame is sent to storage while detecting.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].detection.enable.writable);
+
+    const uint32_t width = 640, height = 480;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 20;
+    props.video[0].detection.enable = 1;
+    props.video[0].detection.threshold = 120.0f;
+    props.video[0].detection.store_every = 5;
+
+    // A negative threshold is rejected.
+    props.video[0].detection.threshold = -1.0f;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+    props.video[0].detection.threshold = 120.0f;
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].detection.enable);
+        CHECK(actual.video[0].detection.threshold == 120.0f);
+        CHECK(actual.video[0].detection.store_every == 5);
+    }
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t nspots = 0;
+    {
+        uint64_t nrecords = 0, last_frame_id = 0;
+        while (nrecords < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            AcquireSpotList *beg, *end, *cur;
+            OK(acquire_map_read_spots(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end;
+                 cur = (AcquireSpotList*)((uint8_t*)cur +
+                                          cur->bytes_of_record)) {
+                CHECK(nrecords == 0 || cur->frame_id > last_frame_id);
+                CHECK(cur->bytes_of_record >=
+                      sizeof(*cur) + cur->spot_count * sizeof(AcquireSpot));
+                for (uint32_t i = 0; i < cur->spot_count; ++i) {
+                    const AcquireSpot* spot = cur->spots + i;
+                    CHECK(spot->x >= 0.0f && spot->x <= width - 1.0f);
+                    CHECK(spot->y >= 0.0f && spot->y <= height - 1.0f);
+                    CHECK(spot->peak > 120.0f);
+                }
+                last_frame_id = cur->frame_id;
+                nspots += cur->spot_count;
+                ++nrecords;
+            }
+            OK(acquire_unmap_read_spots(
+              runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            clock_sleep_ms(0, 10.0);
+        }
+        CHECK(nrecords == props.video[0].max_frame_count);
+    }
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    LOG("Detected %llu spots in %llu frames (%llu dropped)",
+        (unsigned long long)stats.detection.spot_count,
+        (unsigned long long)stats.detection.frame_count,
+        (unsigned long long)stats.detection.dropped_count);
+    CHECK(stats.detection.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.detection.spot_count == nspots);
+    // Uniform noise has plenty of bright local maxima.
+    CHECK(nspots > 0);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,131 @@
+//! Regions of interest are copied out of each frame sent to storage, and
+//! frames that don't contain every region are skipped.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].roi.count.writable);
+    CHECK(metadata.video[0].roi.count.high == ACQUIRE_MAX_ROI_COUNT);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 640,
+        .y = 480,
+    };
+    props.video[0].max_frame_count = 50;
+    props.video[0].roi.rects[0] = {
+        .x = 10,
+        .y = 20,
+        .width = 64,
+        .height = 32,
+    };
+    // Touches the bottom right corner.
+    props.video[0].roi.rects[1] = {
+        .x = 600,
+        .y = 400,
+        .width = 40,
+        .height = 80,
+    };
+    props.video[0].roi.count = 2;
+
+    // Regions can't be combined with gating.
+    props.video[0].gating.enable = 1;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+    props.video[0].gating.enable = 0;
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].roi.count == 2);
+        CHECK(actual.video[0].roi.rects[1].x == 600);
+        CHECK(actual.video[0].roi.rects[1].height == 80);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.roi.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.roi.skipped_count == 0);
+
+    // A region past the edge of the frame skips every frame.
+    props.video[0].roi.rects[1].x = 601;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.roi.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.roi.skipped_count == props.video[0].max_frame_count);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,119 @@
+//! Per-frame pixel statistics are published for every acquired frame.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 640,
+        .y = 480,
+    };
+    props.video[0].max_frame_count = 10;
+    props.video[0].enable_frame_statistics = 1;
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].enable_frame_statistics);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireFrameStatistics stats[16] = {};
+    uint32_t count = 0;
+    OK(acquire_read_frame_statistics(runtime, 0, stats, 16, &count));
+    CHECK(count == props.video[0].max_frame_count);
+
+    const uint64_t npx = props.video[0].camera.settings.shape.x *
+                         props.video[0].camera.settings.shape.y;
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto& s = stats[i];
+        CHECK(s.frame_id == i);
+        CHECK(s.pixel_count == npx);
+        CHECK(s.min <= s.mean && s.mean <= s.max);
+        CHECK(s.max <= 255.0);
+        CHECK(s.histogram_bin_width == 1.0);
+        uint64_t total = 0;
+        for (auto c : s.histogram)
+            total += c;
+        CHECK(total == npx);
+        CHECK(s.saturated_count == s.histogram[255]);
+    }
+
+    // Everything has been read.
+    OK(acquire_read_frame_statistics(runtime, 0, stats, 16, &count));
+    CHECK(count == 0);
+
+    AcquireStreamStatistics stream = {};
+    OK(acquire_get_statistics(runtime, 0, &stream));
+    CHECK(stream.frame_statistics_dropped == 0);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,140 @@
+//! Frames that barely change are kept out of storage when change gating is
+//! enabled, keyframes are forced periodically, and every frame is logged.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    // The empty camera produces frames that never change.
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*empty.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].gating.enable.writable);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = 640,
+        .y = 480,
+    };
+    props.video[0].max_frame_count = 100;
+    props.video[0].gating.enable = 1;
+    props.video[0].gating.keyframe_interval = 9;
+
+    // A negative threshold is rejected.
+    props.video[0].gating.threshold = -1.0f;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+
+    props.video[0].gating.threshold = 1.0f;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].gating.enable);
+        CHECK(actual.video[0].gating.threshold == 1.0f);
+        CHECK(actual.video[0].gating.keyframe_interval == 9);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    LOG("Stored %llu of %llu frames (%llu keyframes)",
+        (unsigned long long)stats.gating.stored_count,
+        (unsigned long long)stats.gating.frame_count,
+        (unsigned long long)stats.gating.keyframe_count);
+    CHECK(stats.gating.frame_count == props.video[0].max_frame_count);
+    // Every 10th frame is a keyframe, and nothing else changes.
+    CHECK(stats.gating.stored_count == 10);
+    CHECK(stats.gating.keyframe_count == 10);
+    CHECK(stats.gating.records_dropped == 0);
+
+    // The log is still readable after stopping.
+    {
+        AcquireGatingRecord *beg, *end, *cur;
+        OK(acquire_map_read_gating(runtime, 0, &beg, &end));
+        CHECK(end - beg == (ptrdiff_t)props.video[0].max_frame_count);
+        uint64_t nstored = 0;
+        for (cur = beg; cur < end; ++cur) {
+            const uint64_t i = cur - beg;
+            CHECK(cur->frame_id == i);
+            const uint32_t expected =
+              i % 10 == 0 ? AcquireGating_Stored | AcquireGating_Keyframe : 0;
+            EXPECT(cur->flags == expected,
+                   "Frame %llu: expected flags %u. Got %u.",
+                   (unsigned long long)i,
+                   expected,
+                   cur->flags);
+            nstored += (cur->flags & AcquireGating_Stored) != 0;
+        }
+        CHECK(nstored == stats.gating.stored_count);
+        OK(acquire_unmap_read_gating(
+          runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+    }
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
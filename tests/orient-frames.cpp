@@ -0,0 +1,149 @@
+//! Rotates and mirrors the camera's frames and checks every reader sees the
+//! reoriented shape.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+/// Reads `nframes` frames from the monitor, checking their shape.
+static void
+read_oriented_frames(AcquireRuntime* runtime,
+                     uint64_t nframes,
+                     uint32_t width,
+                     uint32_t height)
+{
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    uint64_t iframe = 0;
+    while (iframe < nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            CHECK(cur->shape.dims.width == width);
+            CHECK(cur->shape.dims.height == height);
+            CHECK(cur->shape.strides.width == 1);
+            CHECK(cur->shape.strides.height == width);
+            ++iframe;
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    CHECK(iframe == nframes);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].orientation.writable);
+    CHECK(metadata.video[0].orientation.high ==
+          (float)AcquireOrientation_Transpose);
+
+    const uint32_t width = 64, height = 48;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 40;
+    props.video[0].orientation = AcquireOrientation_Rotate90;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].orientation == AcquireOrientation_Rotate90);
+        ImageShape shape = {};
+        OK(acquire_get_shape(runtime, 0, &shape));
+        CHECK(shape.dims.width == height);
+        CHECK(shape.dims.height == width);
+    }
+
+    // A quarter turn swaps the width and height.
+    OK(acquire_start(runtime));
+    read_oriented_frames(runtime, 10, height, width);
+    OK(acquire_stop(runtime));
+
+    // Mirroring keeps them.
+    props.video[0].orientation = AcquireOrientation_FlipX;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    read_oriented_frames(runtime, 10, width, height);
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.orientation.frame_count >= 10);
+    CHECK(stats.orientation.skipped_count == 0);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,145 @@
+//! Small, display-mapped u8 previews are published at a capped rate on a
+//! queue of their own.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].preview.downscale.writable);
+
+    const uint32_t width = 640, height = 480;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 200;
+    props.video[0].preview.max_rate_hz = 20.0f;
+    props.video[0].preview.display_min = 0.0f;
+    props.video[0].preview.display_max = 1000.0f;
+
+    // Only power of two downscales are supported.
+    props.video[0].preview.downscale = 3;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+
+    props.video[0].preview.downscale = 4;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].preview.downscale == 4);
+        CHECK(actual.video[0].preview.max_rate_hz == 20.0f);
+        CHECK(actual.video[0].preview.display_min == 0.0f);
+        CHECK(actual.video[0].preview.display_max == 1000.0f);
+    }
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    uint64_t npreviews = 0, last_frame_id = 0;
+    while (DeviceState_Running == acquire_get_state(runtime)) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read_preview(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            CHECK(cur->shape.type == SampleType_u8);
+            CHECK(cur->shape.dims.width == width / 4);
+            CHECK(cur->shape.dims.height == height / 4);
+            CHECK(cur->bytes_of_frame >=
+                  sizeof(*cur) + (width / 4) * (height / 4));
+            CHECK(npreviews == 0 || cur->frame_id > last_frame_id);
+            last_frame_id = cur->frame_id;
+            ++npreviews;
+        }
+        OK(acquire_unmap_read_preview(
+          runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    LOG("Published %llu previews (%llu dropped). Read %llu.",
+        (unsigned long long)stats.preview.frame_count,
+        (unsigned long long)stats.preview.dropped_count,
+        (unsigned long long)npreviews);
+    CHECK(npreviews > 0);
+    CHECK(npreviews <= stats.preview.frame_count);
+    // The rate cap keeps previews well below the frame rate.
+    CHECK(stats.preview.frame_count < props.video[0].max_frame_count);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,120 @@
+//! Configures the same properties repeatedly and checks that changes are
+//! still applied.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/props/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e4;
+    props.video[0].max_frame_count = 7;
+    storage_properties_init(
+      &props.video[0].storage.settings, 0, SIZED("out.tif"), 0, 0, { 1, 1 });
+    OK(acquire_configure(runtime, &props));
+
+    // Configuring what was read back changes nothing.
+    AcquireProperties applied = {};
+    OK(acquire_get_configuration(runtime, &applied));
+    for (int i = 0; i < 10; ++i) {
+        struct clock clock = {};
+        clock_init(&clock);
+        OK(acquire_configure(runtime, &applied));
+        LOG("Unchanged configuration took %f ms", clock_toc_ms(&clock));
+    }
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].camera.settings.exposure_time_us ==
+              applied.video[0].camera.settings.exposure_time_us);
+        CHECK(actual.video[0].camera.settings.shape.x == 64);
+        CHECK(0 == strcmp(actual.video[0].storage.settings.filename.str,
+                          "out.tif"));
+    }
+
+    // Changes still reach the devices.
+    const float exposure_time_us =
+      applied.video[0].camera.settings.exposure_time_us;
+    applied.video[0].camera.settings.exposure_time_us *= 2;
+    storage_properties_set_filename(
+      &applied.video[0].storage.settings, SIZED("changed.tif"));
+    OK(acquire_configure(runtime, &applied));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].camera.settings.exposure_time_us >
+              exposure_time_us);
+        CHECK(0 == strcmp(actual.video[0].storage.settings.filename.str,
+                          "changed.tif"));
+    }
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+    CHECK(file_exists(SIZED("changed.tif")));
+
+    LOG("DONE (OK)");
+    acquire_shutdown(runtime);
+    return 0;
+}
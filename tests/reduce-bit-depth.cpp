@@ -0,0 +1,180 @@
+//! 16-bit frames are reduced to 8 bits through a lookup table before they
+//! are stored, and the monitor sees the reduced frames unless reduction is
+//! only for storage.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads `nframes` frames from the monitor, checking they were reduced to
+/// 8 bits. When `expected_value` isn't negative, every sample must equal it.
+static void
+read_frames(AcquireRuntime* runtime,
+            uint64_t nframes,
+            uint32_t width,
+            uint32_t height,
+            int expected_value)
+{
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    uint64_t iframe = 0;
+    while (iframe < nframes) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, 0, &beg, &end));
+        for (cur = beg; cur < end;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+            CHECK(cur->shape.type == SampleType_u8);
+            CHECK(cur->shape.dims.width == width);
+            CHECK(cur->shape.dims.height == height);
+            CHECK(cur->bytes_of_frame >= sizeof(*cur) + width * height);
+            for (uint32_t i = 0; expected_value >= 0 && i < width * height;
+                 ++i) {
+                EXPECT(cur->data[i] == expected_value,
+                       "Frame %llu sample %u: expected %d. Got %d.",
+                       (unsigned long long)cur->frame_id,
+                       i,
+                       expected_value,
+                       cur->data[i]);
+            }
+            ++iframe;
+        }
+        OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+    CHECK(iframe == nframes);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].bit_depth.curve.writable);
+
+    const uint32_t width = 640, height = 480;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 50;
+    props.video[0].bit_depth.window_min = 0.0f;
+    props.video[0].bit_depth.window_max = 4095.0f;
+    props.video[0].bit_depth.storage_only = 0;
+
+    // A gamma curve needs a positive exponent.
+    props.video[0].bit_depth.curve = AcquireLutCurve_Gamma;
+    props.video[0].bit_depth.gamma = 0.0f;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+
+    props.video[0].bit_depth.gamma = 0.5f;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].bit_depth.curve == AcquireLutCurve_Gamma);
+        CHECK(actual.video[0].bit_depth.window_max == 4095.0f);
+        CHECK(actual.video[0].bit_depth.gamma == 0.5f);
+        CHECK(actual.video[0].bit_depth.storage_only == 0);
+    }
+
+    OK(acquire_start(runtime));
+    read_frames(runtime, props.video[0].max_frame_count, width, height, -1);
+    OK(acquire_stop(runtime));
+
+    // A one entry table maps every sample to that entry.
+    {
+        const uint8_t table[] = { 7 };
+        OK(acquire_set_bit_depth_table(runtime, 0, table, 1));
+    }
+    props.video[0].bit_depth.curve = AcquireLutCurve_Custom;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    read_frames(runtime, props.video[0].max_frame_count, width, height, 7);
+    OK(acquire_stop(runtime));
+
+    // Clearing the table in use doesn't fall back to another curve. The
+    // stream won't start, configured or not, until a table is set again.
+    OK(acquire_set_bit_depth_table(runtime, 0, 0, 0));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+    {
+        const uint8_t table[] = { 9 };
+        OK(acquire_set_bit_depth_table(runtime, 0, table, 1));
+    }
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    read_frames(runtime, props.video[0].max_frame_count, width, height, 9);
+    OK(acquire_stop(runtime));
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -0,0 +1,172 @@
+//! Starts and stops each of two video streams on its own, while the other
+//! keeps acquiring, and checks that configuring and starting leave running
+//! streams alone.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads until `n` more frames have arrived on the `istream`'th stream.
+static void
+wait_for_frames(AcquireRuntime* runtime, uint32_t istream, uint64_t n)
+{
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    while (n) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "[stream %d] Timeout at %f ms",
+               istream,
+               clock_toc_ms(&clock) + time_limit_ms);
+        VideoFrame *beg, *end, *cur;
+        OK(acquire_map_read(runtime, istream, &beg, &end));
+        for (cur = beg; cur < end && n;
+             cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame))
+            --n;
+        OK(acquire_unmap_read(runtime, istream, (uint8_t*)cur - (uint8_t*)beg));
+        clock_sleep_ms(0, 10.0);
+    }
+}
+
+static void
+check_states(AcquireRuntime* runtime, DeviceState s0, DeviceState s1)
+{
+    CHECK(acquire_get_stream_state(runtime, 0) == s0);
+    CHECK(acquire_get_stream_state(runtime, 1) == s1);
+    const DeviceState expected =
+      (s0 == DeviceState_Running || s1 == DeviceState_Running)
+        ? DeviceState_Running
+        : DeviceState_Armed;
+    CHECK(acquire_get_state(runtime) == expected);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*sin.*") - 1,
+                                &props.video[1].camera.identifier));
+    for (auto& video : props.video) {
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("Trash") - 1,
+                                    &video.storage.identifier));
+        video.camera.settings.binning = 1;
+        video.camera.settings.pixel_type = SampleType_u8;
+        video.camera.settings.shape = { .x = 64, .y = 48 };
+        video.camera.settings.exposure_time_us = 1e4;
+        video.max_frame_count = 1 << 30;
+    }
+    OK(acquire_configure(runtime, &props));
+    check_states(runtime, DeviceState_Armed, DeviceState_Armed);
+
+    // Stream 1 joins stream 0 while it's acquiring.
+    OK(acquire_start_stream(runtime, 0));
+    check_states(runtime, DeviceState_Running, DeviceState_Armed);
+    wait_for_frames(runtime, 0, 5);
+    OK(acquire_start_stream(runtime, 1));
+    CHECK(AcquireStatus_Error == acquire_start_stream(runtime, 1));
+    check_states(runtime, DeviceState_Running, DeviceState_Running);
+    wait_for_frames(runtime, 1, 5);
+
+    // Stream 0 keeps going while stream 1 is stopped and started again.
+    OK(acquire_abort_stream(runtime, 1));
+    check_states(runtime, DeviceState_Running, DeviceState_Armed);
+    wait_for_frames(runtime, 0, 5);
+    OK(acquire_start_stream(runtime, 1));
+    wait_for_frames(runtime, 1, 5);
+    wait_for_frames(runtime, 0, 5);
+
+    OK(acquire_abort(runtime));
+    check_states(runtime, DeviceState_Armed, DeviceState_Armed);
+
+    // Stopping a stream only waits for that stream's frame count.
+    props.video[1].max_frame_count = 10;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start_stream(runtime, 0));
+    OK(acquire_start_stream(runtime, 1));
+    OK(acquire_stop_stream(runtime, 1));
+    check_states(runtime, DeviceState_Running, DeviceState_Armed);
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 1, &stats));
+    CHECK(stats.acquisition.frame_count == 10);
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_FrameCount);
+    wait_for_frames(runtime, 0, 5);
+
+    // Configuring and starting leave the running stream alone.
+    props.video[1].max_frame_count = 1 << 30;
+    OK(acquire_configure(runtime, &props));
+    check_states(runtime, DeviceState_Running, DeviceState_Armed);
+    OK(acquire_start(runtime));
+    check_states(runtime, DeviceState_Running, DeviceState_Running);
+    wait_for_frames(runtime, 0, 5);
+    wait_for_frames(runtime, 1, 5);
+
+    // The settings of a running stream can't change.
+    props.video[0].max_frame_count += 1;
+    CHECK(AcquireStatus_Error == acquire_configure(runtime, &props));
+    props.video[0].max_frame_count -= 1;
+    check_states(runtime, DeviceState_Running, DeviceState_Running);
+    wait_for_frames(runtime, 0, 5);
+    OK(acquire_abort_stream(runtime, 0));
+    check_states(runtime, DeviceState_Armed, DeviceState_Running);
+    OK(acquire_abort(runtime));
+    check_states(runtime, DeviceState_Armed, DeviceState_Armed);
+
+    LOG("DONE (OK)");
+    acquire_shutdown(runtime);
+    return 0;
+}
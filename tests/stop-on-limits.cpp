@@ -0,0 +1,161 @@
+//! Ends acquisitions on a duration, a byte count and a hardware frame id and
+//! checks they end on the right frame.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+
+
+/// Waits for the acquisition to end on its own.
+static void
+wait_for_stop(AcquireRuntime* runtime)
+{
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    while (DeviceState_Running == acquire_get_state(runtime)) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        clock_sleep_ms(0, 10.0);
+    }
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].limits.max_duration_s.writable);
+    CHECK(metadata.video[0].limits.max_bytes.writable);
+    CHECK(metadata.video[0].limits.last_hardware_frame_id.writable);
+
+    const uint32_t width = 64, height = 48;
+    const uint64_t bytes_of_frame = width * height;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 1 << 30;
+
+    // The frame that would go past the byte limit isn't acquired.
+    props.video[0].limits.max_bytes = 10 * bytes_of_frame + bytes_of_frame / 2;
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].limits.max_bytes ==
+              props.video[0].limits.max_bytes);
+    }
+    OK(acquire_start(runtime));
+    wait_for_stop(runtime);
+    OK(acquire_stop(runtime));
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_Bytes);
+    CHECK(stats.acquisition.frame_count == 10);
+    CHECK(stats.acquisition.bytes == 10 * bytes_of_frame);
+
+    // The frame with the last hardware id is the last one acquired.
+    props.video[0].limits.max_bytes = 0;
+    props.video[0].limits.has_last_hardware_frame_id = 1;
+    props.video[0].limits.last_hardware_frame_id = 4;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    wait_for_stop(runtime);
+    OK(acquire_stop(runtime));
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_HardwareFrameId);
+    CHECK(stats.acquisition.frame_count > 0);
+    CHECK(stats.acquisition.frame_count <= 5);
+
+    // Duration.
+    props.video[0].limits.has_last_hardware_frame_id = 0;
+    props.video[0].limits.max_duration_s = 0.5;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    wait_for_stop(runtime);
+    OK(acquire_stop(runtime));
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_Duration);
+    CHECK(stats.acquisition.bytes ==
+          stats.acquisition.frame_count * bytes_of_frame);
+
+    // Stopped before any limit.
+    props.video[0].limits.max_duration_s = 0;
+    props.video[0].max_frame_count = 7;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    wait_for_stop(runtime);
+    OK(acquire_stop(runtime));
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.acquisition.stop_reason == AcquireStopReason_FrameCount);
+    CHECK(stats.acquisition.frame_count == 7);
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
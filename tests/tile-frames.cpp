@@ -0,0 +1,213 @@
+//! Frames sent to storage are reordered into contiguous chunks when tiling
+//! is enabled, while the monitor still sees raw frames. Tiling can't be
+//! combined with compression. The records stored with raw storage are read
+//! back and untiled.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/props/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads back a file written by raw storage: the frames, headers and all.
+static std::vector<uint8_t>
+read_file(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(path, "rb");
+    EXPECT(fp, "Failed to open %s", path);
+    uint8_t buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)))
+        data.insert(data.end(), buf, buf + n);
+    fclose(fp);
+    return data;
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("raw") - 1,
+                                &props.video[0].storage.identifier));
+    storage_properties_init(&props.video[0].storage.settings,
+                            0,
+                            SIZED("tile-frames.raw"),
+                            0,
+                            0,
+                            { 1, 1 });
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].tiling.tile_x.writable);
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    // Not a multiple of the tile size, so edge tiles are padded.
+    props.video[0].camera.settings.shape = {
+        .x = 600,
+        .y = 450,
+    };
+    // Not a multiple of tile_t, so the last group is short.
+    props.video[0].max_frame_count = 10;
+    props.video[0].tiling.tile_x = 64;
+    props.video[0].tiling.tile_y = 64;
+    props.video[0].tiling.tile_t = 4;
+
+    // Tiling and compression are mutually exclusive.
+    props.video[0].compression.codec = AcquireCodec_Lz;
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+    props.video[0].compression.codec = AcquireCodec_None;
+
+    // Tiff would write each tiled record as a single image.
+    {
+        AcquireProperties tiff = props;
+        DEVOK(device_manager_select(dm,
+                                    DeviceKind_Storage,
+                                    SIZED("tiff") - 1,
+                                    &tiff.video[0].storage.identifier));
+        OK(acquire_configure(runtime, &tiff));
+        CHECK(AcquireStatus_Error == acquire_start(runtime));
+    }
+
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].tiling.tile_x == 64);
+        CHECK(actual.video[0].tiling.tile_y == 64);
+        CHECK(actual.video[0].tiling.tile_t == 4);
+    }
+
+    const size_t bytes_of_raw = 1ULL * props.video[0].camera.settings.shape.x *
+                                props.video[0].camera.settings.shape.y;
+    std::map<uint64_t, std::vector<uint8_t>> seen;
+
+    struct clock clock
+    {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    {
+        uint64_t nframes = 0;
+        while (nframes < props.video[0].max_frame_count) {
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            VideoFrame *beg, *end, *cur;
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end;
+                 cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+                // The monitor sees raw frames.
+                CHECK(cur->bytes_of_frame >= sizeof(*cur) + bytes_of_raw);
+                CHECK(cur->shape.dims.width == 600);
+                seen[cur->frame_id].assign(cur->data,
+                                           cur->data + bytes_of_raw);
+                ++nframes;
+            }
+            OK(acquire_unmap_read(
+              runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+            clock_sleep_ms(0, 10.0);
+        }
+        CHECK(nframes == props.video[0].max_frame_count);
+    }
+    // Stopping flushes the short last group through to storage.
+    OK(acquire_stop(runtime));
+
+    // Every frame comes back out of the stored records, in order.
+    {
+        const std::vector<uint8_t> stored = read_file("tile-frames.raw");
+        std::vector<uint8_t> frame(bytes_of_raw);
+        uint64_t nframes = 0, nrecords = 0;
+        for (size_t offset = 0; offset < stored.size(); ++nrecords) {
+            const auto* record = (const VideoFrame*)(stored.data() + offset);
+            CHECK(offset + sizeof(*record) <= stored.size());
+            CHECK(offset + record->bytes_of_frame <= stored.size());
+            const uint32_t count = acquire_get_tiled_frame_count(record);
+            CHECK(count == (nrecords < 2 ? 4 : 2));
+            for (uint32_t k = 0; k < count; ++k, ++nframes) {
+                OK(acquire_untile_frame(
+                  record, k, frame.data(), frame.size()));
+                const auto it = seen.find(record->frame_id + k);
+                CHECK(it != seen.end());
+                EXPECT(0 == memcmp(frame.data(),
+                                   it->second.data(),
+                                   bytes_of_raw),
+                       "Frame %llu didn't survive tiling",
+                       (unsigned long long)(record->frame_id + k));
+            }
+            offset += record->bytes_of_frame;
+        }
+        CHECK(nrecords == 3);
+        CHECK(nframes == props.video[0].max_frame_count);
+    }
+
+    // Disabling tiling restores the direct path to storage.
+    props.video[0].tiling.tile_x = 0;
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
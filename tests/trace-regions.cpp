@@ -0,0 +1,139 @@
+//! The mean of each labeled region is published for every frame, and the
+//! traces stay readable after stopping.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define LOGE(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            LOGE(__VA_ARGS__);                                                 \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+
+    OK(acquire_configure(runtime, &props));
+
+    AcquirePropertyMetadata metadata = { 0 };
+    OK(acquire_get_configuration_metadata(runtime, &metadata));
+    CHECK(metadata.video[0].traces.enable.writable);
+
+    const uint32_t width = 640, height = 480;
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = {
+        .x = width,
+        .y = height,
+    };
+    props.video[0].max_frame_count = 100;
+    props.video[0].traces.enable = 1;
+    props.video[0].traces.statistic = AcquireTraceStatistic_Mean;
+
+    // Traces need regions.
+    OK(acquire_configure(runtime, &props));
+    CHECK(AcquireStatus_Error == acquire_start(runtime));
+
+    // Two squares, and a label that isn't used.
+    std::vector<uint16_t> labels(width * height, 0);
+    for (uint32_t y = 100; y < 140; ++y) {
+        for (uint32_t x = 200; x < 240; ++x) {
+            labels[y * width + x] = 1;
+            labels[(y + 200) * width + x + 300] = 3;
+        }
+    }
+    OK(acquire_set_trace_labels(runtime, 0, labels.data(), width, height));
+    OK(acquire_configure(runtime, &props));
+    {
+        AcquireProperties actual = {};
+        OK(acquire_get_configuration(runtime, &actual));
+        CHECK(actual.video[0].traces.enable);
+        CHECK(actual.video[0].traces.statistic == AcquireTraceStatistic_Mean);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    AcquireStreamStatistics stats = {};
+    OK(acquire_get_statistics(runtime, 0, &stats));
+    CHECK(stats.traces.frame_count == props.video[0].max_frame_count);
+    CHECK(stats.traces.skipped_count == 0);
+    CHECK(stats.traces.dropped_count == 0);
+
+    // The traces are still readable after stopping.
+    {
+        AcquireTraceRecord *beg, *end, *cur;
+        OK(acquire_map_read_traces(runtime, 0, &beg, &end));
+        uint64_t nrecords = 0;
+        for (cur = beg; cur < end;
+             cur = (AcquireTraceRecord*)((uint8_t*)cur +
+                                         cur->bytes_of_record)) {
+            CHECK(cur->frame_id == nrecords);
+            CHECK(cur->label_count == 3);
+            CHECK(cur->statistic == AcquireTraceStatistic_Mean);
+            CHECK(cur->values[0] > 0.0f && cur->values[0] < 255.0f);
+            CHECK(cur->values[1] == 0.0f);
+            CHECK(cur->values[2] > 0.0f && cur->values[2] < 255.0f);
+            ++nrecords;
+        }
+        CHECK(nrecords == props.video[0].max_frame_count);
+        OK(acquire_unmap_read_traces(
+          runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+    }
+
+    OK(acquire_shutdown(runtime));
+    return 0;
+}
@@ -38,6 +38,32 @@ extern "C"
     int unit_test__storage__copy_string();
     int unit_test__monotonic_clock_increases_monotonically();
     int unit_test__clock_sleep_ms_accepts_null();
+    int unit_test__codec_round_trip();
+    int unit_test__frame_marker_is_distinct_from_frames();
+    int unit_test__frame_stats_u16();
+    int unit_test__defect_map_corrects_listed_pixels();
+    int unit_test__temporal_median();
+    int unit_test__fusion_kernels();
+    int unit_test__welford_matches_two_pass();
+    int unit_test__sparse_round_trip();
+    int unit_test__detect_spots_in_tile();
+    int unit_test__tiler_copy_tile();
+    int unit_test__tiler_read_frame();
+    int unit_test__preview_row();
+    int unit_test__gate_sum_of_absolute_differences();
+    int unit_test__gate_keeps_changed_frames();
+    int unit_test__lut_maps_u16_to_u8();
+    int unit_test__roi_extracts_regions();
+    int unit_test__traces_reduce_labeled_regions();
+    int unit_test__decimator_skips_frames();
+    int unit_test__demosaic_recovers_gradients();
+    int unit_test__orient_matches_definition();
+    int unit_test__sink_names_burst_outputs();
+    int unit_test__sink_compares_storage_settings();
+    int unit_test__parked_thread_runs_work_repeatedly();
+    int unit_test__mailbox_merges_updates();
+    int unit_test__channel_detached_reader_does_not_block_writer();
+    int unit_test__channel_reader_follows_wrap();
 }
 
 //
@@ -60,6 +86,32 @@ main()
         CASE(unit_test__storage__copy_string),
         CASE(unit_test__monotonic_clock_increases_monotonically),
         CASE(unit_test__clock_sleep_ms_accepts_null),
+        CASE(unit_test__codec_round_trip),
+        CASE(unit_test__frame_marker_is_distinct_from_frames),
+        CASE(unit_test__frame_stats_u16),
+        CASE(unit_test__defect_map_corrects_listed_pixels),
+        CASE(unit_test__temporal_median),
+        CASE(unit_test__fusion_kernels),
+        CASE(unit_test__welford_matches_two_pass),
+        CASE(unit_test__sparse_round_trip),
+        CASE(unit_test__detect_spots_in_tile),
+        CASE(unit_test__tiler_copy_tile),
+        CASE(unit_test__tiler_read_frame),
+        CASE(unit_test__preview_row),
+        CASE(unit_test__gate_sum_of_absolute_differences),
+        CASE(unit_test__gate_keeps_changed_frames),
+        CASE(unit_test__lut_maps_u16_to_u8),
+        CASE(unit_test__roi_extracts_regions),
+        CASE(unit_test__traces_reduce_labeled_regions),
+        CASE(unit_test__decimator_skips_frames),
+        CASE(unit_test__demosaic_recovers_gradients),
+        CASE(unit_test__orient_matches_definition),
+        CASE(unit_test__sink_names_burst_outputs),
+        CASE(unit_test__sink_compares_storage_settings),
+        CASE(unit_test__parked_thread_runs_work_repeatedly),
+        CASE(unit_test__mailbox_merges_updates),
+        CASE(unit_test__channel_detached_reader_does_not_block_writer),
+        CASE(unit_test__channel_reader_follows_wrap),
 #undef CASE
     };
 
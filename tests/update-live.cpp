@@ -0,0 +1,201 @@
+//! Changes the exposure, the output file, the metadata and the averaging
+//! window of a running stream, and checks no frame is dropped.
+#include "acquire.h"
+#include "device/hal/device.manager.h"
+#include "device/props/storage.h"
+#include "platform.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",6)`.
+#define SIZED(str) str, sizeof(str)
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Reads what's available on stream 0, checking frame ids follow one
+/// another by `step`.
+/// @returns The number of frames read.
+static uint64_t
+read_frames(AcquireRuntime* runtime, uint64_t* next_id, uint64_t* step)
+{
+    uint64_t n = 0;
+    VideoFrame *beg, *end, *cur;
+    OK(acquire_map_read(runtime, 0, &beg, &end));
+    for (cur = beg; cur < end;
+         cur = (VideoFrame*)((uint8_t*)cur + cur->bytes_of_frame)) {
+        // A change of window shows up as a new step.
+        if (*next_id && cur->frame_id != *next_id) {
+            CHECK(cur->frame_id > *next_id - *step);
+            *step = cur->frame_id - (*next_id - *step);
+        }
+        *next_id = cur->frame_id + *step;
+        ++n;
+    }
+    OK(acquire_unmap_read(runtime, 0, (uint8_t*)end - (uint8_t*)beg));
+    return n;
+}
+
+/// Reads until `n` more frames have arrived.
+static void
+wait_for_frames(AcquireRuntime* runtime,
+                uint64_t n,
+                uint64_t* next_id,
+                uint64_t* step)
+{
+    struct clock clock = {};
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    while (n) {
+        EXPECT(clock_cmp_now(&clock) < 0,
+               "Timeout at %f ms",
+               clock_toc_ms(&clock) + time_limit_ms);
+        const uint64_t nread = read_frames(runtime, next_id, step);
+        n -= nread < n ? nread : n;
+        clock_sleep_ms(0, 10.0);
+    }
+}
+
+/// Changes the exposure, the file name and the metadata while running.
+static void
+update_camera_and_storage(AcquireRuntime* runtime, const DeviceManager* dm)
+{
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*random.*") - 1,
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("tiff") - 1,
+                                &props.video[0].storage.identifier));
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u8;
+    props.video[0].camera.settings.shape = { .x = 64, .y = 48 };
+    props.video[0].camera.settings.exposure_time_us = 1e4;
+    props.video[0].max_frame_count = 1 << 30;
+    props.video[0].frame_average_count = 0;
+    storage_properties_init(&props.video[0].storage.settings,
+                            0,
+                            SIZED("live-0.tif"),
+                            SIZED(R"({"part": 0})"),
+                            { 1, 1 });
+    OK(acquire_configure(runtime, &props));
+
+    // Nothing changes without a running acquisition.
+    CHECK(AcquireStatus_Error ==
+          acquire_update_live(runtime, 0, &props, AcquireLiveUpdate_Exposure));
+
+    uint64_t next_id = 0, step = 1;
+    OK(acquire_start(runtime));
+    wait_for_frames(runtime, 10, &next_id, &step);
+
+    props.video[0].camera.settings.exposure_time_us = 2e4;
+    storage_properties_set_filename(
+      &props.video[0].storage.settings, SIZED("live-1.tif"));
+    storage_properties_set_external_metadata(
+      &props.video[0].storage.settings, SIZED(R"({"part": 1})"));
+    OK(acquire_update_live(runtime,
+                           0,
+                           &props,
+                           AcquireLiveUpdate_Exposure |
+                             AcquireLiveUpdate_Filename |
+                             AcquireLiveUpdate_ExternalMetadata));
+    wait_for_frames(runtime, 10, &next_id, &step);
+    // No frame was dropped.
+    CHECK(step == 1);
+    OK(acquire_abort(runtime));
+
+    CHECK(file_exists(SIZED("live-0.tif")));
+    CHECK(file_exists(SIZED("live-1.tif")));
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].camera.settings.exposure_time_us > 1e4);
+    CHECK(0 ==
+          strcmp(actual.video[0].storage.settings.filename.str, "live-1.tif"));
+    const String* metadata =
+      &actual.video[0].storage.settings.external_metadata_json;
+    CHECK(0 == strcmp(metadata->str, R"({"part": 1})"));
+}
+
+/// Widens the averaging window while running.
+static void
+update_frame_average_count(AcquireRuntime* runtime, const DeviceManager* dm)
+{
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                SIZED("Trash") - 1,
+                                &props.video[0].storage.identifier));
+    props.video[0].frame_average_count = 2;
+    OK(acquire_configure(runtime, &props));
+
+    uint64_t next_id = 0, step = 2;
+    OK(acquire_start(runtime));
+    wait_for_frames(runtime, 5, &next_id, &step);
+    CHECK(step == 2);
+
+    props.video[0].frame_average_count = 4;
+    OK(acquire_update_live(
+      runtime, 0, &props, AcquireLiveUpdate_FrameAverageCount));
+    wait_for_frames(runtime, 5, &next_id, &step);
+    CHECK(step == 4);
+    OK(acquire_abort(runtime));
+
+    AcquireProperties actual = {};
+    OK(acquire_get_configuration(runtime, &actual));
+    CHECK(actual.video[0].frame_average_count == 4);
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    update_camera_and_storage(runtime, dm);
+    update_frame_average_count(runtime, dm);
+
+    LOG("DONE (OK)");
+    acquire_shutdown(runtime);
+    return 0;
+}